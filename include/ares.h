@@ -226,47 +226,58 @@ typedef enum {
   /*! POSIX poll() */
   ARES_EVSYS_POLL = 4,
   /*! last fallback on Unix-like systems, select() */
-  ARES_EVSYS_SELECT = 5
+  ARES_EVSYS_SELECT = 5,
+  /*! Linux io_uring, falls back to the default if the kernel doesn't
+   *  support it */
+  ARES_EVSYS_IO_URING = 6
 } ares_evsys_t;
 
 /* Flag values */
-#define ARES_FLAG_USEVC       (1 << 0)
-#define ARES_FLAG_PRIMARY     (1 << 1)
-#define ARES_FLAG_IGNTC       (1 << 2)
-#define ARES_FLAG_NORECURSE   (1 << 3)
-#define ARES_FLAG_STAYOPEN    (1 << 4)
-#define ARES_FLAG_NOSEARCH    (1 << 5)
-#define ARES_FLAG_NOALIASES   (1 << 6)
-#define ARES_FLAG_NOCHECKRESP (1 << 7)
-#define ARES_FLAG_EDNS        (1 << 8)
-#define ARES_FLAG_NO_DFLT_SVR (1 << 9)
-#define ARES_FLAG_DNS0x20     (1 << 10)
+#define ARES_FLAG_USEVC           (1 << 0)
+#define ARES_FLAG_PRIMARY         (1 << 1)
+#define ARES_FLAG_IGNTC           (1 << 2)
+#define ARES_FLAG_NORECURSE       (1 << 3)
+#define ARES_FLAG_STAYOPEN        (1 << 4)
+#define ARES_FLAG_NOSEARCH        (1 << 5)
+#define ARES_FLAG_NOALIASES       (1 << 6)
+#define ARES_FLAG_NOCHECKRESP     (1 << 7)
+#define ARES_FLAG_EDNS            (1 << 8)
+#define ARES_FLAG_NO_DFLT_SVR     (1 << 9)
+#define ARES_FLAG_DNS0x20         (1 << 10)
+#define ARES_FLAG_LATENCY_SELECT  (1 << 11)
+#define ARES_FLAG_PARALLEL_SEARCH (1 << 12)
 
 /* Option mask values */
-#define ARES_OPT_FLAGS           (1 << 0)
-#define ARES_OPT_TIMEOUT         (1 << 1)
-#define ARES_OPT_TRIES           (1 << 2)
-#define ARES_OPT_NDOTS           (1 << 3)
-#define ARES_OPT_UDP_PORT        (1 << 4)
-#define ARES_OPT_TCP_PORT        (1 << 5)
-#define ARES_OPT_SERVERS         (1 << 6)
-#define ARES_OPT_DOMAINS         (1 << 7)
-#define ARES_OPT_LOOKUPS         (1 << 8)
-#define ARES_OPT_SOCK_STATE_CB   (1 << 9)
-#define ARES_OPT_SORTLIST        (1 << 10)
-#define ARES_OPT_SOCK_SNDBUF     (1 << 11)
-#define ARES_OPT_SOCK_RCVBUF     (1 << 12)
-#define ARES_OPT_TIMEOUTMS       (1 << 13)
-#define ARES_OPT_ROTATE          (1 << 14)
-#define ARES_OPT_EDNSPSZ         (1 << 15)
-#define ARES_OPT_NOROTATE        (1 << 16)
-#define ARES_OPT_RESOLVCONF      (1 << 17)
-#define ARES_OPT_HOSTS_FILE      (1 << 18)
-#define ARES_OPT_UDP_MAX_QUERIES (1 << 19)
-#define ARES_OPT_MAXTIMEOUTMS    (1 << 20)
-#define ARES_OPT_QUERY_CACHE     (1 << 21)
-#define ARES_OPT_EVENT_THREAD    (1 << 22)
-#define ARES_OPT_SERVER_FAILOVER (1 << 23)
+#define ARES_OPT_FLAGS               (1 << 0)
+#define ARES_OPT_TIMEOUT             (1 << 1)
+#define ARES_OPT_TRIES               (1 << 2)
+#define ARES_OPT_NDOTS               (1 << 3)
+#define ARES_OPT_UDP_PORT            (1 << 4)
+#define ARES_OPT_TCP_PORT            (1 << 5)
+#define ARES_OPT_SERVERS             (1 << 6)
+#define ARES_OPT_DOMAINS             (1 << 7)
+#define ARES_OPT_LOOKUPS             (1 << 8)
+#define ARES_OPT_SOCK_STATE_CB       (1 << 9)
+#define ARES_OPT_SORTLIST            (1 << 10)
+#define ARES_OPT_SOCK_SNDBUF         (1 << 11)
+#define ARES_OPT_SOCK_RCVBUF         (1 << 12)
+#define ARES_OPT_TIMEOUTMS           (1 << 13)
+#define ARES_OPT_ROTATE              (1 << 14)
+#define ARES_OPT_EDNSPSZ             (1 << 15)
+#define ARES_OPT_NOROTATE            (1 << 16)
+#define ARES_OPT_RESOLVCONF          (1 << 17)
+#define ARES_OPT_HOSTS_FILE          (1 << 18)
+#define ARES_OPT_UDP_MAX_QUERIES     (1 << 19)
+#define ARES_OPT_MAXTIMEOUTMS        (1 << 20)
+#define ARES_OPT_QUERY_CACHE         (1 << 21)
+#define ARES_OPT_EVENT_THREAD        (1 << 22)
+#define ARES_OPT_SERVER_FAILOVER     (1 << 23)
+#define ARES_OPT_QUERY_CACHE_OPTS    (1 << 24)
+#define ARES_OPT_QUERY_CACHE_SHARED  (1 << 25)
+#define ARES_OPT_EVENT_THREAD_SHARDS (1 << 26)
+#define ARES_OPT_LATENCY_TIMEOUT     (1 << 27)
+#define ARES_OPT_HEDGE               (1 << 28)
+#define ARES_OPT_SEARCH_NEGCACHE     (1 << 29)
 
 /* Nameinfo flag values */
 #define ARES_NI_NOFQDN        (1 << 0)
@@ -353,6 +364,61 @@ struct ares_server_failover_options {
   size_t         retry_delay;
 };
 
+/* Options controlling how query timeouts are derived from the latency
+ * measured for each server.
+ * The percentile (1-100) is the percentile of recent latencies to base the
+ * timeout on, e.g. 99 for p99.
+ * The multiplier is applied to that latency, in hundredths, e.g. 150 for
+ * 1.5x.
+ */
+struct ares_latency_timeout_options {
+  unsigned short percentile;
+  unsigned short multiplier;
+};
+
+/* Options controlling hedged queries.
+ * The percentile (1-99) is the percentile of recent latencies of the server a
+ * query was sent to after which the same question is also sent to the next
+ * best server, e.g. 95 for p95.
+ * The budget is the maximum number of such extra queries, in percent of the
+ * queries sent, e.g. 5 for 5%.
+ */
+struct ares_hedge_options {
+  unsigned short percentile;
+  unsigned short budget;
+};
+
+/* Query cache that may be shared by multiple channels, see
+ * ares_qcache_shared_create() */
+struct ares_qcache;
+typedef struct ares_qcache ares_qcache_t;
+
+/* Options controlling the query cache.
+ * The max entries is the maximum number of responses that may be cached.
+ * The max bytes is the approximate maximum amount of memory cached responses
+ * may consume.
+ * A value of 0 means unlimited.  When a limit is reached the least recently
+ * used entries are evicted.
+ * The stale max ttl is the number of seconds past expiration a response is
+ * retained so it may be served stale (RFC 8767) if the servers fail to
+ * respond.  0 disables serve-stale.
+ * The stale client timeout is the time in milliseconds after which a stale
+ * response is returned if the servers haven't yet responded, while the query
+ * continues in the background to refresh the cache.  0 means stale responses
+ * are only returned once the query has failed.
+ * The prefetch pct enables refreshing an entry in the background when it is
+ * served from the cache within the last given percent of its TTL, provided it
+ * has been served at least prefetch min hits times.  0 disables prefetch.
+ */
+struct ares_qcache_options {
+  size_t       max_entries;
+  size_t       max_bytes;
+  unsigned int stale_max_ttl;
+  size_t       stale_client_timeout;
+  unsigned int prefetch_pct;
+  size_t       prefetch_min_hits;
+};
+
 /* NOTE about the ares_options struct to users and developers.
 
    This struct will remain looking like this. It will not be extended nor
@@ -396,6 +462,12 @@ struct ares_options {
   unsigned int qcache_max_ttl;   /* Maximum TTL for query cache, 0=disabled */
   ares_evsys_t evsys;
   struct ares_server_failover_options server_failover_opts;
+  struct ares_qcache_options          qcache_opts;
+  ares_qcache_t                      *qcache_shared;
+  size_t                              event_thread_shards;
+  struct ares_latency_timeout_options latency_timeout_opts;
+  struct ares_hedge_options           hedge_opts;
+  unsigned int                        search_negcache_ttl; /* seconds */
 };
 
 struct hostent;
@@ -466,6 +538,9 @@ typedef int (*ares_sock_config_callback)(ares_socket_t socket_fd, int type,
 typedef void (*ares_addrinfo_callback)(void *arg, int status, int timeouts,
                                        struct ares_addrinfo *res);
 
+typedef void (*ares_addrinfo_partial_callback)(
+  void *arg, const struct ares_addrinfo *res);
+
 typedef void (*ares_server_state_callback)(const char *server_string,
                                            ares_bool_t success, int flags,
                                            void *data);
@@ -512,6 +587,30 @@ CARES_EXTERN int ares_dup(ares_channel_t **dest, const ares_channel_t *src);
 
 CARES_EXTERN ares_status_t ares_reinit(ares_channel_t *channel);
 
+/*! Create a query cache that can be shared by multiple channels via the
+ *  ARES_OPT_QUERY_CACHE_SHARED option, including channels used from different
+ *  threads.  Each channel holds its own reference, so the cache may be
+ *  destroyed by the caller once it has been handed to the channels.
+ *
+ *  \param[in]  max_ttl Maximum TTL of cached responses in seconds
+ *  \param[in]  opts    Optional. Limits and behavior of the cache, the
+ *                      stale_client_timeout field is ignored as it is a
+ *                      per-channel setting.
+ *  \param[out] cache   Pointer passed by reference to hold the new cache
+ *  \return ARES_SUCCESS on success
+ */
+CARES_EXTERN ares_status_t
+  ares_qcache_shared_create(unsigned int                      max_ttl,
+                            const struct ares_qcache_options *opts,
+                            ares_qcache_t                   **cache);
+
+/*! Release the caller's reference to a shared query cache.  The cache is
+ *  freed once no channel references it.
+ *
+ *  \param[in] cache Cache created with ares_qcache_shared_create()
+ */
+CARES_EXTERN void ares_qcache_shared_destroy(ares_qcache_t *cache);
+
 CARES_EXTERN void ares_destroy(ares_channel_t *channel);
 
 CARES_EXTERN void ares_cancel(ares_channel_t *channel);
@@ -561,6 +660,12 @@ CARES_EXTERN void ares_getaddrinfo(ares_channel_t *channel, const char *node,
                                    const struct ares_addrinfo_hints *hints,
                                    ares_addrinfo_callback callback, void *arg);
 
+CARES_EXTERN void ares_getaddrinfo_partial(
+  ares_channel_t *channel, const char *node, const char *service,
+  const struct ares_addrinfo_hints *hints,
+  ares_addrinfo_partial_callback partial_callback,
+  ares_addrinfo_callback callback, void *arg);
+
 CARES_EXTERN void ares_freeaddrinfo(struct ares_addrinfo *ai);
 
 /*
@@ -631,9 +736,28 @@ typedef enum {
   ARES_SOCKET_BIND_CLIENT = 1 << 1
 } ares_socket_bind_flags_t;
 
+/*! A single datagram slot used by the batched socket functions in
+ *  ares_socket_functions_ex (ABI version 2 and later). */
+struct ares_socket_msg {
+  /*! Buffer to hold the datagram.  Never modified when sending. */
+  void            *buffer;
+  /*! Size of buffer, or size of the datagram when sending */
+  size_t           length;
+  /*! Receive only. Output: size of the datagram placed into buffer.  If the
+   *  datagram did not fit, this must be set to a value larger than length so
+   *  it can be discarded. */
+  size_t           datagram_len;
+  /*! Buffer to hold address data was received from, always provided to
+   *  arecvmmsg which must fill it in.  When sending, the destination address
+   *  or NULL if the socket is connected. */
+  struct sockaddr *address;
+  /*! Input size of address buffer, output actual written size. */
+  ares_socklen_t   address_len;
+};
+
 /*! Socket functions to call rather than using OS-native functions */
 struct ares_socket_functions_ex {
-  /*! ABI Version: must be "1" */
+  /*! ABI Version: must be "1" or "2" */
   unsigned int version;
 
   /*! Flags indicating behavior of the subsystem. One or more
@@ -808,6 +932,45 @@ struct ares_socket_functions_ex {
    */
   const char *(*aif_indextoname)(unsigned int ifindex, char *ifname_buf,
                                  size_t ifname_buf_len, void *user_data);
+
+  /*! Optional, ABI version 2+. Attempt to read multiple UDP datagrams from
+   *  the remote in a single call, such as via recvmmsg().  If this callback
+   *  is not specified, arecvfrom will be called once per datagram.  Each
+   *  datagram is placed into its own slot, and a datagram must never span
+   *  slots.  The address of each slot is always provided and must be filled
+   *  in with the source of the datagram, as datagrams not originating from
+   *  the server are discarded.
+   *
+   *  \param[in]     sock      Socket file descriptor returned from asocket.
+   *  \param[in,out] msgs      Array of datagram slots to fill in order.
+   *  \param[in]     cnt       Number of slots in msgs.
+   *  \param[in]     flags     Unused, always 0.
+   *  \param[in]     user_data Pointer provided to
+   * ares_set_socket_functions_ex().
+   *  \return number of slots filled (at least 1), or -1 on error with
+   * appropriate errno (or WSASetLastError()) set, such as EWOULDBLOCK /
+   * EAGAIN / WSAEWOULDBLOCK, or ECONNREFUSED / WSAECONNREFUSED.
+   */
+  ares_ssize_t (*arecvmmsg)(ares_socket_t sock, struct ares_socket_msg *msgs,
+                            size_t cnt, int flags, void *user_data);
+
+  /*! Optional, ABI version 2+. Attempt to send multiple UDP datagrams in a
+   *  single call, such as via sendmmsg().  If this callback is not specified,
+   *  asendto will be called once per datagram.  Each slot is sent as its own
+   *  datagram, in order.
+   *
+   *  \param[in] sock      Socket file descriptor returned from asocket.
+   *  \param[in] msgs      Array of datagrams to send.
+   *  \param[in] cnt       Number of datagrams in msgs.
+   *  \param[in] flags     Same as for asendto.
+   *  \param[in] user_data Pointer provided to ares_set_socket_functions_ex().
+   *  \return number of datagrams sent (at least 1), or -1 on error with
+   * appropriate errno (or WSASetLastError()) set, such as EWOULDBLOCK /
+   * EAGAIN / WSAEWOULDBLOCK.
+   */
+  ares_ssize_t (*asendmmsg)(ares_socket_t                 sock,
+                            const struct ares_socket_msg *msgs, size_t cnt,
+                            int flags, void *user_data);
 };
 
 /*! Override the native socket functions for the OS with the provided set.
@@ -1196,6 +1359,31 @@ CARES_EXTERN int ares_set_servers_ports_csv(ares_channel_t *channel,
                                             const char     *servers);
 CARES_EXTERN char *ares_get_servers_csv(const ares_channel_t *channel);
 
+/* Time periods server latency is tracked over */
+typedef enum {
+  ARES_METRICS_PERIOD_1MINUTE   = 0, /* Current minute */
+  ARES_METRICS_PERIOD_15MINUTES = 1, /* Current 15 minutes */
+  ARES_METRICS_PERIOD_1HOUR     = 2, /* Current hour */
+  ARES_METRICS_PERIOD_1DAY      = 3, /* Current day */
+  ARES_METRICS_PERIOD_INCEPTION = 4  /* Since the server was configured */
+} ares_metrics_period_t;
+
+/* Latency of successful queries to a server over a time period, in
+ * milliseconds.  Percentiles are accurate to within 12.5%. */
+typedef struct {
+  size_t       count;
+  unsigned int min_ms;
+  unsigned int max_ms;
+  unsigned int avg_ms;
+  unsigned int p50_ms;
+  unsigned int p90_ms;
+  unsigned int p99_ms;
+} ares_server_latency_t;
+
+CARES_EXTERN ares_status_t ares_get_server_latency(
+  const ares_channel_t *channel, const char *server,
+  ares_metrics_period_t period, ares_server_latency_t *latency);
+
 CARES_EXTERN CARES_DEPRECATED_FOR(ares_get_servers_csv) int ares_get_servers(
   const ares_channel_t *channel, struct ares_addr_node **servers);
 
@@ -574,7 +574,11 @@ typedef enum {
   /*! Parse Authority from later RFCs (no name compression) as RAW */
   ARES_DNS_PARSE_NS_EXT_RAW = 1 << 4,
   /*! Parse Additional from later RFCs (no name compression) as RAW */
-  ARES_DNS_PARSE_AR_EXT_RAW = 1 << 5
+  ARES_DNS_PARSE_AR_EXT_RAW = 1 << 5,
+  /*! Allocate the parsed record and its data from a single arena so that
+   *  parsing makes few allocations and destroying the record is nearly a
+   *  single free.  The record may still be modified. */
+  ARES_DNS_PARSE_ARENA = 1 << 6
 } ares_dns_parse_flags_t;
 
 /*! String representation of DNS Record Type
@@ -1276,6 +1280,222 @@ CARES_EXTERN ares_status_t ares_dns_write(const ares_dns_record_t *dnsrec,
 CARES_EXTERN ares_dns_record_t *
   ares_dns_record_duplicate(const ares_dns_record_t *dnsrec);
 
+/*! Read-only view of a DNS message in wire format.  Initialized by
+ *  ares_dns_view_init(), it references the caller's message rather than
+ *  copying it and never allocates.  The members are private and must not be
+ *  accessed directly. */
+typedef struct {
+  const unsigned char *msg;
+  size_t               msg_len;
+  unsigned short       id;
+  unsigned short       flags;
+  unsigned short       opcode;
+  unsigned short       rcode;
+  unsigned short       cnt[4];
+  size_t               offset[4];
+} ares_dns_view_t;
+
+/*! Position of an iterator over the resource records of a section of an
+ *  ares_dns_view_t.  The members are private and must not be accessed
+ *  directly. */
+typedef struct {
+  const ares_dns_view_t *view;
+  ares_dns_section_t     sect;
+  size_t                 idx;
+  size_t                 name_offset;
+  unsigned short         type;
+  unsigned short         rclass;
+  unsigned int           ttl;
+  size_t                 rdata_offset;
+  size_t                 rdata_len;
+} ares_dns_view_rr_t;
+
+/*! Validate a complete DNS message and initialize a read-only view of it.
+ *  The structure of the message is validated up front with the same limits
+ *  as ares_dns_parse(), record data is only validated as it is accessed.
+ *  The message must remain valid for the lifetime of the view.
+ *
+ *  \param[out] view    View to initialize
+ *  \param[in]  msg     DNS message in wire format
+ *  \param[in]  msg_len Length of the message
+ *  \return ARES_SUCCESS on success, ARES_EBADRESP on a malformed message
+ */
+CARES_EXTERN ares_status_t ares_dns_view_init(ares_dns_view_t     *view,
+                                              const unsigned char *msg,
+                                              size_t               msg_len);
+
+/*! Get the DNS query id of the message.
+ *
+ *  \param[in] view Initialized view
+ *  \return DNS query id
+ */
+CARES_EXTERN unsigned short ares_dns_view_get_id(const ares_dns_view_t *view);
+
+/*! Get the flags of the message.
+ *
+ *  \param[in] view Initialized view
+ *  \return One or more \ares_dns_flags_t
+ */
+CARES_EXTERN unsigned short
+  ares_dns_view_get_flags(const ares_dns_view_t *view);
+
+/*! Get the opcode of the message.
+ *
+ *  \param[in] view Initialized view
+ *  \return opcode
+ */
+CARES_EXTERN ares_dns_opcode_t
+  ares_dns_view_get_opcode(const ares_dns_view_t *view);
+
+/*! Get the response code of the message, including the extended bits from
+ *  an OPT RR.
+ *
+ *  \param[in] view Initialized view
+ *  \return response code
+ */
+CARES_EXTERN ares_dns_rcode_t
+  ares_dns_view_get_rcode(const ares_dns_view_t *view);
+
+/*! Get the question of the message.
+ *
+ *  \param[in]  view     Initialized view
+ *  \param[out] name     Optional.  Storage for the NULL terminated question
+ *                       name.  1025 bytes are enough for any name.
+ *  \param[in]  name_len Size of name storage
+ *  \param[out] qtype    Optional.  Record type being queried.
+ *  \param[out] qclass   Optional.  Class being queried.
+ *  \return ARES_SUCCESS on success, ARES_ENOMEM if name storage is too small
+ */
+CARES_EXTERN ares_status_t ares_dns_view_query_get(
+  const ares_dns_view_t *view, char *name, size_t name_len,
+  ares_dns_rec_type_t *qtype, ares_dns_class_t *qclass);
+
+/*! Get the number of resource records in a section of the message.
+ *
+ *  \param[in] view Initialized view
+ *  \param[in] sect Section
+ *  \return count
+ */
+CARES_EXTERN size_t ares_dns_view_rr_cnt(const ares_dns_view_t *view,
+                                         ares_dns_section_t     sect);
+
+/*! Position an iterator on the first resource record of a section.
+ *
+ *  \param[in]  view Initialized view
+ *  \param[in]  sect Section
+ *  \param[out] rr   Iterator
+ *  \return ARES_TRUE if positioned on a record, ARES_FALSE if the section is
+ *          empty
+ */
+CARES_EXTERN ares_bool_t ares_dns_view_rr_first(const ares_dns_view_t *view,
+                                                ares_dns_section_t     sect,
+                                                ares_dns_view_rr_t    *rr);
+
+/*! Advance an iterator to the next resource record of its section.
+ *
+ *  \param[in,out] rr Iterator
+ *  \return ARES_TRUE if positioned on a record, ARES_FALSE at the end of the
+ *          section
+ */
+CARES_EXTERN ares_bool_t ares_dns_view_rr_next(ares_dns_view_rr_t *rr);
+
+/*! Get the name of a resource record.
+ *
+ *  \param[in]  rr       Iterator positioned on a record
+ *  \param[out] name     Storage for the NULL terminated name.  1025 bytes are
+ *                       enough for any name.
+ *  \param[in]  name_len Size of name storage
+ *  \return ARES_SUCCESS on success, ARES_ENOMEM if name storage is too small
+ */
+CARES_EXTERN ares_status_t ares_dns_view_rr_get_name(
+  const ares_dns_view_rr_t *rr, char *name, size_t name_len);
+
+/*! Get the type of a resource record.  Types c-ares doesn't know about are
+ *  returned as-is rather than as ARES_REC_TYPE_RAW_RR.
+ *
+ *  \param[in] rr Iterator positioned on a record
+ *  \return type
+ */
+CARES_EXTERN ares_dns_rec_type_t
+  ares_dns_view_rr_get_type(const ares_dns_view_rr_t *rr);
+
+/*! Get the class of a resource record.
+ *
+ *  \param[in] rr Iterator positioned on a record
+ *  \return class
+ */
+CARES_EXTERN ares_dns_class_t
+  ares_dns_view_rr_get_class(const ares_dns_view_rr_t *rr);
+
+/*! Get the TTL of a resource record.
+ *
+ *  \param[in] rr Iterator positioned on a record
+ *  \return TTL
+ */
+CARES_EXTERN unsigned int
+  ares_dns_view_rr_get_ttl(const ares_dns_view_rr_t *rr);
+
+/*! Get the raw, unvalidated record data of a resource record.  Names within
+ *  it may be compressed.
+ *
+ *  \param[in]  rr  Iterator positioned on a record
+ *  \param[out] len Length of the record data
+ *  \return pointer into the message, or NULL if there is no record data
+ */
+CARES_EXTERN const unsigned char *
+  ares_dns_view_rr_get_rdata(const ares_dns_view_rr_t *rr, size_t *len);
+
+/*! Get the address of an A record.
+ *
+ *  \param[in]  rr   Iterator positioned on a record
+ *  \param[out] addr Address
+ *  \return ARES_SUCCESS on success, ARES_EFORMERR if not an A record,
+ *          ARES_EBADRESP if the record data is malformed
+ */
+CARES_EXTERN ares_status_t ares_dns_view_rr_get_addr(
+  const ares_dns_view_rr_t *rr, struct in_addr *addr);
+
+/*! Get the address of an AAAA record.
+ *
+ *  \param[in]  rr   Iterator positioned on a record
+ *  \param[out] addr Address
+ *  \return ARES_SUCCESS on success, ARES_EFORMERR if not an AAAA record,
+ *          ARES_EBADRESP if the record data is malformed
+ */
+CARES_EXTERN ares_status_t ares_dns_view_rr_get_addr6(
+  const ares_dns_view_rr_t *rr, struct ares_in6_addr *addr);
+
+/*! Get the domain name held by a CNAME, NS or PTR record.
+ *
+ *  \param[in]  rr       Iterator positioned on a record
+ *  \param[out] name     Storage for the NULL terminated name.  1025 bytes are
+ *                       enough for any name.
+ *  \param[in]  name_len Size of name storage
+ *  \return ARES_SUCCESS on success, ARES_EFORMERR if not a CNAME, NS or PTR
+ *          record, ARES_EBADRESP or ARES_EBADNAME if the record data is
+ *          malformed, ARES_ENOMEM if name storage is too small
+ */
+CARES_EXTERN ares_status_t ares_dns_view_rr_get_dname(
+  const ares_dns_view_rr_t *rr, char *name, size_t name_len);
+
+/*! Get the contents of an SRV record.
+ *
+ *  \param[in]  rr         Iterator positioned on a record
+ *  \param[out] priority   Optional. Priority
+ *  \param[out] weight     Optional. Weight
+ *  \param[out] port       Optional. Port
+ *  \param[out] target     Optional. Storage for the NULL terminated target.
+ *                         1025 bytes are enough for any name.
+ *  \param[in]  target_len Size of target storage
+ *  \return ARES_SUCCESS on success, ARES_EFORMERR if not an SRV record,
+ *          ARES_EBADRESP or ARES_EBADNAME if the record data is malformed,
+ *          ARES_ENOMEM if target storage is too small
+ */
+CARES_EXTERN ares_status_t ares_dns_view_rr_get_srv(
+  const ares_dns_view_rr_t *rr, unsigned short *priority,
+  unsigned short *weight, unsigned short *port, char *target,
+  size_t target_len);
+
 /*! @} */
 
 #ifdef __cplusplus
@@ -33,12 +33,22 @@
  */
 void ares_cancel(ares_channel_t *channel)
 {
+  size_t i;
+
   if (channel == NULL) {
     return;
   }
 
+  /* Shards don't share queries, each is cancelled on its own */
+  for (i = 0; i < channel->nshards; i++) {
+    ares_cancel(channel->shards[i]);
+  }
+
   ares_channel_lock(channel);
 
+  /* Requests not yet started by the event thread are cancelled too */
+  ares_submit_drain(channel, ARES_ECANCELLED);
+
   if (ares_llist_len(channel->all_queries) > 0) {
     ares_llist_node_t *node = NULL;
     ares_llist_node_t *next = NULL;
@@ -56,6 +66,7 @@ void ares_cancel(ares_channel_t *channel)
       channel->all_queries = list_copy; /* LCOV_EXCL_LINE: OutOfMemory */
       goto done;                        /* LCOV_EXCL_LINE: OutOfMemory */
     }
+    ares_llist_set_pool(channel->all_queries, channel->llist_node_pool);
 
     node = ares_llist_node_first(list_copy);
     while (node != NULL) {
@@ -68,7 +79,7 @@ void ares_cancel(ares_channel_t *channel)
       query->node_all_queries = NULL;
 
       /* NOTE: its possible this may enqueue new queries */
-      query->callback(query->arg, ARES_ECANCELLED, 0, NULL);
+      ares_query_invoke_callbacks(query, ARES_ECANCELLED, 0, NULL);
       ares_free_query(query);
 
       node = next;
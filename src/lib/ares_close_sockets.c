@@ -67,7 +67,7 @@ void ares_close_connection(ares_conn_t *conn, ares_status_t requeue_status)
 
   ares_socket_close(channel, conn->fd);
 
-  ares_free(conn);
+  ares_pool_free(channel->conn_pool, conn);
 }
 
 void ares_close_sockets(ares_server_t *server)
@@ -100,6 +100,9 @@
 /* Define to 1 if you have the epoll{_create,ctl,wait} functions. */
 #cmakedefine HAVE_EPOLL 1
 
+/* Define to 1 if you have io_uring. */
+#cmakedefine HAVE_IO_URING 1
+
 /* Define to 1 if you have the fcntl function. */
 #cmakedefine HAVE_FCNTL 1
 
@@ -260,12 +263,18 @@
 /* Define to 1 if you have the recvfrom function. */
 #cmakedefine HAVE_RECVFROM 1
 
+/* Define to 1 if you have the recvmmsg function. */
+#cmakedefine HAVE_RECVMMSG 1
+
 /* Define to 1 if you have the send function. */
 #cmakedefine HAVE_SEND 1
 
 /* Define to 1 if you have the sendto function. */
 #cmakedefine HAVE_SENDTO 1
 
+/* Define to 1 if you have the sendmmsg function. */
+#cmakedefine HAVE_SENDMMSG 1
+
 /* Define to 1 if you have the setsockopt function. */
 #cmakedefine HAVE_SETSOCKOPT 1
 
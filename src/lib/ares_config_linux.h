@@ -94,6 +94,9 @@
 /* Define to 1 if you have `epoll_{create1,ctl,wait}` */
 #define HAVE_EPOLL 1
 
+/* Define to 1 if you have io_uring */
+#define HAVE_IO_URING 1
+
 /* Define to 1 if you have the <errno.h> header file. */
 #define HAVE_ERRNO_H 1
 
@@ -247,6 +250,9 @@
 /* Define to 1 if you have `recvfrom` */
 #define HAVE_RECVFROM 1
 
+/* Define to 1 if you have `recvmmsg` */
+#define HAVE_RECVMMSG 1
+
 /* Define to 1 if you have `RegisterWaitForSingleObject` */
 /* #undef HAVE_REGISTERWAITFORSINGLEOBJECT */
 
@@ -256,6 +262,9 @@
 /* Define to 1 if you have `sendto` */
 #define HAVE_SENDTO 1
 
+/* Define to 1 if you have `sendmmsg` */
+#define HAVE_SENDMMSG 1
+
 /* Define to 1 if you have `setsockopt` */
 #define HAVE_SETSOCKOPT 1
 
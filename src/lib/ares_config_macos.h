@@ -94,6 +94,9 @@
 /* Define to 1 if you have `epoll_{create1,ctl,wait}` */
 /* #undef HAVE_EPOLL */
 
+/* Define to 1 if you have io_uring */
+/* #undef HAVE_IO_URING */
+
 /* Define to 1 if you have the <errno.h> header file. */
 #define HAVE_ERRNO_H 1
 
@@ -247,6 +250,9 @@
 /* Define to 1 if you have `recvfrom` */
 #define HAVE_RECVFROM 1
 
+/* Define to 1 if you have `recvmmsg` */
+/* #undef HAVE_RECVMMSG */
+
 /* Define to 1 if you have `RegisterWaitForSingleObject` */
 /* #undef HAVE_REGISTERWAITFORSINGLEOBJECT */
 
@@ -256,6 +262,9 @@
 /* Define to 1 if you have `sendto` */
 #define HAVE_SENDTO 1
 
+/* Define to 1 if you have `sendmmsg` */
+/* #undef HAVE_SENDMMSG */
+
 /* Define to 1 if you have `setsockopt` */
 #define HAVE_SETSOCKOPT 1
 
@@ -100,6 +100,9 @@
 /* Define to 1 if you have the epoll{_create,ctl,wait} functions. */
 /* #undef HAVE_EPOLL */
 
+/* Define to 1 if you have io_uring */
+/* #undef HAVE_IO_URING */
+
 /* Define to 1 if you have the fcntl function. */
 /* #undef HAVE_FCNTL */
 
@@ -242,12 +245,18 @@
 /* Define to 1 if you have the recvfrom function. */
 #define HAVE_RECVFROM 1
 
+/* Define to 1 if you have the recvmmsg function. */
+/* #undef HAVE_RECVMMSG */
+
 /* Define to 1 if you have the send function. */
 #define HAVE_SEND 1
 
 /* Define to 1 if you have the sendto function. */
 #define HAVE_SENDTO 1
 
+/* Define to 1 if you have the sendmmsg function. */
+/* #undef HAVE_SENDMMSG */
+
 /* Define to 1 if you have the setsockopt function. */
 #define HAVE_SETSOCKOPT 1
 
@@ -42,6 +42,41 @@ void ares_conn_sock_state_cb_update(ares_conn_t            *conn,
   conn->state_flags |= flags;
 }
 
+/* UDP datagrams read or written by the event system (io_uring) rather than
+ * the socket functions.  ARES_CONN_ERR_NOTIMP means the socket functions
+ * should be used. */
+static ares_conn_err_t ares_conn_dgram_recv(const ares_conn_t      *conn,
+                                            struct ares_socket_msg *msgs,
+                                            size_t cnt, size_t *read_cnt)
+{
+  const ares_channel_t *channel = conn->server->channel;
+
+  *read_cnt = 0;
+
+  if (conn->flags & ARES_CONN_FLAG_TCP || channel->dgram_recv_cb == NULL) {
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+  return channel->dgram_recv_cb(channel->dgram_cb_data, conn->fd, msgs, cnt,
+                                read_cnt);
+}
+
+static ares_conn_err_t ares_conn_dgram_send(const ares_conn_t            *conn,
+                                            const struct ares_socket_msg *msgs,
+                                            size_t cnt, size_t *sent_cnt)
+{
+  const ares_channel_t *channel = conn->server->channel;
+
+  *sent_cnt = 0;
+
+  if (conn->flags & ARES_CONN_FLAG_TCP || channel->dgram_send_cb == NULL) {
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+  return channel->dgram_send_cb(channel->dgram_cb_data, conn->fd, msgs, cnt,
+                                sent_cnt);
+}
+
 ares_conn_err_t ares_conn_read(ares_conn_t *conn, void *data, size_t len,
                                size_t *read_bytes)
 {
@@ -51,12 +86,26 @@ ares_conn_err_t ares_conn_read(ares_conn_t *conn, void *data, size_t len,
   if (!(conn->flags & ARES_CONN_FLAG_TCP)) {
     struct sockaddr_storage sa_storage;
     ares_socklen_t          salen = sizeof(sa_storage);
+    struct ares_socket_msg  msg;
+    size_t                  cnt = 0;
 
     memset(&sa_storage, 0, sizeof(sa_storage));
 
-    err =
-      ares_socket_recvfrom(channel, conn->fd, ARES_FALSE, data, len, 0,
-                           (struct sockaddr *)&sa_storage, &salen, read_bytes);
+    memset(&msg, 0, sizeof(msg));
+    msg.buffer      = data;
+    msg.length      = len;
+    msg.address     = (struct sockaddr *)&sa_storage;
+    msg.address_len = salen;
+
+    err = ares_conn_dgram_recv(conn, &msg, 1, &cnt);
+    if (err == ARES_CONN_ERR_SUCCESS) {
+      /* Truncated like recvfrom() would */
+      *read_bytes = msg.datagram_len > len ? len : msg.datagram_len;
+    } else if (err == ARES_CONN_ERR_NOTIMP) {
+      err = ares_socket_recvfrom(channel, conn->fd, ARES_FALSE, data, len, 0,
+                                 (struct sockaddr *)&sa_storage, &salen,
+                                 read_bytes);
+    }
 
 #ifdef HAVE_RECVFROM
     if (err == ARES_CONN_ERR_SUCCESS &&
@@ -77,6 +126,53 @@ ares_conn_err_t ares_conn_read(ares_conn_t *conn, void *data, size_t len,
   return err;
 }
 
+ares_conn_err_t ares_conn_read_batch(ares_conn_t *conn,
+                                     struct ares_socket_msg *msgs, size_t cnt,
+                                     size_t *read_cnt)
+{
+  ares_channel_t         *channel = conn->server->channel;
+  struct sockaddr_storage sa_storage[ARES_CONN_READ_BATCH_MAX];
+  ares_conn_err_t         err;
+  size_t                  i;
+
+  if (cnt > ARES_CONN_READ_BATCH_MAX) {
+    cnt = ARES_CONN_READ_BATCH_MAX;
+  }
+
+  memset(sa_storage, 0, sizeof(*sa_storage) * cnt);
+  for (i = 0; i < cnt; i++) {
+    msgs[i].datagram_len = 0;
+    msgs[i].address      = (struct sockaddr *)&sa_storage[i];
+    msgs[i].address_len  = sizeof(sa_storage[i]);
+  }
+
+  err = ares_conn_dgram_recv(conn, msgs, cnt, read_cnt);
+  if (err == ARES_CONN_ERR_NOTIMP) {
+    err = ares_socket_recvmmsg(channel, conn->fd, msgs, cnt, read_cnt);
+  }
+  if (err != ARES_CONN_ERR_SUCCESS) {
+    return err;
+  }
+
+  /* Same source validation as ares_conn_read(), but a spoofed datagram only
+   * invalidates its own slot rather than the whole batch */
+  for (i = 0; i < *read_cnt; i++) {
+    if (msgs[i].datagram_len > msgs[i].length) {
+      msgs[i].datagram_len = 0;
+    }
+#ifdef HAVE_RECVFROM
+    if (!ares_sockaddr_addr_eq(msgs[i].address, &conn->server->addr)) {
+      msgs[i].datagram_len = 0;
+    }
+#endif
+    msgs[i].address     = NULL;
+    msgs[i].address_len = 0;
+  }
+
+  conn->state_flags |= ARES_CONN_STATE_CONNECTED;
+  return ARES_CONN_ERR_SUCCESS;
+}
+
 /* Use like:
  *   struct sockaddr_storage sa_storage;
  *   ares_socklen_t          salen     = sizeof(sa_storage);
@@ -201,6 +297,24 @@ ares_conn_err_t ares_conn_write(ares_conn_t *conn, const void *data, size_t len,
     }
   }
 
+  if (!(conn->flags & ARES_CONN_FLAG_TCP)) {
+    struct ares_socket_msg msg;
+    size_t                 cnt = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.buffer = (void *)((size_t)data); /* Cast off const */
+    msg.length = len;
+
+    err = ares_conn_dgram_send(conn, &msg, 1, &cnt);
+    if (err == ARES_CONN_ERR_SUCCESS) {
+      *written = len;
+      goto done;
+    }
+    if (err != ARES_CONN_ERR_NOTIMP) {
+      goto done;
+    }
+  }
+
   err = ares_socket_write(channel, conn->fd, data, len, written, sa, salen);
   if (err != ARES_CONN_ERR_SUCCESS) {
     goto done;
@@ -231,6 +345,72 @@ done:
   return err;
 }
 
+/* Send as many whole queued datagrams as possible with one asendmmsg call (or
+ * one submission by the event system).  Only used once at least two datagrams
+ * are queued, a single datagram goes through ares_conn_write() as usual. */
+static ares_conn_err_t ares_conn_write_udp_batch(ares_conn_t *conn,
+                                                 ares_bool_t *sent_all)
+{
+  ares_channel_t        *channel = conn->server->channel;
+  struct ares_socket_msg msgs[ARES_CONN_WRITE_BATCH_MAX];
+  const unsigned char   *data;
+  size_t                 data_len;
+  size_t                 cnt      = 0;
+  size_t                 sent_cnt = 0;
+  size_t                 consume  = 0;
+  size_t                 i;
+  ares_conn_err_t        err;
+
+  *sent_all = ARES_FALSE;
+
+  memset(msgs, 0, sizeof(msgs));
+
+  data = ares_buf_peek(conn->out_buf, &data_len);
+  while (cnt < ARES_CONN_WRITE_BATCH_MAX && data_len >= 2) {
+    size_t msg_len = ((size_t)data[0] << 8) | (size_t)data[1];
+
+    if (data_len < msg_len + 2) {
+      break;
+    }
+    msgs[cnt].buffer = (void *)((size_t)(data + 2)); /* Cast off const */
+    msgs[cnt].length = msg_len;
+    cnt++;
+    data     += msg_len + 2;
+    data_len -= msg_len + 2;
+  }
+
+  if (cnt < 2) {
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+  err = ares_conn_dgram_send(conn, msgs, cnt, &sent_cnt);
+  if (err == ARES_CONN_ERR_NOTIMP) {
+    if (channel->sock_funcs.asendmmsg == NULL) {
+      return ARES_CONN_ERR_NOTIMP;
+    }
+    err = ares_socket_write_batch(channel, conn->fd, msgs, cnt, &sent_cnt);
+  }
+  if (err != ARES_CONN_ERR_SUCCESS) {
+    if (err == ARES_CONN_ERR_WOULDBLOCK) {
+      ares_conn_sock_state_cb_update(conn, ARES_CONN_STATE_READ |
+                                             ARES_CONN_STATE_WRITE);
+    }
+    return err;
+  }
+
+  for (i = 0; i < sent_cnt; i++) {
+    consume += msgs[i].length + 2;
+  }
+  ares_buf_consume(conn->out_buf, consume);
+
+  if (ares_buf_len(conn->out_buf) == 0) {
+    ares_conn_sock_state_cb_update(conn, ARES_CONN_STATE_READ);
+    *sent_all = ARES_TRUE;
+  }
+
+  return ARES_CONN_ERR_SUCCESS;
+}
+
 ares_status_t ares_conn_flush(ares_conn_t *conn)
 {
   const unsigned char *data;
@@ -254,6 +434,30 @@ ares_status_t ares_conn_flush(ares_conn_t *conn)
       goto done;
     }
 
+    if (!(conn->flags & ARES_CONN_FLAG_TCP) &&
+        (conn->server->channel->sock_funcs.asendmmsg != NULL ||
+         conn->server->channel->dgram_send_cb != NULL)) {
+      ares_bool_t sent_all = ARES_FALSE;
+
+      err = ares_conn_write_udp_batch(conn, &sent_all);
+      if (err == ARES_CONN_ERR_SUCCESS) {
+        status = ARES_SUCCESS;
+        if (sent_all) {
+          goto done;
+        }
+        continue;
+      }
+      if (err == ARES_CONN_ERR_WOULDBLOCK) {
+        status = ARES_SUCCESS;
+        goto done;
+      }
+      if (err != ARES_CONN_ERR_NOTIMP) {
+        status = ARES_ECONNREFUSED;
+        goto done;
+      }
+      /* Fewer than two datagrams queued, send normally */
+    }
+
     if (conn->flags & ARES_CONN_FLAG_TCP) {
       data = ares_buf_peek(conn->out_buf, &data_len);
     } else {
@@ -352,12 +556,11 @@ ares_status_t ares_open_connection(ares_conn_t   **conn_out,
 
   *conn_out = NULL;
 
-  conn = ares_malloc(sizeof(*conn));
+  conn = ares_pool_alloc(channel->conn_pool);
   if (conn == NULL) {
     return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  memset(conn, 0, sizeof(*conn));
   conn->fd              = ARES_SOCKET_BAD;
   conn->server          = server;
   conn->queries_to_conn = ares_llist_create(NULL);
@@ -365,6 +568,8 @@ ares_status_t ares_open_connection(ares_conn_t   **conn_out,
   conn->out_buf         = ares_buf_create();
   conn->in_buf          = ares_buf_create();
 
+  ares_llist_set_pool(conn->queries_to_conn, channel->llist_node_pool);
+
   if (conn->queries_to_conn == NULL || conn->out_buf == NULL ||
       conn->in_buf == NULL) {
     /* LCOV_EXCL_START: OutOfMemory */
@@ -491,7 +696,7 @@ done:
     ares_socket_close(channel, conn->fd);
     ares_buf_destroy(conn->out_buf);
     ares_buf_destroy(conn->in_buf);
-    ares_free(conn);
+    ares_pool_free(channel->conn_pool, conn);
   } else {
     *conn_out = conn;
   }
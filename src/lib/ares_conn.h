@@ -96,6 +96,17 @@ typedef enum {
   ARES_METRIC_COUNT        /*!< Count of buckets, not a real bucket */
 } ares_server_bucket_t;
 
+/*! Latencies below this many milliseconds get a histogram slot each, above it
+ *  every power of 2 range is split into this many equal slots.  Must be a
+ *  power of 2. */
+#define ARES_METRIC_HIST_SUB 8
+
+/*! Number of latency histogram slots.  Log-linear (HDR style) so memory is
+ *  fixed while every slot stays within 12.5% of the latencies counted in it.
+ *  Covers latencies up to 32767ms, anything longer is counted in the last
+ *  slot. */
+#define ARES_METRIC_HIST_SLOTS 104
+
 /*! Data metrics collected for each bucket */
 typedef struct {
   time_t        ts;             /*!< Timestamp divided by bucket divisor */
@@ -103,11 +114,14 @@ typedef struct {
   unsigned int  latency_max_ms; /*!< Maximum latency for queries */
   ares_uint64_t total_ms;       /*!< Cumulative query time for bucket */
   ares_uint64_t total_count;    /*!< Number of queries for bucket */
+  ares_uint64_t hist[ARES_METRIC_HIST_SLOTS]; /*!< Latency histogram */
 
   time_t        prev_ts;        /*!< Previous period bucket timestamp */
   ares_uint64_t
     prev_total_ms; /*!< Previous period bucket cumulative query time */
   ares_uint64_t prev_total_count; /*!< Previous period bucket query count */
+  ares_uint64_t
+    prev_hist[ARES_METRIC_HIST_SLOTS]; /*!< Previous period histogram */
 } ares_server_metrics_t;
 
 typedef enum {
@@ -163,6 +177,11 @@ struct ares_server {
   /*! Buckets for collecting metrics about the server */
   ares_server_metrics_t metrics[ARES_METRIC_COUNT];
 
+  /*! Smoothed round trip time in microseconds, exponentially weighted moving
+   *  average with a gain of 1/8 (as used for TCP SRTT).  0 if no query has
+   *  completed yet. */
+  ares_uint64_t         srtt_us;
+
   /*! RFC 7873/9018 DNS Cookies */
   ares_cookie_t         cookie;
 
@@ -184,6 +203,27 @@ ares_conn_err_t ares_conn_write(ares_conn_t *conn, const void *data, size_t len,
 ares_status_t ares_conn_flush(ares_conn_t *conn);
 ares_conn_err_t ares_conn_read(ares_conn_t *conn, void *data, size_t len,
                                size_t *read_bytes);
+
+/*! Maximum number of datagrams ares_conn_read_batch() will read at once */
+#define ARES_CONN_READ_BATCH_MAX 8
+
+/*! Maximum number of datagrams ares_conn_flush() will send at once */
+#define ARES_CONN_WRITE_BATCH_MAX 16
+
+/*! Read up to cnt UDP datagrams in a single call using the arecvmmsg socket
+ *  function.  The caller fills in the buffer and length of each slot.  On
+ *  return, datagram_len of each filled slot is the datagram size, or 0 if the
+ *  datagram must be discarded (spoofed source address or truncated).
+ *
+ *  \param[in]     conn     UDP connection, arecvmmsg must be registered.
+ *  \param[in,out] msgs     Slots to fill.
+ *  \param[in]     cnt      Number of slots, at most ARES_CONN_READ_BATCH_MAX.
+ *  \param[out]    read_cnt Number of slots filled.
+ *  \return ARES_CONN_ERR_SUCCESS if at least one slot was filled.
+ */
+ares_conn_err_t ares_conn_read_batch(ares_conn_t *conn,
+                                     struct ares_socket_msg *msgs, size_t cnt,
+                                     size_t *read_cnt);
 ares_conn_t *ares_conn_from_fd(const ares_channel_t *channel, ares_socket_t fd);
 void ares_conn_sock_state_cb_update(ares_conn_t            *conn,
                                     ares_conn_state_flags_t flags);
@@ -196,6 +236,9 @@ ares_conn_err_t ares_socket_recvfrom(ares_channel_t *channel, ares_socket_t s,
                                      struct sockaddr *from,
                                      ares_socklen_t  *from_len,
                                      size_t          *read_bytes);
+ares_conn_err_t ares_socket_recvmmsg(ares_channel_t *channel, ares_socket_t s,
+                                     struct ares_socket_msg *msgs, size_t cnt,
+                                     size_t *read_cnt);
 
 void ares_destroy_server(ares_server_t *server);
 
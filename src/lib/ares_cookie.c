@@ -196,8 +196,8 @@
 
 #define COOKIE_RESEND_MAX 3
 
-static const unsigned char *
-  ares_dns_cookie_fetch(const ares_dns_record_t *dnsrec, size_t *len)
+const unsigned char *ares_dns_cookie_fetch(const ares_dns_record_t *dnsrec,
+                                           size_t                  *len)
 {
   const ares_dns_rr_t *rr  = ares_dns_get_opt_rr_const(dnsrec);
   const unsigned char *val = NULL;
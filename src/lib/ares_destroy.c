@@ -38,6 +38,9 @@ void ares_destroy(ares_channel_t *channel)
     return;
   }
 
+  /* Shards are complete channels of their own, tear them down first */
+  ares_shards_destroy(channel);
+
   /* Mark as being shutdown */
   ares_channel_lock(channel);
   channel->sys_up = ARES_FALSE;
@@ -69,6 +72,9 @@ void ares_destroy(ares_channel_t *channel)
    * callbacks need to hold a channel lock. */
   ares_channel_lock(channel);
 
+  /* Fail anything submitted but not yet started */
+  ares_submit_drain(channel, ARES_EDESTRUCTION);
+
   /* Destroy all queries */
   node = ares_llist_node_first(channel->all_queries);
   while (node != NULL) {
@@ -76,7 +82,7 @@ void ares_destroy(ares_channel_t *channel)
     ares_query_t      *query = ares_llist_node_claim(node);
 
     query->node_all_queries = NULL;
-    query->callback(query->arg, ARES_EDESTRUCTION, 0, NULL);
+    ares_query_invoke_callbacks(query, ARES_EDESTRUCTION, 0, NULL);
     ares_free_query(query);
 
     node = next;
@@ -89,8 +95,12 @@ void ares_destroy(ares_channel_t *channel)
    * so all query lists should be empty now.
    */
   assert(ares_llist_len(channel->all_queries) == 0);
-  assert(ares_htable_szvp_num_keys(channel->queries_by_qid) == 0);
-  assert(ares_slist_len(channel->queries_by_timeout) == 0);
+  assert(ares_qidmap_len(channel->queries_by_qid) == 0);
+  assert(ares_htable_binvp_num_keys(channel->queries_by_key) == 0);
+  assert(ares_timerwheel_len(channel->queries_by_timeout) == 0);
+  assert(ares_slist_len(channel->queries_by_stale) == 0);
+  assert(ares_timerwheel_len(channel->queries_by_hedge) == 0);
+  assert(ares_timerwheel_len(channel->timers) == 0);
 #endif
 
   ares_destroy_servers_state(channel);
@@ -115,8 +125,12 @@ void ares_destroy(ares_channel_t *channel)
   }
 
   ares_llist_destroy(channel->all_queries);
-  ares_slist_destroy(channel->queries_by_timeout);
-  ares_htable_szvp_destroy(channel->queries_by_qid);
+  ares_timerwheel_destroy(channel->queries_by_timeout);
+  ares_slist_destroy(channel->queries_by_stale);
+  ares_timerwheel_destroy(channel->queries_by_hedge);
+  ares_timerwheel_destroy(channel->timers);
+  ares_qidmap_destroy(channel->queries_by_qid);
+  ares_htable_binvp_destroy(channel->queries_by_key);
   ares_htable_asvp_destroy(channel->connnode_by_socket);
 
   ares_free(channel->sortlist);
@@ -128,6 +142,12 @@ void ares_destroy(ares_channel_t *channel)
   ares_hosts_file_destroy(channel->hf);
 
   ares_qcache_destroy(channel->qcache);
+  ares_search_negcache_destroy(channel->search_negcache);
+
+  /* Everything allocated from the pools has been released by now */
+  ares_pool_destroy(channel->query_pool);
+  ares_pool_destroy(channel->conn_pool);
+  ares_pool_destroy(channel->llist_node_pool);
 
   ares_channel_threading_destroy(channel);
 
@@ -84,8 +84,24 @@ struct host_query {
 
   /* Track nodata responses to possibly override final result */
   size_t                nodata_cnt;
+
+  /* Queries for all names when ARES_FLAG_PARALLEL_SEARCH is set, and their
+   * qids, A and AAAA for each name */
+  ares_search_fanout_t *fanout;
+  unsigned short       *fanout_qids;
+
+  /* ares_getaddrinfo_partial(): callback for the first usable family, the
+   * pending resolution delay if IPv4 answered first, and whether partial
+   * results were delivered already */
+  ares_addrinfo_partial_callback partial_callback;
+  ares_timer_t                  *partial_timer;
+  ares_bool_t                    partial_done;
 };
 
+/* RFC 8305 Section 3 Resolution Delay, how long to wait for the AAAA answer
+ * once the A answer is in before returning the IPv4 addresses */
+#define ARES_GAI_RESOLUTION_DELAY_MS 50
+
 static const struct ares_addrinfo_hints default_hints = {
   0,         /* ai_flags */
   AF_UNSPEC, /* ai_family */
@@ -330,30 +346,41 @@ static void hquery_free(struct host_query *hquery, ares_bool_t cleanup_ai)
   if (cleanup_ai) {
     ares_freeaddrinfo(hquery->ai);
   }
+  ares_search_fanout_release(hquery->fanout);
+  ares_free(hquery->fanout_qids);
   ares_strsplit_free(hquery->names, hquery->names_cnt);
   ares_free(hquery->name);
   ares_free(hquery->lookups);
   ares_free(hquery);
 }
 
-static void end_hquery(struct host_query *hquery, ares_status_t status)
+/* Sort the collected addresses and fill in the socket type and protocol */
+static void hquery_finish_nodes(struct host_query *hquery)
 {
   struct ares_addrinfo_node  sentinel;
   struct ares_addrinfo_node *next;
 
-  if (status == ARES_SUCCESS) {
-    if (!(hquery->hints.ai_flags & ARES_AI_NOSORT) && hquery->ai->nodes) {
-      sentinel.ai_next = hquery->ai->nodes;
-      ares_sortaddrinfo(hquery->channel, &sentinel);
-      hquery->ai->nodes = sentinel.ai_next;
-    }
-    next = hquery->ai->nodes;
+  if (!(hquery->hints.ai_flags & ARES_AI_NOSORT) && hquery->ai->nodes) {
+    sentinel.ai_next = hquery->ai->nodes;
+    ares_sortaddrinfo(hquery->channel, &sentinel);
+    hquery->ai->nodes = sentinel.ai_next;
+  }
+  next = hquery->ai->nodes;
 
-    while (next) {
-      next->ai_socktype = hquery->hints.ai_socktype;
-      next->ai_protocol = hquery->hints.ai_protocol;
-      next              = next->ai_next;
-    }
+  while (next) {
+    next->ai_socktype = hquery->hints.ai_socktype;
+    next->ai_protocol = hquery->hints.ai_protocol;
+    next              = next->ai_next;
+  }
+}
+
+static void end_hquery(struct host_query *hquery, ares_status_t status)
+{
+  ares_timer_destroy(hquery->partial_timer);
+  hquery->partial_timer = NULL;
+
+  if (status == ARES_SUCCESS) {
+    hquery_finish_nodes(hquery);
   } else {
     /* Clean up what we have collected by so far. */
     ares_freeaddrinfo(hquery->ai);
@@ -484,7 +511,7 @@ static void terminate_retries(const struct host_query *hquery,
     return;
   }
 
-  query = ares_htable_szvp_get_direct(channel->queries_by_qid, term_qid);
+  query = ares_qidmap_get(channel->queries_by_qid, term_qid);
   if (query == NULL) {
     return;
   }
@@ -504,6 +531,55 @@ static ares_bool_t ai_has_ipv4(struct ares_addrinfo *ai)
   return ARES_FALSE;
 }
 
+/* Hand the addresses collected so far to the partial callback.  The callback
+ * may cancel the lookup, so hquery must not be touched afterwards. */
+static void hquery_deliver_partial(struct host_query *hquery)
+{
+  ares_timer_destroy(hquery->partial_timer);
+  hquery->partial_timer = NULL;
+  hquery->partial_done  = ARES_TRUE;
+
+  hquery_finish_nodes(hquery);
+  hquery->partial_callback(hquery->arg, hquery->ai);
+}
+
+static void hquery_resolution_delay_cb(void *arg)
+{
+  struct host_query *hquery = arg;
+
+  /* The timer is already freed */
+  hquery->partial_timer = NULL;
+  hquery_deliver_partial(hquery);
+}
+
+/* One family answered with addresses while the other is still outstanding.
+ * As per RFC 8305 Section 3, IPv6 addresses are returned right away, IPv4
+ * ones only once the Resolution Delay passed without an AAAA answer.  Must be
+ * the last thing done with hquery. */
+static void hquery_partial(struct host_query       *hquery,
+                           const ares_dns_record_t *dnsrec)
+{
+  ares_dns_rec_type_t qtype = ARES_REC_TYPE_A;
+
+  if (hquery->partial_callback == NULL || hquery->partial_done ||
+      hquery->ai->nodes == NULL) {
+    return;
+  }
+
+  if (ares_dns_record_query_get(dnsrec, 0, NULL, &qtype, NULL) ==
+        ARES_SUCCESS &&
+      qtype == ARES_REC_TYPE_AAAA) {
+    hquery_deliver_partial(hquery);
+    return;
+  }
+
+  if (hquery->partial_timer == NULL) {
+    hquery->partial_timer =
+      ares_timer_create(hquery->channel, ARES_GAI_RESOLUTION_DELAY_MS,
+                        hquery_resolution_delay_cb, hquery);
+  }
+}
+
 static void host_callback(void *arg, ares_status_t status, size_t timeouts,
                           const ares_dns_record_t *dnsrec)
 {
@@ -542,6 +618,9 @@ static void host_callback(void *arg, ares_status_t status, size_t timeouts,
     if (addinfostatus == ARES_SUCCESS && ai_has_ipv4(hquery->ai)) {
       terminate_retries(hquery, ares_dns_record_get_id(dnsrec));
     }
+  } else if (status == ARES_ENOTFOUND) {
+    ares_search_negcache_note(hquery->channel, hquery->name,
+                              hquery->names[hquery->next_name_idx - 1], dnsrec);
   }
 
   if (!hquery->remaining) {
@@ -577,9 +656,11 @@ static void host_callback(void *arg, ares_status_t status, size_t timeouts,
     } else {
       end_hquery(hquery, status);
     }
+  } else if (status == ARES_SUCCESS && addinfostatus == ARES_SUCCESS) {
+    /* at this point we keep on waiting for the next query to finish, but
+     * may return what we have so far */
+    hquery_partial(hquery, dnsrec);
   }
-
-  /* at this point we keep on waiting for the next query to finish */
 }
 
 /* Per POSIX getaddrinfo(), when no node/hostname is provided the returned
@@ -633,10 +714,11 @@ static ares_status_t
   return ARES_SUCCESS;
 }
 
-static void ares_getaddrinfo_int(ares_channel_t *channel, const char *name,
-                                 const char                       *service,
-                                 const struct ares_addrinfo_hints *hints,
-                                 ares_addrinfo_callback callback, void *arg)
+void ares_getaddrinfo_nolock(ares_channel_t *channel, const char *name,
+                             const char                       *service,
+                             const struct ares_addrinfo_hints *hints,
+                             ares_addrinfo_partial_callback    partial_callback,
+                             ares_addrinfo_callback callback, void *arg)
 {
   struct host_query    *hquery;
   unsigned short        port = 0;
@@ -717,14 +799,15 @@ static void ares_getaddrinfo_int(ares_channel_t *channel, const char *name,
     return;
   }
 
-  hquery->port        = port;
-  hquery->channel     = channel;
-  hquery->hints       = *hints;
-  hquery->sent_family = -1; /* nothing is sent yet */
-  hquery->callback    = callback;
-  hquery->arg         = arg;
-  hquery->ai          = ai;
-  hquery->name        = ares_strdup(name);
+  hquery->port             = port;
+  hquery->channel          = channel;
+  hquery->hints            = *hints;
+  hquery->sent_family      = -1; /* nothing is sent yet */
+  hquery->partial_callback = partial_callback;
+  hquery->callback         = callback;
+  hquery->arg              = arg;
+  hquery->ai               = ai;
+  hquery->name             = ares_strdup(name);
   if (hquery->name == NULL) {
     hquery_free(hquery, ARES_TRUE);
     callback(arg, ARES_ENOMEM, 0, NULL);
@@ -749,23 +832,130 @@ static void ares_getaddrinfo_int(ares_channel_t *channel, const char *name,
   }
   hquery->remaining_lookups = hquery->lookups;
 
-  /* Start performing lookups according to channel->lookups. */
+  /* Start performing lookups according to channel->lookups.  The A and AAAA
+   * queries are written out together once both are enqueued. */
+  ares_write_defer_begin(channel);
   next_lookup(hquery, ARES_ECONNREFUSED /* initial error code */);
+  ares_write_defer_end(channel);
 }
 
-void ares_getaddrinfo(ares_channel_t *channel, const char *name,
-                      const char                       *service,
-                      const struct ares_addrinfo_hints *hints,
-                      ares_addrinfo_callback callback, void *arg)
+/* Lookups of numeric addresses, or of just a service, never send a query and
+ * complete before ares_getaddrinfo() returns */
+static ares_bool_t ares_getaddrinfo_is_immediate(const char *name)
+{
+  struct ares_addr addr;
+
+  if (name == NULL) {
+    return ARES_TRUE;
+  }
+
+  if (ares_inet_pton(AF_INET, name, &addr.addr.addr4) == 1 ||
+      ares_inet_pton(AF_INET6, name, &addr.addr.addr6) == 1) {
+    return ARES_TRUE;
+  }
+
+  return ARES_FALSE;
+}
+
+static void ares_getaddrinfo_int(ares_channel_t *channel, const char *name,
+                                 const char                       *service,
+                                 const struct ares_addrinfo_hints *hints,
+                                 ares_addrinfo_partial_callback partial_callback,
+                                 ares_addrinfo_callback callback, void *arg)
 {
   if (channel == NULL) {
     return;
   }
+  channel = ares_shard_select(channel, name, ares_strlen(name));
+
+  if (!ares_getaddrinfo_is_immediate(name) &&
+      ares_submit_getaddrinfo(channel, name, service, hints, partial_callback,
+                              callback, arg) == ARES_SUCCESS) {
+    return;
+  }
+
   ares_channel_lock(channel);
-  ares_getaddrinfo_int(channel, name, service, hints, callback, arg);
+  ares_getaddrinfo_nolock(channel, name, service, hints, partial_callback,
+                          callback, arg);
   ares_channel_unlock(channel);
 }
 
+void ares_getaddrinfo(ares_channel_t *channel, const char *name,
+                      const char                       *service,
+                      const struct ares_addrinfo_hints *hints,
+                      ares_addrinfo_callback callback, void *arg)
+{
+  ares_getaddrinfo_int(channel, name, service, hints, NULL, callback, arg);
+}
+
+void ares_getaddrinfo_partial(ares_channel_t *channel, const char *name,
+                              const char                       *service,
+                              const struct ares_addrinfo_hints *hints,
+                              ares_addrinfo_partial_callback    partial_callback,
+                              ares_addrinfo_callback callback, void *arg)
+{
+  ares_getaddrinfo_int(channel, name, service, hints, partial_callback,
+                       callback, arg);
+}
+
+/* Send the queries for every name in the search list at once */
+static ares_bool_t hquery_fanout(struct host_query *hquery)
+{
+  int    family = hquery->hints.ai_family;
+  size_t i;
+
+  hquery->fanout_qids =
+    ares_malloc_zero(sizeof(*hquery->fanout_qids) * hquery->names_cnt * 2);
+  if (hquery->fanout_qids == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  hquery->fanout =
+    ares_search_fanout_create(hquery->names_cnt, 2, host_callback, hquery);
+  if (hquery->fanout == NULL) {
+    /* LCOV_EXCL_START: OutOfMemory */
+    ares_free(hquery->fanout_qids);
+    hquery->fanout_qids = NULL;
+    return ARES_FALSE;
+    /* LCOV_EXCL_STOP */
+  }
+
+  /* Responses are held until the name is selected, so none of them can reach
+   * host_callback() yet */
+  for (i = 0; i < hquery->names_cnt; i++) {
+    if (family == AF_INET || family == AF_UNSPEC) {
+      ares_query_nolock(hquery->channel, hquery->names[i], ARES_CLASS_IN,
+                        ARES_REC_TYPE_A, ares_search_fanout_cb,
+                        ares_search_fanout_arg(hquery->fanout, i, 0),
+                        &hquery->fanout_qids[i * 2]);
+    }
+    if (family == AF_INET6 || family == AF_UNSPEC) {
+      ares_query_nolock(hquery->channel, hquery->names[i], ARES_CLASS_IN,
+                        ARES_REC_TYPE_AAAA, ares_search_fanout_cb,
+                        ares_search_fanout_arg(hquery->fanout, i, 1),
+                        &hquery->fanout_qids[i * 2 + 1]);
+    }
+  }
+
+  return ARES_TRUE;
+}
+
+static ares_bool_t next_dns_lookup_fanout(struct host_query *hquery)
+{
+  size_t idx = hquery->next_name_idx++;
+
+  hquery->remaining += (hquery->hints.ai_family == AF_UNSPEC) ? 2 : 1;
+
+  hquery->qid_a    = hquery->fanout_qids[idx * 2];
+  hquery->qid_aaaa = hquery->fanout_qids[idx * 2 + 1];
+
+  /* NOTE: hquery may be invalidated during the call to
+   *       ares_search_fanout_select(), so should not be referenced after this
+   *       point */
+  ares_search_fanout_select(hquery->fanout, idx);
+  return ARES_TRUE;
+}
+
 static ares_bool_t next_dns_lookup(struct host_query *hquery)
 {
   const char *name = NULL;
@@ -774,6 +964,17 @@ static ares_bool_t next_dns_lookup(struct host_query *hquery)
     return ARES_FALSE;
   }
 
+  /* Falls back to querying one name at a time if out of memory */
+  if (hquery->fanout == NULL && hquery->next_name_idx == 0 &&
+      hquery->names_cnt > 1 &&
+      hquery->channel->flags & ARES_FLAG_PARALLEL_SEARCH) {
+    hquery_fanout(hquery);
+  }
+
+  if (hquery->fanout != NULL) {
+    return next_dns_lookup_fanout(hquery);
+  }
+
   name = hquery->names[hquery->next_name_idx++];
 
   /* NOTE: hquery may be invalidated during the call to ares_query_qid(),
@@ -111,6 +111,9 @@ void ares_gethostbyaddr(ares_channel_t *channel, const void *addr, int addrlen,
   if (channel == NULL) {
     return;
   }
+  if (addrlen > 0) {
+    channel = ares_shard_select(channel, addr, (size_t)addrlen);
+  }
   ares_channel_lock(channel);
   ares_gethostbyaddr_nolock(channel, addr, addrlen, family, callback, arg);
   ares_channel_unlock(channel);
@@ -193,6 +193,21 @@ void ares_getnameinfo(ares_channel_t *channel, const struct sockaddr *sa,
     return;
   }
 
+  /* Pick the same shard ares_gethostbyaddr() would for the address */
+  if (sa && sa->sa_family == AF_INET &&
+      salen >= (ares_socklen_t)sizeof(struct sockaddr_in)) {
+    const struct sockaddr_in *addr =
+      CARES_INADDR_CAST(const struct sockaddr_in *, sa);
+    channel =
+      ares_shard_select(channel, &addr->sin_addr, sizeof(struct in_addr));
+  } else if (sa && sa->sa_family == AF_INET6 &&
+             salen >= (ares_socklen_t)sizeof(struct sockaddr_in6)) {
+    const struct sockaddr_in6 *addr6 =
+      CARES_INADDR_CAST(const struct sockaddr_in6 *, sa);
+    channel = ares_shard_select(channel, &addr6->sin6_addr,
+                                sizeof(struct ares_in6_addr));
+  }
+
   ares_channel_lock(channel);
   ares_getnameinfo_int(channel, sa, salen, flags_int, callback, arg);
   ares_channel_unlock(channel);
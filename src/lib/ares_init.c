@@ -69,22 +69,22 @@ int ares_init(ares_channel_t **channelptr)
   return ares_init_options(channelptr, NULL, 0);
 }
 
-static int ares_query_timeout_cmp_cb(const void *arg1, const void *arg2)
+static int ares_query_stale_cmp_cb(const void *arg1, const void *arg2)
 {
   const ares_query_t *q1 = arg1;
   const ares_query_t *q2 = arg2;
 
-  if (q1->timeout.sec > q2->timeout.sec) {
+  if (q1->stale_timeout.sec > q2->stale_timeout.sec) {
     return 1;
   }
-  if (q1->timeout.sec < q2->timeout.sec) {
+  if (q1->stale_timeout.sec < q2->stale_timeout.sec) {
     return -1;
   }
 
-  if (q1->timeout.usec > q2->timeout.usec) {
+  if (q1->stale_timeout.usec > q2->stale_timeout.usec) {
     return 1;
   }
-  if (q1->timeout.usec < q2->timeout.usec) {
+  if (q1->stale_timeout.usec < q2->stale_timeout.usec) {
     return -1;
   }
 
@@ -295,26 +295,60 @@ int ares_init_options(ares_channel_t           **channelptr,
     goto done;
   }
 
+  channel->query_pool      = ares_pool_create(sizeof(ares_query_t), 0);
+  channel->conn_pool       = ares_pool_create(sizeof(ares_conn_t), 8);
+  channel->llist_node_pool = ares_pool_create(ares_llist_node_size(), 0);
+  if (channel->query_pool == NULL || channel->conn_pool == NULL ||
+      channel->llist_node_pool == NULL) {
+    status = ARES_ENOMEM;
+    goto done;
+  }
+
   /* Initialize our lists of queries */
   channel->all_queries = ares_llist_create(NULL);
   if (channel->all_queries == NULL) {
     status = ARES_ENOMEM;
     goto done;
   }
+  ares_llist_set_pool(channel->all_queries, channel->llist_node_pool);
 
-  channel->queries_by_qid = ares_htable_szvp_create(NULL);
+  channel->queries_by_qid = ares_qidmap_create();
   if (channel->queries_by_qid == NULL) {
     status = ARES_ENOMEM;
     goto done;
   }
 
-  channel->queries_by_timeout =
-    ares_slist_create(channel->rand_state, ares_query_timeout_cmp_cb, NULL);
+  channel->queries_by_key = ares_htable_binvp_create(NULL);
+  if (channel->queries_by_key == NULL) {
+    status = ARES_ENOMEM;
+    goto done;
+  }
+
+  channel->queries_by_timeout = ares_timerwheel_create();
   if (channel->queries_by_timeout == NULL) {
     status = ARES_ENOMEM;
     goto done;
   }
 
+  channel->queries_by_stale =
+    ares_slist_create(channel->rand_state, ares_query_stale_cmp_cb, NULL);
+  if (channel->queries_by_stale == NULL) {
+    status = ARES_ENOMEM;
+    goto done;
+  }
+
+  channel->queries_by_hedge = ares_timerwheel_create();
+  if (channel->queries_by_hedge == NULL) {
+    status = ARES_ENOMEM;
+    goto done;
+  }
+
+  channel->timers = ares_timerwheel_create();
+  if (channel->timers == NULL) {
+    status = ARES_ENOMEM;
+    goto done;
+  }
+
   channel->connnode_by_socket = ares_htable_asvp_create(NULL);
   if (channel->connnode_by_socket == NULL) {
     status = ARES_ENOMEM;
@@ -336,11 +370,31 @@ int ares_init_options(ares_channel_t           **channelptr,
 
   /* Go ahead and let it initialize the query cache even if the ttl is 0 and
    * completely unused.  This reduces the number of different code paths that
-   * might be followed even if there is a minor performance hit. */
-  status = ares_qcache_create(channel->rand_state, channel->qcache_max_ttl,
-                              &channel->qcache);
-  if (status != ARES_SUCCESS) {
-    goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+   * might be followed even if there is a minor performance hit.  A shared
+   * cache may have already been attached by the options.  Shards of the
+   * same channel always share a cache. */
+  if (channel->qcache == NULL &&
+      channel->optmask & ARES_OPT_EVENT_THREAD_SHARDS) {
+    status = ares_qcache_shared_create(
+      channel->qcache_max_ttl, &channel->qcache_opts, &channel->qcache);
+    if (status != ARES_SUCCESS) {
+      goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  } else if (channel->qcache == NULL) {
+    status = ares_qcache_create(channel->rand_state, channel->qcache_max_ttl,
+                                &channel->qcache_opts, &channel->qcache);
+    if (status != ARES_SUCCESS) {
+      goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  if (channel->search_negcache_ttl > 0) {
+    channel->search_negcache =
+      ares_search_negcache_create(channel->search_negcache_ttl);
+    if (channel->search_negcache == NULL) {
+      status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+    }
   }
 
   if (status == ARES_SUCCESS) {
@@ -382,6 +436,14 @@ int ares_init_options(ares_channel_t           **channelptr,
     status = ARES_SUCCESS;
   }
 
+  if (channel->optmask & ARES_OPT_EVENT_THREAD_SHARDS) {
+    status = ares_shards_create(channel, options, optmask,
+                                options->event_thread_shards);
+    if (status != ARES_SUCCESS) {
+      goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
 done:
   if (status != ARES_SUCCESS) {
     ares_destroy(channel);
@@ -407,11 +469,17 @@ static void *ares_reinit_thread(void *arg)
 
   ares_channel_lock(channel);
 
-  /* Flush cached queries on reinit */
-  if (status == ARES_SUCCESS && channel->qcache) {
+  /* Flush cached queries on reinit, unless shared with other channels */
+  if (status == ARES_SUCCESS && channel->qcache &&
+      ares_channel_owns_qcache(channel)) {
     ares_qcache_flush(channel->qcache);
   }
 
+  /* Search domains may have changed */
+  if (status == ARES_SUCCESS) {
+    ares_search_negcache_flush(channel->search_negcache);
+  }
+
   channel->reinit_pending = ARES_FALSE;
   ares_channel_unlock(channel);
 
@@ -421,11 +489,16 @@ static void *ares_reinit_thread(void *arg)
 ares_status_t ares_reinit(ares_channel_t *channel)
 {
   ares_status_t status = ARES_SUCCESS;
+  size_t        i;
 
   if (channel == NULL) {
     return ARES_EFORMERR;
   }
 
+  for (i = 0; i < channel->nshards; i++) {
+    ares_reinit(channel->shards[i]);
+  }
+
   ares_channel_lock(channel);
 
   /* If a reinit is already in process, lets not do it again. Or if we are
@@ -559,28 +632,42 @@ done:
 
 void ares_set_local_ip4(ares_channel_t *channel, unsigned int local_ip)
 {
+  size_t i;
+
   if (channel == NULL) {
     return;
   }
   ares_channel_lock(channel);
   channel->local_ip4 = local_ip;
   ares_channel_unlock(channel);
+
+  for (i = 0; i < channel->nshards; i++) {
+    ares_set_local_ip4(channel->shards[i], local_ip);
+  }
 }
 
 /* local_ip6 should be 16 bytes in length */
 void ares_set_local_ip6(ares_channel_t *channel, const unsigned char *local_ip6)
 {
+  size_t i;
+
   if (channel == NULL) {
     return;
   }
   ares_channel_lock(channel);
   memcpy(&channel->local_ip6, local_ip6, sizeof(channel->local_ip6));
   ares_channel_unlock(channel);
+
+  for (i = 0; i < channel->nshards; i++) {
+    ares_set_local_ip6(channel->shards[i], local_ip6);
+  }
 }
 
 /* local_dev_name should be null terminated. */
 void ares_set_local_dev(ares_channel_t *channel, const char *local_dev_name)
 {
+  size_t i;
+
   if (channel == NULL) {
     return;
   }
@@ -590,6 +677,10 @@ void ares_set_local_dev(ares_channel_t *channel, const char *local_dev_name)
               sizeof(channel->local_dev_name));
   channel->local_dev_name[sizeof(channel->local_dev_name) - 1] = 0;
   ares_channel_unlock(channel);
+
+  for (i = 0; i < channel->nshards; i++) {
+    ares_set_local_dev(channel->shards[i], local_dev_name);
+  }
 }
 
 int ares_set_sortlist(ares_channel_t *channel, const char *sortstr)
@@ -597,6 +688,7 @@ int ares_set_sortlist(ares_channel_t *channel, const char *sortstr)
   size_t           nsort    = 0;
   struct apattern *sortlist = NULL;
   ares_status_t    status;
+  size_t           i;
 
   if (!channel) {
     return ARES_ENODATA;
@@ -615,6 +707,10 @@ int ares_set_sortlist(ares_channel_t *channel, const char *sortstr)
     channel->optmask |= ARES_OPT_SORTLIST;
   }
   ares_channel_unlock(channel);
+
+  for (i = 0; i < channel->nshards && status == ARES_SUCCESS; i++) {
+    status = (ares_status_t)ares_set_sortlist(channel->shards[i], sortstr);
+  }
   return (int)status;
 }
 
@@ -44,6 +44,10 @@
  * - Initial Timeout: User-specified via configuration or ARES_OPT_TIMEOUTMS
  * - Average latency multiplier: 5x (a local DNS server returning a cached value
  *   will be quicker than if it needs to recurse so we need to account for this)
+ * - Latency percentile and multiplier: Alternative to the average latency
+ *   multiplier, user-specified via ARES_OPT_LATENCY_TIMEOUT (e.g. p99 * 1.5).
+ *   Averages hide the bimodal latency of recursive resolvers, cached answers
+ *   are fast and recursed ones slow, a high percentile doesn't.
  * - Minimum Count for Average: 3.  This is the minimum number of queries we
  *   need to form an average for the bucket.
  *
@@ -63,9 +67,15 @@
  * - maximum latency
  * - total time
  * - count
+ * - latency histogram
  * NOTE: average latency is (total time / count), we will calculate this
  *       dynamically when needed
  *
+ * The latency histogram is log-linear like HDR histograms: latencies below 8ms
+ * get a slot each, and every power of 2 range above that is split into 8
+ * equal slots.  So memory is fixed regardless of the number of queries, and
+ * the latency reported for a percentile is within 12.5% of the real one.
+ *
  * Basic algorithm for calculating timeout to use would be:
  * - Scan from most recent bucket to least recent
  * - Check timestamp of bucket, if doesn't match current time, continue to next
@@ -75,7 +85,9 @@
  * - If we reached the end with no bucket match, use "Initial Timeout"
  * - If bucket is selected, take ("total time" / count) as Average latency,
  *   multiply by "Average Latency Multiplier", bound by "Minimum Timeout" and
- *   "Maximum Timeout"
+ *   "Maximum Timeout".  If a latency percentile is configured, the latency at
+ *   that percentile of the bucket's histogram multiplied by the configured
+ *   multiplier is used instead of the average.
  * NOTE: The timeout calculated may not be the timeout used.  If we are retrying
  * the query on the same server another time, then it will use a larger value
  *
@@ -87,12 +99,15 @@
  * - Compare current minimum and maximum recorded latency against query time and
  *   adjust if necessary
  * - Increment "count" by 1 and "total time" by the query time
+ * - Increment the histogram slot for the query time by 1
+ * - Fold the query time into the server's smoothed RTT (EWMA, gain 1/8)
  *
  * Other Notes:
- * - This is always-on, the only user-configurable value is the initial
- *   timeout which will simply re-uses the current option.
- * - Minimum and Maximum latencies for a bucket are currently unused but are
- *   there in case we find a need for them in the future.
+ * - This is always-on, the only user-configurable values are the initial
+ *   timeout which will simply re-uses the current option, and the optional
+ *   latency percentile.
+ * - Metrics for the current period of each bucket are exposed via
+ *   ares_get_server_latency().
  */
 
 #include "ares_private.h"
@@ -110,6 +125,66 @@
 /*! Minimum queries required to form an average */
 #define MIN_COUNT_FOR_AVERAGE 3
 
+/*! Histogram slot to count a latency in */
+static size_t ares_metric_hist_slot(unsigned int query_ms)
+{
+  size_t       mag = 0;
+  unsigned int v;
+
+  if (query_ms < ARES_METRIC_HIST_SUB) {
+    return query_ms;
+  }
+
+  for (v = query_ms; v >= ARES_METRIC_HIST_SUB * 2; v >>= 1) {
+    mag++;
+  }
+
+  if (ARES_METRIC_HIST_SUB * (mag + 1) + (v - ARES_METRIC_HIST_SUB) >=
+      ARES_METRIC_HIST_SLOTS) {
+    return ARES_METRIC_HIST_SLOTS - 1;
+  }
+
+  return ARES_METRIC_HIST_SUB * (mag + 1) + (v - ARES_METRIC_HIST_SUB);
+}
+
+/*! Highest latency counted in a histogram slot */
+static unsigned int ares_metric_hist_value(size_t slot)
+{
+  size_t mag;
+  size_t sub;
+
+  if (slot < ARES_METRIC_HIST_SUB) {
+    return (unsigned int)slot;
+  }
+
+  mag = (slot - ARES_METRIC_HIST_SUB) / ARES_METRIC_HIST_SUB;
+  sub = (slot - ARES_METRIC_HIST_SUB) % ARES_METRIC_HIST_SUB;
+  return (unsigned int)(((ARES_METRIC_HIST_SUB + sub + 1) << mag) - 1);
+}
+
+/*! Latency at a percentile (1-100) of a histogram holding count latencies */
+static unsigned int ares_metric_hist_percentile(const ares_uint64_t *hist,
+                                                ares_uint64_t        count,
+                                                unsigned int         percentile)
+{
+  ares_uint64_t target = (count * percentile + 99) / 100;
+  ares_uint64_t seen   = 0;
+  size_t        i;
+
+  if (target == 0) {
+    target = 1;
+  }
+
+  for (i = 0; i < ARES_METRIC_HIST_SLOTS; i++) {
+    seen += hist[i];
+    if (seen >= target) {
+      return ares_metric_hist_value(i);
+    }
+  }
+
+  return ares_metric_hist_value(ARES_METRIC_HIST_SLOTS - 1);
+}
+
 static time_t ares_metric_timestamp(ares_server_bucket_t  bucket,
                                     const ares_timeval_t *now,
                                     ares_bool_t           is_previous)
@@ -151,6 +226,8 @@ void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
   ares_timeval_t       now;
   ares_timeval_t       tvdiff;
   unsigned int         query_ms;
+  ares_uint64_t        query_us;
+  size_t               slot;
   ares_dns_rcode_t     rcode;
   ares_server_bucket_t i;
 
@@ -174,6 +251,21 @@ void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
   if (query_ms == 0) {
     query_ms = 1;
   }
+  slot = ares_metric_hist_slot(query_ms);
+
+  /* Smoothed RTT used for latency based server selection, kept in
+   * microseconds as the millisecond buckets can't tell apart servers on a
+   * local network */
+  query_us =
+    ((ares_uint64_t)tvdiff.sec * 1000000) + (ares_uint64_t)tvdiff.usec;
+  if (query_us == 0) {
+    query_us = 1;
+  }
+  if (server->srtt_us == 0) {
+    server->srtt_us = query_us;
+  } else {
+    server->srtt_us = ((server->srtt_us * 7) + query_us) / 8;
+  }
 
   /* Place in each bucket */
   for (i = 0; i < ARES_METRIC_COUNT; i++) {
@@ -184,11 +276,14 @@ void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
       server->metrics[i].prev_ts          = server->metrics[i].ts;
       server->metrics[i].prev_total_ms    = server->metrics[i].total_ms;
       server->metrics[i].prev_total_count = server->metrics[i].total_count;
-      server->metrics[i].ts               = ts;
-      server->metrics[i].latency_min_ms   = 0;
-      server->metrics[i].latency_max_ms   = 0;
-      server->metrics[i].total_ms         = 0;
-      server->metrics[i].total_count      = 0;
+      memcpy(server->metrics[i].prev_hist, server->metrics[i].hist,
+             sizeof(server->metrics[i].prev_hist));
+      server->metrics[i].ts             = ts;
+      server->metrics[i].latency_min_ms = 0;
+      server->metrics[i].latency_max_ms = 0;
+      server->metrics[i].total_ms       = 0;
+      server->metrics[i].total_count    = 0;
+      memset(server->metrics[i].hist, 0, sizeof(server->metrics[i].hist));
     }
 
     if (server->metrics[i].latency_min_ms == 0 ||
@@ -202,42 +297,92 @@ void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
 
     server->metrics[i].total_count++;
     server->metrics[i].total_ms += (ares_uint64_t)query_ms;
+    server->metrics[i].hist[slot]++;
   }
 }
 
-size_t ares_metrics_server_timeout(const ares_server_t  *server,
-                                   const ares_timeval_t *now)
+/*! Find the most specific bucket with enough queries recorded to be
+ *  meaningful, using its current period if it has one, otherwise its
+ *  previous one.  max_ms is only known for the current period, 0 otherwise. */
+static ares_bool_t ares_metrics_server_window(const ares_server_t  *server,
+                                              const ares_timeval_t *now,
+                                              const ares_uint64_t **hist,
+                                              ares_uint64_t        *total_ms,
+                                              ares_uint64_t        *count,
+                                              unsigned int         *max_ms)
 {
-  const ares_channel_t *channel = server->channel;
-  ares_server_bucket_t  i;
-  size_t                timeout_ms = 0;
-  size_t                max_timeout_ms;
+  ares_server_bucket_t i;
 
   for (i = 0; i < ARES_METRIC_COUNT; i++) {
-    time_t ts = ares_metric_timestamp(i, now, ARES_FALSE);
+    const ares_server_metrics_t *metrics = &server->metrics[i];
+    time_t                       ts = ares_metric_timestamp(i, now, ARES_FALSE);
 
     /* This ts has been invalidated, see if we should use the previous
      * time period */
-    if (ts != server->metrics[i].ts ||
-        server->metrics[i].total_count < MIN_COUNT_FOR_AVERAGE) {
+    if (ts != metrics->ts || metrics->total_count < MIN_COUNT_FOR_AVERAGE) {
       time_t prev_ts = ares_metric_timestamp(i, now, ARES_TRUE);
-      if (prev_ts != server->metrics[i].prev_ts ||
-          server->metrics[i].prev_total_count < MIN_COUNT_FOR_AVERAGE) {
+      if (prev_ts != metrics->prev_ts ||
+          metrics->prev_total_count < MIN_COUNT_FOR_AVERAGE) {
         /* Move onto next bucket */
         continue;
       }
-      /* Calculate average time for previous bucket */
-      timeout_ms = (size_t)(server->metrics[i].prev_total_ms /
-                            server->metrics[i].prev_total_count);
+      /* Use previous bucket */
+      *hist     = metrics->prev_hist;
+      *total_ms = metrics->prev_total_ms;
+      *count    = metrics->prev_total_count;
+      *max_ms   = 0;
     } else {
-      /* Calculate average time for current bucket*/
-      timeout_ms =
-        (size_t)(server->metrics[i].total_ms / server->metrics[i].total_count);
+      /* Use current bucket */
+      *hist     = metrics->hist;
+      *total_ms = metrics->total_ms;
+      *count    = metrics->total_count;
+      *max_ms   = metrics->latency_max_ms;
     }
+    return ARES_TRUE;
+  }
 
-    /* Multiply average by constant to get timeout value */
-    timeout_ms *= AVG_TIMEOUT_MULTIPLIER;
-    break;
+  return ARES_FALSE;
+}
+
+/*! Latency percentile of a window, never beyond the maximum seen as a
+ *  histogram slot spans a range */
+static unsigned int
+  ares_metrics_window_percentile(const ares_uint64_t *hist, ares_uint64_t count,
+                                 unsigned int max_ms, unsigned short percentile)
+{
+  unsigned int latency_ms =
+    ares_metric_hist_percentile(hist, count, percentile);
+
+  if (max_ms != 0 && latency_ms > max_ms) {
+    latency_ms = max_ms;
+  }
+
+  return latency_ms;
+}
+
+size_t ares_metrics_server_timeout(const ares_server_t  *server,
+                                   const ares_timeval_t *now)
+{
+  const ares_channel_t *channel    = server->channel;
+  size_t                timeout_ms = 0;
+  size_t                max_timeout_ms;
+  const ares_uint64_t  *hist;
+  ares_uint64_t         total_ms;
+  ares_uint64_t         count;
+  unsigned int          max_ms;
+
+  if (ares_metrics_server_window(server, now, &hist, &total_ms, &count,
+                                 &max_ms)) {
+    if (channel->latency_timeout_percentile) {
+      unsigned int latency_ms = ares_metrics_window_percentile(
+        hist, count, max_ms, channel->latency_timeout_percentile);
+
+      timeout_ms =
+        (size_t)latency_ms * channel->latency_timeout_multiplier / 100;
+    } else {
+      /* Multiply average by constant to get timeout value */
+      timeout_ms = (size_t)(total_ms / count) * AVG_TIMEOUT_MULTIPLIER;
+    }
   }
 
   /* If we're here, that means its the first query for the server, so we just
@@ -259,3 +404,159 @@ size_t ares_metrics_server_timeout(const ares_server_t  *server,
 
   return timeout_ms;
 }
+
+size_t ares_metrics_server_hedge_delay(const ares_server_t  *server,
+                                       const ares_timeval_t *now)
+{
+  const ares_channel_t *channel = server->channel;
+  const ares_uint64_t  *hist;
+  ares_uint64_t         total_ms;
+  ares_uint64_t         count;
+  unsigned int          max_ms;
+
+  if (channel->hedge_percentile == 0) {
+    return 0;
+  }
+
+  /* Without enough history there's nothing to tell a slow answer apart */
+  if (!ares_metrics_server_window(server, now, &hist, &total_ms, &count,
+                                  &max_ms)) {
+    return 0;
+  }
+
+  return ares_metrics_window_percentile(hist, count, max_ms,
+                                        channel->hedge_percentile);
+}
+
+/* Add the current period of a bucket of the server matching the address, if
+ * any, to the totals.  Returns whether the server was found. */
+static ares_bool_t ares_metrics_server_collect(
+  const ares_channel_t *channel, const char *server_str, size_t server_len,
+  ares_server_bucket_t bucket, const ares_timeval_t *now,
+  ares_server_metrics_t *totals)
+{
+  ares_slist_node_t *node;
+  ares_bool_t        found = ARES_FALSE;
+  time_t             ts    = ares_metric_timestamp(bucket, now, ARES_FALSE);
+
+  ares_channel_lock(channel);
+
+  for (node = ares_slist_node_first(channel->servers); node != NULL;
+       node = ares_slist_node_next(node)) {
+    const ares_server_t         *server = ares_slist_node_val(node);
+    const ares_server_metrics_t *metrics;
+    unsigned char                addr[256];
+    ares_buf_t                   buf;
+    size_t                       len = 0;
+    const unsigned char         *ptr;
+    size_t                       i;
+
+    ares_buf_init_fixed(&buf, addr, sizeof(addr));
+    if (ares_get_server_addr(server, &buf) != ARES_SUCCESS) {
+      continue; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+
+    ptr = ares_buf_peek(&buf, &len);
+    if (len != server_len || memcmp(ptr, server_str, len) != 0) {
+      continue;
+    }
+
+    found   = ARES_TRUE;
+    metrics = &server->metrics[bucket];
+
+    /* Nothing recorded yet in the current period */
+    if (metrics->ts != ts || metrics->total_count == 0) {
+      break;
+    }
+
+    if (totals->latency_min_ms == 0 ||
+        metrics->latency_min_ms < totals->latency_min_ms) {
+      totals->latency_min_ms = metrics->latency_min_ms;
+    }
+    if (metrics->latency_max_ms > totals->latency_max_ms) {
+      totals->latency_max_ms = metrics->latency_max_ms;
+    }
+    totals->total_ms    += metrics->total_ms;
+    totals->total_count += metrics->total_count;
+    for (i = 0; i < ARES_METRIC_HIST_SLOTS; i++) {
+      totals->hist[i] += metrics->hist[i];
+    }
+    break;
+  }
+
+  ares_channel_unlock(channel);
+  return found;
+}
+
+static unsigned int ares_metrics_percentile(const ares_server_metrics_t *totals,
+                                            unsigned int percentile)
+{
+  unsigned int latency_ms =
+    ares_metric_hist_percentile(totals->hist, totals->total_count, percentile);
+
+  if (latency_ms > totals->latency_max_ms) {
+    latency_ms = totals->latency_max_ms;
+  }
+  if (latency_ms < totals->latency_min_ms) {
+    latency_ms = totals->latency_min_ms;
+  }
+  return latency_ms;
+}
+
+ares_status_t ares_get_server_latency(const ares_channel_t *channel,
+                                      const char           *server,
+                                      ares_metrics_period_t period,
+                                      ares_server_latency_t *latency)
+{
+  ares_server_metrics_t *totals = NULL;
+  ares_timeval_t         now;
+  size_t                 server_len;
+  ares_bool_t            found;
+  size_t                 i;
+
+  if (channel == NULL || server == NULL || latency == NULL ||
+      (int)period < 0 || (int)period >= (int)ARES_METRIC_COUNT) {
+    return ARES_EFORMERR;
+  }
+
+  memset(latency, 0, sizeof(*latency));
+
+  totals = ares_malloc_zero(sizeof(*totals));
+  if (totals == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  ares_tvnow(&now);
+  server_len = ares_strlen(server);
+
+  /* Each shard of a channel talks to the same servers but measures them
+   * independently */
+  found = ares_metrics_server_collect(channel, server, server_len,
+                                      (ares_server_bucket_t)period, &now,
+                                      totals);
+  for (i = 0; i < channel->nshards; i++) {
+    if (ares_metrics_server_collect(channel->shards[i], server, server_len,
+                                    (ares_server_bucket_t)period, &now,
+                                    totals)) {
+      found = ARES_TRUE;
+    }
+  }
+
+  if (!found) {
+    ares_free(totals);
+    return ARES_ENOTFOUND;
+  }
+
+  if (totals->total_count) {
+    latency->count  = (size_t)totals->total_count;
+    latency->min_ms = totals->latency_min_ms;
+    latency->max_ms = totals->latency_max_ms;
+    latency->avg_ms = (unsigned int)(totals->total_ms / totals->total_count);
+    latency->p50_ms = ares_metrics_percentile(totals, 50);
+    latency->p90_ms = ares_metrics_percentile(totals, 90);
+    latency->p99_ms = ares_metrics_percentile(totals, 99);
+  }
+
+  ares_free(totals);
+  return ARES_SUCCESS;
+}
@@ -227,12 +227,41 @@ int ares_save_options(const ares_channel_t *channel,
     options->evsys = channel->evsys;
   }
 
+  if (channel->optmask & ARES_OPT_QUERY_CACHE_OPTS) {
+    options->qcache_opts = channel->qcache_opts;
+  }
+
+  if (channel->optmask & ARES_OPT_EVENT_THREAD_SHARDS) {
+    options->event_thread_shards = channel->nshards + 1;
+  }
+
+  /* No reference is taken, only valid for the lifetime of the channel */
+  if (channel->optmask & ARES_OPT_QUERY_CACHE_SHARED) {
+    options->qcache_shared = channel->qcache;
+  }
+
   /* Set options for server failover behavior */
   if (channel->optmask & ARES_OPT_SERVER_FAILOVER) {
     options->server_failover_opts.retry_chance = channel->server_retry_chance;
     options->server_failover_opts.retry_delay  = channel->server_retry_delay;
   }
 
+  if (channel->optmask & ARES_OPT_LATENCY_TIMEOUT) {
+    options->latency_timeout_opts.percentile =
+      channel->latency_timeout_percentile;
+    options->latency_timeout_opts.multiplier =
+      channel->latency_timeout_multiplier;
+  }
+
+  if (channel->optmask & ARES_OPT_HEDGE) {
+    options->hedge_opts.percentile = channel->hedge_percentile;
+    options->hedge_opts.budget     = channel->hedge_budget;
+  }
+
+  if (channel->optmask & ARES_OPT_SEARCH_NEGCACHE) {
+    options->search_negcache_ttl = channel->search_negcache_ttl;
+  }
+
   *optmask = (int)channel->optmask;
 
   return ARES_SUCCESS;
@@ -288,6 +317,18 @@ ares_status_t ares_init_by_options(ares_channel_t            *channel,
     channel->evsys = options->evsys;
   }
 
+  /* Shards each run their own event thread */
+  if (optmask & ARES_OPT_EVENT_THREAD_SHARDS) {
+    if (!(optmask & ARES_OPT_EVENT_THREAD)) {
+      return ARES_EFORMERR;
+    }
+    if (options->event_thread_shards < 2) {
+      optmask &= ~(ARES_OPT_EVENT_THREAD_SHARDS);
+    } else if (options->event_thread_shards > ARES_SHARDS_MAX) {
+      return ARES_EFORMERR;
+    }
+  }
+
   if (optmask & ARES_OPT_FLAGS) {
     channel->flags = (unsigned int)options->flags;
   }
@@ -466,6 +507,18 @@ ares_status_t ares_init_by_options(ares_channel_t            *channel,
     channel->qcache_max_ttl  = 3600;
   }
 
+  if (optmask & ARES_OPT_QUERY_CACHE_OPTS) {
+    channel->qcache_opts = options->qcache_opts;
+  }
+
+  if (optmask & ARES_OPT_QUERY_CACHE_SHARED) {
+    if (options->qcache_shared == NULL) {
+      optmask &= ~(ARES_OPT_QUERY_CACHE_SHARED);
+    } else {
+      channel->qcache = ares_qcache_ref(options->qcache_shared);
+    }
+  }
+
   /* Initialize the ipv4 servers if provided */
   if (optmask & ARES_OPT_SERVERS) {
     if (options->nservers <= 0) {
@@ -486,6 +539,33 @@ ares_status_t ares_init_by_options(ares_channel_t            *channel,
     channel->server_retry_delay  = options->server_failover_opts.retry_delay;
   }
 
+  if (optmask & ARES_OPT_LATENCY_TIMEOUT) {
+    if (options->latency_timeout_opts.percentile == 0 ||
+        options->latency_timeout_opts.percentile > 100 ||
+        options->latency_timeout_opts.multiplier == 0) {
+      return ARES_EFORMERR;
+    }
+    channel->latency_timeout_percentile =
+      options->latency_timeout_opts.percentile;
+    channel->latency_timeout_multiplier =
+      options->latency_timeout_opts.multiplier;
+  }
+
+  if (optmask & ARES_OPT_HEDGE) {
+    if (options->hedge_opts.percentile == 0 ||
+        options->hedge_opts.percentile > 99 ||
+        options->hedge_opts.budget == 0 || options->hedge_opts.budget > 100) {
+      return ARES_EFORMERR;
+    }
+    channel->hedge_percentile = options->hedge_opts.percentile;
+    channel->hedge_budget     = options->hedge_opts.budget;
+  }
+
+  /* A TTL of 0 leaves the cache disabled */
+  if (optmask & ARES_OPT_SEARCH_NEGCACHE) {
+    channel->search_negcache_ttl = options->search_negcache_ttl;
+  }
+
   channel->optmask = (unsigned int)optmask;
 
   return ARES_SUCCESS;
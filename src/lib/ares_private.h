@@ -46,16 +46,21 @@
 #include "util/ares_time.h"
 #include "util/ares_rand.h"
 #include "ares_array.h"
+#include "ares_pool.h"
 #include "ares_llist.h"
 #include "dsa/ares_slist.h"
 #include "ares_htable_strvp.h"
 #include "ares_htable_szvp.h"
 #include "ares_htable_asvp.h"
+#include "ares_htable_binvp.h"
 #include "ares_htable_dict.h"
 #include "ares_htable_vpvp.h"
 #include "ares_htable_vpstr.h"
+#include "ares_qidmap.h"
+#include "ares_timerwheel.h"
 #include "record/ares_dns_multistring.h"
 #include "ares_buf.h"
+#include "util/ares_arena.h"
 #include "record/ares_dns_private.h"
 #include "util/ares_iface_ips.h"
 #include "util/ares_threads.h"
@@ -142,6 +147,12 @@ W32_FUNC const char *_w32_GetHostsFile(void);
 struct ares_query;
 typedef struct ares_query ares_query_t;
 
+/* Additional caller attached to an in-flight query by request coalescing */
+typedef struct {
+  ares_callback_dnsrec callback;
+  void                *arg;
+} ares_query_waiter_t;
+
 /* State to represent a DNS query */
 struct ares_query {
   /* Query ID from qbuf, for faster lookup, and current timeout */
@@ -154,19 +165,46 @@ struct ares_query {
    * Node object for each list entry the query belongs to in order to
    * make removal operations O(1).
    */
-  ares_slist_node_t   *node_queries_by_timeout;
+  ares_timerwheel_node_t *node_queries_by_timeout;
   ares_llist_node_t   *node_queries_to_conn;
   ares_llist_node_t   *node_all_queries;
+  ares_slist_node_t   *node_queries_by_stale;
+  ares_timerwheel_node_t *node_queries_by_hedge;
+
+  /* Time at which a stale cached response will be returned if no answer has
+   * been received yet */
+  ares_timeval_t       stale_timeout;
 
   /* connection handle query is associated with */
   ares_conn_t         *conn;
 
+  /* A hedged query and the duplicate sent to another server for it point at
+   * each other until either one ends.  NULL if there is none. */
+  ares_query_t        *hedge;
+  ares_bool_t          is_hedge; /* this query is the duplicate */
+
   /* Query */
   ares_dns_record_t   *query;
 
+  /* Wire format of query, serialized on first write.  Later writes only patch
+   * the query id and cookie in place as long as the cookie length is
+   * unchanged.  Must be discarded whenever query is otherwise modified. */
+  unsigned char       *qwire;
+  size_t               qwire_len;
+  size_t               qwire_cookie_offset; /*!< 0 if no cookie */
+  size_t               qwire_cookie_len;
+
   ares_callback_dnsrec callback;
   void                *arg;
 
+  /* Identical requests coalesced onto this query while it was in flight, type
+   * is ares_query_waiter_t.  NULL if there are none. */
+  ares_array_t        *waiters;
+
+  /* Key this query is registered under in queries_by_key, NULL if it isn't */
+  unsigned char       *inflight_key;
+  size_t               inflight_key_len;
+
   /* Query status */
   size_t        try_count; /* Number of times we tried this query already. */
   size_t        cookie_try_count; /* Attempt count for cookie resends */
@@ -175,6 +213,7 @@ struct ares_query {
   size_t        timeouts;   /* number of timeouts we saw for this request */
   ares_bool_t   no_retries; /* do not perform any additional retries, this is
                              * set when a query is to be canceled */
+  ares_bool_t   no_cache;   /* query bypasses the cache, never serve stale */
 };
 
 struct apattern {
@@ -182,12 +221,12 @@ struct apattern {
   unsigned char    mask;
 };
 
-struct ares_qcache;
-typedef struct ares_qcache ares_qcache_t;
-
 struct ares_hosts_file;
 typedef struct ares_hosts_file ares_hosts_file_t;
 
+struct ares_search_negcache;
+typedef struct ares_search_negcache ares_search_negcache_t;
+
 struct ares_channeldata {
   /* Configuration data */
   unsigned int         flags;
@@ -234,10 +273,24 @@ struct ares_channeldata {
   /* All active queries in a single list */
   ares_llist_t        *all_queries;
   /* Queries bucketed by qid, for quickly dispatching DNS responses: */
-  ares_htable_szvp_t  *queries_by_qid;
+  ares_qidmap_t       *queries_by_qid;
+  /* Cacheable queries keyed by the query cache key, for coalescing identical
+   * requests while one is already in flight: */
+  ares_htable_binvp_t *queries_by_key;
 
   /* Queries bucketed by timeout, for quickly handling timeouts: */
-  ares_slist_t        *queries_by_timeout;
+  ares_timerwheel_t   *queries_by_timeout;
+
+  /* Queries with a stale cached response available, bucketed by the time
+   * that response should be returned (serve-stale client timeout) */
+  ares_slist_t        *queries_by_stale;
+
+  /* Queries that may be hedged, bucketed by the time a duplicate should be
+   * sent to another server if no answer has been received yet */
+  ares_timerwheel_t   *queries_by_hedge;
+
+  /* Channel timers (ares_timer_t) for state other than queries */
+  ares_timerwheel_t   *timers;
 
   /* Map linked list node member for connection to file descriptor.  We use
    * the node instead of the connection object itself so we can quickly look
@@ -245,6 +298,12 @@ struct ares_channeldata {
    * scan all connections) */
   ares_htable_asvp_t  *connnode_by_socket;
 
+  /* Pools for the objects allocated for every query and connection, rather
+   * than a separate ares_malloc() for each.  Protected by the channel lock. */
+  ares_pool_t         *query_pool;
+  ares_pool_t         *conn_pool;
+  ares_pool_t         *llist_node_pool;
+
   ares_sock_state_cb   sock_state_cb;
   void                *sock_state_cb_data;
 
@@ -263,6 +322,17 @@ struct ares_channeldata {
   void                               *notify_pending_write_cb_data;
   ares_bool_t                         notify_pending_write;
 
+  /* Datagram I/O performed by the event thread's event system, NULL if it
+   * only provides readiness.  Only called from the event thread. */
+  ares_dgram_recv_cb                  dgram_recv_cb;
+  ares_dgram_send_cb                  dgram_send_cb;
+  void                               *dgram_cb_data;
+
+  /* Nesting depth of ares_write_defer_begin().  While non-zero, query writes
+   * are only buffered, and are flushed together once it drops back to 0 */
+  size_t                              write_defer;
+  ares_bool_t                         write_defer_pending;
+
   ares_query_enqueue_cb               query_enqueue_cb;
   void                               *query_enqueue_cb_data;
 
@@ -280,6 +350,22 @@ struct ares_channeldata {
 
   /* Query Cache */
   ares_qcache_t                      *qcache;
+  struct ares_qcache_options          qcache_opts;
+
+  /* Search list names known not to exist, NULL if disabled */
+  ares_search_negcache_t             *search_negcache;
+  unsigned int                        search_negcache_ttl;
+
+  /* Additional channels when the event thread is sharded via
+   * ARES_OPT_EVENT_THREAD_SHARDS.  This channel is the first shard. */
+  ares_channel_t                    **shards;
+  size_t                              nshards;
+
+  /* Lock-free stack of requests submitted by other threads while an event
+   * thread is in use, and the number not yet started.  Only accessed via
+   * ares_atomic_*(), drained by ares_submit_drain(). */
+  void                               *submit_head;
+  size_t                              submit_pending;
 
   /* Fields controlling server failover behavior.
    * The retry chance is the probability (1/N) by which we will retry a failed
@@ -291,6 +377,20 @@ struct ares_channeldata {
   unsigned short                      server_retry_chance;
   size_t                              server_retry_delay;
 
+  /* Percentile of measured server latency, and multiplier to apply to it in
+   * hundredths, used to derive query timeouts.  A percentile of 0 derives
+   * them from the average latency instead. */
+  unsigned short                      latency_timeout_percentile;
+  unsigned short                      latency_timeout_multiplier;
+
+  /* Percentile of measured server latency after which a query is hedged to
+   * another server, 0 if hedging is disabled.  The budget caps hedges in
+   * percent of queries sent, counted over a decaying window. */
+  unsigned short                      hedge_percentile;
+  unsigned short                      hedge_budget;
+  size_t                              hedge_window_queries;
+  size_t                              hedge_window_hedges;
+
   /* Callback triggered when a server has a successful or failed response */
   ares_server_state_callback          server_state_cb;
   void                               *server_state_cb_data;
@@ -309,6 +409,120 @@ struct ares_channeldata {
   ares_bool_t                         sys_up;
 };
 
+/*! Maximum number of shards supported by ARES_OPT_EVENT_THREAD_SHARDS */
+#define ARES_SHARDS_MAX 256
+
+/*! Create the additional shards of a channel, configured with the same
+ *  options the channel itself was initialized with.
+ *
+ *  \param[in] channel Initialized channel, becomes the first shard
+ *  \param[in] options Options passed to ares_init_options()
+ *  \param[in] optmask Option mask passed to ares_init_options()
+ *  \param[in] cnt     Total number of shards, including the channel itself
+ *  \return ARES_SUCCESS on success
+ */
+ares_status_t ares_shards_create(ares_channel_t            *channel,
+                                 const struct ares_options *options,
+                                 int optmask, size_t cnt);
+
+/*! Destroy the additional shards of a channel, if any.
+ *
+ *  \param[in] channel Initialized channel, must not be locked
+ */
+void ares_shards_destroy(ares_channel_t *channel);
+
+/*! Whether the channel is responsible for flushing its query cache when its
+ *  configuration changes.
+ *
+ *  \param[in] channel Initialized channel
+ *  \return ARES_TRUE if the channel owns the cache
+ */
+ares_bool_t ares_channel_owns_qcache(const ares_channel_t *channel);
+
+/*! Select the shard responsible for a key, such as a name or an address.
+ *
+ *  \param[in] channel Initialized channel, not locked
+ *  \param[in] key     Key to hash, may be NULL
+ *  \param[in] key_len Length of key
+ *  \return the shard, or channel itself if not sharded
+ */
+ares_channel_t *ares_shard_select(ares_channel_t *channel, const void *key,
+                                  size_t key_len);
+
+/*! Select the shard responsible for the question of a DNS record.
+ *
+ *  \param[in] channel Initialized channel, not locked
+ *  \param[in] dnsrec  DNS record with at least one question
+ *  \return the shard, or channel itself if not sharded
+ */
+ares_channel_t *ares_shard_select_dnsrec(ares_channel_t          *channel,
+                                         const ares_dns_record_t *dnsrec);
+
+/*! Whether requests to the channel may be submitted without taking the
+ *  channel lock, via ares_submit_*().  Only when the channel is processed by
+ *  an event thread, which is what drains the submissions.
+ *
+ *  \param[in] channel Initialized channel, not locked
+ *  \return ARES_TRUE if lock-free submission is possible
+ */
+ares_bool_t ares_submit_enabled(const ares_channel_t *channel);
+
+/*! Submit ares_send_dnsrec() without taking the channel lock.
+ *
+ *  \param[in] channel  Initialized channel, not locked
+ *  \param[in] dnsrec   DNS record to send, duplicated
+ *  \param[in] callback Callback
+ *  \param[in] arg      Callback argument
+ *  \return ARES_SUCCESS if submitted, otherwise the caller must use the locked
+ *          path
+ */
+ares_status_t ares_submit_send(ares_channel_t          *channel,
+                               const ares_dns_record_t *dnsrec,
+                               ares_callback_dnsrec callback, void *arg);
+
+/*! Submit ares_query_dnsrec() without taking the channel lock.
+ *
+ *  \param[in] channel  Initialized channel, not locked
+ *  \param[in] name     Name to query, duplicated
+ *  \param[in] dnsclass Class
+ *  \param[in] type     Record type
+ *  \param[in] callback Callback
+ *  \param[in] arg      Callback argument
+ *  \return ARES_SUCCESS if submitted, otherwise the caller must use the locked
+ *          path
+ */
+ares_status_t ares_submit_query(ares_channel_t *channel, const char *name,
+                                ares_dns_class_t     dnsclass,
+                                ares_dns_rec_type_t  type,
+                                ares_callback_dnsrec callback, void *arg);
+
+/*! Submit ares_getaddrinfo() without taking the channel lock.
+ *
+ *  \param[in] channel  Initialized channel, not locked
+ *  \param[in] name     Name to look up, duplicated, may be NULL
+ *  \param[in] service  Service to look up, duplicated, may be NULL
+ *  \param[in] hints    Hints, copied, may be NULL
+ *  \param[in] partial_callback Partial results callback, may be NULL
+ *  \param[in] callback Callback
+ *  \param[in] arg      Callback argument
+ *  \return ARES_SUCCESS if submitted, otherwise the caller must use the locked
+ *          path
+ */
+ares_status_t
+  ares_submit_getaddrinfo(ares_channel_t *channel, const char *name,
+                          const char                       *service,
+                          const struct ares_addrinfo_hints *hints,
+                          ares_addrinfo_partial_callback    partial_callback,
+                          ares_addrinfo_callback callback, void *arg);
+
+/*! Start every request submitted so far, or if status is not ARES_SUCCESS,
+ *  fail them with that status instead.
+ *
+ *  \param[in] channel Initialized channel, locked
+ *  \param[in] status  ARES_SUCCESS, or the status to fail requests with
+ */
+void ares_submit_drain(ares_channel_t *channel, ares_status_t status);
+
 /* Does the domain end in ".onion" or ".onion."? Case-insensitive. */
 ares_bool_t ares_is_onion_domain(const char *name);
 
@@ -321,6 +535,21 @@ ares_status_t ares_requeue_query(ares_query_t *query, const ares_timeval_t *now,
                                  ares_dns_record_t *dnsrec,
                                  ares_array_t     **requeue);
 
+/*! Start a region where query writes are buffered rather than sent, so queries
+ *  issued back to back go out in as few send calls as possible.  May be
+ *  nested.
+ *
+ *  \param[in] channel Initialized ares channel, must be locked
+ */
+void ares_write_defer_begin(ares_channel_t *channel);
+
+/*! End a region started by ares_write_defer_begin().  Leaving the outermost
+ *  region flushes every connection with buffered data.
+ *
+ *  \param[in] channel Initialized ares channel, must be locked
+ */
+void ares_write_defer_end(ares_channel_t *channel);
+
 /*! Count the number of labels (dots+1) in a domain */
 size_t ares_name_label_cnt(const char *name);
 
@@ -339,6 +568,90 @@ ares_status_t ares_search_name_list(const ares_channel_t *channel,
                                     const char *name, char ***names,
                                     size_t *names_len);
 
+/*! Queries for all names of a search list sent at once, see
+ *  ARES_FLAG_PARALLEL_SEARCH.  Responses are held until the consumer selects
+ *  the name they belong to, so they are seen in search list order. */
+typedef struct ares_search_fanout ares_search_fanout_t;
+
+/*! Create a fanout for a search list.
+ *
+ *  \param[in] names_cnt Number of names in the search list
+ *  \param[in] slots     Number of queries sent per name
+ *  \param[in] callback  Callback to deliver responses of the selected name to
+ *  \param[in] arg       Argument passed to callback
+ *  \return fanout or NULL on out of memory
+ */
+ares_search_fanout_t *ares_search_fanout_create(size_t names_cnt, size_t slots,
+                                                ares_callback_dnsrec callback,
+                                                void                *arg);
+
+/*! Retrieve the argument to send a query for a name with.  The query must be
+ *  sent with ares_search_fanout_cb() as its callback.
+ *
+ *  \param[in] fanout Fanout
+ *  \param[in] idx    Index of the name in the search list
+ *  \param[in] slot   Query slot of the name, less than slots at creation
+ *  \return argument for ares_search_fanout_cb()
+ */
+void *ares_search_fanout_arg(ares_search_fanout_t *fanout, size_t idx,
+                             size_t slot);
+
+/*! Query callback for queries sent for a fanout */
+void ares_search_fanout_cb(void *arg, ares_status_t status, size_t timeouts,
+                           const ares_dns_record_t *dnsrec);
+
+/*! Select the name to deliver responses for.  Responses already received
+ *  for the name are delivered immediately, others as they arrive.  Names must
+ *  be selected in order.  The callback may be invoked, the consumer must not
+ *  touch any state it may free afterwards.
+ *
+ *  \param[in] fanout Fanout
+ *  \param[in] idx    Index of the name in the search list
+ */
+void ares_search_fanout_select(ares_search_fanout_t *fanout, size_t idx);
+
+/*! Release a fanout once the search completed.  The callback will no
+ *  longer be called, queries still outstanding complete in the background.
+ *
+ *  \param[in] fanout Fanout, may be NULL
+ */
+void ares_search_fanout_release(ares_search_fanout_t *fanout);
+
+/*! Remember a name from a search list that does not exist if it was formed by
+ *  appending a search domain, so later searches skip it.  See
+ *  ARES_OPT_SEARCH_NEGCACHE.
+ *
+ *  \param[in] channel   Initialized ares channel, must be locked
+ *  \param[in] name      Name being searched
+ *  \param[in] candidate Name from the search list that was queried
+ *  \param[in] dnsrec    Response, only NXDOMAIN responses are remembered
+ */
+void ares_search_negcache_note(ares_channel_t *channel, const char *name,
+                               const char              *candidate,
+                               const ares_dns_record_t *dnsrec);
+
+/*! Create a cache of search list names which do not exist
+ *
+ *  \param[in] ttl Seconds each name is remembered for
+ *  \return cache or NULL on out of memory
+ */
+ares_search_negcache_t *ares_search_negcache_create(unsigned int ttl);
+
+/*! Destroy a search list negative cache, NULL is ignored */
+void ares_search_negcache_destroy(ares_search_negcache_t *cache);
+
+/*! Forget all names in a search list negative cache, NULL is ignored */
+void ares_search_negcache_flush(ares_search_negcache_t *cache);
+
+/*! Remember a name does not exist, NULL cache is ignored */
+void ares_search_negcache_insert(ares_search_negcache_t *cache,
+                                 const ares_timeval_t *now, const char *name);
+
+/*! Whether a name is known not to exist, NULL cache never matches */
+ares_bool_t ares_search_negcache_fetch(const ares_search_negcache_t *cache,
+                                       const ares_timeval_t         *now,
+                                       const char                   *name);
+
 /*! Function to create callback arg for converting from ares_callback_dnsrec
  *  to ares_calback */
 void *ares_dnsrec_convert_arg(ares_callback callback, void *arg);
@@ -352,6 +665,19 @@ void ares_dnsrec_convert_cb(void *arg, ares_status_t status, size_t timeouts,
 
 void ares_free_query(ares_query_t *query);
 
+/*! Invoke the callback for the query and any requests coalesced onto it, and
+ *  unregister it so new requests are no longer coalesced onto it.  The query
+ *  itself is not freed.
+ *
+ *  \param[in] query    Query being completed
+ *  \param[in] status   Result status
+ *  \param[in] timeouts Number of timeouts seen
+ *  \param[in] dnsrec   Response, may be NULL
+ */
+void ares_query_invoke_callbacks(ares_query_t *query, ares_status_t status,
+                                 size_t                   timeouts,
+                                 const ares_dns_record_t *dnsrec);
+
 unsigned short ares_generate_new_id(ares_rand_state *state);
 ares_status_t ares_expand_name_validated(const unsigned char *encoded,
                                          const unsigned char *abuf, size_t alen,
@@ -366,6 +692,7 @@ ares_status_t ares_init_by_options(ares_channel_t            *channel,
                                    int                        optmask);
 ares_status_t ares_init_by_sysconfig(ares_channel_t *channel);
 void ares_set_socket_functions_def(ares_channel_t *channel);
+ares_bool_t ares_socket_functions_are_default(const ares_channel_t *channel);
 
 typedef struct {
   ares_llist_t    *sconfig;
@@ -543,6 +870,14 @@ void ares_gethostbyaddr_nolock(ares_channel_t *channel, const void *addr,
                                int addrlen, int family,
                                ares_host_callback callback, void *arg);
 
+/* Same as ares_getaddrinfo_partial() except does not take a channel lock.  Use
+ * this if a channel lock is already held */
+void ares_getaddrinfo_nolock(ares_channel_t *channel, const char *name,
+                             const char                       *service,
+                             const struct ares_addrinfo_hints *hints,
+                             ares_addrinfo_partial_callback    partial_callback,
+                             ares_addrinfo_callback callback, void *arg);
+
 /*! Parse a compressed DNS name as defined in RFC1035 starting at the current
  *  offset within the buffer.
  *
@@ -565,24 +900,54 @@ ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
                                   ares_bool_t is_hostname,
                                   ares_bool_t allow_compression);
 
+/*! Same as ares_dns_name_parse() except the name is allocated from an arena
+ *  rather than with ares_malloc(), if an arena is given.
+ *
+ *  \param[in]  buf        Initialized buffer object
+ *  \param[in]  arena      Arena to allocate the name from, or NULL
+ *  \param[out] name       Pointer passed by reference to be filled in with
+ *                         the parsed name
+ *  \param[in] is_hostname See ares_dns_name_parse()
+ *  \param[in] allow_compression See ares_dns_name_parse()
+ *  \return ARES_SUCCESS on success
+ */
+ares_status_t ares_dns_name_parse_arena(ares_buf_t *buf, ares_arena_t *arena,
+                                        char **name, ares_bool_t is_hostname,
+                                        ares_bool_t allow_compression);
+
+/*! Same as ares_dns_name_parse() except the name is written to
+ *  caller-provided storage rather than allocated.
+ *
+ *  \param[in]  buf        Initialized buffer object
+ *  \param[out] name       Storage to write the NULL terminated name to
+ *  \param[in]  name_len   Size of the storage
+ *  \param[in] is_hostname See ares_dns_name_parse()
+ *  \param[in] allow_compression See ares_dns_name_parse()
+ *  \return ARES_SUCCESS on success, ARES_ENOMEM if the storage is too small
+ */
+ares_status_t ares_dns_name_parse_fixed(ares_buf_t *buf, char *name,
+                                        size_t name_len, ares_bool_t is_hostname,
+                                        ares_bool_t allow_compression);
+
 /*! Write the DNS name to the buffer in the DNS domain-name syntax as a
  *  series of labels.  The maximum domain name length is 255 characters with
  *  each label being a maximum of 63 characters.  If the validate_hostname
  *  flag is set, it will strictly validate the character set.
  *
  *  \param[in,out]  buf   Initialized buffer object to write name to
- *  \param[in,out]  list  Pointer passed by reference to maintain a list of
- *                        domain name to indexes used for name compression.
- *                        Pass NULL (not by reference) if name compression isn't
- *                        desired.  Otherwise the list will be automatically
- *                        created upon first entry.
+ *  \param[in,out]  list  Pointer passed by reference to maintain a table of
+ *                        domain name suffixes to indexes used for name
+ *                        compression.  Pass NULL (not by reference) if name
+ *                        compression isn't desired.  Otherwise the table will
+ *                        be automatically created upon first entry and must be
+ *                        destroyed with ares_htable_binvp_destroy().
  *  \param[in]      validate_hostname Validate the hostname character set.
  *  \param[in]      name              Name to write out, it may have escape
  *                                    sequences.
  *  \return ARES_SUCCESS on success, most likely ARES_EBADNAME if the name is
  *          bad.
  */
-ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
+ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_htable_binvp_t **list,
                                   ares_bool_t validate_hostname,
                                   const char *name);
 
@@ -604,27 +969,130 @@ ares_bool_t ares_subnet_match(const struct ares_addr *addr,
                               unsigned char           netmask);
 ares_bool_t ares_addr_is_linklocal(const struct ares_addr *addr);
 
+/* Binary cache key.  Format is:
+ *   OPCODE(1) | FLAGS(1) [| QTYPE(2) | QCLASS(2) | NAMELEN(2) | NAME]...
+ * Where FLAGS only contains the RD and CD bits and NAME is lowercased with any
+ * trailing '.' stripped.  Large enough for a single question with a maximum
+ * length (fully escaped) name, anything that won't fit is simply not
+ * cached. */
+#define ARES_QCACHE_KEY_MAX 1024
+
+typedef struct {
+  unsigned char data[ARES_QCACHE_KEY_MAX];
+  size_t        len;
+} ares_qcache_key_t;
+
+/*! Generate the binary cache key for a request into the caller-provided
+ *  buffer, no allocations are performed.  Also used to identify identical
+ *  in-flight requests.
+ *
+ *  \param[in]  dnsrec Request
+ *  \param[out] key    Key to fill in
+ *  \return ARES_FALSE if the request can't be represented (e.g. too large), in
+ *          which case it must not be cached.
+ */
+ares_bool_t ares_qcache_calc_key(const ares_dns_record_t *dnsrec,
+                                 ares_qcache_key_t       *key);
+
+/*! Release a reference to the query cache, freeing it once the last
+ *  reference is released. */
 void ares_qcache_destroy(ares_qcache_t *cache);
-ares_status_t ares_qcache_create(ares_rand_state *rand_state,
-                                 unsigned int     max_ttl,
-                                 ares_qcache_t  **cache_out);
+
+/*! Take a reference to a shared query cache for a channel. */
+ares_qcache_t *ares_qcache_ref(ares_qcache_t *cache);
+
+/*! Whether the query cache will store responses */
+ares_bool_t ares_qcache_is_enabled(const ares_qcache_t *cache);
+
+/*! Whether the query cache was created via ares_qcache_shared_create() */
+ares_bool_t ares_qcache_is_shared(const ares_qcache_t *cache);
+ares_status_t ares_qcache_create(ares_rand_state                  *rand_state,
+                                 unsigned int                      max_ttl,
+                                 const struct ares_qcache_options *opts,
+                                 ares_qcache_t                   **cache_out);
 void ares_qcache_flush(ares_qcache_t *cache);
 ares_status_t ares_qcache_insert(ares_channel_t          *channel,
                                  const ares_timeval_t    *now,
                                  const ares_query_t      *query,
                                  const ares_dns_record_t *dnsrec);
-ares_status_t ares_qcache_fetch(ares_channel_t           *channel,
-                                const ares_timeval_t     *now,
-                                const ares_dns_record_t  *dnsrec,
-                                const ares_dns_record_t **dnsrec_resp);
+
+/*! Fetch a response from the cache.
+ *
+ *  \param[in]  channel     Initialized channel
+ *  \param[in]  now         Current time
+ *  \param[in]  dnsrec      Query to look up
+ *  \param[out] dnsrec_resp Cached response with TTLs adjusted for the time
+ *                          spent in the cache, must be destroyed by the
+ *                          caller.
+ *  \param[out] prefetch    Set to ARES_TRUE if the entry is close to expiring
+ *                          and popular enough that the caller should issue a
+ *                          refresh query bypassing the cache.
+ *  \return ARES_SUCCESS on a cache hit, ARES_ENOTFOUND if not cached.
+ */
+ares_status_t ares_qcache_fetch(ares_channel_t          *channel,
+                                const ares_timeval_t    *now,
+                                const ares_dns_record_t *dnsrec,
+                                ares_dns_record_t      **dnsrec_resp,
+                                ares_bool_t             *prefetch);
+
+/*! Fetch an expired entry from the cache that is still within the configured
+ *  serve-stale window (RFC 8767).  The returned record is a copy owned by the
+ *  caller with all TTLs set to the stale answer TTL.
+ *
+ *  \param[in]  channel     Initialized channel
+ *  \param[in]  now         Current time
+ *  \param[in]  dnsrec      Query to look up
+ *  \param[out] dnsrec_resp Optional. Stale response, must be destroyed by the
+ *                          caller.  If NULL, only checks for existence.
+ *  \return ARES_SUCCESS if a stale entry exists, ARES_ENOTFOUND if not.
+ */
+ares_status_t ares_qcache_fetch_stale(ares_channel_t          *channel,
+                                      const ares_timeval_t    *now,
+                                      const ares_dns_record_t *dnsrec,
+                                      ares_dns_record_t      **dnsrec_resp);
+
+/*! Callback invoked when a channel timer expires */
+typedef void (*ares_timer_cb_t)(void *arg);
+
+/*! One-shot timer fired from the channel's timeout processing, for state
+ *  other than queries which have their own tracking */
+typedef struct ares_timer ares_timer_t;
+
+/*! Create a timer.  The channel lock must be held.
+ *
+ *  \param[in] channel    Initialized channel
+ *  \param[in] timeout_ms Milliseconds from now until the timer fires
+ *  \param[in] callback   Callback to invoke, the timer is already freed by
+ *                        then and must not be destroyed by the owner
+ *  \param[in] arg        Argument passed to the callback
+ *  \return timer or NULL on out of memory
+ */
+ares_timer_t *ares_timer_create(ares_channel_t *channel, size_t timeout_ms,
+                                ares_timer_cb_t callback, void *arg);
+
+/*! Cancel and free a timer that has not fired yet.
+ *
+ *  \param[in] timer Timer, may be NULL
+ */
+void ares_timer_destroy(ares_timer_t *timer);
+
+/*! Fire all expired channel timers */
+void ares_timers_process(ares_channel_t *channel, const ares_timeval_t *now);
 
 void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
                          ares_status_t status, const ares_dns_record_t *dnsrec);
 size_t ares_metrics_server_timeout(const ares_server_t  *server,
                                    const ares_timeval_t *now);
 
+/*! Time in milliseconds after which a query to the server should be hedged,
+ *  or 0 if hedging is disabled or there is not enough history to tell. */
+size_t ares_metrics_server_hedge_delay(const ares_server_t  *server,
+                                       const ares_timeval_t *now);
+
 ares_status_t ares_cookie_apply(ares_dns_record_t *dnsrec, ares_conn_t *conn,
                                 const ares_timeval_t *now);
+const unsigned char *ares_dns_cookie_fetch(const ares_dns_record_t *dnsrec,
+                                           size_t                  *len);
 ares_status_t ares_cookie_validate(ares_query_t            *query,
                                    const ares_dns_record_t *dnsresp,
                                    ares_conn_t *conn, const ares_timeval_t *now,
@@ -52,6 +52,8 @@ static ares_status_t process_read(ares_channel_t       *channel,
                                   const ares_timeval_t *now);
 static ares_status_t process_timeouts(ares_channel_t       *channel,
                                       const ares_timeval_t *now);
+static void process_hedge_timeouts(ares_channel_t       *channel,
+                                   const ares_timeval_t *now);
 static ares_status_t process_answer(ares_channel_t      *channel,
                                     const unsigned char *abuf, size_t alen,
                                     ares_conn_t          *conn,
@@ -69,13 +71,16 @@ static ares_status_t ares_send_query_int(ares_server_t        *requested_server,
                                          const ares_timeval_t *now,
                                          ares_array_t        **requeue);
 static void ares_detach_query(ares_query_t *query);
+static void ares_query_wire_reset(ares_query_t *query);
 
 static void ares_query_remove_from_conn(ares_query_t *query)
 {
   /* If its not part of a connection, it can't be tracked for timeouts either */
-  ares_slist_node_destroy(query->node_queries_by_timeout);
+  ares_timerwheel_node_destroy(query->node_queries_by_timeout);
+  ares_timerwheel_node_destroy(query->node_queries_by_hedge);
   ares_llist_node_destroy(query->node_queries_to_conn);
   query->node_queries_by_timeout = NULL;
+  query->node_queries_by_hedge   = NULL;
   query->node_queries_to_conn    = NULL;
   query->conn                    = NULL;
 }
@@ -205,6 +210,13 @@ static ares_status_t ares_process_fds_nolock(ares_channel_t         *channel,
 
   ares_tvnow(&now);
 
+  /* Anything sent while processing (retries, follow-up queries issued from
+   * callbacks) goes out together at the end of the pass */
+  ares_write_defer_begin(channel);
+
+  /* Start anything submitted by other threads without the channel lock */
+  ares_submit_drain(channel, ARES_SUCCESS);
+
   /* Process write events */
   for (i = 0; i < nevents; i++) {
     if (events[i].fd == ARES_SOCKET_BAD ||
@@ -243,6 +255,8 @@ static ares_status_t ares_process_fds_nolock(ares_channel_t         *channel,
   }
 
 done:
+  ares_write_defer_end(channel);
+
   if (status == ARES_ENOMEM) {
     return ARES_ENOMEM;
   }
@@ -406,10 +420,39 @@ static ares_status_t process_write(ares_channel_t *channel,
   return status;
 }
 
-void ares_process_pending_write(ares_channel_t *channel)
+/* Flush every connection with buffered data.  Flushing can fail and requeue
+ * queries, which opens and closes connections, so work from a snapshot of the
+ * sockets and look each connection up again. */
+static void flush_pending_conns(ares_channel_t *channel)
 {
-  ares_slist_node_t *node;
+  ares_socket_t *socketlist;
+  size_t         num_sockets;
+  size_t         i;
+
+  socketlist = channel_socket_list(channel, &num_sockets);
+  if (socketlist == NULL) {
+    return;
+  }
+
+  for (i = 0; i < num_sockets; i++) {
+    ares_conn_t  *conn = ares_conn_from_fd(channel, socketlist[i]);
+    ares_status_t status;
+
+    if (conn == NULL || ares_buf_len(conn->out_buf) == 0) {
+      continue;
+    }
+
+    status = ares_conn_flush(conn);
+    if (status != ARES_SUCCESS) {
+      handle_conn_error(conn, ARES_TRUE, status);
+    }
+  }
 
+  ares_free(socketlist);
+}
+
+void ares_process_pending_write(ares_channel_t *channel)
+{
   if (channel == NULL) {
     return;
   }
@@ -426,24 +469,97 @@ void ares_process_pending_write(ares_channel_t *channel)
    */
   channel->notify_pending_write = ARES_FALSE;
 
-  for (node = ares_slist_node_first(channel->servers); node != NULL;
-       node = ares_slist_node_next(node)) {
-    ares_server_t *server = ares_slist_node_val(node);
-    ares_conn_t   *conn   = server->tcp_conn;
-    ares_status_t  status;
+  flush_pending_conns(channel);
+
+  ares_channel_unlock(channel);
+}
+
+void ares_write_defer_begin(ares_channel_t *channel)
+{
+  channel->write_defer++;
+}
+
+void ares_write_defer_end(ares_channel_t *channel)
+{
+  channel->write_defer--;
+  if (channel->write_defer != 0 || !channel->write_defer_pending) {
+    return;
+  }
+
+  channel->write_defer_pending = ARES_FALSE;
+  flush_pending_conns(channel);
+}
 
-    if (conn == NULL) {
+/* Minimum slot size for batched UDP reads.  Responses are bounded by the
+ * advertised EDNS size, this just leaves headroom for servers that ignore it */
+#define ARES_UDP_BATCH_SLOT_MIN 4096
+
+/* Read a batch of UDP datagrams directly into preallocated slots at the end
+ * of conn->in_buf, then compact them into the usual 16bit length-prefixed
+ * framing. */
+static ares_status_t read_conn_udp_batch(ares_conn_t     *conn,
+                                         ares_conn_err_t *err,
+                                         ares_bool_t     *read_again)
+{
+  const ares_channel_t  *channel = conn->server->channel;
+  struct ares_socket_msg msgs[ARES_CONN_READ_BATCH_MAX];
+  size_t                 slot_len = ARES_UDP_BATCH_SLOT_MIN;
+  size_t                 len;
+  size_t                 cnt = 0;
+  size_t                 i;
+  unsigned char         *ptr;
+  unsigned char         *out;
+
+  *read_again = ARES_FALSE;
+
+  if (channel->ednspsz + 2 > slot_len) {
+    slot_len = channel->ednspsz + 2;
+  }
+
+  len = slot_len * ARES_CONN_READ_BATCH_MAX;
+  ptr = ares_buf_append_start(conn->in_buf, &len);
+  if (ptr == NULL) {
+    return ARES_ENOMEM;
+  }
+
+  /* Each slot reserves 2 bytes in front of the datagram for the length */
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < ARES_CONN_READ_BATCH_MAX; i++) {
+    msgs[i].buffer = ptr + (i * slot_len) + 2;
+    msgs[i].length = slot_len - 2;
+  }
+
+  *err = ares_conn_read_batch(conn, msgs, ARES_CONN_READ_BATCH_MAX, &cnt);
+  if (*err != ARES_CONN_ERR_SUCCESS) {
+    ares_buf_append_finish(conn->in_buf, 0);
+    return ARES_SUCCESS;
+  }
+
+  /* Slide datagrams down over unused slot space.  The write position never
+   * passes the start of the slot being read so memmove() is safe. */
+  out = ptr;
+  for (i = 0; i < cnt; i++) {
+    size_t dlen = msgs[i].datagram_len;
+
+    if (dlen == 0) {
       continue;
     }
 
-    /* Enqueue any pending data if there is any */
-    status = ares_conn_flush(conn);
-    if (status != ARES_SUCCESS) {
-      handle_conn_error(conn, ARES_TRUE, status);
-    }
+    out[0] = (unsigned char)((dlen >> 8) & 0xFF);
+    out[1] = (unsigned char)(dlen & 0xFF);
+    memmove(out + 2, msgs[i].buffer, dlen);
+    out += dlen + 2;
   }
 
-  ares_channel_unlock(channel);
+  ares_buf_append_finish(conn->in_buf, (size_t)(out - ptr));
+
+  /* A full batch means more datagrams are likely queued */
+  if (channel->sock_funcs.flags & ARES_SOCKFUNC_FLAG_NONBLOCKING &&
+      cnt == ARES_CONN_READ_BATCH_MAX) {
+    *read_again = ARES_TRUE;
+  }
+
+  return ARES_SUCCESS;
 }
 
 static ares_status_t read_conn_packets(ares_conn_t *conn,
@@ -459,6 +575,19 @@ static ares_status_t read_conn_packets(ares_conn_t *conn,
 
   *conn_error = ARES_FALSE;
 
+  /* Prefer pulling many datagrams per syscall when the socket layer allows */
+  if (!(conn->flags & ARES_CONN_FLAG_TCP) &&
+      channel->sock_funcs.arecvmmsg != NULL) {
+    do {
+      if (read_conn_udp_batch(conn, &err, &read_again) != ARES_SUCCESS) {
+        handle_conn_error(conn, ARES_FALSE /* not critical to connection */,
+                          ARES_SUCCESS);
+        return ARES_ENOMEM;
+      }
+    } while (err == ARES_CONN_ERR_SUCCESS && read_again);
+    goto done;
+  }
+
   do {
     size_t         count;
     size_t         len = 65535;
@@ -527,6 +656,7 @@ static ares_status_t read_conn_packets(ares_conn_t *conn,
      * a blocking socket and would cause recvfrom to hang. */
   } while (read_again);
 
+done:
   if (err != ARES_CONN_ERR_SUCCESS && err != ARES_CONN_ERR_WOULDBLOCK) {
     /* If there is no packet data buffered, preserve the historical
      * immediate connection-failure behavior so retries happen promptly.
@@ -631,7 +761,7 @@ static ares_status_t ares_flush_requeue(ares_channel_t       *channel,
       break; /* LCOV_EXCL_LINE: DefensiveCoding */
     }
 
-    query = ares_htable_szvp_get_direct(channel->queries_by_qid, entry.qid);
+    query = ares_qidmap_get(channel->queries_by_qid, entry.qid);
 
     if (entry.type == REQUEUE_REQUEUE) {
       /* Query disappeared (e.g. a prior callback in this drain cancelled it) */
@@ -653,8 +783,8 @@ static ares_status_t ares_flush_requeue(ares_channel_t       *channel,
          * find this query still linked in all_queries/queries_by_qid, free it,
          * and the ares_free_query() below would then double-free it. */
         ares_detach_query(query);
-        query->callback(query->arg, entry.status, query->timeouts,
-                        entry.dnsrec);
+        ares_query_invoke_callbacks(query, entry.status, query->timeouts,
+                                    entry.dnsrec);
         ares_free_query(query);
       }
       ares_dns_record_destroy(entry.dnsrec);
@@ -765,25 +895,331 @@ static ares_status_t process_read(ares_channel_t       *channel,
   return ARES_SUCCESS;
 }
 
+static void stale_refresh_cb(void *arg, ares_status_t status, size_t timeouts,
+                             const ares_dns_record_t *dnsrec)
+{
+  (void)arg;
+  (void)status;
+  (void)timeouts;
+  (void)dnsrec;
+  /* Nothing to do, the caller was already answered from a stale cache entry
+   * and any response was inserted into the cache */
+}
+
+/* Serve-stale (RFC 8767): only failures that indicate the servers couldn't
+ * provide an answer qualify, not cancellations or local errors */
+static ares_bool_t ares_status_allows_stale(ares_status_t status)
+{
+  switch (status) {
+    case ARES_ETIMEOUT:
+    case ARES_ESERVFAIL:
+    case ARES_EREFUSED:
+    case ARES_ECONNREFUSED:
+    case ARES_ENOSERVER:
+      return ARES_TRUE;
+    default:
+      break;
+  }
+  return ARES_FALSE;
+}
+
+/* Fetch a stale response for the query if one exists and there is a caller
+ * that hasn't already been answered with one.  A query that was answered from
+ * a stale entry has its callback replaced with stale_refresh_cb(), but may
+ * since have had identical requests coalesced onto it. */
+static ares_bool_t ares_query_fetch_stale(ares_query_t         *query,
+                                          const ares_timeval_t *now,
+                                          ares_dns_record_t   **dnsrec)
+{
+  ares_slist_node_destroy(query->node_queries_by_stale);
+  query->node_queries_by_stale = NULL;
+
+  if (query->no_cache) {
+    return ARES_FALSE;
+  }
+
+  if (query->callback == stale_refresh_cb &&
+      ares_array_len(query->waiters) == 0) {
+    return ARES_FALSE;
+  }
+
+  if (ares_qcache_fetch_stale(query->channel, now, query->query, dnsrec) !=
+      ARES_SUCCESS) {
+    return ARES_FALSE;
+  }
+
+  return ARES_TRUE;
+}
+
+/* Invoke the primary callback followed by those of any coalesced waiters,
+ * then destroy the waiter list */
+static void ares_invoke_callbacks(ares_callback_dnsrec callback, void *arg,
+                                  ares_array_t *waiters, ares_status_t status,
+                                  size_t                   timeouts,
+                                  const ares_dns_record_t *dnsrec)
+{
+  size_t i;
+
+  callback(arg, status, timeouts, dnsrec);
+
+  for (i = 0; i < ares_array_len(waiters); i++) {
+    const ares_query_waiter_t *waiter = ares_array_at_const(waiters, i);
+    waiter->callback(waiter->arg, status, timeouts, dnsrec);
+  }
+
+  ares_array_destroy(waiters);
+}
+
+/* Answer any queries that have passed their serve-stale client timeout with
+ * the stale cached response.  The queries themselves are left running. */
+static void process_stale_timeouts(ares_channel_t       *channel,
+                                   const ares_timeval_t *now)
+{
+  ares_query_t *query;
+
+  while ((query = ares_slist_first_val(channel->queries_by_stale)) != NULL) {
+    ares_dns_record_t   *dnsrec = NULL;
+    ares_callback_dnsrec callback;
+    void                *arg;
+    ares_array_t        *waiters;
+
+    if (!ares_timedout(now, &query->stale_timeout)) {
+      break;
+    }
+
+    /* Always removes the query from queries_by_stale */
+    if (!ares_query_fetch_stale(query, now, &dnsrec)) {
+      continue;
+    }
+
+    /* Everyone waiting is answered now, the query continues in the background
+     * to refresh the cache */
+    callback        = query->callback;
+    arg             = query->arg;
+    waiters         = query->waiters;
+    query->callback = stale_refresh_cb;
+    query->arg      = NULL;
+    query->waiters  = NULL;
+
+    /* The query must not be touched after this as the callback may cancel
+     * it */
+    ares_invoke_callbacks(callback, arg, waiters, ARES_SUCCESS, query->timeouts,
+                          dnsrec);
+    ares_dns_record_destroy(dnsrec);
+  }
+}
+
+/* Number of queries after which the hedge budget window is halved, so the
+ * budget follows recent traffic */
+#define HEDGE_BUDGET_WINDOW 1000
+
+/* Whether another hedge fits in the budget, in percent of queries sent */
+static ares_bool_t ares_hedge_budget_allows(const ares_channel_t *channel)
+{
+  return ((channel->hedge_window_hedges + 1) * 100 <=
+          channel->hedge_window_queries * channel->hedge_budget)
+           ? ARES_TRUE
+           : ARES_FALSE;
+}
+
+/* Unlink a query from its hedge peer.  If the peer is a hedge that is still
+ * outstanding it is made to expire right away and is cancelled from
+ * process_timeouts(), it can't be freed here as the caller may be walking a
+ * list it is on (e.g. ares_cancel()). */
+static void ares_query_hedge_unlink(ares_query_t *query)
+{
+  ares_query_t           *peer = query->hedge;
+  ares_timerwheel_node_t *node;
+
+  if (peer == NULL) {
+    return;
+  }
+
+  query->hedge = NULL;
+  peer->hedge  = NULL;
+
+  if (!peer->is_hedge || peer->node_queries_by_timeout == NULL) {
+    return;
+  }
+
+  node = ares_timerwheel_insert(query->channel->queries_by_timeout, 0, peer);
+  if (node == NULL) {
+    return; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  ares_timerwheel_node_destroy(peer->node_queries_by_timeout);
+  peer->node_queries_by_timeout = node;
+}
+
+/* Completion of a hedge.  The first valid answer wins, so if the original
+ * query is still waiting it is answered with this response.  Failures are
+ * ignored, the original query carries on by itself. */
+static void ares_hedge_cb(void *arg, ares_status_t status, size_t timeouts,
+                          const ares_dns_record_t *dnsrec)
+{
+  ares_query_t      *hedge = arg;
+  ares_query_t      *query;
+  ares_dns_record_t *rec = NULL;
+
+  (void)timeouts;
+
+  /* Failed before it was ever linked */
+  if (hedge == NULL) {
+    return;
+  }
+
+  query = hedge->hedge;
+  if (query == NULL) {
+    return;
+  }
+  ares_query_hedge_unlink(hedge);
+
+  if (status != ARES_SUCCESS || dnsrec == NULL) {
+    return;
+  }
+
+  if (ares_dns_record_duplicate_ex(&rec, dnsrec) != ARES_SUCCESS) {
+    return; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  /* The original query's server did not answer, so no metrics are recorded
+   * for it and it isn't marked as failed.  Detach before invoking the
+   * callbacks so a reentrant ares_cancel() can't free it from under us. */
+  ares_detach_query(query);
+  ares_query_invoke_callbacks(query, ARES_SUCCESS, query->timeouts, rec);
+  ares_free_query(query);
+  ares_dns_record_destroy(rec);
+}
+
+/* Send a duplicate of a query to the best server other than the one it is
+ * waiting on */
+static void ares_send_hedge(ares_channel_t *channel, ares_query_t *query)
+{
+  ares_slist_node_t *node;
+  ares_server_t     *server = NULL;
+  ares_query_t      *hedge;
+  unsigned short     qid;
+
+  if (query->conn == NULL || query->hedge != NULL ||
+      !ares_hedge_budget_allows(channel)) {
+    return;
+  }
+
+  for (node = ares_slist_node_first(channel->servers); node != NULL;
+       node = ares_slist_node_next(node)) {
+    ares_server_t *node_val = ares_slist_node_val(node);
+    if (node_val != query->conn->server) {
+      server = node_val;
+      break;
+    }
+  }
+
+  if (server == NULL) {
+    return;
+  }
+
+  if (ares_send_nolock(channel, server,
+                       ARES_SEND_FLAG_NOCACHE | ARES_SEND_FLAG_NORETRY,
+                       query->query, ares_hedge_cb, NULL,
+                       &qid) != ARES_SUCCESS) {
+    return;
+  }
+
+  hedge = ares_qidmap_get(channel->queries_by_qid, qid);
+  if (hedge == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  channel->hedge_window_hedges++;
+  hedge->is_hedge = ARES_TRUE;
+  hedge->arg      = hedge;
+  hedge->hedge    = query;
+  query->hedge    = hedge;
+}
+
+/* Hedge any queries that have been waiting longer than their server usually
+ * takes to answer */
+static void process_hedge_timeouts(ares_channel_t       *channel,
+                                   const ares_timeval_t *now)
+{
+  ares_timerwheel_node_t *node;
+  ares_uint64_t           now_ms = ares_timeval_to_ms(now, ARES_FALSE);
+
+  while ((node = ares_timerwheel_first_expired(channel->queries_by_hedge,
+                                               now_ms)) != NULL) {
+    ares_query_t *query = ares_timerwheel_node_claim(node);
+
+    query->node_queries_by_hedge = NULL;
+    ares_send_hedge(channel, query);
+  }
+}
+
+/* Arm the hedge timer of a query that was just sent for the first time */
+static void ares_query_arm_hedge(ares_query_t         *query,
+                                 const ares_server_t  *server,
+                                 const ares_timeval_t *now, size_t timeplus)
+{
+  ares_channel_t *channel = query->channel;
+  ares_timeval_t  hedge_time;
+  size_t          delay_ms;
+
+  if (channel->hedge_percentile == 0 || query->is_hedge ||
+      query->no_retries || query->try_count != 0) {
+    return;
+  }
+
+  channel->hedge_window_queries++;
+  if (channel->hedge_window_queries >= HEDGE_BUDGET_WINDOW * 2) {
+    channel->hedge_window_queries /= 2;
+    channel->hedge_window_hedges  /= 2;
+  }
+
+  if (query->hedge != NULL || ares_slist_len(channel->servers) < 2) {
+    return;
+  }
+
+  delay_ms = ares_metrics_server_hedge_delay(server, now);
+  if (delay_ms == 0 || delay_ms >= timeplus) {
+    return;
+  }
+
+  hedge_time = *now;
+  ares_timeval_add(&hedge_time, delay_ms);
+
+  /* Out of memory only means the query isn't hedged */
+  ares_timerwheel_node_destroy(query->node_queries_by_hedge);
+  query->node_queries_by_hedge =
+    ares_timerwheel_insert(channel->queries_by_hedge,
+                           ares_timeval_to_ms(&hedge_time, ARES_TRUE), query);
+}
+
 /* If any queries have timed out, note the timeout and move them on. */
 static ares_status_t process_timeouts(ares_channel_t       *channel,
                                       const ares_timeval_t *now)
 {
-  ares_slist_node_t *node;
-  ares_status_t      status  = ARES_SUCCESS;
-  ares_array_t      *requeue = NULL;
-
-  /* Just keep popping off the first as this list will re-sort as things come
-   * and go.  We don't want to try to rely on 'next' as some operation might
+  ares_timerwheel_node_t *node;
+  ares_status_t           status  = ARES_SUCCESS;
+  ares_array_t           *requeue = NULL;
+  ares_uint64_t           now_ms  = ares_timeval_to_ms(now, ARES_FALSE);
+
+  process_stale_timeouts(channel, now);
+  process_hedge_timeouts(channel, now);
+  ares_timers_process(channel, now);
+
+  /* Just keep taking the first expired query, requeuing it always removes it
+   * from the expired list (either rescheduling it or dropping it from the
+   * wheel).  We don't want to try to rely on 'next' as some operation might
    * cause a cleanup of that pointer and would become invalid */
-  while ((node = ares_slist_node_first(channel->queries_by_timeout)) != NULL) {
-    ares_query_t *query = ares_slist_node_val(node);
+  while ((node = ares_timerwheel_first_expired(channel->queries_by_timeout,
+                                               now_ms)) != NULL) {
+    ares_query_t *query = ares_timerwheel_node_val(node);
     ares_conn_t  *conn;
 
-    /* Since this is sorted, as soon as we hit a query that isn't timed out,
-     * break */
-    if (!ares_timedout(now, &query->timeout)) {
-      break;
+    /* A hedge whose original query has already ended, it lost the race and
+     * is not held against the server */
+    if (query->is_hedge && query->hedge == NULL) {
+      ares_query_remove_from_conn(query);
+      end_query(channel, NULL, query, ARES_ECANCELLED, NULL, &requeue);
+      continue;
     }
 
     query->timeouts++;
@@ -838,6 +1274,8 @@ static ares_status_t rewrite_without_edns(ares_query_t *query)
     goto done;
   }
 
+  ares_query_wire_reset(query);
+
 done:
   return status;
 }
@@ -910,18 +1348,18 @@ static ares_status_t process_answer(ares_channel_t      *channel,
   }
 
   /* Parse the response */
-  status = ares_dns_parse(abuf, alen, 0, &rdnsrec);
+  status = ares_dns_parse(abuf, alen, ARES_DNS_PARSE_ARENA, &rdnsrec);
   if (status != ARES_SUCCESS) {
     /* Malformations are never accepted */
     status = ARES_EBADRESP;
     goto cleanup;
   }
 
-  /* Find the query corresponding to this packet. The queries are
-   * hashed/bucketed by query id, so this lookup should be quick.
+  /* Find the query corresponding to this packet. The queries are indexed
+   * directly by query id, so this lookup is a couple of array accesses.
    */
-  query = ares_htable_szvp_get_direct(channel->queries_by_qid,
-                                      ares_dns_record_get_id(rdnsrec));
+  query =
+    ares_qidmap_get(channel->queries_by_qid, ares_dns_record_get_id(rdnsrec));
   if (!query) {
     /* We may have stopped listening for this query, that's ok */
     status = ARES_SUCCESS;
@@ -1155,6 +1593,80 @@ static ares_server_t *ares_random_server(ares_channel_t *channel)
   return NULL;
 }
 
+/* Number of queries currently outstanding to a server across all of its
+ * connections */
+static size_t ares_server_outstanding(const ares_server_t *server)
+{
+  ares_llist_node_t *node;
+  size_t             cnt = 0;
+
+  for (node = ares_llist_node_first(server->connections); node != NULL;
+       node = ares_llist_node_next(node)) {
+    const ares_conn_t *conn = ares_llist_node_val(node);
+    cnt += ares_llist_len(conn->queries_to_conn);
+  }
+
+  return cnt;
+}
+
+/* Expected cost of sending one more query to a server, the smoothed RTT scaled
+ * by the queue of queries already waiting on it.  A server that has never
+ * answered costs nothing so that it gets sampled. */
+static ares_uint64_t ares_server_cost(const ares_server_t *server)
+{
+  size_t outstanding = ares_server_outstanding(server);
+  return server->srtt_us * (ares_uint64_t)(outstanding + 1);
+}
+
+/* Pick a *best* server using the power of two choices: draw two distinct
+ * random servers out of those with the fewest consecutive failures and use
+ * the one with the lower expected cost.  On a tie the one earlier in the list
+ * (configuration order) wins. */
+static ares_server_t *ares_latency_server(ares_channel_t *channel)
+{
+  unsigned char      c[2];
+  size_t             idx1;
+  size_t             idx2;
+  size_t             cnt;
+  ares_slist_node_t *node;
+  ares_server_t     *cand1       = NULL;
+  ares_server_t     *cand2       = NULL;
+  size_t             num_servers = count_highest_prio_servers(channel);
+
+  if (num_servers <= 1) {
+    return ares_slist_first_val(channel->servers);
+  }
+
+  ares_rand_bytes(channel->rand_state, c, sizeof(c));
+
+  idx1 = (size_t)c[0] % num_servers;
+  idx2 = (size_t)c[1] % (num_servers - 1);
+  if (idx2 >= idx1) {
+    idx2++;
+  }
+
+  cnt = 0;
+  for (node = ares_slist_node_first(channel->servers); node != NULL;
+       node = ares_slist_node_next(node)) {
+    if (cnt == idx1 || cnt == idx2) {
+      if (cand1 == NULL) {
+        cand1 = ares_slist_node_val(node);
+      } else {
+        cand2 = ares_slist_node_val(node);
+        break;
+      }
+    }
+    cnt++;
+  }
+
+  /* Silence coverity, not possible */
+  if (cand2 == NULL) {
+    return cand1;
+  }
+
+  return (ares_server_cost(cand2) < ares_server_cost(cand1)) ? cand2 : cand1;
+}
+
 static void server_probe_cb(void *arg, ares_status_t status, size_t timeouts,
                             const ares_dns_record_t *dnsrec)
 {
@@ -1322,12 +1834,106 @@ static ares_conn_t *ares_fetch_connection(const ares_channel_t *channel,
   return conn;
 }
 
+static void ares_query_wire_reset(ares_query_t *query)
+{
+  ares_free(query->qwire);
+  query->qwire               = NULL;
+  query->qwire_len           = 0;
+  query->qwire_cookie_offset = 0;
+  query->qwire_cookie_len    = 0;
+}
+
+/* Locate the cookie option data within the OPT RR of the serialized query */
+static void ares_query_wire_find_cookie(ares_query_t *query)
+{
+  ares_dns_view_t      view;
+  ares_dns_view_rr_t   rr;
+  const unsigned char *rdata;
+  size_t               rdata_len = 0;
+  size_t               pos       = 0;
+
+  if (ares_dns_view_init(&view, query->qwire, query->qwire_len) !=
+      ARES_SUCCESS) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  if (!ares_dns_view_rr_first(&view, ARES_SECTION_ADDITIONAL, &rr)) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  while (ares_dns_view_rr_get_type(&rr) != ARES_REC_TYPE_OPT) {
+    if (!ares_dns_view_rr_next(&rr)) {
+      return; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+  }
+
+  rdata = ares_dns_view_rr_get_rdata(&rr, &rdata_len);
+
+  /* Options are a 2 byte code, 2 byte length, then data */
+  while (rdata != NULL && pos + 4 <= rdata_len) {
+    unsigned short code = (unsigned short)(rdata[pos] << 8 | rdata[pos + 1]);
+    size_t         len  = (size_t)(rdata[pos + 2] << 8 | rdata[pos + 3]);
+
+    pos += 4;
+    if (code == ARES_OPT_PARAM_COOKIE && len == query->qwire_cookie_len &&
+        pos + len <= rdata_len) {
+      query->qwire_cookie_offset = (size_t)(rdata - query->qwire) + pos;
+      return;
+    }
+    pos += len;
+  }
+}
+
+/* Bring the serialized query in line with query->query.  The query id and
+ * DNS 0x20 casing are fixed for the life of a query, and the only other thing
+ * that changes between writes is the cookie applied for the connection, so as
+ * long as its length is unchanged it is patched in place rather than encoding
+ * the whole message again on every retry. */
+static ares_status_t ares_query_wire_update(ares_query_t *query)
+{
+  const unsigned char *cookie;
+  size_t               cookie_len = 0;
+  ares_status_t        status;
+
+  cookie = ares_dns_cookie_fetch(query->query, &cookie_len);
+
+  if (query->qwire != NULL && cookie_len == query->qwire_cookie_len &&
+      (cookie_len == 0 || query->qwire_cookie_offset != 0)) {
+    if (cookie_len) {
+      memcpy(query->qwire + query->qwire_cookie_offset, cookie, cookie_len);
+    }
+    query->qwire[0] = (unsigned char)(query->qid >> 8);
+    query->qwire[1] = (unsigned char)(query->qid & 0xFF);
+    return ARES_SUCCESS;
+  }
+
+  ares_query_wire_reset(query);
+
+  status = ares_dns_write(query->query, &query->qwire, &query->qwire_len);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  if (query->qwire_len > 65535) {
+    ares_query_wire_reset(query);
+    return ARES_EBADQUERY;
+  }
+
+  query->qwire_cookie_len = cookie_len;
+  if (cookie_len) {
+    ares_query_wire_find_cookie(query);
+  }
+
+  return ARES_SUCCESS;
+}
+
 static ares_status_t ares_conn_query_write(ares_conn_t          *conn,
                                            ares_query_t         *query,
                                            const ares_timeval_t *now)
 {
   ares_server_t  *server  = conn->server;
   ares_channel_t *channel = server->channel;
+  size_t          orig_len;
   ares_status_t   status;
 
   status = ares_cookie_apply(query->query, conn, now);
@@ -1335,11 +1941,22 @@ static ares_status_t ares_conn_query_write(ares_conn_t          *conn,
     return status;
   }
 
+  status = ares_query_wire_update(query);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
   /* We write using the TCP format even for UDP, we just strip the length
    * before putting on the wire */
-  status = ares_dns_write_buf_tcp(query->query, conn->out_buf);
+  orig_len = ares_buf_len(conn->out_buf);
+  status   = ares_buf_append_be16(conn->out_buf,
+                                  (unsigned short)(query->qwire_len & 0xFFFF));
+  if (status == ARES_SUCCESS) {
+    status = ares_buf_append(conn->out_buf, query->qwire, query->qwire_len);
+  }
   if (status != ARES_SUCCESS) {
-    return status;
+    ares_buf_set_length(conn->out_buf, orig_len); /* LCOV_EXCL_LINE */
+    return status;                                /* LCOV_EXCL_LINE */
   }
 
   /* Not pending a TFO write and not connected, so we can't even try to
@@ -1350,17 +1967,22 @@ static ares_status_t ares_conn_query_write(ares_conn_t          *conn,
     return ARES_SUCCESS;
   }
 
-  /* Delay actual write if possible (TCP only, and only if callback
-   * configured) */
-  if (channel->notify_pending_write_cb && !channel->notify_pending_write &&
-      conn->flags & ARES_CONN_FLAG_TCP) {
-    channel->notify_pending_write = ARES_TRUE;
-    channel->notify_pending_write_cb(channel->notify_pending_write_cb_data);
+  /* Delay actual write if possible (only if callback configured), everything
+   * buffered is flushed together from ares_process_pending_write() */
+  if (channel->notify_pending_write_cb) {
+    if (!channel->notify_pending_write) {
+      channel->notify_pending_write = ARES_TRUE;
+      channel->notify_pending_write_cb(channel->notify_pending_write_cb_data);
+    }
+    return ARES_SUCCESS;
+  }
+
+  /* Inside a deferred write region, the write happens when it ends */
+  if (channel->write_defer > 0) {
+    channel->write_defer_pending = ARES_TRUE;
     return ARES_SUCCESS;
   }
 
-  /* Unfortunately we need to write right away and can't aggregate multiple
-   * queries into a single write. */
   return ares_conn_flush(conn);
 }
 
@@ -1391,7 +2013,7 @@ ares_status_t ares_send_query(ares_server_t *requested_server,
    * it ended, so don't report success to the caller (which would, e.g., cause
    * ares_send_nolock() to write to a now-freed *qid). */
   if (status == ARES_SUCCESS &&
-      ares_htable_szvp_get_direct(channel->queries_by_qid, qid) == NULL) {
+      ares_qidmap_get(channel->queries_by_qid, qid) == NULL) {
     status = ARES_ETIMEOUT;
   }
 
@@ -1407,6 +2029,7 @@ static ares_status_t ares_send_query_int(ares_server_t        *requested_server,
   ares_server_t  *server;
   ares_conn_t    *conn;
   size_t          timeplus;
+  ares_uint64_t   timeout_ms;
   ares_status_t   status;
   ares_bool_t     probe_downed_server = ARES_TRUE;
 
@@ -1414,8 +2037,11 @@ static ares_status_t ares_send_query_int(ares_server_t        *requested_server,
   if (requested_server != NULL) {
     server = requested_server;
   } else {
-    /* If rotate is turned on, do a random selection */
-    if (channel->rotate) {
+    if (channel->flags & ARES_FLAG_LATENCY_SELECT) {
+      /* Latency aware selection takes precedence over rotate */
+      server = ares_latency_server(channel);
+    } else if (channel->rotate) {
+      /* If rotate is turned on, do a random selection */
       server = ares_random_server(channel);
     } else {
       /* First server in list */
@@ -1492,12 +2118,14 @@ static ares_status_t ares_send_query_int(ares_server_t        *requested_server,
   /* Keep track of queries bucketed by timeout, so we can process
    * timeout events quickly.
    */
-  ares_slist_node_destroy(query->node_queries_by_timeout);
   query->ts      = *now;
   query->timeout = *now;
   ares_timeval_add(&query->timeout, timeplus);
+  /* Round up so the deadline never fires before the timeout has elapsed */
+  timeout_ms = ares_timeval_to_ms(&query->timeout, ARES_TRUE);
+  ares_timerwheel_node_destroy(query->node_queries_by_timeout);
   query->node_queries_by_timeout =
-    ares_slist_insert(channel->queries_by_timeout, query);
+    ares_timerwheel_insert(channel->queries_by_timeout, timeout_ms, query);
   if (!query->node_queries_by_timeout) {
     /* LCOV_EXCL_START: OutOfMemory */
     end_query(channel, server, query, ARES_ENOMEM, NULL, requeue);
@@ -1521,6 +2149,9 @@ static ares_status_t ares_send_query_int(ares_server_t        *requested_server,
   query->conn = conn;
   conn->total_queries++;
 
+  /* Send a duplicate to another server if this one is slower than usual */
+  ares_query_arm_hedge(query, server, now, timeplus);
+
   /* We just successfully enqueud a query, see if we should probe downed
    * servers. */
   if (probe_downed_server) {
@@ -1594,19 +2225,52 @@ done:
   return rv;
 }
 
+/* Stop coalescing new requests onto the query */
+static void ares_query_remove_inflight(ares_query_t *query)
+{
+  if (query->inflight_key == NULL) {
+    return;
+  }
+  ares_htable_binvp_remove(query->channel->queries_by_key, query->inflight_key,
+                           query->inflight_key_len);
+  ares_free(query->inflight_key);
+  query->inflight_key     = NULL;
+  query->inflight_key_len = 0;
+}
+
+void ares_query_invoke_callbacks(ares_query_t *query, ares_status_t status,
+                                 size_t                   timeouts,
+                                 const ares_dns_record_t *dnsrec)
+{
+  ares_array_t *waiters = query->waiters;
+
+  /* A callback may issue the same request again, that must start a new query
+   * rather than attach to this one */
+  ares_query_remove_inflight(query);
+  query->waiters = NULL;
+
+  ares_invoke_callbacks(query->callback, query->arg, waiters, status, timeouts,
+                        dnsrec);
+}
+
 static void ares_detach_query(ares_query_t *query)
 {
   /* Remove the query from all the lists in which it is linked */
   ares_query_remove_from_conn(query);
-  ares_htable_szvp_remove(query->channel->queries_by_qid, query->qid);
+  ares_query_remove_inflight(query);
+  ares_qidmap_remove(query->channel->queries_by_qid, query->qid);
   ares_llist_node_destroy(query->node_all_queries);
   query->node_all_queries = NULL;
+  ares_slist_node_destroy(query->node_queries_by_stale);
+  query->node_queries_by_stale = NULL;
 }
 
 static void end_query(ares_channel_t *channel, ares_server_t *server,
                       ares_query_t *query, ares_status_t status,
                       ares_dns_record_t *dnsrec, ares_array_t **requeue)
 {
+  ares_dns_record_t *stale_rec = NULL;
+
   /* If we were probing for the server to come back online, lets mark it as
    * no longer being probed */
   if (server != NULL) {
@@ -1615,15 +2279,31 @@ static void end_query(ares_channel_t *channel, ares_server_t *server,
 
   ares_metrics_record(query, server, status, dnsrec);
 
+  /* Answer from a stale cache entry rather than returning a failure */
+  if (ares_status_allows_stale(status)) {
+    ares_timeval_t now;
+    ares_tvnow(&now);
+    if (ares_query_fetch_stale(query, &now, &stale_rec)) {
+      status = ARES_SUCCESS;
+    }
+  }
+
   /* Delay calling the query callback */
   if (requeue != NULL) {
+    if (stale_rec != NULL) {
+      /* The endqueue takes ownership of the response */
+      ares_dns_record_destroy(dnsrec);
+      dnsrec = stale_rec;
+    }
     ares_append_endqueue(requeue, query, status, dnsrec);
     return;
   }
 
   /* Invoke the callback. */
-  query->callback(query->arg, status, query->timeouts, dnsrec);
+  ares_query_invoke_callbacks(query, status, query->timeouts,
+                              stale_rec != NULL ? stale_rec : dnsrec);
   ares_free_query(query);
+  ares_dns_record_destroy(stale_rec);
 
   /* Check and notify if no other queries are enqueued on the channel.  This
    * must come after the callback and freeing the query for 2 reasons.
@@ -1636,11 +2316,14 @@ static void end_query(ares_channel_t *channel, ares_server_t *server,
 void ares_free_query(ares_query_t *query)
 {
   ares_detach_query(query);
+  ares_query_hedge_unlink(query);
   /* Zero out some important stuff, to help catch bugs */
   query->callback = NULL;
   query->arg      = NULL;
   /* Deallocate the memory associated with the query */
   ares_dns_record_destroy(query->query);
+  ares_query_wire_reset(query);
+  ares_array_destroy(query->waiters);
 
-  ares_free(query);
+  ares_pool_free(query->channel->query_pool, query);
 }
@@ -24,93 +24,128 @@
  * SPDX-License-Identifier: MIT
  */
 #include "ares_private.h"
+#include "dsa/ares_htable.h"
 
-struct ares_qcache {
-  ares_htable_strvp_t *cache;
+/* Number of shards used by a cache shared between channels.  Each shard has
+ * its own lock so lookups of different names from multiple threads rarely
+ * contend. */
+#define ARES_QCACHE_SHARED_SHARDS 16
+
+typedef struct {
+  /* NULL for a cache private to a channel as the channel lock protects it */
+  ares_thread_mutex_t *lock;
+  /* Only set if owned by the shard, otherwise the channel's is used */
+  ares_rand_state     *rand_state;
+  ares_htable_binvp_t *cache;
   ares_slist_t        *expire;
+  /* Entries ordered by use, most recently used first.  Used for eviction when
+   * max_entries or max_bytes is reached */
+  ares_llist_t        *lru;
+  size_t               max_entries;
+  size_t               max_bytes;
+  /* Sum of the footprint of all cached entries */
+  size_t               num_bytes;
+} ares_qcache_shard_t;
+
+struct ares_qcache {
+  ares_qcache_shard_t *shards;
+  size_t               num_shards;
   unsigned int         max_ttl;
+  /* Seconds past expiration an entry is retained for serve-stale, 0 if
+   * disabled */
+  unsigned int         stale_max_ttl;
+  /* Percent of the TTL remaining at which a hit triggers a prefetch, 0 if
+   * disabled */
+  unsigned int         prefetch_pct;
+  size_t               prefetch_min_hits;
+  /* Protects refcnt, NULL if not shared */
+  ares_thread_mutex_t *lock;
+  /* Number of channels plus the creator holding a reference */
+  size_t               refcnt;
+  ares_bool_t          shared;
 };
 
+/* Location of a TTL within the cached wire-format response along with the
+ * TTL as originally received */
 typedef struct {
-  char              *key;
-  ares_dns_record_t *dnsrec;
+  unsigned short offset;
+  unsigned int   ttl;
+} ares_qcache_ttl_t;
+
+typedef struct {
+  unsigned char     *key;
+  size_t             key_len;
+  /* Response in wire format, parsed on each fetch after adjusting the TTLs */
+  unsigned char     *wire;
+  size_t             wire_len;
+  ares_qcache_ttl_t *ttls;
+  size_t             ttls_cnt;
   time_t             expire_ts;
   time_t             insert_ts;
+  /* TTL the entry was inserted with */
+  unsigned int       ttl;
+  /* Number of times the entry has been served from the cache */
+  size_t             hits;
+  /* Whether a refresh query has been issued for this entry */
+  ares_bool_t        prefetch_pending;
+  /* Approximate memory consumed by this entry, including the response */
+  size_t             footprint;
+  ares_slist_node_t *node_expire;
+  ares_llist_node_t *node_lru;
 } ares_qcache_entry_t;
 
-static char *ares_qcache_calc_key(const ares_dns_record_t *dnsrec)
+/* TTL to apply to stale responses, as recommended by RFC 8767 Section 4 */
+#define ARES_QCACHE_STALE_TTL 30
+
+#define ARES_QCACHE_KEY_FLAG_RD (1 << 0)
+#define ARES_QCACHE_KEY_FLAG_CD (1 << 1)
+
+static ares_bool_t ares_qcache_key_append_u16(ares_qcache_key_t *key,
+                                              unsigned short     u16)
+{
+  if (key->len + 2 > sizeof(key->data)) {
+    return ARES_FALSE;
+  }
+  key->data[key->len++] = (unsigned char)((u16 >> 8) & 0xFF);
+  key->data[key->len++] = (unsigned char)(u16 & 0xFF);
+  return ARES_TRUE;
+}
+
+ares_bool_t ares_qcache_calc_key(const ares_dns_record_t *dnsrec,
+                                 ares_qcache_key_t       *key)
 {
-  ares_buf_t      *buf = ares_buf_create();
   size_t           i;
-  ares_status_t    status;
   ares_dns_flags_t flags;
+  unsigned char    kflags = 0;
 
-  if (dnsrec == NULL || buf == NULL) {
-    return NULL; /* LCOV_EXCL_LINE: DefensiveCoding */
+  if (dnsrec == NULL || key == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
-  /* Format is OPCODE|FLAGS[|QTYPE1|QCLASS1|QNAME1]... */
-
-  status = ares_buf_append_str(
-    buf, ares_dns_opcode_tostr(ares_dns_record_get_opcode(dnsrec)));
-  if (status != ARES_SUCCESS) {
-    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-  }
+  key->len = 0;
 
-  status = ares_buf_append_byte(buf, '|');
-  if (status != ARES_SUCCESS) {
-    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-  }
+  key->data[key->len++] = (unsigned char)ares_dns_record_get_opcode(dnsrec);
 
   flags = ares_dns_record_get_flags(dnsrec);
   /* Only care about RD and CD */
   if (flags & ARES_FLAG_RD) {
-    status = ares_buf_append_str(buf, "rd");
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-    }
+    kflags |= ARES_QCACHE_KEY_FLAG_RD;
   }
   if (flags & ARES_FLAG_CD) {
-    status = ares_buf_append_str(buf, "cd");
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-    }
+    kflags |= ARES_QCACHE_KEY_FLAG_CD;
   }
+  key->data[key->len++] = kflags;
 
   for (i = 0; i < ares_dns_record_query_cnt(dnsrec); i++) {
     const char         *name;
     size_t              name_len;
+    size_t              j;
     ares_dns_rec_type_t qtype;
     ares_dns_class_t    qclass;
 
-    status = ares_dns_record_query_get(dnsrec, i, &name, &qtype, &qclass);
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: DefensiveCoding */
-    }
-
-    status = ares_buf_append_byte(buf, '|');
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-    }
-
-    status = ares_buf_append_str(buf, ares_dns_rec_type_tostr(qtype));
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-    }
-
-    status = ares_buf_append_byte(buf, '|');
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-    }
-
-    status = ares_buf_append_str(buf, ares_dns_class_tostr(qclass));
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-    }
-
-    status = ares_buf_append_byte(buf, '|');
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    if (ares_dns_record_query_get(dnsrec, i, &name, &qtype, &qclass) !=
+        ARES_SUCCESS) {
+      return ARES_FALSE; /* LCOV_EXCL_LINE: DefensiveCoding */
     }
 
     /* On queries, a '.' may be appended to the name to indicate an explicit
@@ -121,60 +156,153 @@ static char *ares_qcache_calc_key(const ares_dns_record_t *dnsrec)
       name_len--;
     }
 
-    if (name_len > 0) {
-      status = ares_buf_append(buf, (const unsigned char *)name, name_len);
-      if (status != ARES_SUCCESS) {
-        goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-      }
+    if (!ares_qcache_key_append_u16(key, (unsigned short)qtype) ||
+        !ares_qcache_key_append_u16(key, (unsigned short)qclass) ||
+        name_len > 0xFFFF ||
+        !ares_qcache_key_append_u16(key, (unsigned short)name_len) ||
+        key->len + name_len > sizeof(key->data)) {
+      return ARES_FALSE;
+    }
+
+    /* Names are case-insensitive (and may have DNS 0x20 applied) */
+    for (j = 0; j < name_len; j++) {
+      key->data[key->len++] = ares_tolower((unsigned char)name[j]);
     }
   }
 
-  return ares_buf_finish_str(buf, NULL);
+  return ARES_TRUE;
+}
 
-/* LCOV_EXCL_START: OutOfMemory */
-fail:
-  ares_buf_destroy(buf);
-  return NULL;
-  /* LCOV_EXCL_STOP */
+/* Unlinks the entry from all indexes and frees it */
+static void ares_qcache_entry_remove(ares_qcache_shard_t *shard,
+                                     ares_qcache_entry_t *entry)
+{
+  ares_htable_binvp_remove(shard->cache, entry->key, entry->key_len);
+  ares_llist_node_destroy(entry->node_lru);
+  shard->num_bytes -= entry->footprint;
+  /* Destructor frees the entry itself */
+  ares_slist_node_destroy(entry->node_expire);
 }
 
-static void ares_qcache_expire(ares_qcache_t *cache, const ares_timeval_t *now)
+static void ares_qcache_expire(const ares_qcache_t  *cache,
+                               ares_qcache_shard_t  *shard,
+                               const ares_timeval_t *now)
 {
-  ares_slist_node_t *node;
+  ares_qcache_entry_t *entry;
 
-  if (cache == NULL) {
-    return;
+  while ((entry = ares_slist_first_val(shard->expire)) != NULL) {
+    /* If now is NULL, we're flushing everything, so don't break.  Expired
+     * entries are retained for the stale window if serve-stale is enabled. */
+    if (now != NULL &&
+        entry->expire_ts + (time_t)cache->stale_max_ttl > now->sec) {
+      break;
+    }
+
+    ares_qcache_entry_remove(shard, entry);
   }
+}
 
-  while ((node = ares_slist_node_first(cache->expire)) != NULL) {
-    const ares_qcache_entry_t *entry = ares_slist_node_val(node);
+/* Evict least recently used entries until there is room for one more entry
+ * consuming the given number of bytes */
+static void ares_qcache_evict(ares_qcache_shard_t *shard, size_t footprint)
+{
+  ares_qcache_entry_t *entry;
 
-    /* If now is NULL, we're flushing everything, so don't break */
-    if (now != NULL && entry->expire_ts > now->sec) {
+  while ((entry = ares_llist_last_val(shard->lru)) != NULL) {
+    if ((shard->max_entries == 0 ||
+         ares_llist_len(shard->lru) < shard->max_entries) &&
+        (shard->max_bytes == 0 ||
+         shard->num_bytes + footprint <= shard->max_bytes)) {
       break;
     }
 
-    ares_htable_strvp_remove(cache->cache, entry->key);
-    ares_slist_node_destroy(node);
+    ares_qcache_entry_remove(shard, entry);
+  }
+}
+
+static ares_qcache_shard_t *ares_qcache_get_shard(ares_qcache_t           *cache,
+                                                  const ares_qcache_key_t *key)
+{
+  if (cache->num_shards == 1) {
+    return &cache->shards[0];
   }
+  return &cache->shards[ares_htable_hash_FNV1a(key->data, key->len, 0) %
+                        cache->num_shards];
 }
 
 void ares_qcache_flush(ares_qcache_t *cache)
 {
-  ares_qcache_expire(cache, NULL /* flush all */);
+  size_t i;
+
+  if (cache == NULL) {
+    return;
+  }
+
+  for (i = 0; i < cache->num_shards; i++) {
+    ares_qcache_shard_t *shard = &cache->shards[i];
+    ares_thread_mutex_lock(shard->lock);
+    ares_qcache_expire(cache, shard, NULL /* flush all */);
+    ares_thread_mutex_unlock(shard->lock);
+  }
+}
+
+static void ares_qcache_shard_destroy(ares_qcache_shard_t *shard)
+{
+  ares_htable_binvp_destroy(shard->cache);
+  ares_llist_destroy(shard->lru);
+  ares_slist_destroy(shard->expire);
+  ares_destroy_rand_state(shard->rand_state);
+  ares_thread_mutex_destroy(shard->lock);
 }
 
 void ares_qcache_destroy(ares_qcache_t *cache)
 {
+  size_t i;
+  size_t refcnt;
+
   if (cache == NULL) {
     return;
   }
 
-  ares_htable_strvp_destroy(cache->cache);
-  ares_slist_destroy(cache->expire);
+  ares_thread_mutex_lock(cache->lock);
+  refcnt = --cache->refcnt;
+  ares_thread_mutex_unlock(cache->lock);
+
+  if (refcnt > 0) {
+    return;
+  }
+
+  for (i = 0; cache->shards != NULL && i < cache->num_shards; i++) {
+    ares_qcache_shard_destroy(&cache->shards[i]);
+  }
+  ares_free(cache->shards);
+  ares_thread_mutex_destroy(cache->lock);
   ares_free(cache);
 }
 
+void ares_qcache_shared_destroy(ares_qcache_t *cache)
+{
+  ares_qcache_destroy(cache);
+}
+
+ares_bool_t ares_qcache_is_enabled(const ares_qcache_t *cache)
+{
+  return (cache != NULL && cache->max_ttl > 0) ? ARES_TRUE : ARES_FALSE;
+}
+
+ares_bool_t ares_qcache_is_shared(const ares_qcache_t *cache)
+{
+  return cache != NULL && cache->shared;
+}
+
+ares_qcache_t *ares_qcache_ref(ares_qcache_t *cache)
+{
+  ares_thread_mutex_lock(cache->lock);
+  cache->refcnt++;
+  ares_thread_mutex_unlock(cache->lock);
+  return cache;
+}
+
 static int ares_qcache_entry_sort_cb(const void *arg1, const void *arg2)
 {
   const ares_qcache_entry_t *entry1 = arg1;
@@ -198,17 +326,63 @@ static void ares_qcache_entry_destroy_cb(void *arg)
     return; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
-  ares_free(entry->key);
-  ares_dns_record_destroy(entry->dnsrec);
+  /* Key, TTL index and response are all part of the same allocation */
   ares_free(entry);
 }
 
-ares_status_t ares_qcache_create(ares_rand_state *rand_state,
-                                 unsigned int     max_ttl,
-                                 ares_qcache_t  **cache_out)
+/* If rand_state is NULL, the shard is shared between channels and gets its
+ * own random state and lock */
+static ares_status_t ares_qcache_shard_init(ares_qcache_shard_t *shard,
+                                            ares_rand_state     *rand_state,
+                                            size_t               max_entries,
+                                            size_t               max_bytes)
+{
+  if (rand_state == NULL) {
+    if (ares_threadsafety()) {
+      shard->lock = ares_thread_mutex_create();
+      if (shard->lock == NULL) {
+        return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+
+    shard->rand_state = ares_init_rand_state();
+    if (shard->rand_state == NULL) {
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    rand_state = shard->rand_state;
+  }
+
+  shard->cache = ares_htable_binvp_create(NULL);
+  if (shard->cache == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  shard->expire = ares_slist_create(rand_state, ares_qcache_entry_sort_cb,
+                                    ares_qcache_entry_destroy_cb);
+  if (shard->expire == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  shard->lru = ares_llist_create(NULL);
+  if (shard->lru == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  shard->max_entries = max_entries;
+  shard->max_bytes   = max_bytes;
+  return ARES_SUCCESS;
+}
+
+static ares_status_t
+  ares_qcache_create_int(ares_rand_state *rand_state, unsigned int max_ttl,
+                         const struct ares_qcache_options *opts,
+                         size_t num_shards, ares_qcache_t **cache_out)
 {
   ares_status_t  status = ARES_SUCCESS;
   ares_qcache_t *cache;
+  size_t         max_entries = 0;
+  size_t         max_bytes   = 0;
+  size_t         i;
 
   cache = ares_malloc_zero(sizeof(*cache));
   if (cache == NULL) {
@@ -216,20 +390,44 @@ ares_status_t ares_qcache_create(ares_rand_state *rand_state,
     goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  cache->cache = ares_htable_strvp_create(NULL);
-  if (cache->cache == NULL) {
-    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-    goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+  cache->refcnt = 1;
+
+  if (num_shards > 1 && ares_threadsafety()) {
+    cache->lock = ares_thread_mutex_create();
+    if (cache->lock == NULL) {
+      status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+    }
   }
 
-  cache->expire = ares_slist_create(rand_state, ares_qcache_entry_sort_cb,
-                                    ares_qcache_entry_destroy_cb);
-  if (cache->expire == NULL) {
+  cache->shards = ares_malloc_zero(num_shards * sizeof(*cache->shards));
+  if (cache->shards == NULL) {
     status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
     goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
   }
+  cache->num_shards = num_shards;
 
   cache->max_ttl = max_ttl;
+  if (opts != NULL) {
+    cache->stale_max_ttl = opts->stale_max_ttl;
+    cache->prefetch_pct  = opts->prefetch_pct;
+    if (cache->prefetch_pct > 100) {
+      cache->prefetch_pct = 100;
+    }
+    cache->prefetch_min_hits = opts->prefetch_min_hits;
+
+    /* Limits are split evenly between shards, rounding up */
+    max_entries = (opts->max_entries + num_shards - 1) / num_shards;
+    max_bytes   = (opts->max_bytes + num_shards - 1) / num_shards;
+  }
+
+  for (i = 0; i < num_shards; i++) {
+    status = ares_qcache_shard_init(&cache->shards[i], rand_state, max_entries,
+                                    max_bytes);
+    if (status != ARES_SUCCESS) {
+      goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
 
 done:
   if (status != ARES_SUCCESS) {
@@ -242,7 +440,34 @@ done:
   return status;
 }
 
-static unsigned int ares_qcache_calc_minttl(ares_dns_record_t *dnsrec)
+ares_status_t ares_qcache_create(ares_rand_state                  *rand_state,
+                                 unsigned int                      max_ttl,
+                                 const struct ares_qcache_options *opts,
+                                 ares_qcache_t                   **cache_out)
+{
+  return ares_qcache_create_int(rand_state, max_ttl, opts, 1, cache_out);
+}
+
+ares_status_t
+  ares_qcache_shared_create(unsigned int                      max_ttl,
+                            const struct ares_qcache_options *opts,
+                            ares_qcache_t                   **cache)
+{
+  ares_status_t status;
+
+  if (cache == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  status = ares_qcache_create_int(NULL, max_ttl, opts,
+                                  ARES_QCACHE_SHARED_SHARDS, cache);
+  if (status == ARES_SUCCESS) {
+    (*cache)->shared = ARES_TRUE;
+  }
+  return status;
+}
+
+static unsigned int ares_qcache_calc_minttl(const ares_dns_record_t *dnsrec)
 {
   unsigned int minttl = 0xFFFFFFFF;
   size_t       sect;
@@ -252,7 +477,7 @@ static unsigned int ares_qcache_calc_minttl(ares_dns_record_t *dnsrec)
     for (i = 0; i < ares_dns_record_rr_cnt(dnsrec, (ares_dns_section_t)sect);
          i++) {
       const ares_dns_rr_t *rr =
-        ares_dns_record_rr_get(dnsrec, (ares_dns_section_t)sect, i);
+        ares_dns_record_rr_get_const(dnsrec, (ares_dns_section_t)sect, i);
       ares_dns_rec_type_t type = ares_dns_rr_get_type(rr);
       unsigned int        ttl  = ares_dns_rr_get_ttl(rr);
 
@@ -271,7 +496,7 @@ static unsigned int ares_qcache_calc_minttl(ares_dns_record_t *dnsrec)
   return minttl;
 }
 
-static unsigned int ares_qcache_soa_minimum(ares_dns_record_t *dnsrec)
+static unsigned int ares_qcache_soa_minimum(const ares_dns_record_t *dnsrec)
 {
   size_t i;
 
@@ -279,7 +504,7 @@ static unsigned int ares_qcache_soa_minimum(ares_dns_record_t *dnsrec)
    * record. */
   for (i = 0; i < ares_dns_record_rr_cnt(dnsrec, ARES_SECTION_AUTHORITY); i++) {
     const ares_dns_rr_t *rr =
-      ares_dns_record_rr_get(dnsrec, ARES_SECTION_AUTHORITY, i);
+      ares_dns_record_rr_get_const(dnsrec, ARES_SECTION_AUTHORITY, i);
     ares_dns_rec_type_t type = ares_dns_rr_get_type(rr);
     unsigned int        ttl;
     unsigned int        minimum;
@@ -300,14 +525,155 @@ static unsigned int ares_qcache_soa_minimum(ares_dns_record_t *dnsrec)
   return 0;
 }
 
-/* On success, takes ownership of dnsrec */
+/* Records the location of every TTL in the wire-format response so they can be
+ * adjusted in place on fetch.  The OPT RR doesn't have a real TTL so it is
+ * skipped.  The ttls array must be large enough to hold an entry for every
+ * RR. */
+static ares_status_t ares_qcache_index_ttls(const unsigned char *wire,
+                                            size_t               wire_len,
+                                            ares_qcache_ttl_t   *ttls,
+                                            size_t              *ttls_cnt)
+{
+  ares_buf_t    *buf    = NULL;
+  ares_status_t  status = ARES_SUCCESS;
+  unsigned short qdcount;
+  unsigned short cnt[3];
+  size_t         rrcount = 0;
+  size_t         i;
+
+  *ttls_cnt = 0;
+
+  /* Offsets are stored as 16bit values which is the maximum size of a DNS
+   * message */
+  if (wire_len > 0xFFFF) {
+    return ARES_EBADRESP;
+  }
+
+  buf = ares_buf_create_const(wire, wire_len);
+  if (buf == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  /* Skip ID and flags */
+  status = ares_buf_consume(buf, 4);
+  if (status != ARES_SUCCESS) {
+    goto done; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  status = ares_buf_fetch_be16(buf, &qdcount);
+  for (i = 0; status == ARES_SUCCESS && i < 3; i++) {
+    status   = ares_buf_fetch_be16(buf, &cnt[i]);
+    rrcount += cnt[i];
+  }
+  if (status != ARES_SUCCESS) {
+    goto done; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  for (i = 0; i < qdcount; i++) {
+    status = ares_dns_name_parse(buf, NULL, ARES_FALSE, ARES_TRUE);
+    if (status != ARES_SUCCESS) {
+      goto done; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+
+    /* QTYPE and QCLASS */
+    status = ares_buf_consume(buf, 4);
+    if (status != ARES_SUCCESS) {
+      goto done; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+  }
+
+  for (i = 0; i < rrcount; i++) {
+    unsigned short type;
+    unsigned short rdlength;
+    unsigned int   ttl;
+    size_t         offset;
+
+    status = ares_dns_name_parse(buf, NULL, ARES_FALSE, ARES_TRUE);
+    if (status != ARES_SUCCESS) {
+      goto done; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+
+    status = ares_buf_fetch_be16(buf, &type);
+    if (status == ARES_SUCCESS) {
+      /* CLASS */
+      status = ares_buf_consume(buf, 2);
+    }
+    offset = ares_buf_get_position(buf);
+    if (status == ARES_SUCCESS) {
+      status = ares_buf_fetch_be32(buf, &ttl);
+    }
+    if (status == ARES_SUCCESS) {
+      status = ares_buf_fetch_be16(buf, &rdlength);
+    }
+    if (status == ARES_SUCCESS) {
+      status = ares_buf_consume(buf, rdlength);
+    }
+    if (status != ARES_SUCCESS) {
+      goto done; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+
+    if (type == ARES_REC_TYPE_OPT) {
+      continue;
+    }
+
+    ttls[*ttls_cnt].offset = (unsigned short)offset;
+    ttls[*ttls_cnt].ttl    = ttl;
+    (*ttls_cnt)++;
+  }
+
+done:
+  ares_buf_destroy(buf);
+  return status;
+}
+
+/* Writes the TTLs into the cached response and parses it for the caller.  If
+ * stale is set, all TTLs are set to the stale answer TTL, otherwise they are
+ * decremented by the time spent in the cache. */
+static ares_status_t ares_qcache_entry_parse(ares_qcache_entry_t  *entry,
+                                             const ares_timeval_t *now,
+                                             ares_bool_t           stale,
+                                             ares_dns_record_t   **dnsrec_resp)
+{
+  unsigned int elapsed = (unsigned int)(now->sec - entry->insert_ts);
+  size_t       i;
+
+  for (i = 0; i < entry->ttls_cnt; i++) {
+    unsigned int   ttl = entry->ttls[i].ttl;
+    unsigned char *ptr = entry->wire + entry->ttls[i].offset;
+
+    if (stale) {
+      ttl = ARES_QCACHE_STALE_TTL;
+    } else if (elapsed > ttl) {
+      ttl = 0;
+    } else {
+      ttl -= elapsed;
+    }
+
+    ptr[0] = (unsigned char)((ttl >> 24) & 0xFF);
+    ptr[1] = (unsigned char)((ttl >> 16) & 0xFF);
+    ptr[2] = (unsigned char)((ttl >> 8) & 0xFF);
+    ptr[3] = (unsigned char)(ttl & 0xFF);
+  }
+
+  return ares_dns_parse(entry->wire, entry->wire_len, ARES_DNS_PARSE_ARENA,
+                        dnsrec_resp);
+}
+
 static ares_status_t ares_qcache_insert_int(ares_qcache_t           *qcache,
-                                            ares_dns_record_t       *qresp,
+                                            const ares_dns_record_t *qresp,
                                             const ares_dns_record_t *qreq,
                                             const ares_timeval_t    *now)
 {
-  ares_qcache_entry_t *entry;
+  ares_qcache_entry_t *entry    = NULL;
+  ares_qcache_entry_t *existing = NULL;
+  ares_qcache_shard_t *shard    = NULL;
+  ares_qcache_key_t    key;
   unsigned int         ttl;
+  size_t               footprint;
+  unsigned char       *wire     = NULL;
+  size_t               wire_len = 0;
+  size_t               rr_cnt;
+  ares_status_t        status;
   ares_dns_rcode_t     rcode = ares_dns_record_get_rcode(qresp);
   ares_dns_flags_t     flags = ares_dns_record_get_flags(qresp);
 
@@ -341,85 +707,231 @@ static ares_status_t ares_qcache_insert_int(ares_qcache_t           *qcache,
     return ARES_EREFUSED;
   }
 
-  entry = ares_malloc_zero(sizeof(*entry));
+  /* We can't guarantee the server responded with the same flags as the
+   * request had, so we have to re-parse the request in order to generate the
+   * key for caching, but we'll only do this once we know for sure we really
+   * want to cache it */
+  if (!ares_qcache_calc_key(qreq, &key)) {
+    return ARES_ENOTIMP;
+  }
+
+  /* Upper bound of the number of TTLs in the response */
+  rr_cnt = ares_dns_record_rr_cnt(qresp, ARES_SECTION_ANSWER) +
+           ares_dns_record_rr_cnt(qresp, ARES_SECTION_AUTHORITY) +
+           ares_dns_record_rr_cnt(qresp, ARES_SECTION_ADDITIONAL);
+
+  status = ares_dns_write(qresp, &wire, &wire_len);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  /* Allocator overhead isn't known so this is a lower bound, but it scales
+   * with the size of the response which is what matters for bounding the
+   * cache.  Includes the htable bucket, expire and lru nodes. */
+  footprint = sizeof(*entry) + (rr_cnt * sizeof(*entry->ttls)) + key.len +
+              wire_len + (3 * 4 * sizeof(void *));
+  shard     = ares_qcache_get_shard(qcache, &key);
+  if (shard->max_bytes && footprint > shard->max_bytes) {
+    ares_free(wire);
+    return ARES_ENOTIMP;
+  }
+
+  /* TTL index, key and response are stored in the same allocation as the
+   * entry */
+  entry = ares_malloc_zero(sizeof(*entry) + (rr_cnt * sizeof(*entry->ttls)) +
+                           key.len + wire_len);
   if (entry == NULL) {
-    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    ares_free(wire);    /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  entry->dnsrec    = qresp;
   entry->expire_ts = (time_t)now->sec + (time_t)ttl;
   entry->insert_ts = (time_t)now->sec;
+  entry->ttl       = ttl;
+  entry->footprint = footprint;
+  entry->ttls      = (ares_qcache_ttl_t *)(entry + 1);
+  entry->key       = (unsigned char *)(entry->ttls + rr_cnt);
+  entry->key_len   = key.len;
+  entry->wire      = entry->key + key.len;
+  entry->wire_len  = wire_len;
+  memcpy(entry->key, key.data, key.len);
+  memcpy(entry->wire, wire, wire_len);
+  ares_free(wire);
+
+  status = ares_qcache_index_ttls(entry->wire, entry->wire_len, entry->ttls,
+                                  &entry->ttls_cnt);
+  if (status != ARES_SUCCESS) {
+    /* LCOV_EXCL_START: DefensiveCoding */
+    ares_free(entry);
+    return status;
+    /* LCOV_EXCL_STOP */
+  }
 
-  /* We can't guarantee the server responded with the same flags as the
-   * request had, so we have to re-parse the request in order to generate the
-   * key for caching, but we'll only do this once we know for sure we really
-   * want to cache it */
-  entry->key = ares_qcache_calc_key(qreq);
-  if (entry->key == NULL) {
+  ares_thread_mutex_lock(shard->lock);
+
+  /* Replace any existing entry for the same key, such as when multiple
+   * identical queries were outstanding at the same time */
+  existing = ares_htable_binvp_get_direct(shard->cache, key.data, key.len);
+  if (existing != NULL) {
+    ares_qcache_entry_remove(shard, existing);
+  }
+
+  ares_qcache_evict(shard, footprint);
+
+  if (!ares_htable_binvp_insert(shard->cache, entry->key, entry->key_len,
+                                entry)) {
     goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  if (!ares_htable_strvp_insert(qcache->cache, entry->key, entry)) {
+  entry->node_expire = ares_slist_insert(shard->expire, entry);
+  if (entry->node_expire == NULL) {
     goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  if (ares_slist_insert(qcache->expire, entry) == NULL) {
+  entry->node_lru = ares_llist_insert_first(shard->lru, entry);
+  if (entry->node_lru == NULL) {
     goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
+  shard->num_bytes += footprint;
+
+  ares_thread_mutex_unlock(shard->lock);
   return ARES_SUCCESS;
 
 /* LCOV_EXCL_START: OutOfMemory */
 fail:
-  if (entry != NULL) {
-    if (entry->key != NULL) {
-      ares_htable_strvp_remove(qcache->cache, entry->key);
-      ares_free(entry->key);
-    }
-    ares_free(entry);
-  }
+  ares_htable_binvp_remove(shard->cache, entry->key, entry->key_len);
+  /* Claim so the destructor isn't called */
+  ares_slist_node_claim(entry->node_expire);
+  ares_thread_mutex_unlock(shard->lock);
+  ares_free(entry);
   return ARES_ENOMEM;
   /* LCOV_EXCL_STOP */
 }
 
-ares_status_t ares_qcache_fetch(ares_channel_t           *channel,
-                                const ares_timeval_t     *now,
-                                const ares_dns_record_t  *dnsrec,
-                                const ares_dns_record_t **dnsrec_resp)
+/* Returns the entry for the request, if any, with the shard holding it
+ * locked.  The caller must always unlock the returned shard. */
+static ares_qcache_entry_t *ares_qcache_lookup(ares_qcache_t           *cache,
+                                               const ares_timeval_t    *now,
+                                               const ares_dns_record_t *dnsrec,
+                                               ares_qcache_shard_t    **shard)
+{
+  ares_qcache_key_t key;
+
+  *shard = NULL;
+
+  if (!ares_qcache_calc_key(dnsrec, &key)) {
+    return NULL;
+  }
+
+  *shard = ares_qcache_get_shard(cache, &key);
+  ares_thread_mutex_lock((*shard)->lock);
+
+  ares_qcache_expire(cache, *shard, now);
+
+  return ares_htable_binvp_get_direct((*shard)->cache, key.data, key.len);
+}
+
+/* Determine if a hit on the entry should trigger a background refresh.  Only
+ * one refresh is issued per entry, a successful refresh replaces the entry. */
+static ares_bool_t ares_qcache_entry_want_prefetch(const ares_qcache_t  *cache,
+                                                   ares_qcache_entry_t  *entry,
+                                                   const ares_timeval_t *now)
+{
+  time_t remaining;
+
+  if (cache->prefetch_pct == 0 || entry->prefetch_pending ||
+      entry->hits < cache->prefetch_min_hits) {
+    return ARES_FALSE;
+  }
+
+  remaining = entry->expire_ts - (time_t)now->sec;
+  if ((unsigned long)remaining * 100 >
+      (unsigned long)entry->ttl * cache->prefetch_pct) {
+    return ARES_FALSE;
+  }
+
+  entry->prefetch_pending = ARES_TRUE;
+  return ARES_TRUE;
+}
+
+ares_status_t ares_qcache_fetch(ares_channel_t          *channel,
+                                const ares_timeval_t    *now,
+                                const ares_dns_record_t *dnsrec,
+                                ares_dns_record_t      **dnsrec_resp,
+                                ares_bool_t             *prefetch)
 {
-  char                *key = NULL;
   ares_qcache_entry_t *entry;
-  ares_status_t        status = ARES_SUCCESS;
+  ares_qcache_shard_t *shard;
+  ares_status_t        status = ARES_ENOTFOUND;
 
-  if (channel == NULL || dnsrec == NULL || dnsrec_resp == NULL) {
+  if (channel == NULL || dnsrec == NULL || dnsrec_resp == NULL ||
+      prefetch == NULL) {
     return ARES_EFORMERR;
   }
 
+  *prefetch = ARES_FALSE;
+
   if (channel->qcache == NULL) {
     return ARES_ENOTFOUND;
   }
 
-  ares_qcache_expire(channel->qcache, now);
+  entry = ares_qcache_lookup(channel->qcache, now, dnsrec, &shard);
+  /* Stale entries are only returned via ares_qcache_fetch_stale() */
+  if (entry == NULL || entry->expire_ts <= now->sec) {
+    goto done;
+  }
 
-  key = ares_qcache_calc_key(dnsrec);
-  if (key == NULL) {
-    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-    goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+  status = ares_qcache_entry_parse(entry, now, ARES_FALSE, dnsrec_resp);
+  if (status != ARES_SUCCESS) {
+    goto done; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  entry = ares_htable_strvp_get_direct(channel->qcache->cache, key);
-  if (entry == NULL) {
-    status = ARES_ENOTFOUND;
+  ares_llist_node_mvparent_first(entry->node_lru, shard->lru);
+
+  entry->hits++;
+  *prefetch = ares_qcache_entry_want_prefetch(channel->qcache, entry, now);
+
+done:
+  if (shard != NULL) {
+    ares_thread_mutex_unlock(shard->lock);
+  }
+  return status;
+}
+
+ares_status_t ares_qcache_fetch_stale(ares_channel_t          *channel,
+                                      const ares_timeval_t    *now,
+                                      const ares_dns_record_t *dnsrec,
+                                      ares_dns_record_t      **dnsrec_resp)
+{
+  ares_qcache_entry_t *entry;
+  ares_qcache_shard_t *shard;
+  ares_status_t        status = ARES_ENOTFOUND;
+
+  if (channel == NULL || dnsrec == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  if (channel->qcache == NULL || channel->qcache->stale_max_ttl == 0) {
+    return ARES_ENOTFOUND;
+  }
+
+  entry = ares_qcache_lookup(channel->qcache, now, dnsrec, &shard);
+  if (entry == NULL || entry->expire_ts > now->sec) {
     goto done;
   }
 
-  ares_dns_record_ttl_decrement(entry->dnsrec,
-                                (unsigned int)(now->sec - entry->insert_ts));
+  if (dnsrec_resp == NULL) {
+    status = ARES_SUCCESS;
+    goto done;
+  }
 
-  *dnsrec_resp = entry->dnsrec;
+  status = ares_qcache_entry_parse(entry, now, ARES_TRUE, dnsrec_resp);
 
 done:
-  ares_free(key);
+  if (shard != NULL) {
+    ares_thread_mutex_unlock(shard->lock);
+  }
   return status;
 }
 
@@ -428,15 +940,5 @@ ares_status_t ares_qcache_insert(ares_channel_t          *channel,
                                  const ares_query_t      *query,
                                  const ares_dns_record_t *dnsrec)
 {
-  ares_dns_record_t *dupdns = ares_dns_record_duplicate(dnsrec);
-  ares_status_t      status;
-
-  if (dupdns == NULL) {
-    return ARES_ENOMEM;
-  }
-  status = ares_qcache_insert_int(channel->qcache, dupdns, query->query, now);
-  if (status != ARES_SUCCESS) {
-    ares_dns_record_destroy(dupdns);
-  }
-  return status;
+  return ares_qcache_insert_int(channel->qcache, dnsrec, query->query, now);
 }
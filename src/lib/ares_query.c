@@ -124,6 +124,13 @@ ares_status_t ares_query_dnsrec(ares_channel_t *channel, const char *name,
     return ARES_EFORMERR;
   }
 
+  channel = ares_shard_select(channel, name, ares_strlen(name));
+
+  if (qid == NULL && ares_submit_query(channel, name, dnsclass, type, callback,
+                                       arg) == ARES_SUCCESS) {
+    return ARES_SUCCESS;
+  }
+
   ares_channel_lock(channel);
   status = ares_query_nolock(channel, name, dnsclass, type, callback, arg, qid);
   ares_channel_unlock(channel);
@@ -40,10 +40,16 @@ struct search_query {
   /* Duplicate of DNS record passed to ares_search_dnsrec() */
   ares_dns_record_t   *dnsrec;
 
+  /* Name being searched, before any search domain is appended */
+  char                *name;
+
   /* Search order for names */
   char               **names;
   size_t               names_cnt;
 
+  /* Queries for all names when ARES_FLAG_PARALLEL_SEARCH is set */
+  ares_search_fanout_t *fanout;
+
   /* State tracking progress through the search query */
   size_t               next_name_idx; /* next name index being attempted */
   size_t      timeouts;        /* number of timeouts we saw for this request */
@@ -55,8 +61,10 @@ static void squery_free(struct search_query *squery)
   if (squery == NULL) {
     return; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
+  ares_search_fanout_release(squery->fanout);
   ares_strsplit_free(squery->names, squery->names_cnt);
   ares_dns_record_destroy(squery->dnsrec);
+  ares_free(squery->name);
   ares_free(squery);
 }
 
@@ -86,6 +94,13 @@ static ares_status_t ares_search_next(ares_channel_t      *channel,
     return ARES_EFORMERR; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
+  /* Query was already sent, just wait for its response */
+  if (squery->fanout != NULL) {
+    *skip_cleanup = ARES_TRUE;
+    ares_search_fanout_select(squery->fanout, squery->next_name_idx++);
+    return ARES_SUCCESS;
+  }
+
   status = ares_dns_record_query_set_name(
     squery->dnsrec, 0, squery->names[squery->next_name_idx++]);
   if (status != ARES_SUCCESS) {
@@ -149,6 +164,9 @@ static void search_callback(void *arg, ares_status_t status, size_t timeouts,
     squery->ever_got_nodata = ARES_TRUE;
   }
 
+  ares_search_negcache_note(channel, squery->name,
+                            squery->names[squery->next_name_idx - 1], dnsrec);
+
   if (squery->next_name_idx < squery->names_cnt) {
     mystatus = ares_search_next(channel, squery, &skip_cleanup);
     if (mystatus != ARES_SUCCESS && !skip_cleanup) {
@@ -208,13 +226,14 @@ ares_status_t ares_search_name_list(const ares_channel_t *channel,
                                     const char *name, char ***names,
                                     size_t *names_len)
 {
-  ares_status_t status;
-  char        **list     = NULL;
-  size_t        list_len = 0;
-  char         *alias    = NULL;
-  size_t        ndots    = 0;
-  size_t        idx      = 0;
-  size_t        i;
+  ares_status_t  status;
+  char         **list     = NULL;
+  size_t         list_len = 0;
+  char          *alias    = NULL;
+  size_t         ndots    = 0;
+  size_t         idx      = 0;
+  size_t         i;
+  ares_timeval_t now;
 
   /* Perform HOSTALIASES resolution */
   status = ares_lookup_hostaliases(channel, name, &alias);
@@ -278,12 +297,20 @@ ares_status_t ares_search_name_list(const ares_channel_t *channel,
     idx++;
   }
 
-  /* Append each search suffix to the name */
+  /* Append each search suffix to the name, skipping those known not to
+   * exist */
+  ares_tvnow(&now);
   for (i = 0; i < channel->ndomains; i++) {
     status = ares_cat_domain(name, channel->domains[i], &list[idx]);
     if (status != ARES_SUCCESS) {
       goto done;
     }
+    if (ares_search_negcache_fetch(channel->search_negcache, &now,
+                                   list[idx])) {
+      ares_free(list[idx]);
+      list[idx] = NULL;
+      continue;
+    }
     idx++;
   }
 
@@ -297,6 +324,7 @@ ares_status_t ares_search_name_list(const ares_channel_t *channel,
     idx++;
   }
 
+  list_len = idx;
 
 done:
   if (status == ARES_SUCCESS) {
@@ -310,6 +338,230 @@ done:
   return status;
 }
 
+void ares_search_negcache_note(ares_channel_t *channel, const char *name,
+                               const char              *candidate,
+                               const ares_dns_record_t *dnsrec)
+{
+  ares_timeval_t now;
+
+  if (channel->search_negcache == NULL || dnsrec == NULL ||
+      ares_dns_record_get_rcode(dnsrec) != ARES_RCODE_NXDOMAIN) {
+    return;
+  }
+
+  /* Only names with a search domain appended are skipped by
+   * ares_search_name_list() */
+  if (ares_strcaseeq(name, candidate)) {
+    return;
+  }
+
+  ares_tvnow(&now);
+  ares_search_negcache_insert(channel->search_negcache, &now, candidate);
+}
+
+typedef struct {
+  ares_search_fanout_t *fanout;
+  ares_bool_t           pending; /* query sent, no response yet */
+  ares_bool_t           held;    /* response waiting to be delivered */
+  ares_status_t         status;
+  size_t                timeouts;
+  ares_dns_record_t    *dnsrec;
+} ares_search_fanout_slot_t;
+
+struct ares_search_fanout {
+  ares_search_fanout_slot_t *slots;
+  size_t                     names_cnt;
+  size_t                     slots_per_name;
+
+  /* Name responses are delivered for, only valid once selected is set.
+   * Until then every response is held, queries answered from the cache or
+   * failed while being sent complete before the first name is selected. */
+  size_t                     current;
+  ares_bool_t                selected;
+
+  /* One for the consumer plus one per outstanding query */
+  size_t                     refcnt;
+
+  /* NULL once released */
+  ares_callback_dnsrec       callback;
+  void                      *arg;
+};
+
+static void fanout_slot_clear(ares_search_fanout_slot_t *slot)
+{
+  ares_dns_record_destroy(slot->dnsrec);
+  slot->dnsrec = NULL;
+  slot->held   = ARES_FALSE;
+}
+
+static void fanout_unref(ares_search_fanout_t *fanout)
+{
+  size_t i;
+
+  if (--fanout->refcnt > 0) {
+    return;
+  }
+
+  for (i = 0; i < fanout->names_cnt * fanout->slots_per_name; i++) {
+    fanout_slot_clear(&fanout->slots[i]);
+  }
+  ares_free(fanout->slots);
+  ares_free(fanout);
+}
+
+ares_search_fanout_t *ares_search_fanout_create(size_t names_cnt, size_t slots,
+                                                ares_callback_dnsrec callback,
+                                                void                *arg)
+{
+  ares_search_fanout_t *fanout = ares_malloc_zero(sizeof(*fanout));
+  size_t                i;
+
+  if (fanout == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  fanout->slots = ares_malloc_zero(sizeof(*fanout->slots) * names_cnt * slots);
+  if (fanout->slots == NULL) {
+    ares_free(fanout); /* LCOV_EXCL_LINE: OutOfMemory */
+    return NULL;       /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  for (i = 0; i < names_cnt * slots; i++) {
+    fanout->slots[i].fanout = fanout;
+  }
+
+  fanout->names_cnt      = names_cnt;
+  fanout->slots_per_name = slots;
+  fanout->refcnt         = 1;
+  fanout->callback       = callback;
+  fanout->arg            = arg;
+  return fanout;
+}
+
+void *ares_search_fanout_arg(ares_search_fanout_t *fanout, size_t idx,
+                             size_t slot)
+{
+  ares_search_fanout_slot_t *s =
+    &fanout->slots[idx * fanout->slots_per_name + slot];
+
+  s->pending = ARES_TRUE;
+  fanout->refcnt++;
+  return s;
+}
+
+void ares_search_fanout_cb(void *arg, ares_status_t status, size_t timeouts,
+                           const ares_dns_record_t *dnsrec)
+{
+  ares_search_fanout_slot_t *slot   = arg;
+  ares_search_fanout_t      *fanout = slot->fanout;
+  size_t idx = (size_t)(slot - fanout->slots) / fanout->slots_per_name;
+
+  slot->pending = ARES_FALSE;
+
+  if (fanout->callback != NULL && fanout->selected &&
+      idx == fanout->current) {
+    fanout->callback(fanout->arg, status, timeouts, dnsrec);
+  } else if (fanout->callback != NULL &&
+             (!fanout->selected || idx > fanout->current)) {
+    /* Not our turn yet (or nothing selected yet), hold on to the response */
+    slot->held     = ARES_TRUE;
+    slot->status   = status;
+    slot->timeouts = timeouts;
+    if (dnsrec != NULL) {
+      slot->dnsrec = ares_dns_record_duplicate(dnsrec);
+      if (slot->dnsrec == NULL) {
+        slot->status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+  }
+
+  fanout_unref(fanout);
+}
+
+void ares_search_fanout_select(ares_search_fanout_t *fanout, size_t idx)
+{
+  size_t i;
+
+  fanout->current  = idx;
+  fanout->selected = ARES_TRUE;
+
+  /* The callback may select the next name or release us */
+  fanout->refcnt++;
+  for (i = 0; i < fanout->slots_per_name; i++) {
+    ares_search_fanout_slot_t *slot =
+      &fanout->slots[idx * fanout->slots_per_name + i];
+    ares_dns_record_t *dnsrec;
+
+    if (fanout->callback == NULL || fanout->current != idx) {
+      break;
+    }
+
+    if (!slot->held) {
+      continue;
+    }
+
+    dnsrec       = slot->dnsrec;
+    slot->dnsrec = NULL;
+    slot->held   = ARES_FALSE;
+    fanout->callback(fanout->arg, slot->status, slot->timeouts, dnsrec);
+    ares_dns_record_destroy(dnsrec);
+  }
+  fanout_unref(fanout);
+}
+
+void ares_search_fanout_release(ares_search_fanout_t *fanout)
+{
+  size_t i;
+
+  if (fanout == NULL) {
+    return;
+  }
+
+  fanout->callback = NULL;
+  fanout->arg      = NULL;
+  for (i = 0; i < fanout->names_cnt * fanout->slots_per_name; i++) {
+    fanout_slot_clear(&fanout->slots[i]);
+  }
+  fanout_unref(fanout);
+}
+
+/* Send the query for every name in the search list at once */
+static ares_status_t ares_search_parallel(ares_channel_t      *channel,
+                                          struct search_query *squery)
+{
+  size_t i;
+
+  squery->fanout = ares_search_fanout_create(squery->names_cnt, 1,
+                                             search_callback, squery);
+  if (squery->fanout == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  ares_write_defer_begin(channel);
+  for (i = 0; i < squery->names_cnt; i++) {
+    void         *arg = ares_search_fanout_arg(squery->fanout, i, 0);
+    ares_status_t status =
+      ares_dns_record_query_set_name(squery->dnsrec, 0, squery->names[i]);
+
+    /* Failures are delivered to the callback in search order like any other
+     * response */
+    if (status != ARES_SUCCESS) {
+      /* LCOV_EXCL_START: OutOfMemory */
+      ares_search_fanout_cb(arg, status, 0, NULL);
+      continue;
+      /* LCOV_EXCL_STOP */
+    }
+
+    ares_send_nolock(channel, NULL, 0, squery->dnsrec, ares_search_fanout_cb,
+                     arg, NULL);
+  }
+  ares_write_defer_end(channel);
+
+  squery->next_name_idx = 1;
+  ares_search_fanout_select(squery->fanout, 0);
+  return ARES_SUCCESS;
+}
+
 static ares_status_t ares_search_int(ares_channel_t          *channel,
                                      const ares_dns_record_t *dnsrec,
                                      ares_callback_dnsrec callback, void *arg)
@@ -361,12 +613,26 @@ static ares_status_t ares_search_int(ares_channel_t          *channel,
   squery->timeouts        = 0;
   squery->ever_got_nodata = ARES_FALSE;
 
+  squery->name = ares_strdup(name);
+  if (squery->name == NULL) {
+    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
   status =
     ares_search_name_list(channel, name, &squery->names, &squery->names_cnt);
   if (status != ARES_SUCCESS) {
     goto fail;
   }
 
+  if (channel->flags & ARES_FLAG_PARALLEL_SEARCH && squery->names_cnt > 1) {
+    status = ares_search_parallel(channel, squery);
+    if (status != ARES_SUCCESS) {
+      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    return status;
+  }
+
   status = ares_search_next(channel, squery, &skip_cleanup);
   if (status != ARES_SUCCESS) {
     goto fail;
@@ -440,6 +706,8 @@ void ares_search(ares_channel_t *channel, const char *name, int dnsclass,
     return;
   }
 
+  channel = ares_shard_select(channel, name, ares_strlen(name));
+
   /* For now, ares_search_int() uses the ares_callback prototype. We need to
    * wrap the callback passed to this function in ares_dnsrec_convert_cb, to
    * convert from ares_callback_dnsrec to ares_callback. Allocate the convert
@@ -480,6 +748,7 @@ ares_status_t ares_search_dnsrec(ares_channel_t          *channel,
     return ARES_EFORMERR; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
+  channel = ares_shard_select_dnsrec(channel, dnsrec);
   ares_channel_lock(channel);
   status = ares_search_int(channel, dnsrec, callback, arg);
   ares_channel_unlock(channel);
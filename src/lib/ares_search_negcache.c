@@ -0,0 +1,197 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ares_private.h"
+
+/* Upper bound on remembered names, the oldest are dropped first */
+#define ARES_SEARCH_NEGCACHE_MAX_ENTRIES 4096
+
+typedef struct {
+  char              *name;
+  ares_timeval_t     expire;
+  ares_llist_node_t *node;
+} ares_search_negcache_entry_t;
+
+struct ares_search_negcache {
+  /* Name to ares_search_negcache_entry_t */
+  ares_htable_strvp_t *cache;
+  /* Entries in insertion order.  As all share the same TTL, this is also the
+   * order in which they expire. */
+  ares_llist_t        *expire;
+  unsigned int         ttl;
+};
+
+static void ares_search_negcache_entry_free(void *arg)
+{
+  ares_search_negcache_entry_t *entry = arg;
+
+  if (entry == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  ares_free(entry->name);
+  ares_free(entry);
+}
+
+ares_search_negcache_t *ares_search_negcache_create(unsigned int ttl)
+{
+  ares_search_negcache_t *cache = ares_malloc_zero(sizeof(*cache));
+
+  if (cache == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  cache->cache = ares_htable_strvp_create(NULL);
+  if (cache->cache == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  cache->expire = ares_llist_create(ares_search_negcache_entry_free);
+  if (cache->expire == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  cache->ttl = ttl;
+  return cache;
+
+/* LCOV_EXCL_START: OutOfMemory */
+fail:
+  ares_search_negcache_destroy(cache);
+  return NULL;
+  /* LCOV_EXCL_STOP */
+}
+
+void ares_search_negcache_destroy(ares_search_negcache_t *cache)
+{
+  if (cache == NULL) {
+    return;
+  }
+
+  ares_htable_strvp_destroy(cache->cache);
+  ares_llist_destroy(cache->expire);
+  ares_free(cache);
+}
+
+void ares_search_negcache_flush(ares_search_negcache_t *cache)
+{
+  ares_search_negcache_entry_t *entry;
+
+  if (cache == NULL) {
+    return;
+  }
+
+  while ((entry = ares_llist_first_val(cache->expire)) != NULL) {
+    ares_htable_strvp_remove(cache->cache, entry->name);
+    ares_llist_node_destroy(entry->node);
+  }
+}
+
+static void ares_search_negcache_expire(ares_search_negcache_t *cache,
+                                        const ares_timeval_t   *now)
+{
+  ares_search_negcache_entry_t *entry;
+
+  while ((entry = ares_llist_first_val(cache->expire)) != NULL) {
+    if (!ares_timedout(now, &entry->expire) &&
+        ares_llist_len(cache->expire) < ARES_SEARCH_NEGCACHE_MAX_ENTRIES) {
+      break;
+    }
+    ares_htable_strvp_remove(cache->cache, entry->name);
+    ares_llist_node_destroy(entry->node);
+  }
+}
+
+void ares_search_negcache_insert(ares_search_negcache_t *cache,
+                                 const ares_timeval_t *now, const char *name)
+{
+  ares_search_negcache_entry_t *entry;
+
+  if (cache == NULL) {
+    return;
+  }
+
+  ares_search_negcache_expire(cache, now);
+
+  /* Already known, restart its TTL */
+  entry = ares_htable_strvp_get_direct(cache->cache, name);
+  if (entry != NULL) {
+    entry->expire = *now;
+    ares_timeval_add(&entry->expire, (size_t)cache->ttl * 1000);
+    ares_llist_node_mvparent_last(entry->node, cache->expire);
+    return;
+  }
+
+  entry = ares_malloc_zero(sizeof(*entry));
+  if (entry == NULL) {
+    return; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  entry->name = ares_strdup(name);
+  if (entry->name == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  entry->expire = *now;
+  ares_timeval_add(&entry->expire, (size_t)cache->ttl * 1000);
+
+  if (!ares_htable_strvp_insert(cache->cache, entry->name, entry)) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  entry->node = ares_llist_insert_last(cache->expire, entry);
+  if (entry->node == NULL) {
+    /* LCOV_EXCL_START: OutOfMemory */
+    ares_htable_strvp_remove(cache->cache, entry->name);
+    goto fail;
+    /* LCOV_EXCL_STOP */
+  }
+
+  return;
+
+/* LCOV_EXCL_START: OutOfMemory */
+fail:
+  ares_search_negcache_entry_free(entry);
+  /* LCOV_EXCL_STOP */
+}
+
+ares_bool_t ares_search_negcache_fetch(const ares_search_negcache_t *cache,
+                                       const ares_timeval_t         *now,
+                                       const char                   *name)
+{
+  const ares_search_negcache_entry_t *entry;
+
+  if (cache == NULL) {
+    return ARES_FALSE;
+  }
+
+  /* Expired entries are left for ares_search_negcache_insert() to remove */
+  entry = ares_htable_strvp_get_direct(cache->cache, name);
+  if (entry == NULL || ares_timedout(now, &entry->expire)) {
+    return ARES_FALSE;
+  }
+
+  return ARES_TRUE;
+}
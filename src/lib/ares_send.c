@@ -32,13 +32,17 @@
 #endif
 #include "ares_nameser.h"
 
+/* Ids are random to make spoofing responses harder, so rather than handing out
+ * the next free slot a random id is drawn until an unused one is found.  Each
+ * check is a direct lookup, and a collision is unlikely unless tens of
+ * thousands of queries are outstanding. */
 static unsigned short generate_unique_qid(ares_channel_t *channel)
 {
   unsigned short id;
 
   do {
     id = ares_generate_new_id(channel->rand_state);
-  } while (ares_htable_szvp_get(channel->queries_by_qid, id, NULL));
+  } while (ares_qidmap_get(channel->queries_by_qid, id) != NULL);
 
   return id;
 }
@@ -105,17 +109,84 @@ done:
   return status;
 }
 
+static void ares_send_prefetch_cb(void *arg, ares_status_t status,
+                                  size_t                   timeouts,
+                                  const ares_dns_record_t *dnsrec)
+{
+  (void)arg;
+  (void)status;
+  (void)timeouts;
+  (void)dnsrec;
+  /* Nothing to do, a successful response replaces the cache entry */
+}
+
+/* If a stale response is cached, arrange for it to be returned if the servers
+ * take too long to respond (RFC 8767 client response timer) */
+static ares_status_t ares_send_arm_stale(ares_query_t         *query,
+                                         const ares_timeval_t *now)
+{
+  ares_channel_t *channel = query->channel;
+
+  if (query->no_cache || query->node_queries_by_stale != NULL ||
+      channel->qcache_opts.stale_client_timeout == 0 ||
+      ares_qcache_fetch_stale(channel, now, query->query, NULL) !=
+        ARES_SUCCESS) {
+    return ARES_SUCCESS;
+  }
+
+  query->stale_timeout = *now;
+  ares_timeval_add(&query->stale_timeout,
+                   channel->qcache_opts.stale_client_timeout);
+  query->node_queries_by_stale =
+    ares_slist_insert(channel->queries_by_stale, query);
+  if (query->node_queries_by_stale == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  return ARES_SUCCESS;
+}
+
+/* Attach the caller to an identical query that is already in flight, it will
+ * be answered with the same response */
+static ares_status_t ares_send_coalesce(ares_query_t        *query,
+                                        ares_callback_dnsrec callback,
+                                        void *arg, const ares_timeval_t *now)
+{
+  ares_query_waiter_t *waiter = NULL;
+  ares_status_t        status;
+
+  if (query->waiters == NULL) {
+    query->waiters = ares_array_create(sizeof(*waiter), NULL);
+    if (query->waiters == NULL) {
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  status = ares_array_insert_last((void **)&waiter, query->waiters);
+  if (status != ARES_SUCCESS) {
+    return status; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  waiter->callback = callback;
+  waiter->arg      = arg;
+
+  /* The query may have already answered its original caller from a stale
+   * cache entry, so the new caller needs its own client response timer */
+  return ares_send_arm_stale(query, now);
+}
+
 ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
                                ares_send_flags_t        flags,
                                const ares_dns_record_t *dnsrec,
                                ares_callback_dnsrec callback, void *arg,
                                unsigned short *qid)
 {
-  ares_query_t            *query;
-  ares_timeval_t           now;
-  ares_status_t            status;
-  unsigned short           id          = generate_unique_qid(channel);
-  const ares_dns_record_t *dnsrec_resp = NULL;
+  ares_query_t      *query;
+  ares_timeval_t     now;
+  ares_status_t      status;
+  unsigned short     id          = generate_unique_qid(channel);
+  ares_dns_record_t *dnsrec_resp = NULL;
+  ares_qcache_key_t  key;
+  ares_bool_t        coalesce = ARES_FALSE;
 
   ares_tvnow(&now);
 
@@ -125,23 +196,59 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
   }
 
   if (!(flags & ARES_SEND_FLAG_NOCACHE)) {
+    ares_bool_t prefetch = ARES_FALSE;
+
     /* Check query cache */
-    status = ares_qcache_fetch(channel, &now, dnsrec, &dnsrec_resp);
+    status = ares_qcache_fetch(channel, &now, dnsrec, &dnsrec_resp, &prefetch);
+
+    /* Refresh popular entries before they expire.  Issued before the callback
+     * as the request isn't guaranteed to outlive it. */
+    if (status == ARES_SUCCESS && prefetch) {
+      ares_send_nolock(channel, NULL, ARES_SEND_FLAG_NOCACHE, dnsrec,
+                       ares_send_prefetch_cb, NULL, NULL);
+    }
+
     if (status != ARES_ENOTFOUND) {
       /* ARES_SUCCESS means we retrieved the cache, anything else is a critical
        * failure, all result in termination */
       callback(arg, status, 0, dnsrec_resp);
+      ares_dns_record_destroy(dnsrec_resp);
       return status;
     }
   }
 
+  /* Identical requests made while one is already in flight share its
+   * response rather than each being sent to the servers.  Limited to
+   * cacheable requests on a channel with caching enabled, since otherwise
+   * callers may reasonably expect each request to hit the network. */
+  if (server == NULL && !(flags & ARES_SEND_FLAG_NOCACHE) &&
+      ares_qcache_is_enabled(channel->qcache) &&
+      ares_qcache_calc_key(dnsrec, &key)) {
+    ares_query_t *inflight =
+      ares_htable_binvp_get_direct(channel->queries_by_key, key.data, key.len);
+
+    if (inflight != NULL) {
+      status = ares_send_coalesce(inflight, callback, arg, &now);
+      if (status != ARES_SUCCESS) {
+        /* LCOV_EXCL_START: OutOfMemory */
+        callback(arg, status, 0, NULL);
+        return status;
+        /* LCOV_EXCL_STOP */
+      }
+      if (qid) {
+        *qid = inflight->qid;
+      }
+      return ARES_SUCCESS;
+    }
+    coalesce = ARES_TRUE;
+  }
+
   /* Allocate space for query and allocated fields. */
-  query = ares_malloc(sizeof(ares_query_t));
+  query = ares_pool_alloc(channel->query_pool);
   if (!query) {
     callback(arg, ARES_ENOMEM, 0, NULL); /* LCOV_EXCL_LINE: OutOfMemory */
     return ARES_ENOMEM;                  /* LCOV_EXCL_LINE: OutOfMemory */
   }
-  memset(query, 0, sizeof(*query));
 
   query->channel      = channel;
   query->qid          = id;
@@ -158,7 +265,7 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
     if (status == ARES_EBADRESP) {
       status = ARES_EBADQUERY;
     }
-    ares_free(query);
+    ares_pool_free(channel->query_pool, query);
     callback(arg, status, 0, NULL);
     return status;
   }
@@ -187,6 +294,10 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
     query->no_retries = ARES_TRUE;
   }
 
+  if (flags & ARES_SEND_FLAG_NOCACHE) {
+    query->no_cache = ARES_TRUE;
+  }
+
   query->error_status = ARES_SUCCESS;
   query->timeouts     = 0;
 
@@ -207,7 +318,7 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
   /* Keep track of queries bucketed by qid, so we can process DNS
    * responses quickly.
    */
-  if (!ares_htable_szvp_insert(channel->queries_by_qid, query->qid, query)) {
+  if (!ares_qidmap_insert(channel->queries_by_qid, query->qid, query)) {
     /* LCOV_EXCL_START: OutOfMemory */
     callback(arg, ARES_ENOMEM, 0, NULL);
     ares_free_query(query);
@@ -215,6 +326,40 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
     /* LCOV_EXCL_STOP */
   }
 
+  /* Register so identical requests can be coalesced onto this query */
+  if (coalesce) {
+    query->inflight_key = ares_malloc(key.len);
+    if (query->inflight_key == NULL) {
+      /* LCOV_EXCL_START: OutOfMemory */
+      callback(arg, ARES_ENOMEM, 0, NULL);
+      ares_free_query(query);
+      return ARES_ENOMEM;
+      /* LCOV_EXCL_STOP */
+    }
+    memcpy(query->inflight_key, key.data, key.len);
+    query->inflight_key_len = key.len;
+
+    if (!ares_htable_binvp_insert(channel->queries_by_key, query->inflight_key,
+                                  query->inflight_key_len, query)) {
+      /* LCOV_EXCL_START: OutOfMemory */
+      ares_free(query->inflight_key);
+      query->inflight_key = NULL;
+      callback(arg, ARES_ENOMEM, 0, NULL);
+      ares_free_query(query);
+      return ARES_ENOMEM;
+      /* LCOV_EXCL_STOP */
+    }
+  }
+
+  status = ares_send_arm_stale(query, &now);
+  if (status != ARES_SUCCESS) {
+    /* LCOV_EXCL_START: OutOfMemory */
+    callback(arg, status, 0, NULL);
+    ares_free_query(query);
+    return status;
+    /* LCOV_EXCL_STOP */
+  }
+
   /* Perform the first query action. */
 
   status = ares_send_query(server, query, &now);
@@ -235,6 +380,15 @@ ares_status_t ares_send_dnsrec(ares_channel_t          *channel,
     return ARES_EFORMERR; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
+  channel = ares_shard_select_dnsrec(channel, dnsrec);
+
+  /* The query id is only known once the query is started, so only callers
+   * that don't ask for it can skip the lock */
+  if (qid == NULL &&
+      ares_submit_send(channel, dnsrec, callback, arg) == ARES_SUCCESS) {
+    return ARES_SUCCESS;
+  }
+
   ares_channel_lock(channel);
 
   status = ares_send_nolock(channel, NULL, 0, dnsrec, callback, arg, qid);
@@ -261,7 +415,7 @@ void ares_send(ares_channel_t *channel, const unsigned char *qbuf, int qlen,
     return;
   }
 
-  status = ares_dns_parse(qbuf, (size_t)qlen, 0, &dnsrec);
+  status = ares_dns_parse(qbuf, (size_t)qlen, ARES_DNS_PARSE_ARENA, &dnsrec);
   if (status != ARES_SUCCESS) {
     callback(arg, (int)status, 0, NULL, 0);
     return;
@@ -285,6 +439,7 @@ void ares_send(ares_channel_t *channel, const unsigned char *qbuf, int qlen,
 size_t ares_queue_active_queries(const ares_channel_t *channel)
 {
   size_t len;
+  size_t i;
 
   if (channel == NULL) {
     return 0;
@@ -292,9 +447,14 @@ size_t ares_queue_active_queries(const ares_channel_t *channel)
 
   ares_channel_lock(channel);
 
-  len = ares_llist_len(channel->all_queries);
+  len  = ares_llist_len(channel->all_queries);
+  len += ares_atomic_size_get(&channel->submit_pending);
 
   ares_channel_unlock(channel);
 
+  for (i = 0; i < channel->nshards; i++) {
+    len += ares_queue_active_queries(channel->shards[i]);
+  }
+
   return len;
 }
@@ -91,7 +91,7 @@ ares_status_t
                                const struct ares_socket_functions_ex *funcs,
                                void                                  *user_data)
 {
-  unsigned int known_versions[] = { 1 };
+  unsigned int known_versions[] = { 1, 2 };
   size_t       i;
 
   if (channel == NULL || funcs == NULL) {
@@ -132,11 +132,20 @@ ares_status_t
     channel->sock_funcs.aif_indextoname = funcs->aif_indextoname;
   }
 
+  if (funcs->version >= 2) {
+    channel->sock_funcs.arecvmmsg = funcs->arecvmmsg;
+    channel->sock_funcs.asendmmsg = funcs->asendmmsg;
+  }
+
   /* Implement newer versions here ...*/
 
 
   channel->sock_func_cb_data = user_data;
 
+  for (i = 0; i < channel->nshards; i++) {
+    ares_set_socket_functions_ex(channel->shards[i], funcs, user_data);
+  }
+
   return ARES_SUCCESS;
 }
 
@@ -381,6 +390,53 @@ static ares_ssize_t default_arecvfrom(ares_socket_t sock, void *buffer,
 #endif
 }
 
+#ifdef HAVE_RECVMMSG
+/* Upper bound on datagrams read per call, keeps the scratch headers on the
+ * stack */
+#  define DEFAULT_RECVMMSG_MAX 16
+
+static ares_ssize_t default_arecvmmsg(ares_socket_t           sock,
+                                      struct ares_socket_msg *msgs, size_t cnt,
+                                      int flags, void *user_data)
+{
+  struct mmsghdr hdrs[DEFAULT_RECVMMSG_MAX];
+  struct iovec   iovs[DEFAULT_RECVMMSG_MAX];
+  size_t         i;
+  int            rv;
+
+  (void)user_data;
+
+  if (cnt > DEFAULT_RECVMMSG_MAX) {
+    cnt = DEFAULT_RECVMMSG_MAX;
+  }
+
+  memset(hdrs, 0, sizeof(*hdrs) * cnt);
+  for (i = 0; i < cnt; i++) {
+    iovs[i].iov_base            = msgs[i].buffer;
+    iovs[i].iov_len             = msgs[i].length;
+    hdrs[i].msg_hdr.msg_iov     = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen  = 1;
+    hdrs[i].msg_hdr.msg_name    = msgs[i].address;
+    hdrs[i].msg_hdr.msg_namelen = msgs[i].address_len;
+  }
+
+  rv = recvmmsg(sock, hdrs, (unsigned int)cnt, flags, NULL);
+  if (rv <= 0) {
+    return rv;
+  }
+
+  for (i = 0; i < (size_t)rv; i++) {
+    msgs[i].datagram_len = hdrs[i].msg_len;
+    msgs[i].address_len  = hdrs[i].msg_hdr.msg_namelen;
+    if (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      msgs[i].datagram_len = msgs[i].length + 1;
+    }
+  }
+
+  return rv;
+}
+#endif
+
 static ares_ssize_t default_asendto(ares_socket_t sock, const void *buffer,
                                     size_t length, int flags,
                                     const struct sockaddr *address,
@@ -402,6 +458,39 @@ static ares_ssize_t default_asendto(ares_socket_t sock, const void *buffer,
                             (SEND_TYPE_ARG3)length, (SEND_TYPE_ARG4)flags);
 }
 
+#ifdef HAVE_SENDMMSG
+/* Upper bound on datagrams sent per call, keeps the scratch headers on the
+ * stack */
+#  define DEFAULT_SENDMMSG_MAX 16
+
+static ares_ssize_t default_asendmmsg(ares_socket_t                 sock,
+                                      const struct ares_socket_msg *msgs,
+                                      size_t cnt, int flags, void *user_data)
+{
+  struct mmsghdr hdrs[DEFAULT_SENDMMSG_MAX];
+  struct iovec   iovs[DEFAULT_SENDMMSG_MAX];
+  size_t         i;
+
+  (void)user_data;
+
+  if (cnt > DEFAULT_SENDMMSG_MAX) {
+    cnt = DEFAULT_SENDMMSG_MAX;
+  }
+
+  memset(hdrs, 0, sizeof(*hdrs) * cnt);
+  for (i = 0; i < cnt; i++) {
+    iovs[i].iov_base            = msgs[i].buffer;
+    iovs[i].iov_len             = msgs[i].length;
+    hdrs[i].msg_hdr.msg_iov     = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen  = 1;
+    hdrs[i].msg_hdr.msg_name    = msgs[i].address;
+    hdrs[i].msg_hdr.msg_namelen = msgs[i].address_len;
+  }
+
+  return (ares_ssize_t)sendmmsg(sock, hdrs, (unsigned int)cnt, flags);
+}
+#endif
+
 static int default_agetsockname(ares_socket_t sock, struct sockaddr *address,
                                 ares_socklen_t *address_len, void *user_data)
 {
@@ -443,7 +532,7 @@ static const char *default_aif_indextoname(unsigned int ifindex,
 }
 
 static const struct ares_socket_functions_ex default_socket_functions = {
-  1,
+  2,
   ARES_SOCKFUNC_FLAG_NONBLOCKING,
   default_asocket,
   default_aclose,
@@ -454,7 +543,17 @@ static const struct ares_socket_functions_ex default_socket_functions = {
   default_agetsockname,
   default_abind,
   default_aif_nametoindex,
-  default_aif_indextoname
+  default_aif_indextoname,
+#ifdef HAVE_RECVMMSG
+  default_arecvmmsg,
+#else
+  NULL, /* arecvmmsg */
+#endif
+#ifdef HAVE_SENDMMSG
+  default_asendmmsg
+#else
+  NULL /* asendmmsg */
+#endif
 };
 
 void ares_set_socket_functions_def(ares_channel_t *channel)
@@ -462,6 +561,24 @@ void ares_set_socket_functions_def(ares_channel_t *channel)
   ares_set_socket_functions_ex(channel, &default_socket_functions, NULL);
 }
 
+ares_bool_t ares_socket_functions_are_default(const ares_channel_t *channel)
+{
+  const struct ares_socket_functions_ex *def = &default_socket_functions;
+
+  /* Only the functions that create, read, write or close sockets matter to
+   * callers that want to bypass them */
+  if (channel->sock_funcs.asocket != def->asocket ||
+      channel->sock_funcs.aclose != def->aclose ||
+      channel->sock_funcs.arecvfrom != def->arecvfrom ||
+      channel->sock_funcs.asendto != def->asendto ||
+      channel->sock_funcs.arecvmmsg != def->arecvmmsg ||
+      channel->sock_funcs.asendmmsg != def->asendmmsg) {
+    return ARES_FALSE;
+  }
+
+  return ARES_TRUE;
+}
+
 static int legacycb_aclose(ares_socket_t sock, void *user_data)
 {
   ares_channel_t *channel = user_data;
@@ -574,13 +691,17 @@ static const struct ares_socket_functions_ex legacy_socket_functions = {
   NULL, /* agetsockname */
   NULL, /* abind */
   NULL, /* aif_nametoindex */
-  NULL  /* aif_indextoname */
+  NULL, /* aif_indextoname */
+  NULL, /* arecvmmsg */
+  NULL  /* asendmmsg */
 };
 
 void ares_set_socket_functions(ares_channel_t                     *channel,
                                const struct ares_socket_functions *funcs,
                                void                               *data)
 {
+  size_t i;
+
   if (channel == NULL || channel->optmask & ARES_OPT_EVENT_THREAD) {
     return;
   }
@@ -588,4 +709,10 @@ void ares_set_socket_functions(ares_channel_t                     *channel,
   channel->legacy_sock_funcs         = funcs;
   channel->legacy_sock_funcs_cb_data = data;
   ares_set_socket_functions_ex(channel, &legacy_socket_functions, channel);
+
+  /* Each shard needs its own legacy wrapper state as the wrappers are handed
+   * the shard itself as their user data. */
+  for (i = 0; i < channel->nshards; i++) {
+    ares_set_socket_functions(channel->shards[i], funcs, data);
+  }
 }
@@ -0,0 +1,141 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ares_private.h"
+#include "dsa/ares_htable.h"
+
+/* A sharded channel is a set of complete channels, each with its own lock,
+ * event thread, sockets, query ids and timeouts.  The channel handed to the
+ * user is the first shard and owns the others, public entry points pick the
+ * shard for a query and then operate on it exactly like an unsharded channel.
+ * Shards never reference each other, so the only lock ordering is the first
+ * shard before the others when configuration changes are propagated. */
+
+ares_status_t ares_shards_create(ares_channel_t            *channel,
+                                 const struct ares_options *options,
+                                 int optmask, size_t cnt)
+{
+  struct ares_options opts;
+  ares_status_t       status = ARES_SUCCESS;
+  size_t              i;
+
+  if (cnt < 2) {
+    return ARES_SUCCESS;
+  }
+
+  channel->shards = ares_malloc_zero((cnt - 1) * sizeof(*channel->shards));
+  if (channel->shards == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  /* Every shard is configured exactly as the first one was, but must not
+   * shard itself, and uses the same query cache so a response learned by one
+   * shard is available to all. */
+  memcpy(&opts, options, sizeof(opts));
+  optmask            &= ~(ARES_OPT_EVENT_THREAD_SHARDS);
+  optmask            |= ARES_OPT_QUERY_CACHE_SHARED;
+  opts.qcache_shared  = channel->qcache;
+
+  for (i = 0; i < cnt - 1; i++) {
+    ares_channel_t *shard = NULL;
+
+    status = (ares_status_t)ares_init_options(&shard, &opts, optmask);
+    if (status != ARES_SUCCESS) {
+      break; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    channel->shards[i] = shard;
+    channel->nshards++;
+  }
+
+  return status;
+}
+
+void ares_shards_destroy(ares_channel_t *channel)
+{
+  size_t i;
+
+  for (i = 0; i < channel->nshards; i++) {
+    ares_destroy(channel->shards[i]);
+  }
+
+  ares_free(channel->shards);
+  channel->shards  = NULL;
+  channel->nshards = 0;
+}
+
+/* A private cache is flushed by its channel and the cache shared by the shards
+ * of a channel by the first shard.  A cache the user shares between channels
+ * is left alone as all channels sharing it are expected to be configured
+ * alike. */
+ares_bool_t ares_channel_owns_qcache(const ares_channel_t *channel)
+{
+  if (!ares_qcache_is_shared(channel->qcache)) {
+    return ARES_TRUE;
+  }
+
+  return channel->nshards > 0 &&
+                 !(channel->optmask & ARES_OPT_QUERY_CACHE_SHARED)
+           ? ARES_TRUE
+           : ARES_FALSE;
+}
+
+ares_channel_t *ares_shard_select(ares_channel_t *channel, const void *key,
+                                  size_t key_len)
+{
+  unsigned int hash;
+  size_t       idx;
+
+  if (channel == NULL || channel->nshards == 0 || key == NULL ||
+      key_len == 0) {
+    return channel;
+  }
+
+  /* Case-insensitive so all spellings of a name land on the same shard and
+   * can be coalesced with each other. */
+  hash = ares_htable_hash_FNV1a_casecmp(key, key_len, 0x2398c1d7);
+  idx  = (size_t)hash % (channel->nshards + 1);
+  if (idx == 0) {
+    return channel;
+  }
+  return channel->shards[idx - 1];
+}
+
+ares_channel_t *ares_shard_select_dnsrec(ares_channel_t          *channel,
+                                         const ares_dns_record_t *dnsrec)
+{
+  const char *name = NULL;
+
+  if (channel == NULL || channel->nshards == 0) {
+    return channel;
+  }
+
+  if (ares_dns_record_query_get(dnsrec, 0, &name, NULL, NULL) !=
+      ARES_SUCCESS) {
+    return channel;
+  }
+
+  return ares_shard_select(channel, name, ares_strlen(name));
+}
@@ -55,7 +55,7 @@
 #include <fcntl.h>
 #include <limits.h>
 
-static ares_conn_err_t ares_socket_deref_error(int err)
+ares_conn_err_t ares_socket_deref_error(int err)
 {
   switch (err) {
 #if defined(EWOULDBLOCK)
@@ -150,6 +150,33 @@ ares_conn_err_t ares_socket_write(ares_channel_t *channel, ares_socket_t fd,
   return err;
 }
 
+ares_conn_err_t ares_socket_write_batch(ares_channel_t *channel,
+                                        ares_socket_t   fd,
+                                        const struct ares_socket_msg *msgs,
+                                        size_t cnt, size_t *sent_cnt)
+{
+  int          flags = 0;
+  ares_ssize_t rv;
+
+  *sent_cnt = 0;
+
+#ifdef HAVE_MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+
+  rv = channel->sock_funcs.asendmmsg(fd, msgs, cnt, flags,
+                                     channel->sock_func_cb_data);
+  if (rv <= 0) {
+    return ares_socket_deref_error(SOCKERRNO);
+  }
+
+  *sent_cnt = (size_t)rv;
+  if (*sent_cnt > cnt) {
+    *sent_cnt = cnt; /* LCOV_EXCL_LINE: misbehaving callback */
+  }
+  return ARES_CONN_ERR_SUCCESS;
+}
+
 ares_conn_err_t ares_socket_recv(ares_channel_t *channel, ares_socket_t s,
                                  ares_bool_t is_tcp, void *data,
                                  size_t data_len, size_t *read_bytes)
@@ -211,6 +238,33 @@ ares_conn_err_t ares_socket_recvfrom(ares_channel_t *channel, ares_socket_t s,
   return ares_socket_deref_error(SOCKERRNO);
 }
 
+ares_conn_err_t ares_socket_recvmmsg(ares_channel_t *channel, ares_socket_t s,
+                                     struct ares_socket_msg *msgs, size_t cnt,
+                                     size_t *read_cnt)
+{
+  ares_ssize_t rv;
+
+  *read_cnt = 0;
+
+  rv = channel->sock_funcs.arecvmmsg(s, msgs, cnt, 0,
+                                     channel->sock_func_cb_data);
+
+  if (rv > 0) {
+    *read_cnt = (size_t)rv;
+    if (*read_cnt > cnt) {
+      *read_cnt = cnt; /* LCOV_EXCL_LINE: misbehaving callback */
+    }
+    return ARES_CONN_ERR_SUCCESS;
+  }
+
+  if (rv == 0) {
+    return ARES_CONN_ERR_WOULDBLOCK;
+  }
+
+  /* If we're here, rv<0 */
+  return ares_socket_deref_error(SOCKERRNO);
+}
+
 ares_conn_err_t ares_socket_enable_tfo(const ares_channel_t *channel,
                                        ares_socket_t         fd)
 {
@@ -398,11 +452,17 @@ void ares_socket_close(ares_channel_t *channel, ares_socket_t s)
 void ares_set_socket_callback(ares_channel_t           *channel,
                               ares_sock_create_callback cb, void *data)
 {
+  size_t i;
+
   if (channel == NULL) {
     return;
   }
   channel->sock_create_cb      = cb;
   channel->sock_create_cb_data = data;
+
+  for (i = 0; i < channel->nshards; i++) {
+    ares_set_socket_callback(channel->shards[i], cb, data);
+  }
 }
 
 void ares_set_socket_configure_callback(ares_channel_t           *channel,
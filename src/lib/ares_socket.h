@@ -160,4 +160,20 @@ ares_conn_err_t ares_socket_write(ares_channel_t *channel, ares_socket_t fd,
                                   const void *data, size_t len, size_t *written,
                                   const struct sockaddr *sa,
                                   ares_socklen_t         salen);
+ares_conn_err_t ares_socket_write_batch(ares_channel_t *channel,
+                                        ares_socket_t   fd,
+                                        const struct ares_socket_msg *msgs,
+                                        size_t cnt, size_t *sent_cnt);
+ares_conn_err_t ares_socket_deref_error(int err);
+
+/*! Datagram I/O performed by the event system rather than the socket
+ *  functions (io_uring).  Both behave like the batched socket functions, and
+ *  return ARES_CONN_ERR_NOTIMP for a socket they don't handle, which is then
+ *  read or written through the socket functions as usual. */
+typedef ares_conn_err_t (*ares_dgram_recv_cb)(void *data, ares_socket_t fd,
+                                              struct ares_socket_msg *msgs,
+                                              size_t cnt, size_t *read_cnt);
+typedef ares_conn_err_t (*ares_dgram_send_cb)(
+  void *data, ares_socket_t fd, const struct ares_socket_msg *msgs, size_t cnt,
+  size_t *sent_cnt);
 #endif
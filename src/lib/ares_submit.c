@@ -0,0 +1,308 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+
+#include "ares_private.h"
+
+/* With an event thread, every public entry point taking the channel lock
+ * contends with the event thread and every other submitting thread.  Instead
+ * requests are pushed onto a lock-free stack on the channel and started by
+ * the event thread in batches the next time it processes the channel.  Only
+ * the push that finds the stack empty wakes the event thread, later pushes
+ * are picked up by that same drain.  The event thread always takes the whole
+ * stack at once, so there is no ABA problem with the compare-and-swap. */
+
+typedef enum {
+  ARES_SUBMIT_SEND        = 1,
+  ARES_SUBMIT_QUERY       = 2,
+  ARES_SUBMIT_GETADDRINFO = 3
+} ares_submit_type_t;
+
+typedef struct ares_submit ares_submit_t;
+
+struct ares_submit {
+  ares_submit_t     *next;
+  ares_submit_type_t type;
+
+  union {
+    struct {
+      ares_dns_record_t   *dnsrec;
+      ares_callback_dnsrec callback;
+      void                *arg;
+    } send;
+
+    struct {
+      char                *name;
+      ares_dns_class_t     dnsclass;
+      ares_dns_rec_type_t  type;
+      ares_callback_dnsrec callback;
+      void                *arg;
+    } query;
+
+    struct {
+      char                          *name;
+      char                          *service;
+      ares_bool_t                    has_hints;
+      struct ares_addrinfo_hints     hints;
+      ares_addrinfo_partial_callback partial_callback;
+      ares_addrinfo_callback         callback;
+      void                          *arg;
+    } gai;
+  } u;
+};
+
+ares_bool_t ares_submit_enabled(const ares_channel_t *channel)
+{
+  if (channel == NULL || !(channel->optmask & ARES_OPT_EVENT_THREAD)) {
+    return ARES_FALSE;
+  }
+
+  return ares_atomics_available();
+}
+
+static void ares_submit_free(ares_submit_t *sub)
+{
+  switch (sub->type) {
+    case ARES_SUBMIT_SEND:
+      ares_dns_record_destroy(sub->u.send.dnsrec);
+      break;
+    case ARES_SUBMIT_QUERY:
+      ares_free(sub->u.query.name);
+      break;
+    case ARES_SUBMIT_GETADDRINFO:
+      ares_free(sub->u.gai.name);
+      ares_free(sub->u.gai.service);
+      break;
+  }
+  ares_free(sub);
+}
+
+static void ares_submit_push(ares_channel_t *channel, ares_submit_t *sub)
+{
+  void *head;
+
+  /* Counted before it is visible so the count never drops below the number
+   * of requests on the stack */
+  ares_atomic_size_add(&channel->submit_pending, 1);
+
+  do {
+    head      = ares_atomic_ptr_get(&channel->submit_head);
+    sub->next = head;
+  } while (!ares_atomic_ptr_cas(&channel->submit_head, head, sub));
+
+  /* Stack was empty, so the event thread isn't going to drain it unless it is
+   * woken up */
+  if (head == NULL && channel->query_enqueue_cb != NULL) {
+    channel->query_enqueue_cb(channel->query_enqueue_cb_data);
+  }
+}
+
+ares_status_t ares_submit_send(ares_channel_t          *channel,
+                               const ares_dns_record_t *dnsrec,
+                               ares_callback_dnsrec callback, void *arg)
+{
+  ares_submit_t *sub;
+
+  if (!ares_submit_enabled(channel) || dnsrec == NULL || callback == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  sub = ares_malloc_zero(sizeof(*sub));
+  if (sub == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  sub->type            = ARES_SUBMIT_SEND;
+  sub->u.send.callback = callback;
+  sub->u.send.arg      = arg;
+  sub->u.send.dnsrec   = ares_dns_record_duplicate(dnsrec);
+  if (sub->u.send.dnsrec == NULL) {
+    ares_submit_free(sub); /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_ENOMEM;    /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  ares_submit_push(channel, sub);
+  return ARES_SUCCESS;
+}
+
+ares_status_t ares_submit_query(ares_channel_t *channel, const char *name,
+                                ares_dns_class_t     dnsclass,
+                                ares_dns_rec_type_t  type,
+                                ares_callback_dnsrec callback, void *arg)
+{
+  ares_submit_t *sub;
+
+  if (!ares_submit_enabled(channel) || name == NULL || callback == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  sub = ares_malloc_zero(sizeof(*sub));
+  if (sub == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  sub->type             = ARES_SUBMIT_QUERY;
+  sub->u.query.dnsclass = dnsclass;
+  sub->u.query.type     = type;
+  sub->u.query.callback = callback;
+  sub->u.query.arg      = arg;
+  sub->u.query.name     = ares_strdup(name);
+  if (sub->u.query.name == NULL) {
+    ares_submit_free(sub); /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_ENOMEM;    /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  ares_submit_push(channel, sub);
+  return ARES_SUCCESS;
+}
+
+ares_status_t
+  ares_submit_getaddrinfo(ares_channel_t *channel, const char *name,
+                          const char                       *service,
+                          const struct ares_addrinfo_hints *hints,
+                          ares_addrinfo_partial_callback    partial_callback,
+                          ares_addrinfo_callback callback, void *arg)
+{
+  ares_submit_t *sub;
+
+  if (!ares_submit_enabled(channel) || callback == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  sub = ares_malloc_zero(sizeof(*sub));
+  if (sub == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  sub->type           = ARES_SUBMIT_GETADDRINFO;
+  sub->u.gai.partial_callback = partial_callback;
+  sub->u.gai.callback         = callback;
+  sub->u.gai.arg              = arg;
+  if (hints != NULL) {
+    sub->u.gai.has_hints = ARES_TRUE;
+    sub->u.gai.hints     = *hints;
+  }
+
+  if (name != NULL) {
+    sub->u.gai.name = ares_strdup(name);
+    if (sub->u.gai.name == NULL) {
+      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  if (service != NULL) {
+    sub->u.gai.service = ares_strdup(service);
+    if (sub->u.gai.service == NULL) {
+      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  ares_submit_push(channel, sub);
+  return ARES_SUCCESS;
+
+/* LCOV_EXCL_START: OutOfMemory */
+fail:
+  ares_submit_free(sub);
+  return ARES_ENOMEM;
+  /* LCOV_EXCL_STOP */
+}
+
+static void ares_submit_start(ares_channel_t *channel, ares_submit_t *sub)
+{
+  switch (sub->type) {
+    case ARES_SUBMIT_SEND:
+      ares_send_nolock(channel, NULL, 0, sub->u.send.dnsrec,
+                       sub->u.send.callback, sub->u.send.arg, NULL);
+      break;
+    case ARES_SUBMIT_QUERY:
+      ares_query_nolock(channel, sub->u.query.name, sub->u.query.dnsclass,
+                        sub->u.query.type, sub->u.query.callback,
+                        sub->u.query.arg, NULL);
+      break;
+    case ARES_SUBMIT_GETADDRINFO:
+      ares_getaddrinfo_nolock(channel, sub->u.gai.name, sub->u.gai.service,
+                              sub->u.gai.has_hints ? &sub->u.gai.hints : NULL,
+                              sub->u.gai.partial_callback, sub->u.gai.callback,
+                              sub->u.gai.arg);
+      break;
+  }
+}
+
+static void ares_submit_fail(ares_submit_t *sub, ares_status_t status)
+{
+  switch (sub->type) {
+    case ARES_SUBMIT_SEND:
+      sub->u.send.callback(sub->u.send.arg, status, 0, NULL);
+      break;
+    case ARES_SUBMIT_QUERY:
+      sub->u.query.callback(sub->u.query.arg, status, 0, NULL);
+      break;
+    case ARES_SUBMIT_GETADDRINFO:
+      sub->u.gai.callback(sub->u.gai.arg, (int)status, 0, NULL);
+      break;
+  }
+}
+
+void ares_submit_drain(ares_channel_t *channel, ares_status_t status)
+{
+  ares_submit_t *list;
+  ares_submit_t *rev = NULL;
+  size_t         cnt = 0;
+
+  if (channel == NULL ||
+      ares_atomic_ptr_get(&channel->submit_head) == NULL) {
+    return;
+  }
+
+  list = ares_atomic_ptr_swap(&channel->submit_head, NULL);
+
+  /* The stack is newest first, start requests in the order submitted */
+  while (list != NULL) {
+    ares_submit_t *next = list->next;
+    list->next          = rev;
+    rev                 = list;
+    list                = next;
+  }
+
+  /* Writes for the whole batch go out together */
+  ares_write_defer_begin(channel);
+  while (rev != NULL) {
+    ares_submit_t *next = rev->next;
+
+    if (status == ARES_SUCCESS) {
+      ares_submit_start(channel, rev);
+    } else {
+      ares_submit_fail(rev, status);
+    }
+    ares_submit_free(rev);
+    cnt++;
+    rev = next;
+  }
+  ares_write_defer_end(channel);
+
+  ares_atomic_size_sub(&channel->submit_pending, cnt);
+  ares_queue_notify_empty(channel);
+}
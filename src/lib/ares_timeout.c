@@ -76,6 +76,28 @@ void ares_timeval_diff(ares_timeval_t *tvdiff, const ares_timeval_t *tvstart,
   }
 }
 
+ares_uint64_t ares_timeval_to_ms(const ares_timeval_t *tv,
+                                 ares_bool_t           round_up)
+{
+  ares_uint64_t ms;
+
+  if (tv->sec < 0) {
+    return 0;
+  }
+
+  ms = (ares_uint64_t)tv->sec * 1000 + tv->usec / 1000;
+  if (round_up && tv->usec % 1000 != 0) {
+    ms++;
+  }
+  return ms;
+}
+
+void ares_timeval_from_ms(ares_timeval_t *tv, ares_uint64_t ms)
+{
+  tv->sec  = (ares_int64_t)(ms / 1000);
+  tv->usec = (unsigned int)((ms % 1000) * 1000);
+}
+
 static void ares_timeval_to_struct_timeval(struct timeval       *tv,
                                            const ares_timeval_t *atv)
 {
@@ -95,29 +117,120 @@ static void struct_timeval_to_ares_timeval(ares_timeval_t       *atv,
   atv->usec = (unsigned int)tv->tv_usec;
 }
 
+struct ares_timer {
+  ares_channel_t         *channel;
+  ares_timerwheel_node_t *node;
+  ares_timer_cb_t         callback;
+  void                   *arg;
+};
+
+ares_timer_t *ares_timer_create(ares_channel_t *channel, size_t timeout_ms,
+                                ares_timer_cb_t callback, void *arg)
+{
+  ares_timer_t  *timer;
+  ares_timeval_t expire;
+
+  timer = ares_malloc_zero(sizeof(*timer));
+  if (timer == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  timer->channel  = channel;
+  timer->callback = callback;
+  timer->arg      = arg;
+
+  ares_tvnow(&expire);
+  ares_timeval_add(&expire, timeout_ms);
+  timer->node = ares_timerwheel_insert(
+    channel->timers, ares_timeval_to_ms(&expire, ARES_TRUE), timer);
+  if (timer->node == NULL) {
+    ares_free(timer); /* LCOV_EXCL_LINE: OutOfMemory */
+    return NULL;      /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return timer;
+}
+
+void ares_timer_destroy(ares_timer_t *timer)
+{
+  if (timer == NULL) {
+    return;
+  }
+
+  ares_timerwheel_node_destroy(timer->node);
+  ares_free(timer);
+}
+
+void ares_timers_process(ares_channel_t *channel, const ares_timeval_t *now)
+{
+  ares_timerwheel_node_t *node;
+  ares_uint64_t           now_ms = ares_timeval_to_ms(now, ARES_FALSE);
+
+  /* The callback may create or destroy other timers, so always restart from
+   * the first expired one */
+  while ((node = ares_timerwheel_first_expired(channel->timers, now_ms)) !=
+         NULL) {
+    ares_timer_t   *timer    = ares_timerwheel_node_claim(node);
+    ares_timer_cb_t callback = timer->callback;
+    void           *arg      = timer->arg;
+
+    ares_free(timer);
+    callback(arg);
+  }
+}
+
 static struct timeval *ares_timeout_int(const ares_channel_t *channel,
                                         struct timeval       *maxtv,
                                         struct timeval       *tvbuf)
 {
-  const ares_query_t *query;
-  ares_slist_node_t  *node;
-  ares_timeval_t      now;
-  ares_timeval_t      atvbuf;
-  ares_timeval_t      amaxtv;
-
-  /* The minimum timeout of all queries is always the first entry in
-   * channel->queries_by_timeout */
-  node = ares_slist_node_first(channel->queries_by_timeout);
+  const ares_query_t   *stale_query;
+  const ares_timeval_t *timeout;
+  ares_uint64_t         timeout_ms;
+  ares_uint64_t         next_ms;
+  ares_bool_t           have_timeout;
+  ares_timeval_t        query_timeout;
+  ares_timeval_t        now;
+  ares_timeval_t        atvbuf;
+  ares_timeval_t        amaxtv;
+
+  have_timeout =
+    ares_timerwheel_next_expire(channel->queries_by_timeout, &timeout_ms);
+
+  /* Queries waiting to be hedged to another server and channel timers may
+   * need to be woken up earlier */
+  if (ares_timerwheel_next_expire(channel->queries_by_hedge, &next_ms) &&
+      (!have_timeout || next_ms < timeout_ms)) {
+    timeout_ms   = next_ms;
+    have_timeout = ARES_TRUE;
+  }
+
+  if (ares_timerwheel_next_expire(channel->timers, &next_ms) &&
+      (!have_timeout || next_ms < timeout_ms)) {
+    timeout_ms   = next_ms;
+    have_timeout = ARES_TRUE;
+  }
+
   /* no queries/timeout */
-  if (node == NULL) {
+  if (!have_timeout) {
     return maxtv;
   }
 
-  query = ares_slist_node_val(node);
+  ares_timeval_from_ms(&query_timeout, timeout_ms);
+  timeout = &query_timeout;
+
+  /* Queries waiting to be answered from a stale cache entry may need to be
+   * woken up earlier */
+  stale_query = ares_slist_first_val(channel->queries_by_stale);
+  if (stale_query != NULL &&
+      (stale_query->stale_timeout.sec < timeout->sec ||
+       (stale_query->stale_timeout.sec == timeout->sec &&
+        stale_query->stale_timeout.usec < timeout->usec))) {
+    timeout = &stale_query->stale_timeout;
+  }
 
   ares_tvnow(&now);
 
-  ares_timeval_remaining(&atvbuf, &now, &query->timeout);
+  ares_timeval_remaining(&atvbuf, &now, timeout);
 
   ares_timeval_to_struct_timeval(tvbuf, &atvbuf);
 
@@ -695,6 +695,7 @@ static ares_status_t ares_server_create(ares_channel_t       *channel,
     status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
     goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
   }
+  ares_llist_set_pool(server->connections, channel->llist_node_pool);
 
   if (ares_slist_insert(channel->servers, server) == NULL) {
     status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
@@ -840,10 +841,28 @@ ares_status_t ares_servers_update(ares_channel_t *channel,
   }
 
   /* Clear any cached query results only if the server list changed */
-  if (list_changed) {
+  if (list_changed && ares_channel_owns_qcache(channel)) {
     ares_qcache_flush(channel->qcache);
   }
 
+  if (list_changed) {
+    ares_search_negcache_flush(channel->search_negcache);
+  }
+
+  /* Shards read the system configuration on their own, but user-specified
+   * servers must be applied to all of them */
+  if (user_specified) {
+    size_t i;
+    for (i = 0; i < channel->nshards; i++) {
+      ares_channel_lock(channel->shards[i]);
+      status = ares_servers_update(channel->shards[i], server_list, ARES_TRUE);
+      ares_channel_unlock(channel->shards[i]);
+      if (status != ARES_SUCCESS) {
+        goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+  }
+
   status = ARES_SUCCESS;
 
 done:
@@ -1372,9 +1391,15 @@ done:
 void ares_set_server_state_callback(ares_channel_t            *channel,
                                     ares_server_state_callback cb, void *data)
 {
+  size_t i;
+
   if (channel == NULL) {
     return; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
   channel->server_state_cb      = cb;
   channel->server_state_cb_data = data;
+
+  for (i = 0; i < channel->nshards; i++) {
+    ares_set_server_state_callback(channel->shards[i], cb, data);
+  }
 }
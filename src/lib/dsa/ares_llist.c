@@ -30,6 +30,7 @@ struct ares_llist {
   ares_llist_node_t      *head;
   ares_llist_node_t      *tail;
   ares_llist_destructor_t destruct;
+  ares_pool_t            *pool;
   size_t                  cnt;
 };
 
@@ -38,6 +39,7 @@ struct ares_llist_node {
   ares_llist_node_t *prev;
   ares_llist_node_t *next;
   ares_llist_t      *parent;
+  ares_pool_t       *pool; /* Pool node was allocated from, if any */
 };
 
 ares_llist_t *ares_llist_create(ares_llist_destructor_t destruct)
@@ -63,6 +65,20 @@ void ares_llist_replace_destructor(ares_llist_t           *list,
   list->destruct = destruct;
 }
 
+size_t ares_llist_node_size(void)
+{
+  return sizeof(ares_llist_node_t);
+}
+
+void ares_llist_set_pool(ares_llist_t *list, ares_pool_t *pool)
+{
+  if (list == NULL) {
+    return;
+  }
+
+  list->pool = pool;
+}
+
 typedef enum {
   ARES__LLIST_INSERT_HEAD,
   ARES__LLIST_INSERT_TAIL,
@@ -129,13 +145,18 @@ static ares_llist_node_t *ares_llist_insert_at(ares_llist_t            *list,
     return NULL; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
-  node = ares_malloc_zero(sizeof(*node));
+  if (list->pool != NULL) {
+    node = ares_pool_alloc(list->pool);
+  } else {
+    node = ares_malloc_zero(sizeof(*node));
+  }
 
   if (node == NULL) {
     return NULL;
   }
 
   node->data = val;
+  node->pool = list->pool;
   ares_llist_attach_at(list, type, at, node);
 
   return node;
@@ -302,7 +323,11 @@ void *ares_llist_node_claim(ares_llist_node_t *node)
 
   val = node->data;
   ares_llist_node_detach(node);
-  ares_free(node);
+  if (node->pool != NULL) {
+    ares_pool_free(node->pool, node);
+  } else {
+    ares_free(node);
+  }
 
   return val;
 }
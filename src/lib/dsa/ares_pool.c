@@ -0,0 +1,281 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ares_private.h"
+#include "ares_pool.h"
+
+#define ARES_POOL_DEFAULT_SLAB_CNT 32
+
+/* Alignment suitable for any object stored in a pool */
+typedef union {
+  void  *p;
+  double d;
+  size_t s;
+  long   l;
+} ares_pool_align_t;
+
+#define ARES_POOL_ALIGN(x) \
+  ((((x) + sizeof(ares_pool_align_t) - 1) / sizeof(ares_pool_align_t)) * \
+   sizeof(ares_pool_align_t))
+
+typedef struct ares_pool_slab ares_pool_slab_t;
+
+/* Slabs with free slots are kept at the front of the list and full slabs at
+ * the back, so the head is the only slab allocations ever need to look at */
+struct ares_pool_slab {
+  ares_pool_slab_t *prev;
+  ares_pool_slab_t *next;
+  void             *free; /* chain of free slots, linked through the object */
+  size_t            used;
+};
+
+/* Each slot is a pointer to its slab followed by the object */
+typedef struct {
+  ares_pool_slab_t *slab;
+} ares_pool_slot_t;
+
+struct ares_pool {
+  size_t            obj_size;
+  size_t            slot_size;
+  size_t            slab_cnt;
+  ares_pool_slab_t *head;
+  ares_pool_slab_t *tail;
+  size_t            empty_slabs;
+  size_t            cnt;
+};
+
+#define ARES_POOL_SLAB_HDR_SIZE ARES_POOL_ALIGN(sizeof(ares_pool_slab_t))
+#define ARES_POOL_SLOT_HDR_SIZE ARES_POOL_ALIGN(sizeof(ares_pool_slot_t))
+
+ares_pool_t *ares_pool_create(size_t obj_size, size_t slab_cnt)
+{
+  ares_pool_t *pool;
+
+  if (obj_size == 0) {
+    return NULL;
+  }
+
+  pool = ares_malloc_zero(sizeof(*pool));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  /* A free object holds the pointer to the next free slot */
+  if (obj_size < sizeof(void *)) {
+    obj_size = sizeof(void *);
+  }
+
+  pool->obj_size  = obj_size;
+  pool->slot_size = ARES_POOL_SLOT_HDR_SIZE + ARES_POOL_ALIGN(obj_size);
+  pool->slab_cnt  = slab_cnt == 0 ? ARES_POOL_DEFAULT_SLAB_CNT : slab_cnt;
+
+  return pool;
+}
+
+void ares_pool_destroy(ares_pool_t *pool)
+{
+  ares_pool_slab_t *slab;
+
+  if (pool == NULL) {
+    return;
+  }
+
+  slab = pool->head;
+  while (slab != NULL) {
+    ares_pool_slab_t *next = slab->next;
+    ares_free(slab);
+    slab = next;
+  }
+
+  ares_free(pool);
+}
+
+static void ares_pool_slab_unlink(ares_pool_t *pool, ares_pool_slab_t *slab)
+{
+  if (slab->prev != NULL) {
+    slab->prev->next = slab->next;
+  } else {
+    pool->head = slab->next;
+  }
+
+  if (slab->next != NULL) {
+    slab->next->prev = slab->prev;
+  } else {
+    pool->tail = slab->prev;
+  }
+
+  slab->prev = NULL;
+  slab->next = NULL;
+}
+
+static void ares_pool_slab_link_head(ares_pool_t *pool, ares_pool_slab_t *slab)
+{
+  slab->prev = NULL;
+  slab->next = pool->head;
+  if (pool->head != NULL) {
+    pool->head->prev = slab;
+  } else {
+    pool->tail = slab;
+  }
+  pool->head = slab;
+}
+
+static void ares_pool_slab_link_tail(ares_pool_t *pool, ares_pool_slab_t *slab)
+{
+  slab->next = NULL;
+  slab->prev = pool->tail;
+  if (pool->tail != NULL) {
+    pool->tail->next = slab;
+  } else {
+    pool->head = slab;
+  }
+  pool->tail = slab;
+}
+
+static ares_pool_slot_t *ares_pool_obj_slot(void *obj)
+{
+  return (ares_pool_slot_t *)((void *)((unsigned char *)obj -
+                                       ARES_POOL_SLOT_HDR_SIZE));
+}
+
+static void *ares_pool_slot_obj(ares_pool_slot_t *slot)
+{
+  return (unsigned char *)slot + ARES_POOL_SLOT_HDR_SIZE;
+}
+
+static ares_pool_slab_t *ares_pool_slab_create(ares_pool_t *pool)
+{
+  ares_pool_slab_t *slab;
+  unsigned char    *ptr;
+  size_t            i;
+
+  slab =
+    ares_malloc(ARES_POOL_SLAB_HDR_SIZE + (pool->slot_size * pool->slab_cnt));
+  if (slab == NULL) {
+    return NULL;
+  }
+
+  slab->prev = NULL;
+  slab->next = NULL;
+  slab->used = 0;
+  slab->free = NULL;
+
+  /* Chain the slots in reverse so they are handed out in address order */
+  ptr = (unsigned char *)slab + ARES_POOL_SLAB_HDR_SIZE;
+  for (i = pool->slab_cnt; i-- > 0;) {
+    ares_pool_slot_t *slot =
+      (ares_pool_slot_t *)((void *)(ptr + (i * pool->slot_size)));
+    void **obj = ares_pool_slot_obj(slot);
+
+    slot->slab = slab;
+    *obj       = slab->free;
+    slab->free = obj;
+  }
+
+  pool->empty_slabs++;
+  return slab;
+}
+
+void *ares_pool_alloc(ares_pool_t *pool)
+{
+  ares_pool_slab_t *slab;
+  void            **obj;
+
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  slab = pool->head;
+  if (slab == NULL || slab->free == NULL) {
+    slab = ares_pool_slab_create(pool);
+    if (slab == NULL) {
+      return NULL;
+    }
+    ares_pool_slab_link_head(pool, slab);
+  }
+
+  obj        = slab->free;
+  slab->free = *obj;
+  if (slab->used++ == 0) {
+    pool->empty_slabs--;
+  }
+
+  /* Out of free slots, move out of the way */
+  if (slab->free == NULL) {
+    ares_pool_slab_unlink(pool, slab);
+    ares_pool_slab_link_tail(pool, slab);
+  }
+
+  pool->cnt++;
+  memset(obj, 0, pool->obj_size);
+  return obj;
+}
+
+void ares_pool_free(ares_pool_t *pool, void *obj)
+{
+  ares_pool_slab_t *slab;
+  ares_pool_slot_t *slot;
+
+  if (pool == NULL || obj == NULL) {
+    return;
+  }
+
+  slot = ares_pool_obj_slot(obj);
+  slab = slot->slab;
+
+  /* Was full, it has a free slot again so belongs at the front */
+  if (slab->free == NULL) {
+    ares_pool_slab_unlink(pool, slab);
+    ares_pool_slab_link_head(pool, slab);
+  }
+
+  *((void **)obj) = slab->free;
+  slab->free      = obj;
+  slab->used--;
+  pool->cnt--;
+
+  if (slab->used != 0) {
+    return;
+  }
+
+  /* Keep a single empty slab around so a pool hovering around a slab
+   * boundary doesn't allocate and free one on every call */
+  if (pool->empty_slabs == 0) {
+    pool->empty_slabs++;
+    return;
+  }
+
+  ares_pool_slab_unlink(pool, slab);
+  ares_free(slab);
+}
+
+size_t ares_pool_len(const ares_pool_t *pool)
+{
+  if (pool == NULL) {
+    return 0;
+  }
+  return pool->cnt;
+}
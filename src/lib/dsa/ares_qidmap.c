@@ -0,0 +1,140 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+#include "ares_qidmap.h"
+
+#define ARES_QIDMAP_PAGE_BITS 8
+#define ARES_QIDMAP_PAGE_SIZE (1 << ARES_QIDMAP_PAGE_BITS)
+#define ARES_QIDMAP_NUM_PAGES (65536 >> ARES_QIDMAP_PAGE_BITS)
+
+typedef struct {
+  void  *vals[ARES_QIDMAP_PAGE_SIZE];
+  size_t cnt;
+} ares_qidmap_page_t;
+
+struct ares_qidmap {
+  ares_qidmap_page_t *pages[ARES_QIDMAP_NUM_PAGES];
+  size_t              cnt;
+};
+
+ares_qidmap_t *ares_qidmap_create(void)
+{
+  return ares_malloc_zero(sizeof(ares_qidmap_t));
+}
+
+void ares_qidmap_destroy(ares_qidmap_t *map)
+{
+  size_t i;
+
+  if (map == NULL) {
+    return;
+  }
+
+  for (i = 0; i < ARES_QIDMAP_NUM_PAGES; i++) {
+    ares_free(map->pages[i]);
+  }
+  ares_free(map);
+}
+
+ares_bool_t ares_qidmap_insert(ares_qidmap_t *map, unsigned short id,
+                               void *val)
+{
+  ares_qidmap_page_t *page;
+  size_t              idx = id & (ARES_QIDMAP_PAGE_SIZE - 1);
+
+  /* NULL marks an unused slot so can't be stored */
+  if (map == NULL || val == NULL) {
+    return ARES_FALSE;
+  }
+
+  page = map->pages[id >> ARES_QIDMAP_PAGE_BITS];
+  if (page == NULL) {
+    page = ares_malloc_zero(sizeof(*page));
+    if (page == NULL) {
+      return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    map->pages[id >> ARES_QIDMAP_PAGE_BITS] = page;
+  }
+
+  if (page->vals[idx] == NULL) {
+    page->cnt++;
+    map->cnt++;
+  }
+  page->vals[idx] = val;
+  return ARES_TRUE;
+}
+
+void *ares_qidmap_get(const ares_qidmap_t *map, unsigned short id)
+{
+  const ares_qidmap_page_t *page;
+
+  if (map == NULL) {
+    return NULL;
+  }
+
+  page = map->pages[id >> ARES_QIDMAP_PAGE_BITS];
+  if (page == NULL) {
+    return NULL;
+  }
+
+  return page->vals[id & (ARES_QIDMAP_PAGE_SIZE - 1)];
+}
+
+ares_bool_t ares_qidmap_remove(ares_qidmap_t *map, unsigned short id)
+{
+  ares_qidmap_page_t *page;
+  size_t              idx = id & (ARES_QIDMAP_PAGE_SIZE - 1);
+
+  if (map == NULL) {
+    return ARES_FALSE;
+  }
+
+  page = map->pages[id >> ARES_QIDMAP_PAGE_BITS];
+  if (page == NULL || page->vals[idx] == NULL) {
+    return ARES_FALSE;
+  }
+
+  page->vals[idx] = NULL;
+  page->cnt--;
+  map->cnt--;
+
+  /* Release pages once empty so a burst of queries doesn't permanently grow
+   * the channel */
+  if (page->cnt == 0) {
+    ares_free(page);
+    map->pages[id >> ARES_QIDMAP_PAGE_BITS] = NULL;
+  }
+
+  return ARES_TRUE;
+}
+
+size_t ares_qidmap_len(const ares_qidmap_t *map)
+{
+  if (map == NULL) {
+    return 0;
+  }
+  return map->cnt;
+}
@@ -0,0 +1,413 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+#include "ares_timerwheel.h"
+
+#define ARES_TIMERWHEEL_BITS   5
+#define ARES_TIMERWHEEL_SLOTS  (1 << ARES_TIMERWHEEL_BITS)
+#define ARES_TIMERWHEEL_MASK   (ARES_TIMERWHEEL_SLOTS - 1)
+/* 6 levels of 5 bits cover 2^30ms (~12 days) ahead of the current time */
+#define ARES_TIMERWHEEL_LEVELS 6
+
+/* Deadlines too far ahead for the top level, or beyond a wrap of the top
+ * level, are kept in a single overflow slot after the regular slots */
+#define ARES_TIMERWHEEL_OVERFLOW \
+  (ARES_TIMERWHEEL_LEVELS * ARES_TIMERWHEEL_SLOTS)
+#define ARES_TIMERWHEEL_NUM_SLOTS (ARES_TIMERWHEEL_OVERFLOW + 1)
+
+/* Slot index for nodes on the expired list */
+#define ARES_TIMERWHEEL_EXPIRED ARES_TIMERWHEEL_NUM_SLOTS
+
+struct ares_timerwheel_node {
+  ares_timerwheel_t      *parent;
+  ares_timerwheel_node_t *prev;
+  ares_timerwheel_node_t *next;
+  ares_uint64_t           expire;
+  size_t                  slot;
+  void                   *val;
+};
+
+typedef struct {
+  ares_timerwheel_node_t *head;
+  /* Earliest deadline in the slot and how many nodes share it.  When the last
+   * of those is removed the slot is marked dirty and rescanned on demand.
+   * Level 0 slots only ever hold a single deadline. */
+  ares_uint64_t           min;
+  size_t                  min_cnt;
+  ares_bool_t             min_dirty;
+} ares_timerwheel_slot_t;
+
+struct ares_timerwheel {
+  /* Time the wheel has been advanced to, everything at or before this is on
+   * the expired list */
+  ares_uint64_t           cur;
+  ares_timerwheel_slot_t  slots[ARES_TIMERWHEEL_NUM_SLOTS];
+  /* Bitmap of non-empty slots for each level */
+  unsigned int            used[ARES_TIMERWHEEL_LEVELS];
+  ares_timerwheel_node_t *expired_head;
+  ares_timerwheel_node_t *expired_tail;
+  size_t                  cnt;
+  /* Every tracked query has a node, so they come from a pool */
+  ares_pool_t            *node_pool;
+};
+
+ares_timerwheel_t *ares_timerwheel_create(void)
+{
+  ares_timerwheel_t *wheel = ares_malloc_zero(sizeof(*wheel));
+
+  if (wheel == NULL) {
+    return NULL;
+  }
+
+  wheel->node_pool = ares_pool_create(sizeof(ares_timerwheel_node_t), 0);
+  if (wheel->node_pool == NULL) {
+    ares_free(wheel); /* LCOV_EXCL_LINE: OutOfMemory */
+    return NULL;      /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return wheel;
+}
+
+static void ares_timerwheel_slot_link(ares_timerwheel_t      *wheel,
+                                      ares_timerwheel_node_t *node,
+                                      size_t                  idx)
+{
+  ares_timerwheel_slot_t *slot = &wheel->slots[idx];
+
+  node->slot = idx;
+  node->prev = NULL;
+  node->next = slot->head;
+
+  if (slot->head == NULL) {
+    slot->min       = node->expire;
+    slot->min_cnt   = 1;
+    slot->min_dirty = ARES_FALSE;
+    if (idx < ARES_TIMERWHEEL_OVERFLOW) {
+      wheel->used[idx / ARES_TIMERWHEEL_SLOTS] |=
+        1U << (idx % ARES_TIMERWHEEL_SLOTS);
+    }
+  } else {
+    slot->head->prev = node;
+    if (!slot->min_dirty) {
+      if (node->expire < slot->min) {
+        slot->min     = node->expire;
+        slot->min_cnt = 1;
+      } else if (node->expire == slot->min) {
+        slot->min_cnt++;
+      }
+    }
+  }
+
+  slot->head = node;
+}
+
+static void ares_timerwheel_expired_link(ares_timerwheel_t      *wheel,
+                                         ares_timerwheel_node_t *node)
+{
+  node->slot = ARES_TIMERWHEEL_EXPIRED;
+  node->next = NULL;
+  node->prev = wheel->expired_tail;
+  if (wheel->expired_tail != NULL) {
+    wheel->expired_tail->next = node;
+  } else {
+    wheel->expired_head = node;
+  }
+  wheel->expired_tail = node;
+}
+
+/* File the node on the lowest level whose span covers its deadline.  All
+ * nodes on a level share the digits above that level with the current
+ * time, and have a larger digit on that level, so lower levels always
+ * expire first. */
+static void ares_timerwheel_place(ares_timerwheel_t      *wheel,
+                                  ares_timerwheel_node_t *node)
+{
+  ares_uint64_t diff;
+  size_t        level = 0;
+
+  if (node->expire <= wheel->cur) {
+    ares_timerwheel_expired_link(wheel, node);
+    return;
+  }
+
+  diff = node->expire ^ wheel->cur;
+  while (level < ARES_TIMERWHEEL_LEVELS &&
+         (diff >> (ARES_TIMERWHEEL_BITS * (level + 1))) != 0) {
+    level++;
+  }
+
+  if (level == ARES_TIMERWHEEL_LEVELS) {
+    ares_timerwheel_slot_link(wheel, node, ARES_TIMERWHEEL_OVERFLOW);
+    return;
+  }
+
+  ares_timerwheel_slot_link(
+    wheel, node,
+    level * ARES_TIMERWHEEL_SLOTS +
+      (size_t)((node->expire >> (ARES_TIMERWHEEL_BITS * level)) &
+               ARES_TIMERWHEEL_MASK));
+}
+
+static void ares_timerwheel_unlink(ares_timerwheel_node_t *node)
+{
+  ares_timerwheel_t      *wheel = node->parent;
+  ares_timerwheel_slot_t *slot;
+
+  if (node->slot == ARES_TIMERWHEEL_EXPIRED) {
+    if (node->prev != NULL) {
+      node->prev->next = node->next;
+    } else {
+      wheel->expired_head = node->next;
+    }
+    if (node->next != NULL) {
+      node->next->prev = node->prev;
+    } else {
+      wheel->expired_tail = node->prev;
+    }
+    node->prev = NULL;
+    node->next = NULL;
+    return;
+  }
+
+  slot = &wheel->slots[node->slot];
+  if (node->prev != NULL) {
+    node->prev->next = node->next;
+  } else {
+    slot->head = node->next;
+  }
+  if (node->next != NULL) {
+    node->next->prev = node->prev;
+  }
+  node->prev = NULL;
+  node->next = NULL;
+
+  if (slot->head == NULL) {
+    if (node->slot < ARES_TIMERWHEEL_OVERFLOW) {
+      wheel->used[node->slot / ARES_TIMERWHEEL_SLOTS] &=
+        ~(1U << (node->slot % ARES_TIMERWHEEL_SLOTS));
+    }
+    slot->min_dirty = ARES_FALSE;
+  } else if (!slot->min_dirty && node->expire == slot->min) {
+    slot->min_cnt--;
+    if (slot->min_cnt == 0) {
+      slot->min_dirty = ARES_TRUE;
+    }
+  }
+}
+
+/* Find the non-empty slot holding the earliest deadlines, and the time at
+ * which that slot starts */
+static ares_bool_t ares_timerwheel_earliest_slot(const ares_timerwheel_t *wheel,
+                                                 size_t                  *idx,
+                                                 ares_uint64_t           *start)
+{
+  size_t level;
+
+  for (level = 0; level < ARES_TIMERWHEEL_LEVELS; level++) {
+    size_t       shift = ARES_TIMERWHEEL_BITS * (level + 1);
+    unsigned int used  = wheel->used[level];
+    size_t       digit;
+
+    if (used == 0) {
+      continue;
+    }
+
+    /* Lowest set bit */
+    digit  = ares_log2((size_t)(used & (0U - used)));
+    *idx   = level * ARES_TIMERWHEEL_SLOTS + digit;
+    *start = ((wheel->cur >> shift) << shift) |
+             ((ares_uint64_t)digit << (ARES_TIMERWHEEL_BITS * level));
+    return ARES_TRUE;
+  }
+
+  if (wheel->slots[ARES_TIMERWHEEL_OVERFLOW].head != NULL) {
+    size_t shift = ARES_TIMERWHEEL_BITS * ARES_TIMERWHEEL_LEVELS;
+    *idx         = ARES_TIMERWHEEL_OVERFLOW;
+    *start       = ((wheel->cur >> shift) + 1) << shift;
+    return ARES_TRUE;
+  }
+
+  return ARES_FALSE;
+}
+
+static void ares_timerwheel_advance(ares_timerwheel_t *wheel, ares_uint64_t now)
+{
+  size_t        idx;
+  ares_uint64_t start;
+
+  /* Move to the start of each slot that has been reached in turn, and
+   * redistribute its nodes relative to that time.  They either expire or
+   * land on a lower level, which is then picked up by a later iteration. */
+  while (ares_timerwheel_earliest_slot(wheel, &idx, &start) && start <= now) {
+    ares_timerwheel_node_t *node = wheel->slots[idx].head;
+
+    wheel->cur             = start;
+    wheel->slots[idx].head = NULL;
+    if (idx < ARES_TIMERWHEEL_OVERFLOW) {
+      wheel->used[idx / ARES_TIMERWHEEL_SLOTS] &=
+        ~(1U << (idx % ARES_TIMERWHEEL_SLOTS));
+    }
+
+    while (node != NULL) {
+      ares_timerwheel_node_t *next = node->next;
+      ares_timerwheel_place(wheel, node);
+      node = next;
+    }
+  }
+
+  if (now > wheel->cur) {
+    wheel->cur = now;
+  }
+}
+
+ares_timerwheel_node_t *ares_timerwheel_insert(ares_timerwheel_t *wheel,
+                                               ares_uint64_t expire, void *val)
+{
+  ares_timerwheel_node_t *node;
+
+  if (wheel == NULL) {
+    return NULL;
+  }
+
+  node = ares_pool_alloc(wheel->node_pool);
+  if (node == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  node->parent = wheel;
+  node->expire = expire;
+  node->val    = val;
+  ares_timerwheel_place(wheel, node);
+  wheel->cnt++;
+
+  return node;
+}
+
+ares_timerwheel_node_t *ares_timerwheel_first_expired(ares_timerwheel_t *wheel,
+                                                      ares_uint64_t      now)
+{
+  if (wheel == NULL) {
+    return NULL;
+  }
+
+  ares_timerwheel_advance(wheel, now);
+  return wheel->expired_head;
+}
+
+ares_bool_t ares_timerwheel_next_expire(ares_timerwheel_t *wheel,
+                                        ares_uint64_t     *expire)
+{
+  ares_timerwheel_slot_t       *slot;
+  const ares_timerwheel_node_t *node;
+  size_t                        idx;
+  ares_uint64_t                 start;
+
+  if (wheel == NULL || expire == NULL) {
+    return ARES_FALSE;
+  }
+
+  if (wheel->expired_head != NULL) {
+    *expire = wheel->expired_head->expire;
+    return ARES_TRUE;
+  }
+
+  if (!ares_timerwheel_earliest_slot(wheel, &idx, &start)) {
+    return ARES_FALSE;
+  }
+
+  slot = &wheel->slots[idx];
+  if (slot->min_dirty) {
+    slot->min     = slot->head->expire;
+    slot->min_cnt = 0;
+    for (node = slot->head; node != NULL; node = node->next) {
+      if (node->expire < slot->min) {
+        slot->min     = node->expire;
+        slot->min_cnt = 1;
+      } else if (node->expire == slot->min) {
+        slot->min_cnt++;
+      }
+    }
+    slot->min_dirty = ARES_FALSE;
+  }
+
+  *expire = slot->min;
+  return ARES_TRUE;
+}
+
+void *ares_timerwheel_node_val(const ares_timerwheel_node_t *node)
+{
+  if (node == NULL) {
+    return NULL;
+  }
+  return node->val;
+}
+
+ares_uint64_t ares_timerwheel_node_expire(const ares_timerwheel_node_t *node)
+{
+  if (node == NULL) {
+    return 0;
+  }
+  return node->expire;
+}
+
+void *ares_timerwheel_node_claim(ares_timerwheel_node_t *node)
+{
+  void *val;
+
+  if (node == NULL) {
+    return NULL;
+  }
+
+  ares_timerwheel_unlink(node);
+  node->parent->cnt--;
+  val = node->val;
+  ares_pool_free(node->parent->node_pool, node);
+  return val;
+}
+
+void ares_timerwheel_node_destroy(ares_timerwheel_node_t *node)
+{
+  ares_timerwheel_node_claim(node);
+}
+
+size_t ares_timerwheel_len(const ares_timerwheel_t *wheel)
+{
+  if (wheel == NULL) {
+    return 0;
+  }
+  return wheel->cnt;
+}
+
+void ares_timerwheel_destroy(ares_timerwheel_t *wheel)
+{
+  if (wheel == NULL) {
+    return;
+  }
+
+  /* Releases any nodes still in the wheel */
+  ares_pool_destroy(wheel->node_pool);
+  ares_free(wheel);
+}
@@ -176,6 +176,10 @@ extern const ares_event_sys_t ares_evsys_kqueue;
 extern const ares_event_sys_t ares_evsys_epoll;
 #  endif
 
+#  ifdef HAVE_IO_URING
+extern const ares_event_sys_t ares_evsys_io_uring;
+#  endif
+
 #  ifdef _WIN32
 extern const ares_event_sys_t ares_evsys_win32;
 #  endif
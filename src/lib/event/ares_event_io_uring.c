@@ -0,0 +1,1106 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+#include "ares_event.h"
+
+#if defined(HAVE_IO_URING) && defined(CARES_THREADS)
+
+#  include <linux/io_uring.h>
+#  include <sys/syscall.h>
+#  include <sys/mman.h>
+#  include <sys/socket.h>
+#  include <poll.h>
+
+/* Readiness is tracked with multishot IORING_OP_POLL_ADD requests, so an
+ * armed socket costs no syscalls until it changes state, and every add, modify
+ * and remove queued between waits is submitted by the same io_uring_enter()
+ * that waits for completions.
+ *
+ * UDP sockets using the default socket functions go further: a multishot
+ * IORING_OP_RECVMSG per socket fills buffers from a registered buffer ring,
+ * the datagrams are queued per socket and handed out by the channel's
+ * dgram_recv_cb, and queries are sent as IORING_OP_SENDMSG requests submitted
+ * together through dgram_send_cb.  Sockets from user supplied socket
+ * functions, TCP, and kernels without multishot receive (5.19 for buffer
+ * rings, 6.0 for multishot recvmsg) only get readiness. */
+
+#  define ARES_URING_ENTRIES 128
+
+/* Provided receive buffers, must be a power of 2 */
+#  define ARES_URING_BUFS        32
+/* Minimum payload size per receive buffer.  Matches the slot size of batched
+ * UDP reads, larger datagrams are discarded the same way. */
+#  define ARES_URING_BUF_PAYLOAD 4096
+/* Datagrams queued per socket before new ones are dropped, like a full socket
+ * receive buffer */
+#  define ARES_URING_RX_MAX      64
+/* Sends in flight */
+#  define ARES_URING_SENDS       64
+
+/* The upper 32 bits of user_data identify the request, the lower 32 bits hold
+ * the fd (or the send slot).  Poll tokens never have the high bit set, a
+ * receive carries the socket id with it, and 0 is used for requests whose
+ * completions are ignored (removals and cancellations). */
+#  define ARES_URING_TOKEN_MASK 0x7FFFFFFFU
+#  define ARES_URING_TOKEN_RECV 0x80000000U
+#  define ARES_URING_TOKEN_SEND 0xFFFFFFFFU
+
+/*! A received datagram, or a socket error to report in its place */
+typedef struct {
+  ares_conn_err_t         err;
+  size_t                  len;
+  struct sockaddr_storage addr;
+  ares_socklen_t          addr_len;
+  /* Followed by len bytes of payload */
+} ares_uring_dgram_t;
+
+typedef struct {
+  ares_socket_t      fd;
+  /*! Unique for the life of the socket, never 0 */
+  unsigned int       id;
+  /*! Token of the armed poll, 0 if none is armed */
+  unsigned int       poll_token;
+  /*! Whether datagrams are received through the ring */
+  ares_bool_t        dgram;
+  /*! Whether the multishot receive is armed */
+  ares_bool_t        recv_armed;
+  /*! Queue of ares_uring_dgram_t not yet read by the channel */
+  ares_llist_t      *rx;
+  /*! Node in the notify list while a read event is due */
+  ares_llist_node_t *notify_node;
+} ares_uring_sock_t;
+
+typedef struct {
+  ares_bool_t             in_use;
+  ares_socket_t           fd;
+  unsigned int            sock_id;
+  struct msghdr           msg;
+  struct iovec            iov;
+  struct sockaddr_storage addr;
+  unsigned char          *buf;
+  size_t                  buf_size;
+} ares_uring_send_t;
+
+typedef struct {
+  int                  ring_fd;
+  void                *ring_ptr;
+  size_t               ring_sz;
+  struct io_uring_sqe *sqes;
+  size_t               sqes_sz;
+
+  unsigned int        *sq_head;
+  unsigned int        *sq_tail;
+  unsigned int        *sq_array;
+  unsigned int         sq_mask;
+  unsigned int         sq_entries;
+  unsigned int         sq_local_tail;
+  unsigned int         to_submit;
+
+  unsigned int        *cq_head;
+  unsigned int        *cq_tail;
+  struct io_uring_cqe *cqes;
+  unsigned int         cq_mask;
+
+  /*! ares_uring_sock_t for each armed socket.  Completions carry the token
+   *  they were armed with, so those from removed or re-armed requests (or
+   *  from a reused fd number) are recognized as stale. */
+  ares_htable_asvp_t  *socks;
+  unsigned int         next_token;
+  /*! Cleared if the kernel rejects IORING_POLL_ADD_MULTI (pre 5.13), polls are
+   *  then re-armed after every completion */
+  ares_bool_t          multishot;
+
+  /*! Whether new UDP sockets receive through the ring.  Cleared if the buffer
+   *  ring can't be registered, or multishot recvmsg is rejected. */
+  ares_bool_t          dgram;
+  struct io_uring_buf *buf_ring;
+  size_t               buf_ring_sz;
+  unsigned short       buf_tail;
+  unsigned char       *bufs;
+  size_t               bufs_sz;
+  size_t               buf_size;
+  /*! Template for multishot receives, only the name and control lengths are
+   *  used by the kernel */
+  struct msghdr        recv_msg;
+  /*! Sockets with queued datagrams that still need a read event */
+  ares_llist_t        *notify;
+
+  ares_uring_send_t    sends[ARES_URING_SENDS];
+  size_t               send_next;
+} ares_evsys_uring_t;
+
+static ares_uint64_t ares_uring_user_data(ares_socket_t fd, unsigned int token)
+{
+  return ((ares_uint64_t)token << 32) | (ares_uint64_t)(unsigned int)fd;
+}
+
+static unsigned int ares_uring_next_token(ares_evsys_uring_t *ur)
+{
+  do {
+    ur->next_token = (ur->next_token + 1) & ARES_URING_TOKEN_MASK;
+  } while (ur->next_token == 0);
+  return ur->next_token;
+}
+
+static ares_uring_sock_t *ares_uring_sock(const ares_evsys_uring_t *ur,
+                                          ares_socket_t             fd)
+{
+  return ares_htable_asvp_get_direct(ur->socks, fd);
+}
+
+static void ares_uring_sock_destroy(void *arg)
+{
+  ares_uring_sock_t *sock = arg;
+
+  if (sock == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  ares_llist_node_destroy(sock->notify_node);
+  ares_llist_destroy(sock->rx);
+  ares_free(sock);
+}
+
+static int ares_uring_enter(ares_evsys_uring_t *ur, ares_bool_t wait,
+                            unsigned long timeout_ms)
+{
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec      ts;
+  unsigned int                  flags = 0;
+  void                         *argp  = NULL;
+  size_t                        argsz = 0;
+  long                          rv;
+
+  /* Publish queued submissions */
+  __atomic_store_n(ur->sq_tail, ur->sq_local_tail, __ATOMIC_RELEASE);
+
+  if (wait) {
+    flags |= IORING_ENTER_GETEVENTS;
+    if (timeout_ms != 0) {
+      memset(&arg, 0, sizeof(arg));
+      memset(&ts, 0, sizeof(ts));
+      ts.tv_sec  = (long long)(timeout_ms / 1000);
+      ts.tv_nsec = (long long)((timeout_ms % 1000) * 1000000);
+      arg.ts     = (ares_uint64_t)((size_t)&ts);
+      flags     |= IORING_ENTER_EXT_ARG;
+      argp       = &arg;
+      argsz      = sizeof(arg);
+    }
+  }
+
+  rv = syscall(__NR_io_uring_enter, ur->ring_fd, ur->to_submit,
+               wait ? 1U : 0U, flags, argp, argsz);
+  if (rv > 0) {
+    if ((unsigned long)rv > ur->to_submit) {
+      rv = (long)ur->to_submit; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+    ur->to_submit -= (unsigned int)rv;
+  }
+
+  return (int)rv;
+}
+
+static struct io_uring_sqe *ares_uring_get_sqe(ares_evsys_uring_t *ur)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int         idx;
+
+  if (ur->sq_local_tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE) >=
+      ur->sq_entries) {
+    /* Ring is full, hand what we have to the kernel to make room */
+    ares_uring_enter(ur, ARES_FALSE, 0);
+    if (ur->sq_local_tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE) >=
+        ur->sq_entries) {
+      return NULL; /* LCOV_EXCL_LINE: UntestablePath */
+    }
+  }
+
+  idx               = ur->sq_local_tail & ur->sq_mask;
+  sqe               = &ur->sqes[idx];
+  ur->sq_array[idx] = idx;
+  ur->sq_local_tail++;
+  ur->to_submit++;
+
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/* Queue removal of a poll or cancellation of a receive.  Completions of the
+ * old request are stale by now, so even if this can't be queued they are
+ * ignored, and the request dies with the socket. */
+static void ares_uring_cancel(ares_evsys_uring_t *ur, ares_uint64_t user_data,
+                              unsigned char opcode)
+{
+  struct io_uring_sqe *sqe = ares_uring_get_sqe(ur);
+
+  if (sqe == NULL) {
+    return; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+  sqe->opcode    = opcode;
+  sqe->fd        = -1;
+  sqe->addr      = user_data;
+  sqe->user_data = 0;
+}
+
+static ares_bool_t ares_uring_arm(ares_evsys_uring_t      *ur,
+                                  const ares_uring_sock_t *sock,
+                                  ares_event_flags_t       flags)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int         mask = POLLERR | POLLHUP | POLLRDHUP;
+
+  if (sock->poll_token == 0) {
+    return ARES_TRUE;
+  }
+
+  sqe = ares_uring_get_sqe(ur);
+  if (sqe == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  /* Reads on a socket receiving through the ring are reported from its
+   * completions instead */
+  if (flags & ARES_EVENT_FLAG_READ && !sock->dgram) {
+    mask |= POLLIN;
+  }
+  if (flags & ARES_EVENT_FLAG_WRITE) {
+    mask |= POLLOUT;
+  }
+
+#  if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  /* The kernel reads poll32_events as little endian halfwords */
+  mask = (mask << 16) | (mask >> 16);
+#  endif
+
+  sqe->opcode        = IORING_OP_POLL_ADD;
+  sqe->fd            = sock->fd;
+  sqe->poll32_events = mask;
+  sqe->len           = ur->multishot ? IORING_POLL_ADD_MULTI : 0;
+  sqe->user_data     = ares_uring_user_data(sock->fd, sock->poll_token);
+  return ARES_TRUE;
+}
+
+/* Replace any armed poll with one for the given flags.  A socket receiving
+ * through the ring only needs one while waiting to write. */
+static ares_bool_t ares_uring_poll(ares_evsys_uring_t *ur,
+                                   ares_uring_sock_t  *sock,
+                                   ares_event_flags_t  flags)
+{
+  if (sock->poll_token != 0) {
+    ares_uring_cancel(ur, ares_uring_user_data(sock->fd, sock->poll_token),
+                      IORING_OP_POLL_REMOVE);
+    sock->poll_token = 0;
+  }
+
+  if (sock->dgram) {
+    flags &= ~((ares_event_flags_t)ARES_EVENT_FLAG_READ);
+  }
+
+  if (!(flags & (ARES_EVENT_FLAG_READ | ARES_EVENT_FLAG_WRITE))) {
+    return ARES_TRUE;
+  }
+
+  sock->poll_token = ares_uring_next_token(ur);
+  return ares_uring_arm(ur, sock, flags);
+}
+
+static ares_bool_t ares_uring_recv(ares_evsys_uring_t *ur,
+                                   ares_uring_sock_t  *sock)
+{
+  struct io_uring_sqe *sqe = ares_uring_get_sqe(ur);
+
+  if (sqe == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  sqe->opcode    = IORING_OP_RECVMSG;
+  sqe->fd        = sock->fd;
+  sqe->addr      = (ares_uint64_t)((size_t)&ur->recv_msg);
+  sqe->len       = 1;
+  sqe->ioprio    = IORING_RECV_MULTISHOT;
+  sqe->flags     = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data =
+    ares_uring_user_data(sock->fd, sock->id | ARES_URING_TOKEN_RECV);
+  sock->recv_armed = ARES_TRUE;
+  return ARES_TRUE;
+}
+
+/* Hand a receive buffer back to the kernel */
+static void ares_uring_buf_recycle(ares_evsys_uring_t *ur, unsigned short bid)
+{
+  struct io_uring_buf *buf;
+
+  if (bid >= ARES_URING_BUFS) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  /* The tail shares the first entry with it, so fields are set one by one */
+  buf       = &ur->buf_ring[ur->buf_tail & (ARES_URING_BUFS - 1)];
+  buf->addr = (ares_uint64_t)((size_t)(ur->bufs + (size_t)bid * ur->buf_size));
+  buf->len  = (unsigned int)ur->buf_size;
+  buf->bid  = bid;
+  ur->buf_tail++;
+  __atomic_store_n(&ur->buf_ring[0].resv, ur->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void ares_uring_notify(ares_evsys_uring_t *ur, ares_uring_sock_t *sock)
+{
+  if (sock->notify_node != NULL) {
+    return;
+  }
+  sock->notify_node = ares_llist_insert_last(ur->notify, sock);
+}
+
+static void ares_uring_rx_error(ares_evsys_uring_t *ur, ares_uring_sock_t *sock,
+                                int err)
+{
+  ares_uring_dgram_t *dgram = ares_malloc_zero(sizeof(*dgram));
+
+  if (dgram == NULL) {
+    return; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  dgram->err = ares_socket_deref_error(err);
+  if (ares_llist_insert_last(sock->rx, dgram) == NULL) {
+    ares_free(dgram); /* LCOV_EXCL_LINE: OutOfMemory */
+    return;           /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  ares_uring_notify(ur, sock);
+}
+
+static void ares_uring_rx(ares_evsys_uring_t *ur, ares_uring_sock_t *sock,
+                          const unsigned char *buf, size_t len)
+{
+  const struct io_uring_recvmsg_out *out;
+  ares_uring_dgram_t                *dgram;
+  size_t                             hdr_len;
+  size_t                             payload_len;
+
+  hdr_len = sizeof(*out) + ur->recv_msg.msg_namelen;
+  if (len < hdr_len) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  out         = (const struct io_uring_recvmsg_out *)(const void *)buf;
+  payload_len = len - hdr_len;
+  if (out->flags & MSG_TRUNC || out->payloadlen != payload_len ||
+      out->namelen > ur->recv_msg.msg_namelen) {
+    return;
+  }
+
+  if (ares_llist_len(sock->rx) >= ARES_URING_RX_MAX) {
+    return; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  dgram = ares_malloc_zero(sizeof(*dgram) + payload_len);
+  if (dgram == NULL) {
+    return; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  dgram->err      = ARES_CONN_ERR_SUCCESS;
+  dgram->len      = payload_len;
+  dgram->addr_len = (ares_socklen_t)out->namelen;
+  memcpy(&dgram->addr, buf + sizeof(*out), out->namelen);
+  memcpy(dgram + 1, buf + hdr_len, payload_len);
+
+  if (ares_llist_insert_last(sock->rx, dgram) == NULL) {
+    ares_free(dgram); /* LCOV_EXCL_LINE: OutOfMemory */
+    return;           /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  ares_uring_notify(ur, sock);
+}
+
+static void ares_uring_recv_cqe(ares_event_thread_t *e, ares_socket_t fd,
+                                unsigned int token, int res,
+                                unsigned int cflags)
+{
+  ares_evsys_uring_t *ur   = e->ev_sys_data;
+  ares_uring_sock_t  *sock = ares_uring_sock(ur, fd);
+  unsigned short bid = (unsigned short)(cflags >> IORING_CQE_BUFFER_SHIFT);
+
+  /* Stale completions still return their buffer */
+  if (sock == NULL || !sock->recv_armed ||
+      sock->id != (token & ARES_URING_TOKEN_MASK)) {
+    if (cflags & IORING_CQE_F_BUFFER) {
+      ares_uring_buf_recycle(ur, bid);
+    }
+    return;
+  }
+
+  if (cflags & IORING_CQE_F_BUFFER) {
+    if (res >= 0) {
+      ares_uring_rx(ur, sock, ur->bufs + (size_t)bid * ur->buf_size,
+                    (size_t)res);
+    }
+    ares_uring_buf_recycle(ur, bid);
+  }
+
+  if (cflags & IORING_CQE_F_MORE) {
+    return;
+  }
+
+  sock->recv_armed = ARES_FALSE;
+
+  /* Ran out of buffers, or the kernel otherwise ended the multishot receive */
+  if (res >= 0 || res == -ENOBUFS) {
+    ares_uring_recv(ur, sock);
+    return;
+  }
+
+  /* LCOV_EXCL_START: kernel < 6.0 */
+  if (res == -EINVAL) {
+    const ares_event_t *ev =
+      ares_htable_asvp_get_direct(e->ev_sock_handles, fd);
+
+    /* No multishot recvmsg, fall back to readiness for this socket and any
+     * later ones */
+    ur->dgram   = ARES_FALSE;
+    sock->dgram = ARES_FALSE;
+    if (ev != NULL) {
+      ares_uring_poll(ur, sock, ev->flags);
+    }
+    return;
+  }
+  /* LCOV_EXCL_STOP */
+
+  /* Socket error such as ECONNREFUSED, reported as a read of it.  The
+   * connection is closed on read errors so the receive isn't re-armed. */
+  ares_uring_rx_error(ur, sock, -res);
+}
+
+static void ares_uring_send_cqe(ares_evsys_uring_t *ur, unsigned int idx,
+                                int res)
+{
+  ares_uring_send_t *send;
+  ares_uring_sock_t *sock;
+
+  if (idx >= ARES_URING_SENDS) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  send         = &ur->sends[idx];
+  send->in_use = ARES_FALSE;
+  if (res >= 0) {
+    return;
+  }
+
+  /* Report send failures as a read error so the connection is cleaned up */
+  sock = ares_uring_sock(ur, send->fd);
+  if (sock != NULL && sock->id == send->sock_id) {
+    ares_uring_rx_error(ur, sock, -res);
+  }
+}
+
+static ares_conn_err_t ares_evsys_uring_dgram_recv(void *data, ares_socket_t fd,
+                                                   struct ares_socket_msg *msgs,
+                                                   size_t cnt, size_t *read_cnt)
+{
+  const ares_event_thread_t *e  = data;
+  const ares_evsys_uring_t  *ur = e->ev_sys_data;
+  ares_uring_sock_t         *sock;
+
+  *read_cnt = 0;
+
+  if (ur == NULL) {
+    return ARES_CONN_ERR_NOTIMP; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  /* Sockets not yet added (or not receiving through the ring) are read
+   * directly */
+  sock = ares_uring_sock(ur, fd);
+  if (sock == NULL || (!sock->dgram && ares_llist_len(sock->rx) == 0)) {
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+  while (*read_cnt < cnt) {
+    ares_llist_node_t        *node  = ares_llist_node_first(sock->rx);
+    const ares_uring_dgram_t *dgram = ares_llist_node_val(node);
+    struct ares_socket_msg   *msg   = &msgs[*read_cnt];
+    size_t                    len;
+
+    if (dgram == NULL) {
+      break;
+    }
+
+    /* Errors are returned on their own, after any datagrams before them */
+    if (dgram->err != ARES_CONN_ERR_SUCCESS) {
+      ares_conn_err_t err = dgram->err;
+
+      if (*read_cnt > 0) {
+        break;
+      }
+      ares_llist_node_destroy(node);
+      return err;
+    }
+
+    len = dgram->len;
+    if (len > msg->length) {
+      len = msg->length;
+    }
+    memcpy(msg->buffer, dgram + 1, len);
+    msg->datagram_len = dgram->len;
+
+    if (msg->address != NULL) {
+      ares_socklen_t addr_len = dgram->addr_len;
+      if (addr_len > msg->address_len) {
+        addr_len = msg->address_len;
+      }
+      memcpy(msg->address, &dgram->addr, (size_t)addr_len);
+      msg->address_len = addr_len;
+    }
+
+    ares_llist_node_destroy(node);
+    (*read_cnt)++;
+  }
+
+  if (*read_cnt == 0) {
+    return ARES_CONN_ERR_WOULDBLOCK;
+  }
+
+  return ARES_CONN_ERR_SUCCESS;
+}
+
+static ares_conn_err_t
+  ares_evsys_uring_dgram_send(void *data, ares_socket_t fd,
+                              const struct ares_socket_msg *msgs, size_t cnt,
+                              size_t *sent_cnt)
+{
+  const ares_event_thread_t *e  = data;
+  ares_evsys_uring_t        *ur = e->ev_sys_data;
+  const ares_uring_sock_t   *sock;
+  size_t                     i;
+
+  *sent_cnt = 0;
+
+  if (ur == NULL) {
+    return ARES_CONN_ERR_NOTIMP; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  sock = ares_uring_sock(ur, fd);
+  if (sock == NULL || !sock->dgram) {
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+  for (i = 0; i < cnt; i++) {
+    ares_uring_send_t   *send = NULL;
+    struct io_uring_sqe *sqe;
+    size_t               idx = 0;
+    size_t               j;
+
+    for (j = 0; j < ARES_URING_SENDS; j++) {
+      idx = (ur->send_next + j) % ARES_URING_SENDS;
+      if (!ur->sends[idx].in_use) {
+        send = &ur->sends[idx];
+        break;
+      }
+    }
+    if (send == NULL) {
+      break; /* LCOV_EXCL_LINE: UntestablePath */
+    }
+
+    /* The payload has to outlive this call, so it is copied */
+    if (send->buf_size < msgs[i].length) {
+      unsigned char *buf = ares_realloc(send->buf, msgs[i].length);
+      if (buf == NULL) {
+        break; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+      send->buf      = buf;
+      send->buf_size = msgs[i].length;
+    }
+    memcpy(send->buf, msgs[i].buffer, msgs[i].length);
+
+    memset(&send->msg, 0, sizeof(send->msg));
+    send->iov.iov_base    = send->buf;
+    send->iov.iov_len     = msgs[i].length;
+    send->msg.msg_iov     = &send->iov;
+    send->msg.msg_iovlen  = 1;
+    if (msgs[i].address != NULL &&
+        (size_t)msgs[i].address_len <= sizeof(send->addr)) {
+      memcpy(&send->addr, msgs[i].address, (size_t)msgs[i].address_len);
+      send->msg.msg_name    = &send->addr;
+      send->msg.msg_namelen = (socklen_t)msgs[i].address_len;
+    }
+
+    sqe = ares_uring_get_sqe(ur);
+    if (sqe == NULL) {
+      break; /* LCOV_EXCL_LINE: UntestablePath */
+    }
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = fd;
+    sqe->addr      = (ares_uint64_t)((size_t)&send->msg);
+    sqe->len       = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data =
+      ares_uring_user_data((ares_socket_t)idx, ARES_URING_TOKEN_SEND);
+
+    send->in_use  = ARES_TRUE;
+    send->fd      = fd;
+    send->sock_id = sock->id;
+    ur->send_next = (idx + 1) % ARES_URING_SENDS;
+    (*sent_cnt)++;
+  }
+
+  /* Out of slots, the caller writes the rest itself */
+  if (*sent_cnt == 0) {
+    return ARES_CONN_ERR_NOTIMP; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  /* Submit the whole batch now rather than on the next wait, the socket may
+   * be closed and its fd number reused before then */
+  ares_uring_enter(ur, ARES_FALSE, 0);
+  return ARES_CONN_ERR_SUCCESS;
+}
+
+static void ares_evsys_uring_destroy(ares_event_thread_t *e)
+{
+  ares_evsys_uring_t *ur = NULL;
+  size_t              i;
+
+  if (e == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  ur = e->ev_sys_data;
+  if (ur == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  /* Closing the ring cancels everything in flight, so buffers can only be
+   * released after it */
+  if (ur->sqes != NULL) {
+    munmap(ur->sqes, ur->sqes_sz);
+  }
+  if (ur->ring_ptr != NULL) {
+    munmap(ur->ring_ptr, ur->ring_sz);
+  }
+  if (ur->ring_fd != -1) {
+    close(ur->ring_fd);
+  }
+  if (ur->buf_ring != NULL) {
+    munmap(ur->buf_ring, ur->buf_ring_sz);
+  }
+  if (ur->bufs != NULL) {
+    munmap(ur->bufs, ur->bufs_sz);
+  }
+  for (i = 0; i < ARES_URING_SENDS; i++) {
+    ares_free(ur->sends[i].buf);
+  }
+  ares_htable_asvp_destroy(ur->socks);
+  ares_llist_destroy(ur->notify);
+
+  ares_free(ur);
+  e->ev_sys_data = NULL;
+}
+
+/* Register the provided buffer ring used by multishot receives.  Fails on
+ * kernels before 5.19, which then only get readiness. */
+static ares_bool_t ares_uring_dgram_init(ares_evsys_uring_t   *ur,
+                                         const ares_channel_t *channel)
+{
+  struct io_uring_buf_reg reg;
+  size_t                  payload = ARES_URING_BUF_PAYLOAD;
+  void                   *ptr;
+  unsigned short          i;
+
+  if (channel->ednspsz > payload) {
+    payload = channel->ednspsz;
+  }
+
+  /* Each buffer holds the recvmsg header and source address ahead of the
+   * datagram */
+  ur->recv_msg.msg_namelen = sizeof(struct sockaddr_storage);
+  ur->buf_size = sizeof(struct io_uring_recvmsg_out) +
+                 sizeof(struct sockaddr_storage) + payload;
+
+  /* Both are mapped rather than allocated, so nothing the kernel might still
+   * write while the ring is torn down can land in the heap */
+  ur->bufs_sz = ur->buf_size * ARES_URING_BUFS;
+  ptr         = mmap(NULL, ur->bufs_sz, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+  ur->bufs = ptr;
+
+  ur->buf_ring_sz = sizeof(*ur->buf_ring) * ARES_URING_BUFS;
+  ptr             = mmap(NULL, ur->buf_ring_sz, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+  ur->buf_ring = ptr;
+
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr    = (ares_uint64_t)((size_t)ur->buf_ring);
+  reg.ring_entries = ARES_URING_BUFS;
+  reg.bgid         = 0;
+  if (syscall(__NR_io_uring_register, ur->ring_fd, IORING_REGISTER_PBUF_RING,
+              &reg, 1) != 0) {
+    return ARES_FALSE;
+  }
+
+  for (i = 0; i < ARES_URING_BUFS; i++) {
+    ares_uring_buf_recycle(ur, i);
+  }
+
+  return ARES_TRUE;
+}
+
+static ares_bool_t ares_evsys_uring_init(ares_event_thread_t *e)
+{
+  ares_evsys_uring_t    *ur = NULL;
+  struct io_uring_params p;
+  unsigned char         *ring;
+  size_t                 cq_sz;
+  void                  *ptr;
+
+  ur = ares_malloc_zero(sizeof(*ur));
+  if (ur == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  e->ev_sys_data = ur;
+  ur->ring_fd    = -1;
+  ur->multishot  = ARES_TRUE;
+
+  ur->socks  = ares_htable_asvp_create(ares_uring_sock_destroy);
+  ur->notify = ares_llist_create(NULL);
+  if (ur->socks == NULL || ur->notify == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  /* io_uring may be missing, or disabled via sysctl or seccomp.  Failing here
+   * lets the event thread fall back to another event system. */
+  memset(&p, 0, sizeof(p));
+  ur->ring_fd = (int)syscall(__NR_io_uring_setup, ARES_URING_ENTRIES, &p);
+  if (ur->ring_fd < 0) {
+    goto fail;
+  }
+
+  /* A single mmap() for both rings (5.4) and timed waits without a timeout
+   * SQE (5.11) keep this simple, older kernels fall back. */
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(p.features & IORING_FEAT_EXT_ARG)) {
+    goto fail;
+  }
+
+  ur->ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cq_sz       = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (cq_sz > ur->ring_sz) {
+    ur->ring_sz = cq_sz;
+  }
+
+  ptr = mmap(NULL, ur->ring_sz, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQ_RING);
+  if (ptr == MAP_FAILED) {
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+  ur->ring_ptr = ptr;
+
+  ur->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  ptr         = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQES);
+  if (ptr == MAP_FAILED) {
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+  ur->sqes = ptr;
+
+  ring              = ur->ring_ptr;
+  ur->sq_head       = (unsigned int *)(void *)(ring + p.sq_off.head);
+  ur->sq_tail       = (unsigned int *)(void *)(ring + p.sq_off.tail);
+  ur->sq_array      = (unsigned int *)(void *)(ring + p.sq_off.array);
+  ur->sq_mask       = *(unsigned int *)(void *)(ring + p.sq_off.ring_mask);
+  ur->sq_entries    = p.sq_entries;
+  ur->sq_local_tail = *ur->sq_tail;
+  ur->cq_head       = (unsigned int *)(void *)(ring + p.cq_off.head);
+  ur->cq_tail       = (unsigned int *)(void *)(ring + p.cq_off.tail);
+  ur->cq_mask       = *(unsigned int *)(void *)(ring + p.cq_off.ring_mask);
+  ur->cqes          = (struct io_uring_cqe *)(void *)(ring + p.cq_off.cqes);
+
+  ur->dgram = ares_uring_dgram_init(ur, e->channel);
+
+  e->ev_signal = ares_pipeevent_create(e);
+  if (e->ev_signal == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  if (ur->dgram) {
+    e->channel->dgram_recv_cb = ares_evsys_uring_dgram_recv;
+    e->channel->dgram_send_cb = ares_evsys_uring_dgram_send;
+    e->channel->dgram_cb_data = e;
+  }
+
+  return ARES_TRUE;
+
+fail:
+  ares_evsys_uring_destroy(e);
+  return ARES_FALSE;
+}
+
+/* Only UDP sockets created by the default socket functions are read and
+ * written through the ring.  This excludes the event thread's own pipe, and
+ * anything user supplied socket functions may want to intercept. */
+static ares_bool_t ares_uring_is_dgram(const ares_evsys_uring_t *ur,
+                                       const ares_channel_t     *channel,
+                                       ares_socket_t             fd)
+{
+  int       type   = 0;
+  int       domain = 0;
+  socklen_t len    = sizeof(type);
+
+  if (!ur->dgram || !ares_socket_functions_are_default(channel)) {
+    return ARES_FALSE;
+  }
+
+  if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) != 0 ||
+      type != SOCK_DGRAM) {
+    return ARES_FALSE;
+  }
+
+  len = sizeof(domain);
+  if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len) != 0) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  return (domain == AF_INET || domain == AF_INET6) ? ARES_TRUE : ARES_FALSE;
+}
+
+static ares_bool_t ares_evsys_uring_event_add(ares_event_t *event)
+{
+  const ares_event_thread_t *e  = event->e;
+  ares_evsys_uring_t        *ur = e->ev_sys_data;
+  ares_uring_sock_t         *sock;
+
+  if (event->fd == ARES_SOCKET_BAD) {
+    return ARES_FALSE;
+  }
+
+  sock = ares_malloc_zero(sizeof(*sock));
+  if (sock == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  sock->fd    = event->fd;
+  sock->id    = ares_uring_next_token(ur);
+  sock->dgram = ares_uring_is_dgram(ur, e->channel, event->fd);
+  sock->rx    = ares_llist_create(ares_free);
+  if (sock->rx == NULL) {
+    ares_free(sock);   /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  if (!ares_htable_asvp_insert(ur->socks, event->fd, sock)) {
+    ares_uring_sock_destroy(sock); /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_FALSE;             /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  if ((sock->dgram && !ares_uring_recv(ur, sock)) ||
+      !ares_uring_poll(ur, sock, event->flags)) {
+    ares_htable_asvp_remove(ur->socks, event->fd); /* LCOV_EXCL_LINE */
+    return ARES_FALSE;                             /* LCOV_EXCL_LINE */
+  }
+
+  return ARES_TRUE;
+}
+
+static void ares_evsys_uring_event_del(ares_event_t *event)
+{
+  const ares_event_thread_t *e    = event->e;
+  ares_evsys_uring_t        *ur   = e->ev_sys_data;
+  ares_uring_sock_t         *sock = ares_uring_sock(ur, event->fd);
+
+  if (sock == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  ares_uring_poll(ur, sock, ARES_EVENT_FLAG_NONE);
+  if (sock->recv_armed) {
+    ares_uring_cancel(
+      ur,
+      ares_uring_user_data(sock->fd, sock->id | ARES_URING_TOKEN_RECV),
+      IORING_OP_ASYNC_CANCEL);
+  }
+
+  /* Any datagrams not yet read go with it */
+  ares_htable_asvp_remove(ur->socks, event->fd);
+}
+
+static void ares_evsys_uring_event_mod(ares_event_t      *event,
+                                       ares_event_flags_t new_flags)
+{
+  const ares_event_thread_t *e    = event->e;
+  ares_evsys_uring_t        *ur   = e->ev_sys_data;
+  ares_uring_sock_t         *sock = ares_uring_sock(ur, event->fd);
+
+  if (sock == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  /* The receive stays armed, only the poll changes */
+  ares_uring_poll(ur, sock, new_flags);
+}
+
+/* Deliver read events for sockets with queued datagrams.  A socket still
+ * holding datagrams afterwards (the reader stopped early) stays in the list,
+ * and the next wait doesn't block so it is retried. */
+static size_t ares_uring_dispatch(ares_event_thread_t *e)
+{
+  ares_evsys_uring_t *ur  = e->ev_sys_data;
+  size_t              cnt = 0;
+  size_t              n   = ares_llist_len(ur->notify);
+
+  while (n-- > 0) {
+    ares_llist_node_t *node = ares_llist_node_first(ur->notify);
+    ares_uring_sock_t *sock;
+    ares_event_t      *ev;
+    ares_socket_t      fd;
+
+    if (node == NULL) {
+      break;
+    }
+
+    sock              = ares_llist_node_claim(node);
+    sock->notify_node = NULL;
+    fd                = sock->fd;
+
+    ev = ares_htable_asvp_get_direct(e->ev_sock_handles, fd);
+    if (ev == NULL || ev->cb == NULL) {
+      continue; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+
+    cnt++;
+    ev->cb(e, ev->fd, ev->data, ARES_EVENT_FLAG_READ);
+
+    /* The callback may have removed the socket */
+    sock = ares_uring_sock(ur, fd);
+    if (sock != NULL && ares_llist_len(sock->rx) > 0) {
+      ares_uring_notify(ur, sock);
+    }
+  }
+
+  return cnt;
+}
+
+static size_t ares_evsys_uring_wait(ares_event_thread_t *e,
+                                    unsigned long        timeout_ms)
+{
+  ares_evsys_uring_t *ur  = e->ev_sys_data;
+  size_t              cnt = 0;
+  unsigned int        head;
+
+  ares_uring_enter(ur, ares_llist_len(ur->notify) == 0 ? ARES_TRUE : ARES_FALSE,
+                   timeout_ms);
+
+  head = *ur->cq_head;
+  while (head != __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE)) {
+    const struct io_uring_cqe *cqe = &ur->cqes[head & ur->cq_mask];
+    ares_uint64_t              user_data = cqe->user_data;
+    int                        res       = cqe->res;
+    unsigned int               cflags    = cqe->flags;
+    ares_socket_t              fd;
+    unsigned int               token;
+    ares_uring_sock_t         *sock;
+    ares_event_t              *ev;
+    ares_event_flags_t         flags = 0;
+
+    /* Release the slot before calling out, callbacks may queue more work */
+    head++;
+    __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+    token = (unsigned int)(user_data >> 32);
+    fd    = (ares_socket_t)(user_data & 0xFFFFFFFF);
+    if (token == 0) {
+      continue;
+    }
+
+    if (token == ARES_URING_TOKEN_SEND) {
+      ares_uring_send_cqe(ur, (unsigned int)fd, res);
+      continue;
+    }
+
+    /* Received datagrams are queued, and their read events delivered once the
+     * completion queue is drained */
+    if (token & ARES_URING_TOKEN_RECV) {
+      ares_uring_recv_cqe(e, fd, token, res, cflags);
+      continue;
+    }
+
+    sock = ares_uring_sock(ur, fd);
+    if (sock == NULL || sock->poll_token != token) {
+      continue;
+    }
+
+    ev = ares_htable_asvp_get_direct(e->ev_sock_handles, fd);
+    if (ev == NULL || ev->cb == NULL) {
+      continue; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+
+    if (res < 0) {
+      if (res == -EINVAL && ur->multishot) {
+        ur->multishot = ARES_FALSE; /* LCOV_EXCL_LINE: kernel < 5.13 */
+        ares_uring_arm(ur, sock, ev->flags); /* LCOV_EXCL_LINE */
+        continue;                            /* LCOV_EXCL_LINE */
+      }
+      /* Poll can't be armed (e.g. socket already closed), forget about it */
+      sock->poll_token = 0; /* LCOV_EXCL_LINE */
+      continue;             /* LCOV_EXCL_LINE */
+    }
+
+    if (res & (POLLIN | POLLRDHUP | POLLHUP | POLLERR)) {
+      flags |= ARES_EVENT_FLAG_READ;
+    }
+    if (res & POLLOUT) {
+      flags |= ARES_EVENT_FLAG_WRITE;
+    }
+
+    cnt++;
+    ev->cb(e, ev->fd, ev->data, flags);
+
+    /* Single shot, or the kernel ended the multishot poll.  Re-arm unless the
+     * callback removed or modified the event. */
+    sock = ares_uring_sock(ur, fd);
+    if (!(cflags & IORING_CQE_F_MORE) && sock != NULL &&
+        sock->poll_token == token) {
+      ev = ares_htable_asvp_get_direct(e->ev_sock_handles, fd);
+      if (ev != NULL) {
+        ares_uring_arm(ur, sock, ev->flags);
+      }
+    }
+  }
+
+  cnt += ares_uring_dispatch(e);
+
+  return cnt;
+}
+
+const ares_event_sys_t ares_evsys_io_uring = { "io_uring",
+                                               ares_evsys_uring_init,
+                                               ares_evsys_uring_destroy,
+                                               ares_evsys_uring_event_add,
+                                               ares_evsys_uring_event_del,
+                                               ares_evsys_uring_event_mod,
+                                               ares_evsys_uring_wait };
+#endif
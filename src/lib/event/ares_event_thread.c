@@ -421,6 +421,9 @@ void ares_event_thread_destroy(ares_channel_t *channel)
   channel->sock_state_cb                = NULL;
   channel->notify_pending_write_cb      = NULL;
   channel->notify_pending_write_cb_data = NULL;
+  channel->dgram_recv_cb                = NULL;
+  channel->dgram_send_cb                = NULL;
+  channel->dgram_cb_data                = NULL;
   ares_set_query_enqueue_cb(channel, NULL, NULL);
 }
 
@@ -462,6 +465,13 @@ static const ares_event_sys_t *ares_event_fetch_sys(ares_evsys_t evsys)
       return NULL;
 #  endif
 
+    case ARES_EVSYS_IO_URING:
+#  if defined(HAVE_IO_URING)
+      return &ares_evsys_io_uring;
+#  else
+      return NULL;
+#  endif
+
     /* case ARES_EVSYS_DEFAULT: */
     default:
       break;
@@ -531,12 +541,22 @@ ares_status_t ares_event_thread_init(ares_channel_t *channel)
   ares_set_query_enqueue_cb(channel, notifyenqueue_cb, e);
 
   if (!e->ev_sys->init(e)) {
-    /* LCOV_EXCL_START: UntestablePath */
-    ares_event_thread_destroy_int(e);
-    channel->sock_state_cb      = NULL;
-    channel->sock_state_cb_data = NULL;
-    return ARES_ESERVFAIL;
-    /* LCOV_EXCL_STOP */
+    /* io_uring is frequently unavailable at runtime (old kernel, sysctl,
+     * seccomp in containers), so quietly use the default event system */
+    ares_bool_t fallback = ARES_FALSE;
+    if (channel->evsys == ARES_EVSYS_IO_URING) {
+      e->ev_sys = ares_event_fetch_sys(ARES_EVSYS_DEFAULT);
+      fallback  = e->ev_sys != NULL && e->ev_sys->init(e);
+    }
+
+    if (!fallback) {
+      /* LCOV_EXCL_START: UntestablePath */
+      ares_event_thread_destroy_int(e);
+      channel->sock_state_cb      = NULL;
+      channel->sock_state_cb_data = NULL;
+      return ARES_ESERVFAIL;
+      /* LCOV_EXCL_STOP */
+    }
   }
 
   /* Before starting the thread, process any possible events the initialization
@@ -552,6 +572,9 @@ ares_status_t ares_event_thread_init(ares_channel_t *channel)
     ares_event_thread_destroy_int(e);
     channel->sock_state_cb      = NULL;
     channel->sock_state_cb_data = NULL;
+    channel->dgram_recv_cb      = NULL;
+    channel->dgram_send_cb      = NULL;
+    channel->dgram_cb_data      = NULL;
     return ARES_ESERVFAIL;
     /* LCOV_EXCL_STOP */
   }
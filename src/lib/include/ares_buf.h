@@ -45,9 +45,26 @@
  *
  * @{
  */
-struct ares_buf;
 
-/*! Opaque data type for generic hash table implementation */
+/*! Buffer object.  The members are private to ares_buf.c, the structure is
+ *  only visible so that a buffer can live on the stack, see
+ *  ares_buf_init_const() and ares_buf_init_fixed(). */
+struct ares_buf {
+  const unsigned char *data;          /*!< pointer to start of data buffer */
+  size_t               data_len;      /*!< total size of data in buffer */
+
+  unsigned char       *alloc_buf;     /*!< Pointer to allocated data buffer,
+                                       *   not used for const buffers */
+  size_t               alloc_buf_len; /*!< Size of allocated data buffer */
+
+  size_t               offset;        /*!< Current working offset in buffer */
+  size_t               tag_offset;    /*!< Tagged offset in buffer. Uses
+                                       *   SIZE_MAX if not set. */
+  ares_bool_t          fixed;         /*!< alloc_buf is caller-provided and
+                                       *   never reallocated or freed */
+};
+
+/*! Data type for buffer object */
 typedef struct ares_buf ares_buf_t;
 
 /*! Create a new buffer object that dynamically allocates buffers for data.
@@ -68,6 +85,31 @@ CARES_EXTERN ares_buf_t *ares_buf_create(void);
 CARES_EXTERN ares_buf_t *ares_buf_create_const(const unsigned char *data,
                                                size_t               data_len);
 
+/*! Initialize a caller-provided buffer object, such as one on the stack, to
+ *  parse user-provided data without allocating.  The object must not be
+ *  passed to ares_buf_destroy().
+ *
+ *  \param[in] buf      Buffer object to initialize
+ *  \param[in] data     Data to provide to buffer
+ *  \param[in] data_len Size of buffer provided
+ */
+CARES_EXTERN void ares_buf_init_const(ares_buf_t *buf,
+                                      const unsigned char *data,
+                                      size_t               data_len);
+
+/*! Initialize a caller-provided buffer object, such as one on the stack, to
+ *  append into caller-provided storage without allocating.  Appending more
+ *  than fits fails with ARES_ENOMEM, and one byte is always left free for a
+ *  NULL terminator.  The object must not be passed to ares_buf_destroy() or
+ *  any of the finish functions.
+ *
+ *  \param[in] buf         Buffer object to initialize
+ *  \param[in] storage     Storage to append into
+ *  \param[in] storage_len Size of storage
+ */
+CARES_EXTERN void ares_buf_init_fixed(ares_buf_t *buf, unsigned char *storage,
+                                      size_t storage_len);
+
 
 /*! Destroy an initialized buffer object.
  *
@@ -785,6 +827,19 @@ CARES_EXTERN ares_status_t ares_buf_parse_dns_str(ares_buf_t *buf,
                                                   size_t      remaining_len,
                                                   char      **name);
 
+/*! Same as ares_buf_parse_dns_str() except the string is appended to another
+ *  buffer rather than allocated.
+ *
+ *  \param[in]  buf            initialized buffer object
+ *  \param[in]  remaining_len  maximum length that should be used for parsing
+ *                             the string
+ *  \param[in]  str            initialized buffer object to append the string
+ *                             to
+ *  \return ARES_SUCCESS on success
+ */
+CARES_EXTERN ares_status_t ares_buf_parse_dns_str_into_buf(
+  ares_buf_t *buf, size_t remaining_len, ares_buf_t *str);
+
 /*! Parse a character-string as defined in RFC1035, as binary, however for
  *  convenience this does guarantee a NULL terminator (that is not included
  *  in the returned length).
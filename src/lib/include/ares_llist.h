@@ -71,6 +71,23 @@ CARES_EXTERN void
   ares_llist_replace_destructor(ares_llist_t           *list,
                                 ares_llist_destructor_t destruct);
 
+/*! Allocate nodes inserted from now on out of a pool rather than
+ *  individually.  Nodes remember the pool they came from, so they may still
+ *  be moved to other lists.
+ *
+ *  \param[in] list  Initialized linked list object
+ *  \param[in] pool  Pool created for ares_llist_node_size() objects, which
+ *                   must outlive every node allocated from it.  NULL to stop
+ *                   using a pool.
+ */
+CARES_EXTERN void ares_llist_set_pool(ares_llist_t *list, ares_pool_t *pool);
+
+/*! Size of a node, for creating a pool of them
+ *
+ *  \return size of a node
+ */
+CARES_EXTERN size_t ares_llist_node_size(void);
+
 /*! Insert value as the first node in the linked list
  *
  *  \param[in] list   Initialized linked list object
@@ -0,0 +1,91 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef __ARES__POOL_H
+#define __ARES__POOL_H
+
+/*! \addtogroup ares_pool Fixed-size object pool
+ *
+ * Hands out objects of a single size carved from larger slabs, so hot objects
+ * such as queries and list nodes don't each cost a trip through the system
+ * allocator, and objects allocated together sit next to each other in
+ * memory.  Slabs come from ares_malloc() so custom allocators registered via
+ * ares_library_init_mem() are still honored.  A slab is released once all of
+ * its objects are free, except for one kept to absorb churn.
+ *
+ * A pool is not thread-safe, it is expected to be protected by the lock of
+ * whatever owns it, like the channel lock.
+ *
+ * Time complexity:
+ *  - Alloc: O(1)
+ *  - Free: O(1)
+ *
+ * @{
+ */
+
+struct ares_pool;
+
+/*! Opaque data type for the object pool */
+typedef struct ares_pool ares_pool_t;
+
+/*! Create an empty pool
+ *
+ *  \param[in] obj_size  Size of each object
+ *  \param[in] slab_cnt  Number of objects per slab, 0 for a default
+ *  \return initialized pool or NULL on out of memory
+ */
+CARES_EXTERN ares_pool_t *ares_pool_create(size_t obj_size, size_t slab_cnt);
+
+/*! Destroy the pool and all its slabs.  Objects still allocated from the
+ *  pool are released along with it.
+ *
+ *  \param[in] pool  Initialized pool, NULL allowed
+ */
+CARES_EXTERN void ares_pool_destroy(ares_pool_t *pool);
+
+/*! Allocate a zeroed object.
+ *
+ *  \param[in] pool  Initialized pool
+ *  \return object or NULL on out of memory
+ */
+CARES_EXTERN void *ares_pool_alloc(ares_pool_t *pool);
+
+/*! Return an object to the pool it was allocated from.
+ *
+ *  \param[in] pool  Pool the object was allocated from
+ *  \param[in] obj   Object to free, NULL allowed
+ */
+CARES_EXTERN void ares_pool_free(ares_pool_t *pool, void *obj);
+
+/*! Retrieve the number of objects currently allocated from the pool
+ *
+ *  \param[in] pool  Initialized pool
+ *  \return count
+ */
+CARES_EXTERN size_t ares_pool_len(const ares_pool_t *pool);
+
+/*! @} */
+
+#endif /* __ARES__POOL_H */
@@ -0,0 +1,97 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef __ARES__QIDMAP_H
+#define __ARES__QIDMAP_H
+
+/*! \addtogroup ares_qidmap Direct-indexed map of 16bit ids to void pointers
+ *
+ * DNS query ids are only 16 bits, so rather than hashing, the id is used
+ * directly as an index.  The map is split into 256 pages of 256 entries each
+ * which are only allocated while they hold a value, so an idle map costs a
+ * couple of kilobytes rather than a flat 64k entry table.
+ *
+ * Time complexity:
+ *  - Insert: O(1)
+ *  - Search: O(1)
+ *  - Delete: O(1)
+ *
+ * @{
+ */
+
+struct ares_qidmap;
+
+/*! Opaque data type for the 16bit id to void pointer map */
+typedef struct ares_qidmap ares_qidmap_t;
+
+/*! Create an empty map
+ *
+ *  \return initialized map or NULL on out of memory
+ */
+CARES_EXTERN ares_qidmap_t *ares_qidmap_create(void);
+
+/*! Destroy the map.  Stored values are not freed.
+ *
+ *  \param[in] map  Initialized map
+ */
+CARES_EXTERN void ares_qidmap_destroy(ares_qidmap_t *map);
+
+/*! Insert a value, replacing any existing value for the id
+ *
+ *  \param[in] map  Initialized map
+ *  \param[in] id   id to associate with value
+ *  \param[in] val  value to store, may not be NULL
+ *  \return ARES_TRUE on success, ARES_FALSE on misuse or out of memory
+ */
+CARES_EXTERN ares_bool_t ares_qidmap_insert(ares_qidmap_t *map,
+                                            unsigned short id, void *val);
+
+/*! Retrieve the value for an id
+ *
+ *  \param[in] map  Initialized map
+ *  \param[in] id   id to look up
+ *  \return value associated with the id or NULL if none
+ */
+CARES_EXTERN void *ares_qidmap_get(const ares_qidmap_t *map, unsigned short id);
+
+/*! Remove the value for an id
+ *
+ *  \param[in] map  Initialized map
+ *  \param[in] id   id to remove
+ *  \return ARES_TRUE if found, ARES_FALSE if not
+ */
+CARES_EXTERN ares_bool_t ares_qidmap_remove(ares_qidmap_t *map,
+                                            unsigned short id);
+
+/*! Retrieve the number of ids stored in the map
+ *
+ *  \param[in] map  Initialized map
+ *  \return count
+ */
+CARES_EXTERN size_t ares_qidmap_len(const ares_qidmap_t *map);
+
+/*! @} */
+
+#endif /* __ARES__QIDMAP_H */
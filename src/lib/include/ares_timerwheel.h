@@ -0,0 +1,139 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef __ARES__TIMERWHEEL_H
+#define __ARES__TIMERWHEEL_H
+
+/*! \addtogroup ares_timerwheel Hierarchical Timer Wheel Data Structure
+ *
+ * Index of deadlines at millisecond granularity.  Level 0 has one slot per
+ * millisecond, and each level above has slots covering 32 times as long.  A
+ * deadline is filed on the lowest level that can hold it relative to the
+ * current time of the wheel.  As time advances, slots from higher levels are
+ * redistributed to the levels below, and deadlines that have passed move to
+ * an expired list.
+ *
+ * Time complexity:
+ *  - Insert: O(1)
+ *  - Delete: O(1)  -- assumes you hold a node pointer
+ *  - Next deadline: O(1), except after the earliest deadline in a slot above
+ *    level 0 was removed, which requires rescanning that slot once
+ *  - Advance: amortized O(1) per entry, each entry moves down at most once
+ *    per level
+ *
+ * @{
+ */
+struct ares_timerwheel;
+
+/*! Timer wheel object, opaque */
+typedef struct ares_timerwheel ares_timerwheel_t;
+
+struct ares_timerwheel_node;
+
+/*! Timer wheel node object, opaque */
+typedef struct ares_timerwheel_node ares_timerwheel_node_t;
+
+/*! Create a timer wheel.  Stored values are never freed by the wheel.
+ *
+ *  \return initialized timer wheel or NULL on out of memory
+ */
+CARES_EXTERN ares_timerwheel_t *ares_timerwheel_create(void);
+
+/*! Destroy the timer wheel and any remaining nodes, stored values are not
+ *  freed.
+ *
+ *  \param[in] wheel  Initialized timer wheel
+ */
+CARES_EXTERN void ares_timerwheel_destroy(ares_timerwheel_t *wheel);
+
+/*! Insert a value with a deadline
+ *
+ *  \param[in] wheel   Initialized timer wheel
+ *  \param[in] expire  Deadline in milliseconds
+ *  \param[in] val     User-supplied value
+ *  \return node on success, NULL on misuse or out of memory
+ */
+CARES_EXTERN ares_timerwheel_node_t *
+  ares_timerwheel_insert(ares_timerwheel_t *wheel, ares_uint64_t expire,
+                         void *val);
+
+/*! Advance the wheel to the given time and return the first node whose
+ *  deadline has passed.  The node must be removed before calling this again
+ *  or the same node will be returned.
+ *
+ *  \param[in] wheel  Initialized timer wheel
+ *  \param[in] now    Current time in milliseconds
+ *  \return expired node or NULL if none
+ */
+CARES_EXTERN ares_timerwheel_node_t *
+  ares_timerwheel_first_expired(ares_timerwheel_t *wheel, ares_uint64_t now);
+
+/*! Retrieve the earliest deadline in the wheel
+ *
+ *  \param[in]  wheel   Initialized timer wheel
+ *  \param[out] expire  Earliest deadline in milliseconds
+ *  \return ARES_TRUE if the wheel has any nodes, ARES_FALSE if empty
+ */
+CARES_EXTERN ares_bool_t ares_timerwheel_next_expire(ares_timerwheel_t *wheel,
+                                                     ares_uint64_t *expire);
+
+/*! Retrieve the value stored in a node
+ *
+ *  \param[in] node  Node in the timer wheel
+ *  \return user-supplied value
+ */
+CARES_EXTERN void *ares_timerwheel_node_val(const ares_timerwheel_node_t *node);
+
+/*! Retrieve the deadline of a node
+ *
+ *  \param[in] node  Node in the timer wheel
+ *  \return deadline in milliseconds
+ */
+CARES_EXTERN ares_uint64_t
+  ares_timerwheel_node_expire(const ares_timerwheel_node_t *node);
+
+/*! Remove the node from the wheel and free it, returning its value
+ *
+ *  \param[in] node  Node in the timer wheel
+ *  \return user-supplied value
+ */
+CARES_EXTERN void *ares_timerwheel_node_claim(ares_timerwheel_node_t *node);
+
+/*! Remove the node from the wheel and free it
+ *
+ *  \param[in] node  Node in the timer wheel, may be NULL
+ */
+CARES_EXTERN void ares_timerwheel_node_destroy(ares_timerwheel_node_t *node);
+
+/*! Retrieve the number of nodes in the wheel
+ *
+ *  \param[in] wheel  Initialized timer wheel
+ *  \return count
+ */
+CARES_EXTERN size_t ares_timerwheel_len(const ares_timerwheel_t *wheel);
+
+/*! @} */
+
+#endif /* __ARES__TIMERWHEEL_H */
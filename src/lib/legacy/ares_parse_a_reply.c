@@ -66,7 +66,7 @@ int ares_parse_a_reply(const unsigned char *abuf, int alen,
 
   memset(&ai, 0, sizeof(ai));
 
-  status = ares_dns_parse(abuf, (size_t)alen, 0, &dnsrec);
+  status = ares_dns_parse(abuf, (size_t)alen, ARES_DNS_PARSE_ARENA, &dnsrec);
   if (status != ARES_SUCCESS) {
     goto fail;
   }
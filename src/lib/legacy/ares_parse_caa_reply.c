@@ -46,7 +46,7 @@ int ares_parse_caa_reply(const unsigned char *abuf, int alen_int,
 
   alen = (size_t)alen_int;
 
-  status = ares_dns_parse(abuf, alen, 0, &dnsrec);
+  status = ares_dns_parse(abuf, alen, ARES_DNS_PARSE_ARENA, &dnsrec);
   if (status != ARES_SUCCESS) {
     goto done;
   }
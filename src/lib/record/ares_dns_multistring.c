@@ -29,6 +29,7 @@
 typedef struct {
   unsigned char *data;
   size_t         len;
+  ares_bool_t    borrowed; /*!< data is owned by an arena, not us */
 } multistring_data_t;
 
 struct ares_dns_multistring {
@@ -45,7 +46,7 @@ struct ares_dns_multistring {
 static void ares_dns_multistring_free_cb(void *arg)
 {
   multistring_data_t *data = arg;
-  if (data == NULL) {
+  if (data == NULL || data->borrowed) {
     return;
   }
   ares_free(data->data);
@@ -107,9 +108,12 @@ ares_status_t ares_dns_multistring_swap_own(ares_dns_multistring_t *strs,
     return ARES_EFORMERR;
   }
 
-  ares_free(data->data);
-  data->data = str;
-  data->len  = len;
+  if (!data->borrowed) {
+    ares_free(data->data);
+  }
+  data->data     = str;
+  data->len      = len;
+  data->borrowed = ARES_FALSE;
   return ARES_SUCCESS;
 }
 
@@ -124,8 +128,10 @@ ares_status_t ares_dns_multistring_del(ares_dns_multistring_t *strs, size_t idx)
   return ares_array_remove_at(strs->strs, idx);
 }
 
-ares_status_t ares_dns_multistring_add_own(ares_dns_multistring_t *strs,
-                                           unsigned char *str, size_t len)
+static ares_status_t ares_dns_multistring_add_int(ares_dns_multistring_t *strs,
+                                                  unsigned char *str,
+                                                  size_t len,
+                                                  ares_bool_t borrowed)
 {
   multistring_data_t *data;
   ares_status_t       status;
@@ -158,12 +164,19 @@ ares_status_t ares_dns_multistring_add_own(ares_dns_multistring_t *strs,
     }
   }
 
-  data->data = str;
-  data->len  = len;
+  data->data     = str;
+  data->len      = len;
+  data->borrowed = borrowed;
 
   return ARES_SUCCESS;
 }
 
+ares_status_t ares_dns_multistring_add_own(ares_dns_multistring_t *strs,
+                                           unsigned char *str, size_t len)
+{
+  return ares_dns_multistring_add_int(strs, str, len, ARES_FALSE);
+}
+
 size_t ares_dns_multistring_cnt(const ares_dns_multistring_t *strs)
 {
   if (strs == NULL) {
@@ -236,8 +249,9 @@ const unsigned char *ares_dns_multistring_combined(ares_dns_multistring_t *strs,
   return strs->cache_str;
 }
 
-ares_status_t ares_dns_multistring_parse_buf(ares_buf_t *buf,
-                                             size_t      remaining_len,
+ares_status_t ares_dns_multistring_parse_buf(ares_buf_t   *buf,
+                                             ares_arena_t *arena,
+                                             size_t        remaining_len,
                                              ares_dns_multistring_t **strs,
                                              ares_bool_t validate_printable)
 {
@@ -278,7 +292,26 @@ ares_status_t ares_dns_multistring_parse_buf(ares_buf_t *buf,
       }
     }
 
-    if (strs != NULL) {
+    if (strs != NULL && arena != NULL) {
+      /* Strings live in the arena, always NULL terminated so an empty string
+       * still has data */
+      unsigned char *data = ares_arena_alloc(arena, (size_t)len + 1);
+      if (data == NULL) {
+        status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+        break;                /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+      if (len) {
+        status = ares_buf_fetch_bytes(buf, data, len);
+        if (status != ARES_SUCCESS) {
+          break;
+        }
+      }
+      data[len] = 0;
+      status    = ares_dns_multistring_add_int(*strs, data, len, ARES_TRUE);
+      if (status != ARES_SUCCESS) {
+        break; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    } else if (strs != NULL) {
       unsigned char *data = NULL;
       if (len) {
         status = ares_buf_fetch_bytes_dup(buf, len, ARES_TRUE, &data);
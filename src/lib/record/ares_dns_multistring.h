@@ -27,6 +27,7 @@
 #define __ARES_DNS_MULTISTRING_H
 
 #include "ares_buf.h"
+#include "util/ares_arena.h"
 
 struct ares_dns_multistring;
 typedef struct ares_dns_multistring ares_dns_multistring_t;
@@ -53,6 +54,8 @@ const unsigned char *ares_dns_multistring_combined(ares_dns_multistring_t *strs,
  *  not included in the length for each value).
  *
  *  \param[in]  buf                initialized buffer object
+ *  \param[in]  arena              arena to allocate the strings from, or NULL
+ *                                 to use ares_malloc()
  *  \param[in]  remaining_len      maximum length that should be used for
  *                                 parsing the string, this is often less than
  *                                 the remaining buffer and is based on the RR
@@ -64,8 +67,9 @@ const unsigned char *ares_dns_multistring_combined(ares_dns_multistring_t *strs,
  *                                 data.
  *  \return ARES_SUCCESS on success
  */
-ares_status_t ares_dns_multistring_parse_buf(ares_buf_t *buf,
-                                             size_t      remaining_len,
+ares_status_t ares_dns_multistring_parse_buf(ares_buf_t   *buf,
+                                             ares_arena_t *arena,
+                                             size_t        remaining_len,
                                              ares_dns_multistring_t **strs,
                                              ares_bool_t validate_printable);
 
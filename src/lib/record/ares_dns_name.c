@@ -38,30 +38,22 @@
  * without limit. */
 #define ARES_MAX_INDIRS 128
 
+/* Compression targets are kept in a hashtable keyed by the presentation form
+ * of every label-suffix written so far, e.g. writing "www.example.com" records
+ * "www.example.com", "example.com" and "com".  Finding the longest target for
+ * a name is then one lookup per label rather than a comparison against every
+ * name previously written, which made writing large messages quadratic. */
 typedef struct {
-  char  *name;
-  size_t name_len;
   size_t idx;
 } ares_nameoffset_t;
 
-static void ares_nameoffset_free(void *arg)
+static ares_status_t ares_nameoffset_create(ares_htable_binvp_t **table,
+                                            const char *name, size_t name_len,
+                                            size_t idx)
 {
-  ares_nameoffset_t *off = arg;
-  if (off == NULL) {
-    return; /* LCOV_EXCL_LINE: DefensiveCoding */
-  }
-  ares_free(off->name);
-  ares_free(off);
-}
-
-static ares_status_t ares_nameoffset_create(ares_llist_t **list,
-                                            const char *name, size_t idx)
-{
-  ares_status_t      status;
   ares_nameoffset_t *off = NULL;
 
-  if (list == NULL || name == NULL || ares_strlen(name) == 0 ||
-      ares_strlen(name) > ARES_MAX_NAME_PRESENTATION_LEN) {
+  if (table == NULL || name == NULL || name_len == 0) {
     return ARES_EFORMERR; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
@@ -73,12 +65,11 @@ static ares_status_t ares_nameoffset_create(ares_llist_t **list,
     return ARES_SUCCESS;
   }
 
-  if (*list == NULL) {
-    *list = ares_llist_create(ares_nameoffset_free);
+  if (*table == NULL) {
+    *table = ares_htable_binvp_create(ares_free);
   }
-  if (*list == NULL) {
-    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-    goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
+  if (*table == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
   off = ares_malloc_zero(sizeof(*off));
@@ -86,75 +77,61 @@ static ares_status_t ares_nameoffset_create(ares_llist_t **list,
     return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  off->name = ares_strdup(name);
-  if (off->name == NULL) {
-    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-    goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
-  }
+  off->idx = idx;
 
-  off->name_len = ares_strlen(off->name);
-  off->idx      = idx;
-
-  if (ares_llist_insert_last(*list, off) == NULL) {
-    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-    goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
+  if (!ares_htable_binvp_insert(*table, (const unsigned char *)name, name_len,
+                                off)) {
+    ares_free(off);     /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
   return ARES_SUCCESS;
-
-/* LCOV_EXCL_START: OutOfMemory */
-fail:
-  ares_nameoffset_free(off);
-  return status;
-  /* LCOV_EXCL_STOP */
 }
 
-static const ares_nameoffset_t *ares_nameoffset_find(ares_llist_t *list,
-                                                     const char   *name)
+/* Offset of the label following the one starting at offset start, or name_len
+ * if it is the last label.  Escaped periods don't separate labels. */
+static size_t ares_nameoffset_next_label(const char *name, size_t name_len,
+                                         size_t start)
 {
-  size_t                   name_len = ares_strlen(name);
-  ares_llist_node_t       *node;
-  const ares_nameoffset_t *longest_match = NULL;
-
-  if (list == NULL || name == NULL || name_len == 0) {
-    return NULL;
-  }
+  size_t i;
 
-  for (node = ares_llist_node_first(list); node != NULL;
-       node = ares_llist_node_next(node)) {
-    const ares_nameoffset_t *val = ares_llist_node_val(node);
-    size_t                   prefix_len;
-
-    /* Can't be a match if the stored name is longer */
-    if (val->name_len > name_len) {
+  for (i = start; i < name_len; i++) {
+    if (name[i] == '\\') {
+      i++;
       continue;
     }
-
-    /* Can't be the longest match if our existing longest match is longer */
-    if (longest_match != NULL && longest_match->name_len > val->name_len) {
-      continue;
+    if (name[i] == '.') {
+      return i + 1;
     }
+  }
 
-    prefix_len = name_len - val->name_len;
+  return name_len;
+}
 
-    /* Due to DNS 0x20, lets not inadvertently mangle things, use case-sensitive
-     * matching instead of case-insensitive.  This may result in slightly
-     * larger DNS queries overall. */
-    if (!ares_streq(val->name, name + prefix_len)) {
-      continue;
-    }
+/* Find the longest label-suffix of name recorded as a compression target.
+ * Due to DNS 0x20, lets not inadvertently mangle things, matching is
+ * case-sensitive.  This may result in slightly larger DNS queries overall. */
+static const ares_nameoffset_t *
+  ares_nameoffset_find(const ares_htable_binvp_t *table, const char *name,
+                       size_t name_len, size_t *match_len)
+{
+  size_t start = 0;
 
-    /* We need to make sure if `val->name` is "example.com" that name is
-     * is separated by a label, e.g. "myexample.com" is not ok, however
-     * "my.example.com" is, so we look for the preceding "." */
-    if (prefix_len != 0 && name[prefix_len - 1] != '.') {
-      continue;
-    }
+  if (table == NULL || name == NULL || name_len == 0) {
+    return NULL;
+  }
 
-    longest_match = val;
+  while (start < name_len) {
+    const ares_nameoffset_t *off = ares_htable_binvp_get_direct(
+      table, (const unsigned char *)name + start, name_len - start);
+    if (off != NULL) {
+      *match_len = name_len - start;
+      return off;
+    }
+    start = ares_nameoffset_next_label(name, name_len, start);
   }
 
-  return longest_match;
+  return NULL;
 }
 
 static void ares_dns_labels_free_cb(void *arg)
@@ -374,13 +351,14 @@ done:
   return status;
 }
 
-ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
+ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_htable_binvp_t **list,
                                   ares_bool_t validate_hostname,
                                   const char *name)
 {
   const ares_nameoffset_t *off = NULL;
   size_t                   name_len;
-  size_t                   orig_name_len;
+  size_t                   match_len = 0;
+  size_t                   prefix_len;
   size_t                   pos    = ares_buf_len(buf);
   ares_array_t            *labels = NULL;
   char                     name_copy[512];
@@ -397,24 +375,29 @@ ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
 
   /* NOTE: due to possible escaping, name_copy buffer is > 256 to allow for
    *       this */
-  name_len      = ares_strcpy(name_copy, name, sizeof(name_copy));
-  orig_name_len = name_len;
+  name_len = ares_strcpy(name_copy, name, sizeof(name_copy));
 
   /* Find longest match */
   if (list != NULL) {
-    off = ares_nameoffset_find(*list, name_copy);
-    if (off != NULL && off->name_len != name_len) {
-      /* truncate */
-      name_len            -= (off->name_len + 1);
-      name_copy[name_len]  = 0;
-    }
+    off = ares_nameoffset_find(*list, name_copy, name_len, &match_len);
+  }
+
+  /* Only the labels preceding the match, and the period separating them from
+   * it, need to be output */
+  prefix_len = name_len;
+  if (off != NULL) {
+    prefix_len = match_len == name_len ? 0 : name_len - match_len - 1;
   }
 
   /* Output labels */
-  if (off == NULL || off->name_len != orig_name_len) {
+  if (prefix_len != 0 || off == NULL) {
     size_t i;
+    char   saved = name_copy[prefix_len];
 
+    /* truncate */
+    name_copy[prefix_len] = 0;
     status = ares_split_dns_name(labels, validate_hostname, name_copy);
+    name_copy[prefix_len] = saved;
     if (status != ARES_SUCCESS) {
       goto done;
     }
@@ -457,13 +440,21 @@ ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
     }
   }
 
-  /* Store pointer for future jumps as long as its not an exact match for
-   * a prior entry */
-  if (list != NULL && (off == NULL || off->name_len != orig_name_len) &&
-      name_len > 0) {
-    status = ares_nameoffset_create(list, name /* not truncated copy! */, pos);
-    if (status != ARES_SUCCESS) {
-      goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+  /* Store pointers for future jumps to each label-suffix we just output, the
+   * shorter suffixes we jumped to are already stored */
+  if (list != NULL && prefix_len != 0) {
+    size_t i;
+    size_t start = 0;
+    size_t idx   = pos;
+
+    for (i = 0; i < ares_array_len(labels); i++) {
+      status =
+        ares_nameoffset_create(list, name_copy + start, name_len - start, idx);
+      if (status != ARES_SUCCESS) {
+        goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+      idx   += 1 + ares_buf_len(ares_dns_labels_get_at(labels, i));
+      start  = ares_nameoffset_next_label(name_copy, name_len, start);
     }
   }
 
@@ -560,14 +551,15 @@ fail:
   return status;
 }
 
-ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
-                                  ares_bool_t is_hostname,
-                                  ares_bool_t allow_compression)
+/* Parse a name, appending it to namebuf if not NULL */
+static ares_status_t ares_dns_name_parse_int(ares_buf_t *buf,
+                                             ares_buf_t *namebuf,
+                                             ares_bool_t is_hostname,
+                                             ares_bool_t allow_compression)
 {
   size_t        save_offset = 0;
   unsigned char c;
   ares_status_t status;
-  ares_buf_t   *namebuf     = NULL;
   size_t        label_start = ares_buf_get_position(buf);
   size_t        name_len    = 0;
   size_t        indir       = 0;
@@ -576,14 +568,6 @@ ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
     return ARES_EFORMERR;
   }
 
-  if (name != NULL) {
-    namebuf = ares_buf_create();
-    if (namebuf == NULL) {
-      status = ARES_ENOMEM;
-      goto fail;
-    }
-  }
-
   /* The compression scheme allows a domain name in a message to be
    * represented as either:
    *
@@ -698,7 +682,7 @@ ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
     }
 
     /* Labels are separated by periods */
-    if (ares_buf_len(namebuf) != 0 && name != NULL) {
+    if (namebuf != NULL && ares_buf_len(namebuf) != 0) {
       status = ares_buf_append_byte(namebuf, '.');
       if (status != ARES_SUCCESS) {
         goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
@@ -717,14 +701,6 @@ ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
     ares_buf_set_position(buf, save_offset);
   }
 
-  if (name != NULL) {
-    *name = ares_buf_finish_str(namebuf, NULL);
-    if (*name == NULL) {
-      status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-      goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
-    }
-  }
-
   return ARES_SUCCESS;
 
 fail:
@@ -733,6 +709,89 @@ fail:
     status = ARES_EBADNAME;
   }
 
-  ares_buf_destroy(namebuf);
   return status;
 }
+
+ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
+                                  ares_bool_t is_hostname,
+                                  ares_bool_t allow_compression)
+{
+  ares_buf_t   *namebuf = NULL;
+  ares_status_t status;
+
+  if (name != NULL) {
+    namebuf = ares_buf_create();
+    if (namebuf == NULL) {
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  status =
+    ares_dns_name_parse_int(buf, namebuf, is_hostname, allow_compression);
+  if (status != ARES_SUCCESS || name == NULL) {
+    ares_buf_destroy(namebuf);
+    return status;
+  }
+
+  *name = ares_buf_finish_str(namebuf, NULL);
+  if (*name == NULL) {
+    ares_buf_destroy(namebuf); /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_ENOMEM;        /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return ARES_SUCCESS;
+}
+
+ares_status_t ares_dns_name_parse_arena(ares_buf_t *buf, ares_arena_t *arena,
+                                        char **name, ares_bool_t is_hostname,
+                                        ares_bool_t allow_compression)
+{
+  ares_buf_t   *namebuf;
+  ares_status_t status;
+
+  if (arena == NULL) {
+    return ares_dns_name_parse(buf, name, is_hostname, allow_compression);
+  }
+
+  namebuf = ares_arena_scratch(arena);
+  if (namebuf == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  status =
+    ares_dns_name_parse_int(buf, namebuf, is_hostname, allow_compression);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  *name = ares_arena_scratch_finish(arena, NULL);
+  if (*name == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return ARES_SUCCESS;
+}
+
+ares_status_t ares_dns_name_parse_fixed(ares_buf_t *buf, char *name,
+                                        size_t name_len, ares_bool_t is_hostname,
+                                        ares_bool_t allow_compression)
+{
+  ares_buf_t    namebuf;
+  ares_status_t status;
+
+  if (name == NULL || name_len == 0) {
+    return ARES_EFORMERR;
+  }
+
+  ares_buf_init_fixed(&namebuf, (unsigned char *)name, name_len);
+
+  status =
+    ares_dns_name_parse_int(buf, &namebuf, is_hostname, allow_compression);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  /* A fixed buffer always leaves room for the terminator */
+  name[ares_buf_len(&namebuf)] = 0;
+  return ARES_SUCCESS;
+}
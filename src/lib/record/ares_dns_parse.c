@@ -39,6 +39,65 @@ static size_t ares_dns_rr_remaining_len(const ares_buf_t *buf, size_t orig_len,
   return rdlength - used_len;
 }
 
+/* Bytes and strings are allocated from the record's arena if it has one */
+static ares_status_t ares_dns_parse_fetch_bytes(ares_buf_t          *buf,
+                                               const ares_dns_rr_t *rr,
+                                               size_t               len,
+                                               ares_bool_t     null_term,
+                                               unsigned char **bytes)
+{
+  ares_arena_t  *arena = rr->parent->arena;
+  unsigned char *ptr;
+
+  if (arena == NULL) {
+    return ares_buf_fetch_bytes_dup(buf, len, null_term, bytes);
+  }
+
+  if (len == 0 || ares_buf_len(buf) < len) {
+    return ARES_EBADRESP;
+  }
+
+  ptr = ares_arena_alloc(arena, null_term ? len + 1 : len);
+  if (ptr == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  if (null_term) {
+    ptr[len] = 0;
+  }
+  *bytes = ptr;
+  return ares_buf_fetch_bytes(buf, ptr, len);
+}
+
+static ares_status_t ares_dns_parse_str(ares_buf_t          *buf,
+                                        const ares_dns_rr_t *rr, size_t max_len,
+                                        char **str)
+{
+  ares_arena_t *arena = rr->parent->arena;
+  ares_buf_t   *strbuf;
+  ares_status_t status;
+
+  if (arena == NULL) {
+    return ares_buf_parse_dns_str(buf, max_len, str);
+  }
+
+  strbuf = ares_arena_scratch(arena);
+  if (strbuf == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  status = ares_buf_parse_dns_str_into_buf(buf, max_len, strbuf);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  *str = ares_arena_scratch_finish(arena, NULL);
+  if (*str == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  return ARES_SUCCESS;
+}
+
 static ares_status_t ares_dns_parse_and_set_dns_name(ares_buf_t    *buf,
                                                      ares_bool_t    is_hostname,
                                                      ares_dns_rr_t *rr,
@@ -53,14 +112,15 @@ static ares_status_t ares_dns_parse_and_set_dns_name(ares_buf_t    *buf,
   ares_bool_t   allow_compression =
     ares_dns_rec_allow_name_comp(ares_dns_rr_get_type(rr));
 
-  status = ares_dns_name_parse(buf, &name, is_hostname, allow_compression);
+  status = ares_dns_name_parse_arena(buf, rr->parent->arena, &name,
+                                     is_hostname, allow_compression);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_str_own(rr, key, name);
   if (status != ARES_SUCCESS) {
-    ares_free(name);
+    ares_dns_record_free_mem(rr->parent, name);
     return status;
   }
   return ARES_SUCCESS;
@@ -75,19 +135,19 @@ static ares_status_t ares_dns_parse_and_set_dns_str(ares_buf_t       *buf,
   ares_status_t status;
   char         *str = NULL;
 
-  status = ares_buf_parse_dns_str(buf, max_len, &str);
+  status = ares_dns_parse_str(buf, rr, max_len, &str);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   if (!blank_allowed && ares_strlen(str) == 0) {
-    ares_free(str);
+    ares_dns_record_free_mem(rr->parent, str);
     return ARES_EBADRESP;
   }
 
   status = ares_dns_rr_set_str_own(rr, key, str);
   if (status != ARES_SUCCESS) {
-    ares_free(str);
+    ares_dns_record_free_mem(rr->parent, str);
     return status;
   }
   return ARES_SUCCESS;
@@ -102,7 +162,8 @@ static ares_status_t
   ares_dns_multistring_t *strs = NULL;
 
   status =
-    ares_dns_multistring_parse_buf(buf, max_len, &strs, validate_printable);
+    ares_dns_multistring_parse_buf(buf, rr->parent->arena, max_len, &strs,
+                                   validate_printable);
   if (status != ARES_SUCCESS) {
     return status;
   }
@@ -355,14 +416,14 @@ static ares_status_t ares_dns_parse_rr_sig(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_FALSE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_SIG_SIGNATURE, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
 
@@ -512,7 +573,7 @@ static ares_status_t ares_dns_parse_rr_opt(ares_buf_t *buf, ares_dns_rr_t *rr,
     }
 
     if (len) {
-      status = ares_buf_fetch_bytes_dup(buf, len, ARES_TRUE, &val);
+      status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_TRUE, &val);
       if (status != ARES_SUCCESS) {
         return status;
       }
@@ -520,7 +581,7 @@ static ares_status_t ares_dns_parse_rr_opt(ares_buf_t *buf, ares_dns_rr_t *rr,
 
     status = ares_dns_rr_set_opt_own(rr, ARES_RR_OPT_OPTIONS, opt, val, len);
     if (status != ARES_SUCCESS) {
-      ares_free(val);
+      ares_dns_record_free_mem(rr->parent, val);
       return status;
     }
   }
@@ -556,14 +617,14 @@ static ares_status_t ares_dns_parse_rr_ds(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_FALSE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_DS_DIGEST, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
 
@@ -593,14 +654,14 @@ static ares_status_t ares_dns_parse_rr_sshfp(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_FALSE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_SSHFP_FINGERPRINT, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
 
@@ -661,14 +722,14 @@ static ares_status_t ares_dns_parse_rr_rrsig(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_FALSE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_RRSIG_SIGNATURE, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
 
@@ -694,14 +755,14 @@ static ares_status_t ares_dns_parse_rr_nsec(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_FALSE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_NSEC_TYPE_BIT_MAPS, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
 
@@ -736,14 +797,14 @@ static ares_status_t
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_FALSE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_DNSKEY_PUBLIC_KEY, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
 
@@ -782,13 +843,14 @@ static ares_status_t ares_dns_parse_rr_nsec3(ares_buf_t *buf, ares_dns_rr_t *rr,
   }
 
   if (salt_length > 0) {
-    status = ares_buf_fetch_bytes_dup(buf, salt_length, ARES_FALSE, &data);
+    status =
+      ares_dns_parse_fetch_bytes(buf, rr, salt_length, ARES_FALSE, &data);
     if (status != ARES_SUCCESS) {
       return status;
     }
     status = ares_dns_rr_set_bin_own(rr, ARES_RR_NSEC3_SALT, data, salt_length);
     if (status != ARES_SUCCESS) {
-      ares_free(data);
+      ares_dns_record_free_mem(rr->parent, data);
       return status;
     }
   } else {
@@ -808,7 +870,7 @@ static ares_status_t ares_dns_parse_rr_nsec3(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, hash_length, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, hash_length, ARES_FALSE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
@@ -816,21 +878,21 @@ static ares_status_t ares_dns_parse_rr_nsec3(ares_buf_t *buf, ares_dns_rr_t *rr,
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_NSEC3_NEXT_HASHED_OWNER, data,
                                    hash_length);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
 
   /* Type Bit Maps (remaining) */
   len = ares_dns_rr_remaining_len(buf, orig_len, rdlength);
   if (len > 0) {
-    status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+    status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_FALSE, &data);
     if (status != ARES_SUCCESS) {
       return status;
     }
     status =
       ares_dns_rr_set_bin_own(rr, ARES_RR_NSEC3_TYPE_BIT_MAPS, data, len);
     if (status != ARES_SUCCESS) {
-      ares_free(data);
+      ares_dns_record_free_mem(rr->parent, data);
       return status;
     }
   } else {
@@ -876,14 +938,15 @@ static ares_status_t ares_dns_parse_rr_nsec3param(ares_buf_t    *buf,
   }
 
   if (salt_length > 0) {
-    status = ares_buf_fetch_bytes_dup(buf, salt_length, ARES_FALSE, &data);
+    status =
+      ares_dns_parse_fetch_bytes(buf, rr, salt_length, ARES_FALSE, &data);
     if (status != ARES_SUCCESS) {
       return status;
     }
     status =
       ares_dns_rr_set_bin_own(rr, ARES_RR_NSEC3PARAM_SALT, data, salt_length);
     if (status != ARES_SUCCESS) {
-      ares_free(data);
+      ares_dns_record_free_mem(rr->parent, data);
       return status;
     }
   } else {
@@ -924,14 +987,14 @@ static ares_status_t ares_dns_parse_rr_tlsa(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_FALSE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_TLSA_DATA, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
 
@@ -974,7 +1037,7 @@ static ares_status_t ares_dns_parse_rr_svcb(ares_buf_t *buf, ares_dns_rr_t *rr,
     }
 
     if (len) {
-      status = ares_buf_fetch_bytes_dup(buf, len, ARES_TRUE, &val);
+      status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_TRUE, &val);
       if (status != ARES_SUCCESS) {
         return status;
       }
@@ -982,7 +1045,7 @@ static ares_status_t ares_dns_parse_rr_svcb(ares_buf_t *buf, ares_dns_rr_t *rr,
 
     status = ares_dns_rr_set_opt_own(rr, ARES_RR_SVCB_PARAMS, opt, val, len);
     if (status != ARES_SUCCESS) {
-      ares_free(val);
+      ares_dns_record_free_mem(rr->parent, val);
       return status;
     }
   }
@@ -1026,7 +1089,7 @@ static ares_status_t ares_dns_parse_rr_https(ares_buf_t *buf, ares_dns_rr_t *rr,
     }
 
     if (len) {
-      status = ares_buf_fetch_bytes_dup(buf, len, ARES_TRUE, &val);
+      status = ares_dns_parse_fetch_bytes(buf, rr, len, ARES_TRUE, &val);
       if (status != ARES_SUCCESS) {
         return status;
       }
@@ -1034,7 +1097,7 @@ static ares_status_t ares_dns_parse_rr_https(ares_buf_t *buf, ares_dns_rr_t *rr,
 
     status = ares_dns_rr_set_opt_own(rr, ARES_RR_HTTPS_PARAMS, opt, val, len);
     if (status != ARES_SUCCESS) {
-      ares_free(val);
+      ares_dns_record_free_mem(rr->parent, val);
       return status;
     }
   }
@@ -1080,7 +1143,7 @@ static ares_status_t ares_dns_parse_rr_uri(ares_buf_t *buf, ares_dns_rr_t *rr,
 
   status = ares_dns_rr_set_str_own(rr, ARES_RR_URI_TARGET, name);
   if (status != ARES_SUCCESS) {
-    ares_free(name);
+    ares_dns_record_free_mem(rr->parent, name);
     return status;
   }
   name = NULL;
@@ -1116,14 +1179,14 @@ static ares_status_t ares_dns_parse_rr_caa(ares_buf_t *buf, ares_dns_rr_t *rr,
     status = ARES_EBADRESP;
     return status;
   }
-  status = ares_buf_fetch_bytes_dup(buf, data_len, ARES_TRUE, &data);
+  status = ares_dns_parse_fetch_bytes(buf, rr, data_len, ARES_TRUE, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_CAA_VALUE, data, data_len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_dns_record_free_mem(rr->parent, data);
     return status;
   }
   data = NULL;
@@ -1149,20 +1212,64 @@ static ares_status_t ares_dns_parse_rr_raw_rr(ares_buf_t    *buf,
     return ARES_SUCCESS;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, rdlength, ARES_FALSE, &bytes);
+  status = ares_dns_parse_fetch_bytes(buf, rr, rdlength, ARES_FALSE, &bytes);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_RAW_RR_DATA, bytes, rdlength);
   if (status != ARES_SUCCESS) {
-    ares_free(bytes);
+    ares_dns_record_free_mem(rr->parent, bytes);
     return status;
   }
 
   return ARES_SUCCESS;
 }
 
+unsigned short ares_dns_flags_fromwire(unsigned short flags)
+{
+  unsigned short dns_flags = 0;
+
+  /* QR */
+  if (flags & 0x8000) {
+    dns_flags |= ARES_FLAG_QR;
+  }
+
+  /* AA */
+  if (flags & 0x400) {
+    dns_flags |= ARES_FLAG_AA;
+  }
+
+  /* TC */
+  if (flags & 0x200) {
+    dns_flags |= ARES_FLAG_TC;
+  }
+
+  /* RD */
+  if (flags & 0x100) {
+    dns_flags |= ARES_FLAG_RD;
+  }
+
+  /* RA */
+  if (flags & 0x80) {
+    dns_flags |= ARES_FLAG_RA;
+  }
+
+  /* Z -- unused */
+
+  /* AD */
+  if (flags & 0x20) {
+    dns_flags |= ARES_FLAG_AD;
+  }
+
+  /* CD */
+  if (flags & 0x10) {
+    dns_flags |= ARES_FLAG_CD;
+  }
+
+  return dns_flags;
+}
+
 static ares_status_t ares_dns_parse_header(ares_buf_t *buf, unsigned int flags,
                                            ares_dns_record_t **dnsrec,
                                            unsigned short     *qdcount,
@@ -1173,11 +1280,10 @@ static ares_status_t ares_dns_parse_header(ares_buf_t *buf, unsigned int flags,
   ares_status_t     status = ARES_EBADRESP;
   unsigned short    u16;
   unsigned short    id;
-  unsigned short    dns_flags = 0;
+  unsigned short    dns_flags;
   ares_dns_opcode_t opcode;
   unsigned short    rcode;
-
-  (void)flags; /* currently unused */
+  ares_arena_t     *arena = NULL;
 
   if (buf == NULL || dnsrec == NULL || qdcount == NULL || ancount == NULL ||
       nscount == NULL || arcount == NULL) {
@@ -1218,46 +1324,11 @@ static ares_status_t ares_dns_parse_header(ares_buf_t *buf, unsigned int flags,
     goto fail;
   }
 
-  /* QR */
-  if (u16 & 0x8000) {
-    dns_flags |= ARES_FLAG_QR;
-  }
+  dns_flags = ares_dns_flags_fromwire(u16);
 
   /* OPCODE */
   opcode = (u16 >> 11) & 0xf;
 
-  /* AA */
-  if (u16 & 0x400) {
-    dns_flags |= ARES_FLAG_AA;
-  }
-
-  /* TC */
-  if (u16 & 0x200) {
-    dns_flags |= ARES_FLAG_TC;
-  }
-
-  /* RD */
-  if (u16 & 0x100) {
-    dns_flags |= ARES_FLAG_RD;
-  }
-
-  /* RA */
-  if (u16 & 0x80) {
-    dns_flags |= ARES_FLAG_RA;
-  }
-
-  /* Z -- unused */
-
-  /* AD */
-  if (u16 & 0x20) {
-    dns_flags |= ARES_FLAG_AD;
-  }
-
-  /* CD */
-  if (u16 & 0x10) {
-    dns_flags |= ARES_FLAG_CD;
-  }
-
   /* RCODE */
   rcode = u16 & 0xf;
 
@@ -1285,8 +1356,18 @@ static ares_status_t ares_dns_parse_header(ares_buf_t *buf, unsigned int flags,
     goto fail;
   }
 
-  status = ares_dns_record_create(dnsrec, id, dns_flags, opcode,
-                                  ARES_RCODE_NOERROR /* Temporary */);
+  /* Decompressed names make the parsed data larger than the message, size
+   * the arena so a typical response fits in the first chunk */
+  if (flags & ARES_DNS_PARSE_ARENA) {
+    arena = ares_arena_create(sizeof(**dnsrec) + ares_buf_len(buf) * 2);
+    if (arena == NULL) {
+      status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  status = ares_dns_record_create_arena(dnsrec, arena, id, dns_flags, opcode,
+                                        ARES_RCODE_NOERROR /* Temporary */);
   if (status != ARES_SUCCESS) {
     goto fail;
   }
@@ -1395,7 +1476,8 @@ static ares_status_t ares_dns_parse_qd(ares_buf_t        *buf,
    */
 
   /* Name */
-  status = ares_dns_name_parse(buf, &name, ARES_FALSE, ARES_TRUE);
+  status =
+    ares_dns_name_parse_arena(buf, dnsrec->arena, &name, ARES_FALSE, ARES_TRUE);
   if (status != ARES_SUCCESS) {
     goto done;
   }
@@ -1415,13 +1497,14 @@ static ares_status_t ares_dns_parse_qd(ares_buf_t        *buf,
   qclass = u16;
 
   /* Add question */
-  status = ares_dns_record_query_add(dnsrec, name, type, qclass);
+  status = ares_dns_record_query_add_own(dnsrec, name, type, qclass);
   if (status != ARES_SUCCESS) {
     goto done;
   }
+  name = NULL;
 
 done:
-  ares_free(name);
+  ares_dns_record_free_mem(dnsrec, name);
   return status;
 }
 
@@ -1466,7 +1549,8 @@ static ares_status_t ares_dns_parse_rr(ares_buf_t *buf, unsigned int flags,
    */
 
   /* Name */
-  status = ares_dns_name_parse(buf, &name, ARES_FALSE, ARES_TRUE);
+  status =
+    ares_dns_name_parse_arena(buf, dnsrec->arena, &name, ARES_FALSE, ARES_TRUE);
   if (status != ARES_SUCCESS) {
     goto done;
   }
@@ -1527,13 +1611,14 @@ static ares_status_t ares_dns_parse_rr(ares_buf_t *buf, unsigned int flags,
   }
 
   /* Add the base rr */
-  status =
-    ares_dns_record_rr_add(&rr, dnsrec, sect, name, type,
-                           type == ARES_REC_TYPE_OPT ? ARES_CLASS_IN : qclass,
-                           type == ARES_REC_TYPE_OPT ? 0 : ttl);
+  status = ares_dns_record_rr_add_own(
+    &rr, dnsrec, sect, name, type,
+    type == ARES_REC_TYPE_OPT ? ARES_CLASS_IN : qclass,
+    type == ARES_REC_TYPE_OPT ? 0 : ttl);
   if (status != ARES_SUCCESS) {
     goto done;
   }
+  name = NULL;
 
   /* Record the current remaining length in the buffer so we can tell how
    * much was processed */
@@ -1563,7 +1648,7 @@ static ares_status_t ares_dns_parse_rr(ares_buf_t *buf, unsigned int flags,
 
 
 done:
-  ares_free(name);
+  ares_dns_record_free_mem(dnsrec, name);
   return status;
 }
 
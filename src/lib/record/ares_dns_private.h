@@ -32,6 +32,8 @@ ares_bool_t ares_dns_rec_allow_name_comp(ares_dns_rec_type_t type);
 ares_bool_t ares_dns_opcode_isvalid(ares_dns_opcode_t opcode);
 ares_bool_t ares_dns_rcode_isvalid(ares_dns_rcode_t rcode);
 ares_bool_t ares_dns_flags_arevalid(unsigned short flags);
+/*! Convert the flags bits of a DNS header to ares_dns_flags_t values */
+unsigned short ares_dns_flags_fromwire(unsigned short flags);
 ares_bool_t ares_dns_rec_type_isvalid(ares_dns_rec_type_t type,
                                       ares_bool_t         is_query);
 ares_bool_t ares_dns_class_isvalid(ares_dns_class_t    qclass,
@@ -49,12 +51,36 @@ ares_status_t ares_dns_rr_set_abin_own(ares_dns_rr_t          *dns_rr,
 ares_status_t ares_dns_rr_set_opt_own(ares_dns_rr_t    *dns_rr,
                                       ares_dns_rr_key_t key, unsigned short opt,
                                       unsigned char *val, size_t val_len);
+/*! Create a record whose structure is allocated from an arena, the record
+ *  takes ownership of the arena even on failure and destroys it when the
+ *  record is destroyed. */
+ares_status_t ares_dns_record_create_arena(ares_dns_record_t **dnsrec,
+                                           ares_arena_t       *arena,
+                                           unsigned short id,
+                                           unsigned short flags,
+                                           ares_dns_opcode_t opcode,
+                                           ares_dns_rcode_t  rcode);
+/*! Release memory held by a record, which is a no-op for memory belonging
+ *  to the record's arena */
+void ares_dns_record_free_mem(const ares_dns_record_t *dnsrec, void *ptr);
+/*! Same as ares_dns_record_query_add() but takes ownership of the name,
+ *  which must come from ares_malloc() or the record's arena */
+ares_status_t ares_dns_record_query_add_own(ares_dns_record_t  *dnsrec,
+                                            char               *name,
+                                            ares_dns_rec_type_t qtype,
+                                            ares_dns_class_t    qclass);
+/*! Same as ares_dns_record_rr_add() but takes ownership of the name,
+ *  which must come from ares_malloc() or the record's arena */
+ares_status_t ares_dns_record_rr_add_own(ares_dns_rr_t    **rr_out,
+                                         ares_dns_record_t *dnsrec,
+                                         ares_dns_section_t sect, char *name,
+                                         ares_dns_rec_type_t type,
+                                         ares_dns_class_t    rclass,
+                                         unsigned int        ttl);
 ares_status_t ares_dns_record_rr_prealloc(ares_dns_record_t *dnsrec,
                                           ares_dns_section_t sect, size_t cnt);
 ares_dns_rr_t *ares_dns_get_opt_rr(ares_dns_record_t *rec);
 const ares_dns_rr_t *ares_dns_get_opt_rr_const(const ares_dns_record_t *rec);
-void ares_dns_record_ttl_decrement(ares_dns_record_t *dnsrec,
-                                   unsigned int       ttl_decrement);
 
 /* Same as ares_dns_write() but appends to an existing buffer object */
 ares_status_t ares_dns_write_buf(const ares_dns_record_t *dnsrec,
@@ -92,6 +118,7 @@ ares_status_t ares_dns_query_reply_tostatus(ares_dns_rcode_t rcode,
                                             size_t           ancount);
 
 struct ares_dns_qd {
+  ares_dns_record_t  *parent;
   char               *name;
   ares_dns_rec_type_t qtype;
   ares_dns_class_t    qclass;
@@ -223,9 +250,10 @@ typedef struct {
 } ares_dns_naptr_t;
 
 typedef struct {
-  unsigned short opt;
-  unsigned char *val;
-  size_t         val_len;
+  ares_dns_record_t *parent;
+  unsigned short     opt;
+  unsigned char     *val;
+  size_t             val_len;
 } ares_dns_optval_t;
 
 typedef struct {
@@ -311,22 +339,21 @@ struct ares_dns_rr {
 
 /*! DNS data structure */
 struct ares_dns_record {
-  unsigned short    id;            /*!< DNS query id */
-  unsigned short    flags;         /*!< One or more ares_dns_flags_t */
-  ares_dns_opcode_t opcode;        /*!< DNS Opcode */
-  ares_dns_rcode_t  rcode;         /*!< DNS RCODE */
-  unsigned short    raw_rcode;     /*!< Raw rcode, used to ultimately form real
-                                    *   rcode after reading OPT record if it
-                                    *   exists */
-  unsigned int      ttl_decrement; /*!< Special case to apply to writing out
-                                    *   this record, where it will decrement
-                                    *   the ttl of any resource records by
-                                    *   this amount.  Used for cache */
-
-  ares_array_t     *qd;            /*!< Type is ares_dns_qd_t */
-  ares_array_t     *an;            /*!< Type is ares_dns_rr_t */
-  ares_array_t     *ns;            /*!< Type is ares_dns_rr_t */
-  ares_array_t     *ar;            /*!< Type is ares_dns_rr_t */
+  unsigned short    id;        /*!< DNS query id */
+  unsigned short    flags;     /*!< One or more ares_dns_flags_t */
+  ares_dns_opcode_t opcode;    /*!< DNS Opcode */
+  ares_dns_rcode_t  rcode;     /*!< DNS RCODE */
+  unsigned short    raw_rcode; /*!< Raw rcode, used to ultimately form real
+                                *   rcode after reading OPT record if it
+                                *   exists */
+
+  ares_array_t     *qd;        /*!< Type is ares_dns_qd_t */
+  ares_array_t     *an;        /*!< Type is ares_dns_rr_t */
+  ares_array_t     *ns;        /*!< Type is ares_dns_rr_t */
+  ares_array_t     *ar;        /*!< Type is ares_dns_rr_t */
+  ares_arena_t     *arena;     /*!< Arena holding the record itself and the
+                                *   data parsed into it, or NULL if
+                                *   everything is individually allocated */
 };
 
 #endif
@@ -37,7 +37,7 @@ static void ares_dns_qd_free_cb(void *arg)
   if (qd == NULL) {
     return;
   }
-  ares_free(qd->name);
+  ares_dns_record_free_mem(qd->parent, qd->name);
 }
 
 static void ares_dns_rr_free_cb(void *arg)
@@ -49,12 +49,23 @@ static void ares_dns_rr_free_cb(void *arg)
   ares_dns_rr_free(rr);
 }
 
-ares_status_t ares_dns_record_create(ares_dns_record_t **dnsrec,
-                                     unsigned short id, unsigned short flags,
-                                     ares_dns_opcode_t opcode,
-                                     ares_dns_rcode_t  rcode)
+void ares_dns_record_free_mem(const ares_dns_record_t *dnsrec, void *ptr)
+{
+  if (dnsrec != NULL && ares_arena_owns(dnsrec->arena, ptr)) {
+    return;
+  }
+  ares_free(ptr);
+}
+
+ares_status_t ares_dns_record_create_arena(ares_dns_record_t **dnsrec,
+                                           ares_arena_t       *arena,
+                                           unsigned short id,
+                                           unsigned short flags,
+                                           ares_dns_opcode_t opcode,
+                                           ares_dns_rcode_t  rcode)
 {
   if (dnsrec == NULL) {
+    ares_arena_destroy(arena);
     return ARES_EFORMERR;
   }
 
@@ -62,10 +73,21 @@ ares_status_t ares_dns_record_create(ares_dns_record_t **dnsrec,
 
   if (!ares_dns_opcode_isvalid(opcode) || !ares_dns_rcode_isvalid(rcode) ||
       !ares_dns_flags_arevalid(flags)) {
+    ares_arena_destroy(arena);
     return ARES_EFORMERR;
   }
 
-  *dnsrec = ares_malloc_zero(sizeof(**dnsrec));
+  if (arena != NULL) {
+    *dnsrec = ares_arena_alloc(arena, sizeof(**dnsrec));
+    if (*dnsrec != NULL) {
+      memset(*dnsrec, 0, sizeof(**dnsrec));
+      (*dnsrec)->arena = arena;
+    } else {
+      ares_arena_destroy(arena); /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  } else {
+    *dnsrec = ares_malloc_zero(sizeof(**dnsrec));
+  }
   if (*dnsrec == NULL) {
     return ARES_ENOMEM;
   }
@@ -89,6 +111,14 @@ ares_status_t ares_dns_record_create(ares_dns_record_t **dnsrec,
   return ARES_SUCCESS;
 }
 
+ares_status_t ares_dns_record_create(ares_dns_record_t **dnsrec,
+                                     unsigned short id, unsigned short flags,
+                                     ares_dns_opcode_t opcode,
+                                     ares_dns_rcode_t  rcode)
+{
+  return ares_dns_record_create_arena(dnsrec, NULL, id, flags, opcode, rcode);
+}
+
 unsigned short ares_dns_record_get_id(const ares_dns_record_t *dnsrec)
 {
   if (dnsrec == NULL) {
@@ -132,7 +162,7 @@ ares_dns_rcode_t ares_dns_record_get_rcode(const ares_dns_record_t *dnsrec)
 
 static void ares_dns_rr_free(ares_dns_rr_t *rr)
 {
-  ares_free(rr->name);
+  ares_dns_record_free_mem(rr->parent, rr->name);
 
   switch (rr->type) {
     case ARES_REC_TYPE_A:
@@ -142,29 +172,29 @@ static void ares_dns_rr_free(ares_dns_rr_t *rr)
       break;
 
     case ARES_REC_TYPE_NS:
-      ares_free(rr->r.ns.nsdname);
+      ares_dns_record_free_mem(rr->parent, rr->r.ns.nsdname);
       break;
 
     case ARES_REC_TYPE_CNAME:
-      ares_free(rr->r.cname.cname);
+      ares_dns_record_free_mem(rr->parent, rr->r.cname.cname);
       break;
 
     case ARES_REC_TYPE_SOA:
-      ares_free(rr->r.soa.mname);
-      ares_free(rr->r.soa.rname);
+      ares_dns_record_free_mem(rr->parent, rr->r.soa.mname);
+      ares_dns_record_free_mem(rr->parent, rr->r.soa.rname);
       break;
 
     case ARES_REC_TYPE_PTR:
-      ares_free(rr->r.ptr.dname);
+      ares_dns_record_free_mem(rr->parent, rr->r.ptr.dname);
       break;
 
     case ARES_REC_TYPE_HINFO:
-      ares_free(rr->r.hinfo.cpu);
-      ares_free(rr->r.hinfo.os);
+      ares_dns_record_free_mem(rr->parent, rr->r.hinfo.cpu);
+      ares_dns_record_free_mem(rr->parent, rr->r.hinfo.os);
       break;
 
     case ARES_REC_TYPE_MX:
-      ares_free(rr->r.mx.exchange);
+      ares_dns_record_free_mem(rr->parent, rr->r.mx.exchange);
       break;
 
     case ARES_REC_TYPE_TXT:
@@ -172,19 +202,19 @@ static void ares_dns_rr_free(ares_dns_rr_t *rr)
       break;
 
     case ARES_REC_TYPE_SIG:
-      ares_free(rr->r.sig.signers_name);
-      ares_free(rr->r.sig.signature);
+      ares_dns_record_free_mem(rr->parent, rr->r.sig.signers_name);
+      ares_dns_record_free_mem(rr->parent, rr->r.sig.signature);
       break;
 
     case ARES_REC_TYPE_SRV:
-      ares_free(rr->r.srv.target);
+      ares_dns_record_free_mem(rr->parent, rr->r.srv.target);
       break;
 
     case ARES_REC_TYPE_NAPTR:
-      ares_free(rr->r.naptr.flags);
-      ares_free(rr->r.naptr.services);
-      ares_free(rr->r.naptr.regexp);
-      ares_free(rr->r.naptr.replacement);
+      ares_dns_record_free_mem(rr->parent, rr->r.naptr.flags);
+      ares_dns_record_free_mem(rr->parent, rr->r.naptr.services);
+      ares_dns_record_free_mem(rr->parent, rr->r.naptr.regexp);
+      ares_dns_record_free_mem(rr->parent, rr->r.naptr.replacement);
       break;
 
     case ARES_REC_TYPE_OPT:
@@ -192,62 +222,62 @@ static void ares_dns_rr_free(ares_dns_rr_t *rr)
       break;
 
     case ARES_REC_TYPE_DS:
-      ares_free(rr->r.ds.digest);
+      ares_dns_record_free_mem(rr->parent, rr->r.ds.digest);
       break;
 
     case ARES_REC_TYPE_SSHFP:
-      ares_free(rr->r.sshfp.fingerprint);
+      ares_dns_record_free_mem(rr->parent, rr->r.sshfp.fingerprint);
       break;
 
     case ARES_REC_TYPE_RRSIG:
-      ares_free(rr->r.rrsig.signers_name);
-      ares_free(rr->r.rrsig.signature);
+      ares_dns_record_free_mem(rr->parent, rr->r.rrsig.signers_name);
+      ares_dns_record_free_mem(rr->parent, rr->r.rrsig.signature);
       break;
 
     case ARES_REC_TYPE_NSEC:
-      ares_free(rr->r.nsec.next_domain_name);
-      ares_free(rr->r.nsec.type_bit_maps);
+      ares_dns_record_free_mem(rr->parent, rr->r.nsec.next_domain_name);
+      ares_dns_record_free_mem(rr->parent, rr->r.nsec.type_bit_maps);
       break;
 
     case ARES_REC_TYPE_DNSKEY:
-      ares_free(rr->r.dnskey.public_key);
+      ares_dns_record_free_mem(rr->parent, rr->r.dnskey.public_key);
       break;
 
     case ARES_REC_TYPE_NSEC3:
-      ares_free(rr->r.nsec3.salt);
-      ares_free(rr->r.nsec3.next_hashed_owner_name);
-      ares_free(rr->r.nsec3.type_bit_maps);
+      ares_dns_record_free_mem(rr->parent, rr->r.nsec3.salt);
+      ares_dns_record_free_mem(rr->parent, rr->r.nsec3.next_hashed_owner_name);
+      ares_dns_record_free_mem(rr->parent, rr->r.nsec3.type_bit_maps);
       break;
 
     case ARES_REC_TYPE_NSEC3PARAM:
-      ares_free(rr->r.nsec3param.salt);
+      ares_dns_record_free_mem(rr->parent, rr->r.nsec3param.salt);
       break;
 
     case ARES_REC_TYPE_TLSA:
-      ares_free(rr->r.tlsa.data);
+      ares_dns_record_free_mem(rr->parent, rr->r.tlsa.data);
       break;
 
     case ARES_REC_TYPE_SVCB:
-      ares_free(rr->r.svcb.target);
+      ares_dns_record_free_mem(rr->parent, rr->r.svcb.target);
       ares_array_destroy(rr->r.svcb.params);
       break;
 
     case ARES_REC_TYPE_HTTPS:
-      ares_free(rr->r.https.target);
+      ares_dns_record_free_mem(rr->parent, rr->r.https.target);
       ares_array_destroy(rr->r.https.params);
       break;
 
     case ARES_REC_TYPE_URI:
-      ares_free(rr->r.uri.target);
+      ares_dns_record_free_mem(rr->parent, rr->r.uri.target);
       break;
 
     case ARES_REC_TYPE_CAA:
-      ares_free(rr->r.caa.tag);
-      ares_free(rr->r.caa.value);
+      ares_dns_record_free_mem(rr->parent, rr->r.caa.tag);
+      ares_dns_record_free_mem(rr->parent, rr->r.caa.value);
       break;
 
     case ARES_REC_TYPE_RAW_RR:
-      ares_free(rr->r.raw_rr.data);
+      ares_dns_record_free_mem(rr->parent, rr->r.raw_rr.data);
       break;
   }
 }
@@ -270,7 +300,12 @@ void ares_dns_record_destroy(ares_dns_record_t *dnsrec)
   /* Free additional */
   ares_array_destroy(dnsrec->ar);
 
-  ares_free(dnsrec);
+  /* The record itself lives in its arena if it has one */
+  if (dnsrec->arena != NULL) {
+    ares_arena_destroy(dnsrec->arena);
+  } else {
+    ares_free(dnsrec);
+  }
 }
 
 size_t ares_dns_record_query_cnt(const ares_dns_record_t *dnsrec)
@@ -281,12 +316,11 @@ size_t ares_dns_record_query_cnt(const ares_dns_record_t *dnsrec)
   return ares_array_len(dnsrec->qd);
 }
 
-ares_status_t ares_dns_record_query_add(ares_dns_record_t  *dnsrec,
-                                        const char         *name,
-                                        ares_dns_rec_type_t qtype,
-                                        ares_dns_class_t    qclass)
+ares_status_t ares_dns_record_query_add_own(ares_dns_record_t  *dnsrec,
+                                            char               *name,
+                                            ares_dns_rec_type_t qtype,
+                                            ares_dns_class_t    qclass)
 {
-  size_t         idx;
   ares_dns_qd_t *qd;
   ares_status_t  status;
 
@@ -296,22 +330,42 @@ ares_status_t ares_dns_record_query_add(ares_dns_record_t  *dnsrec,
     return ARES_EFORMERR;
   }
 
-  idx    = ares_array_len(dnsrec->qd);
   status = ares_array_insert_last((void **)&qd, dnsrec->qd);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
-  qd->name = ares_strdup(name);
-  if (qd->name == NULL) {
-    ares_array_remove_at(dnsrec->qd, idx);
-    return ARES_ENOMEM;
-  }
+  qd->parent = dnsrec;
+  qd->name   = name;
   qd->qtype  = qtype;
   qd->qclass = qclass;
   return ARES_SUCCESS;
 }
 
+ares_status_t ares_dns_record_query_add(ares_dns_record_t  *dnsrec,
+                                        const char         *name,
+                                        ares_dns_rec_type_t qtype,
+                                        ares_dns_class_t    qclass)
+{
+  char         *temp;
+  ares_status_t status;
+
+  if (dnsrec == NULL || name == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  temp = ares_strdup(name);
+  if (temp == NULL) {
+    return ARES_ENOMEM;
+  }
+
+  status = ares_dns_record_query_add_own(dnsrec, temp, qtype, qclass);
+  if (status != ARES_SUCCESS) {
+    ares_free(temp);
+  }
+  return status;
+}
+
 ares_status_t ares_dns_record_query_set_name(ares_dns_record_t *dnsrec,
                                              size_t idx, const char *name)
 {
@@ -331,7 +385,7 @@ ares_status_t ares_dns_record_query_set_name(ares_dns_record_t *dnsrec,
     return ARES_ENOMEM;   /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  ares_free(orig_name);
+  ares_dns_record_free_mem(dnsrec, orig_name);
   return ARES_SUCCESS;
 }
 
@@ -425,16 +479,16 @@ ares_status_t ares_dns_record_rr_prealloc(ares_dns_record_t *dnsrec,
   return ares_array_set_size(arr, cnt);
 }
 
-ares_status_t ares_dns_record_rr_add(ares_dns_rr_t    **rr_out,
-                                     ares_dns_record_t *dnsrec,
-                                     ares_dns_section_t sect, const char *name,
-                                     ares_dns_rec_type_t type,
-                                     ares_dns_class_t rclass, unsigned int ttl)
+ares_status_t ares_dns_record_rr_add_own(ares_dns_rr_t    **rr_out,
+                                         ares_dns_record_t *dnsrec,
+                                         ares_dns_section_t sect, char *name,
+                                         ares_dns_rec_type_t type,
+                                         ares_dns_class_t    rclass,
+                                         unsigned int        ttl)
 {
   ares_dns_rr_t *rr  = NULL;
   ares_array_t  *arr = NULL;
   ares_status_t  status;
-  size_t         idx;
 
   if (dnsrec == NULL || name == NULL || rr_out == NULL ||
       !ares_dns_section_isvalid(sect) ||
@@ -457,18 +511,12 @@ ares_status_t ares_dns_record_rr_add(ares_dns_rr_t    **rr_out,
       break;
   }
 
-  idx    = ares_array_len(arr);
   status = ares_array_insert_last((void **)&rr, arr);
   if (status != ARES_SUCCESS) {
     return status; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  rr->name = ares_strdup(name);
-  if (rr->name == NULL) {
-    ares_array_remove_at(arr, idx);
-    return ARES_ENOMEM;
-  }
-
+  rr->name   = name;
   rr->parent = dnsrec;
   rr->type   = type;
   rr->rclass = rclass;
@@ -479,6 +527,34 @@ ares_status_t ares_dns_record_rr_add(ares_dns_rr_t    **rr_out,
   return ARES_SUCCESS;
 }
 
+ares_status_t ares_dns_record_rr_add(ares_dns_rr_t    **rr_out,
+                                     ares_dns_record_t *dnsrec,
+                                     ares_dns_section_t sect, const char *name,
+                                     ares_dns_rec_type_t type,
+                                     ares_dns_class_t rclass, unsigned int ttl)
+{
+  char         *temp;
+  ares_status_t status;
+
+  if (dnsrec == NULL || name == NULL || rr_out == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  *rr_out = NULL;
+
+  temp = ares_strdup(name);
+  if (temp == NULL) {
+    return ARES_ENOMEM;
+  }
+
+  status =
+    ares_dns_record_rr_add_own(rr_out, dnsrec, sect, temp, type, rclass, ttl);
+  if (status != ARES_SUCCESS) {
+    ares_free(temp);
+  }
+  return status;
+}
+
 ares_status_t ares_dns_record_rr_del(ares_dns_record_t *dnsrec,
                                      ares_dns_section_t sect, size_t idx)
 {
@@ -1404,7 +1480,7 @@ ares_status_t ares_dns_rr_set_bin_own(ares_dns_rr_t    *dns_rr,
   }
 
   if (*bin) {
-    ares_free(*bin);
+    ares_dns_record_free_mem(dns_rr->parent, *bin);
   }
   *bin     = val;
   *bin_len = len;
@@ -1477,7 +1553,7 @@ ares_status_t ares_dns_rr_set_str_own(ares_dns_rr_t    *dns_rr,
   }
 
   if (*str) {
-    ares_free(*str);
+    ares_dns_record_free_mem(dns_rr->parent, *str);
   }
   *str = val;
 
@@ -1534,7 +1610,7 @@ static void ares_dns_opt_free_cb(void *arg)
   if (opt == NULL) {
     return;
   }
-  ares_free(opt->val);
+  ares_dns_record_free_mem(opt->parent, opt->val);
 }
 
 ares_status_t ares_dns_rr_set_opt_own(ares_dns_rr_t    *dns_rr,
@@ -1586,7 +1662,8 @@ ares_status_t ares_dns_rr_set_opt_own(ares_dns_rr_t    *dns_rr,
   }
 
 done:
-  ares_free(optptr->val);
+  ares_dns_record_free_mem(dns_rr->parent, optptr->val);
+  optptr->parent  = dns_rr->parent;
   optptr->opt     = opt;
   optptr->val     = val;
   optptr->val_len = val_len;
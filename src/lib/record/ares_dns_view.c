@@ -0,0 +1,484 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ares_private.h"
+
+/* A view never copies the message or allocates.  Every accessor wraps the
+ * message in a buffer on the stack positioned at the offset it needs, the
+ * structure of the whole message having been validated up front by
+ * ares_dns_view_init() so only record data can still be malformed. */
+
+static void ares_dns_view_buf(const ares_dns_view_t *view, ares_buf_t *buf,
+                              size_t offset)
+{
+  ares_buf_init_const(buf, view->msg, view->msg_len);
+  ares_buf_set_position(buf, offset);
+}
+
+/* Read the resource record at the current position, leaving the position
+ * at the end of its record data */
+static ares_status_t ares_dns_view_rr_read(ares_buf_t         *buf,
+                                           ares_dns_view_rr_t *rr)
+{
+  unsigned short rdlength;
+  ares_status_t  status;
+
+  rr->name_offset = ares_buf_get_position(buf);
+  status          = ares_dns_name_parse(buf, NULL, ARES_FALSE, ARES_TRUE);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  status = ares_buf_fetch_be16(buf, &rr->type);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  status = ares_buf_fetch_be16(buf, &rr->rclass);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  status = ares_buf_fetch_be32(buf, &rr->ttl);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  status = ares_buf_fetch_be16(buf, &rdlength);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  rr->rdata_offset = ares_buf_get_position(buf);
+  rr->rdata_len    = rdlength;
+  return ares_buf_consume(buf, rdlength);
+}
+
+ares_status_t ares_dns_view_init(ares_dns_view_t     *view,
+                                 const unsigned char *msg, size_t msg_len)
+{
+  const size_t       min_rr_wire_len = 11;
+  ares_buf_t         buf;
+  ares_dns_view_rr_t rr;
+  unsigned short     u16;
+  unsigned short     rcode;
+  size_t             total_rr_count;
+  size_t             opt_cnt = 0;
+  size_t             sect;
+  size_t             i;
+  ares_status_t      status;
+
+  if (view == NULL || msg == NULL || msg_len == 0) {
+    return ARES_EFORMERR;
+  }
+
+  /* Maximum DNS packet size is 64k, even over TCP */
+  if (msg_len > 0xFFFF) {
+    return ARES_EFORMERR;
+  }
+
+  memset(view, 0, sizeof(*view));
+  view->msg     = msg;
+  view->msg_len = msg_len;
+  ares_buf_init_const(&buf, msg, msg_len);
+
+  status = ares_buf_fetch_be16(&buf, &view->id);
+  if (status != ARES_SUCCESS) {
+    goto fail;
+  }
+
+  status = ares_buf_fetch_be16(&buf, &u16);
+  if (status != ARES_SUCCESS) {
+    goto fail;
+  }
+  view->flags  = ares_dns_flags_fromwire(u16);
+  view->opcode = (u16 >> 11) & 0xf;
+  rcode        = u16 & 0xf;
+
+  if (!ares_dns_opcode_isvalid((ares_dns_opcode_t)view->opcode)) {
+    status = ARES_EFORMERR;
+    goto fail;
+  }
+
+  for (i = 0; i < 4; i++) {
+    status = ares_buf_fetch_be16(&buf, &view->cnt[i]);
+    if (status != ARES_SUCCESS) {
+      goto fail;
+    }
+  }
+
+  /* Exactly one question, as with ares_dns_parse() */
+  if (view->cnt[0] != 1) {
+    status = ARES_EBADRESP;
+    goto fail;
+  }
+
+  view->offset[0] = ares_buf_get_position(&buf);
+  status          = ares_dns_name_parse(&buf, NULL, ARES_FALSE, ARES_TRUE);
+  if (status != ARES_SUCCESS) {
+    goto fail;
+  }
+
+  /* Type and Class */
+  status = ares_buf_consume(&buf, 4);
+  if (status != ARES_SUCCESS) {
+    goto fail;
+  }
+
+  total_rr_count = (size_t)view->cnt[ARES_SECTION_ANSWER] +
+                   (size_t)view->cnt[ARES_SECTION_AUTHORITY] +
+                   (size_t)view->cnt[ARES_SECTION_ADDITIONAL];
+  if (total_rr_count > ares_buf_len(&buf) / min_rr_wire_len) {
+    status = ARES_EBADRESP;
+    goto fail;
+  }
+
+  for (sect = ARES_SECTION_ANSWER; sect <= ARES_SECTION_ADDITIONAL; sect++) {
+    view->offset[sect] = ares_buf_get_position(&buf);
+    for (i = 0; i < view->cnt[sect]; i++) {
+      status = ares_dns_view_rr_read(&buf, &rr);
+      if (status != ARES_SUCCESS) {
+        goto fail;
+      }
+
+      if (rr.type != ARES_REC_TYPE_OPT) {
+        continue;
+      }
+
+      /* RFC 6891 6.1.1: a message MUST NOT contain more than one OPT RR */
+      if (sect == ARES_SECTION_ADDITIONAL && ++opt_cnt > 1) {
+        status = ARES_EBADRESP;
+        goto fail;
+      }
+
+      /* First 8 bits of TTL are an extended RCODE */
+      rcode |= (unsigned short)((rr.ttl >> 20) & 0x0FF0);
+    }
+  }
+
+  if (!ares_dns_rcode_isvalid((ares_dns_rcode_t)rcode)) {
+    rcode = ARES_RCODE_SERVFAIL;
+  }
+  view->rcode = rcode;
+
+  return ARES_SUCCESS;
+
+fail:
+  if (status == ARES_EBADNAME) {
+    status = ARES_EBADRESP;
+  }
+  memset(view, 0, sizeof(*view));
+  return status;
+}
+
+unsigned short ares_dns_view_get_id(const ares_dns_view_t *view)
+{
+  if (view == NULL) {
+    return 0;
+  }
+  return view->id;
+}
+
+unsigned short ares_dns_view_get_flags(const ares_dns_view_t *view)
+{
+  if (view == NULL) {
+    return 0;
+  }
+  return view->flags;
+}
+
+ares_dns_opcode_t ares_dns_view_get_opcode(const ares_dns_view_t *view)
+{
+  if (view == NULL) {
+    return 0;
+  }
+  return (ares_dns_opcode_t)view->opcode;
+}
+
+ares_dns_rcode_t ares_dns_view_get_rcode(const ares_dns_view_t *view)
+{
+  if (view == NULL) {
+    return 0;
+  }
+  return (ares_dns_rcode_t)view->rcode;
+}
+
+ares_status_t ares_dns_view_query_get(const ares_dns_view_t *view, char *name,
+                                      size_t name_len,
+                                      ares_dns_rec_type_t *qtype,
+                                      ares_dns_class_t    *qclass)
+{
+  ares_buf_t     buf;
+  unsigned short u16;
+  ares_status_t  status;
+
+  if (view == NULL || view->msg == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  ares_dns_view_buf(view, &buf, view->offset[0]);
+
+  if (name != NULL) {
+    status =
+      ares_dns_name_parse_fixed(&buf, name, name_len, ARES_FALSE, ARES_TRUE);
+  } else {
+    status = ares_dns_name_parse(&buf, NULL, ARES_FALSE, ARES_TRUE);
+  }
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  status = ares_buf_fetch_be16(&buf, &u16);
+  if (status != ARES_SUCCESS) {
+    return status; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+  if (qtype != NULL) {
+    *qtype = (ares_dns_rec_type_t)u16;
+  }
+
+  status = ares_buf_fetch_be16(&buf, &u16);
+  if (status != ARES_SUCCESS) {
+    return status; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+  if (qclass != NULL) {
+    *qclass = (ares_dns_class_t)u16;
+  }
+
+  return ARES_SUCCESS;
+}
+
+size_t ares_dns_view_rr_cnt(const ares_dns_view_t *view,
+                            ares_dns_section_t     sect)
+{
+  if (view == NULL || !ares_dns_section_isvalid(sect)) {
+    return 0;
+  }
+  return view->cnt[sect];
+}
+
+ares_bool_t ares_dns_view_rr_first(const ares_dns_view_t *view,
+                                   ares_dns_section_t     sect,
+                                   ares_dns_view_rr_t    *rr)
+{
+  ares_buf_t buf;
+
+  if (rr == NULL) {
+    return ARES_FALSE;
+  }
+
+  memset(rr, 0, sizeof(*rr));
+
+  if (ares_dns_view_rr_cnt(view, sect) == 0) {
+    return ARES_FALSE;
+  }
+
+  rr->view = view;
+  rr->sect = sect;
+  ares_dns_view_buf(view, &buf, view->offset[sect]);
+  return ares_dns_view_rr_read(&buf, rr) == ARES_SUCCESS ? ARES_TRUE
+                                                          : ARES_FALSE;
+}
+
+ares_bool_t ares_dns_view_rr_next(ares_dns_view_rr_t *rr)
+{
+  ares_buf_t buf;
+
+  if (rr == NULL || rr->view == NULL ||
+      rr->idx + 1 >= ares_dns_view_rr_cnt(rr->view, rr->sect)) {
+    return ARES_FALSE;
+  }
+
+  ares_dns_view_buf(rr->view, &buf, rr->rdata_offset + rr->rdata_len);
+  rr->idx++;
+  return ares_dns_view_rr_read(&buf, rr) == ARES_SUCCESS ? ARES_TRUE
+                                                          : ARES_FALSE;
+}
+
+ares_status_t ares_dns_view_rr_get_name(const ares_dns_view_rr_t *rr,
+                                        char *name, size_t name_len)
+{
+  ares_buf_t buf;
+
+  if (rr == NULL || rr->view == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  ares_dns_view_buf(rr->view, &buf, rr->name_offset);
+  return ares_dns_name_parse_fixed(&buf, name, name_len, ARES_FALSE,
+                                   ARES_TRUE);
+}
+
+ares_dns_rec_type_t ares_dns_view_rr_get_type(const ares_dns_view_rr_t *rr)
+{
+  if (rr == NULL || rr->view == NULL) {
+    return 0;
+  }
+  return (ares_dns_rec_type_t)rr->type;
+}
+
+ares_dns_class_t ares_dns_view_rr_get_class(const ares_dns_view_rr_t *rr)
+{
+  if (rr == NULL || rr->view == NULL) {
+    return 0;
+  }
+  return (ares_dns_class_t)rr->rclass;
+}
+
+unsigned int ares_dns_view_rr_get_ttl(const ares_dns_view_rr_t *rr)
+{
+  if (rr == NULL || rr->view == NULL) {
+    return 0;
+  }
+  return rr->ttl;
+}
+
+const unsigned char *ares_dns_view_rr_get_rdata(const ares_dns_view_rr_t *rr,
+                                                size_t                   *len)
+{
+  if (rr == NULL || rr->view == NULL || len == NULL || rr->rdata_len == 0) {
+    return NULL;
+  }
+
+  *len = rr->rdata_len;
+  return rr->view->msg + rr->rdata_offset;
+}
+
+ares_status_t ares_dns_view_rr_get_addr(const ares_dns_view_rr_t *rr,
+                                        struct in_addr           *addr)
+{
+  if (rr == NULL || rr->view == NULL || addr == NULL ||
+      rr->type != ARES_REC_TYPE_A) {
+    return ARES_EFORMERR;
+  }
+
+  if (rr->rdata_len != sizeof(*addr)) {
+    return ARES_EBADRESP;
+  }
+
+  memcpy(addr, rr->view->msg + rr->rdata_offset, sizeof(*addr));
+  return ARES_SUCCESS;
+}
+
+ares_status_t ares_dns_view_rr_get_addr6(const ares_dns_view_rr_t *rr,
+                                         struct ares_in6_addr     *addr)
+{
+  if (rr == NULL || rr->view == NULL || addr == NULL ||
+      rr->type != ARES_REC_TYPE_AAAA) {
+    return ARES_EFORMERR;
+  }
+
+  if (rr->rdata_len != sizeof(*addr)) {
+    return ARES_EBADRESP;
+  }
+
+  memcpy(addr, rr->view->msg + rr->rdata_offset, sizeof(*addr));
+  return ARES_SUCCESS;
+}
+
+/* Parse a name within the record data.  Compression pointers may lead
+ * anywhere in the message, but the name must end within the record data */
+static ares_status_t ares_dns_view_rdata_name(const ares_dns_view_rr_t *rr,
+                                              ares_buf_t *buf, char *name,
+                                              size_t name_len)
+{
+  ares_bool_t   allow_compression =
+    ares_dns_rec_allow_name_comp((ares_dns_rec_type_t)rr->type);
+  ares_status_t status;
+
+  if (name != NULL) {
+    status = ares_dns_name_parse_fixed(buf, name, name_len, ARES_FALSE,
+                                       allow_compression);
+  } else {
+    status = ares_dns_name_parse(buf, NULL, ARES_FALSE, allow_compression);
+  }
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  if (ares_buf_get_position(buf) > rr->rdata_offset + rr->rdata_len) {
+    return ARES_EBADRESP;
+  }
+  return ARES_SUCCESS;
+}
+
+ares_status_t ares_dns_view_rr_get_dname(const ares_dns_view_rr_t *rr,
+                                         char *name, size_t name_len)
+{
+  ares_buf_t buf;
+
+  if (rr == NULL || rr->view == NULL || name == NULL ||
+      (rr->type != ARES_REC_TYPE_CNAME && rr->type != ARES_REC_TYPE_NS &&
+       rr->type != ARES_REC_TYPE_PTR)) {
+    return ARES_EFORMERR;
+  }
+
+  ares_dns_view_buf(rr->view, &buf, rr->rdata_offset);
+  return ares_dns_view_rdata_name(rr, &buf, name, name_len);
+}
+
+ares_status_t ares_dns_view_rr_get_srv(const ares_dns_view_rr_t *rr,
+                                       unsigned short           *priority,
+                                       unsigned short *weight,
+                                       unsigned short *port, char *target,
+                                       size_t target_len)
+{
+  ares_buf_t     buf;
+  unsigned short u16[3];
+  size_t         i;
+  ares_status_t  status;
+
+  if (rr == NULL || rr->view == NULL || rr->type != ARES_REC_TYPE_SRV) {
+    return ARES_EFORMERR;
+  }
+
+  if (rr->rdata_len < sizeof(u16)) {
+    return ARES_EBADRESP;
+  }
+
+  ares_dns_view_buf(rr->view, &buf, rr->rdata_offset);
+  for (i = 0; i < 3; i++) {
+    status = ares_buf_fetch_be16(&buf, &u16[i]);
+    if (status != ARES_SUCCESS) {
+      return status; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+  }
+
+  status = ares_dns_view_rdata_name(rr, &buf, target, target_len);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  if (priority != NULL) {
+    *priority = u16[0];
+  }
+  if (weight != NULL) {
+    *weight = u16[1];
+  }
+  if (port != NULL) {
+    *port = u16[2];
+  }
+  return ARES_SUCCESS;
+}
@@ -136,7 +136,7 @@ static ares_status_t ares_dns_write_header(const ares_dns_record_t *dnsrec,
 }
 
 static ares_status_t ares_dns_write_questions(const ares_dns_record_t *dnsrec,
-                                              ares_llist_t           **namelist,
+                                              ares_htable_binvp_t    **namelist,
                                               ares_buf_t              *buf)
 {
   size_t i;
@@ -174,9 +174,9 @@ static ares_status_t ares_dns_write_questions(const ares_dns_record_t *dnsrec,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_name(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist,
+static ares_status_t ares_dns_write_rr_name(ares_buf_t           *buf,
+                                            const ares_dns_rr_t  *rr,
+                                            ares_htable_binvp_t **namelist,
                                             ares_bool_t       validate_hostname,
                                             ares_dns_rr_key_t key)
 {
@@ -317,9 +317,9 @@ static ares_status_t ares_dns_write_rr_u8(ares_buf_t          *buf,
   return ares_buf_append_byte(buf, ares_dns_rr_get_u8(rr, key));
 }
 
-static ares_status_t ares_dns_write_rr_a(ares_buf_t          *buf,
-                                         const ares_dns_rr_t *rr,
-                                         ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_a(ares_buf_t           *buf,
+                                         const ares_dns_rr_t  *rr,
+                                         ares_htable_binvp_t **namelist)
 {
   const struct in_addr *addr;
   (void)namelist;
@@ -332,25 +332,25 @@ static ares_status_t ares_dns_write_rr_a(ares_buf_t          *buf,
   return ares_buf_append(buf, (const unsigned char *)addr, sizeof(*addr));
 }
 
-static ares_status_t ares_dns_write_rr_ns(ares_buf_t          *buf,
-                                          const ares_dns_rr_t *rr,
-                                          ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_ns(ares_buf_t           *buf,
+                                          const ares_dns_rr_t  *rr,
+                                          ares_htable_binvp_t **namelist)
 {
   return ares_dns_write_rr_name(buf, rr, namelist, ARES_FALSE,
                                 ARES_RR_NS_NSDNAME);
 }
 
-static ares_status_t ares_dns_write_rr_cname(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_cname(ares_buf_t           *buf,
+                                             const ares_dns_rr_t  *rr,
+                                             ares_htable_binvp_t **namelist)
 {
   return ares_dns_write_rr_name(buf, rr, namelist, ARES_FALSE,
                                 ARES_RR_CNAME_CNAME);
 }
 
-static ares_status_t ares_dns_write_rr_soa(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_soa(ares_buf_t           *buf,
+                                           const ares_dns_rr_t  *rr,
+                                           ares_htable_binvp_t **namelist)
 {
   ares_status_t status;
 
@@ -396,17 +396,17 @@ static ares_status_t ares_dns_write_rr_soa(ares_buf_t          *buf,
   return ares_dns_write_rr_be32(buf, rr, ARES_RR_SOA_MINIMUM);
 }
 
-static ares_status_t ares_dns_write_rr_ptr(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_ptr(ares_buf_t           *buf,
+                                           const ares_dns_rr_t  *rr,
+                                           ares_htable_binvp_t **namelist)
 {
   return ares_dns_write_rr_name(buf, rr, namelist, ARES_FALSE,
                                 ARES_RR_PTR_DNAME);
 }
 
-static ares_status_t ares_dns_write_rr_hinfo(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_hinfo(ares_buf_t           *buf,
+                                             const ares_dns_rr_t  *rr,
+                                             ares_htable_binvp_t **namelist)
 {
   ares_status_t status;
 
@@ -422,9 +422,9 @@ static ares_status_t ares_dns_write_rr_hinfo(ares_buf_t          *buf,
   return ares_dns_write_rr_str(buf, rr, ARES_RR_HINFO_OS);
 }
 
-static ares_status_t ares_dns_write_rr_mx(ares_buf_t          *buf,
-                                          const ares_dns_rr_t *rr,
-                                          ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_mx(ares_buf_t           *buf,
+                                          const ares_dns_rr_t  *rr,
+                                          ares_htable_binvp_t **namelist)
 {
   ares_status_t status;
 
@@ -439,17 +439,17 @@ static ares_status_t ares_dns_write_rr_mx(ares_buf_t          *buf,
                                 ARES_RR_MX_EXCHANGE);
 }
 
-static ares_status_t ares_dns_write_rr_txt(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_txt(ares_buf_t           *buf,
+                                           const ares_dns_rr_t  *rr,
+                                           ares_htable_binvp_t **namelist)
 {
   (void)namelist;
   return ares_dns_write_rr_abin(buf, rr, ARES_RR_TXT_DATA);
 }
 
-static ares_status_t ares_dns_write_rr_sig(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_sig(ares_buf_t           *buf,
+                                           const ares_dns_rr_t  *rr,
+                                           ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -515,9 +515,9 @@ static ares_status_t ares_dns_write_rr_sig(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_aaaa(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_aaaa(ares_buf_t           *buf,
+                                            const ares_dns_rr_t  *rr,
+                                            ares_htable_binvp_t **namelist)
 {
   const struct ares_in6_addr *addr;
   (void)namelist;
@@ -530,9 +530,9 @@ static ares_status_t ares_dns_write_rr_aaaa(ares_buf_t          *buf,
   return ares_buf_append(buf, (const unsigned char *)addr, sizeof(*addr));
 }
 
-static ares_status_t ares_dns_write_rr_srv(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_srv(ares_buf_t           *buf,
+                                           const ares_dns_rr_t  *rr,
+                                           ares_htable_binvp_t **namelist)
 {
   ares_status_t status;
 
@@ -559,9 +559,9 @@ static ares_status_t ares_dns_write_rr_srv(ares_buf_t          *buf,
                                 ARES_RR_SRV_TARGET);
 }
 
-static ares_status_t ares_dns_write_rr_naptr(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_naptr(ares_buf_t           *buf,
+                                             const ares_dns_rr_t  *rr,
+                                             ares_htable_binvp_t **namelist)
 {
   ares_status_t status;
 
@@ -600,9 +600,9 @@ static ares_status_t ares_dns_write_rr_naptr(ares_buf_t          *buf,
                                 ARES_RR_NAPTR_REPLACEMENT);
 }
 
-static ares_status_t ares_dns_write_rr_opt(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_opt(ares_buf_t           *buf,
+                                           const ares_dns_rr_t  *rr,
+                                           ares_htable_binvp_t **namelist)
 {
   size_t         len = ares_buf_len(buf);
   ares_status_t  status;
@@ -681,9 +681,9 @@ static ares_status_t ares_dns_write_rr_opt(ares_buf_t          *buf,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_ds(ares_buf_t          *buf,
-                                          const ares_dns_rr_t *rr,
-                                          ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_ds(ares_buf_t           *buf,
+                                          const ares_dns_rr_t  *rr,
+                                          ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -714,9 +714,9 @@ static ares_status_t ares_dns_write_rr_ds(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_sshfp(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_sshfp(ares_buf_t           *buf,
+                                             const ares_dns_rr_t  *rr,
+                                             ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -742,9 +742,9 @@ static ares_status_t ares_dns_write_rr_sshfp(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_rrsig(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_rrsig(ares_buf_t           *buf,
+                                             const ares_dns_rr_t  *rr,
+                                             ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -803,9 +803,9 @@ static ares_status_t ares_dns_write_rr_rrsig(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_nsec(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_nsec(ares_buf_t           *buf,
+                                            const ares_dns_rr_t  *rr,
+                                            ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -829,9 +829,9 @@ static ares_status_t ares_dns_write_rr_nsec(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_dnskey(ares_buf_t          *buf,
-                                              const ares_dns_rr_t *rr,
-                                              ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_dnskey(ares_buf_t           *buf,
+                                              const ares_dns_rr_t  *rr,
+                                              ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -862,9 +862,9 @@ static ares_status_t ares_dns_write_rr_dnskey(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_nsec3(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_nsec3(ares_buf_t           *buf,
+                                             const ares_dns_rr_t  *rr,
+                                             ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -932,9 +932,9 @@ static ares_status_t ares_dns_write_rr_nsec3(ares_buf_t          *buf,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_nsec3param(ares_buf_t          *buf,
-                                                  const ares_dns_rr_t *rr,
-                                                  ares_llist_t       **namelist)
+static ares_status_t
+  ares_dns_write_rr_nsec3param(ares_buf_t *buf, const ares_dns_rr_t *rr,
+                               ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -978,9 +978,9 @@ static ares_status_t ares_dns_write_rr_nsec3param(ares_buf_t          *buf,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_tlsa(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_tlsa(ares_buf_t           *buf,
+                                            const ares_dns_rr_t  *rr,
+                                            ares_htable_binvp_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -1015,9 +1015,9 @@ static ares_status_t ares_dns_write_rr_tlsa(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_svcb(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_svcb(ares_buf_t           *buf,
+                                            const ares_dns_rr_t  *rr,
+                                            ares_htable_binvp_t **namelist)
 {
   ares_status_t status;
   size_t        i;
@@ -1066,9 +1066,9 @@ static ares_status_t ares_dns_write_rr_svcb(ares_buf_t          *buf,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_https(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_https(ares_buf_t           *buf,
+                                             const ares_dns_rr_t  *rr,
+                                             ares_htable_binvp_t **namelist)
 {
   ares_status_t status;
   size_t        i;
@@ -1117,9 +1117,9 @@ static ares_status_t ares_dns_write_rr_https(ares_buf_t          *buf,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_uri(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_uri(ares_buf_t           *buf,
+                                           const ares_dns_rr_t  *rr,
+                                           ares_htable_binvp_t **namelist)
 {
   ares_status_t status;
   const char   *target;
@@ -1149,9 +1149,9 @@ static ares_status_t ares_dns_write_rr_uri(ares_buf_t          *buf,
                          ares_strlen(target));
 }
 
-static ares_status_t ares_dns_write_rr_caa(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_caa(ares_buf_t           *buf,
+                                           const ares_dns_rr_t  *rr,
+                                           ares_htable_binvp_t **namelist)
 {
   const unsigned char *data     = NULL;
   size_t               data_len = 0;
@@ -1180,9 +1180,9 @@ static ares_status_t ares_dns_write_rr_caa(ares_buf_t          *buf,
   return ares_buf_append(buf, data, data_len);
 }
 
-static ares_status_t ares_dns_write_rr_raw_rr(ares_buf_t          *buf,
-                                              const ares_dns_rr_t *rr,
-                                              ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_raw_rr(ares_buf_t           *buf,
+                                              const ares_dns_rr_t  *rr,
+                                              ares_htable_binvp_t **namelist)
 {
   size_t               len = ares_buf_len(buf);
   ares_status_t        status;
@@ -1232,7 +1232,7 @@ static ares_status_t ares_dns_write_rr_raw_rr(ares_buf_t          *buf,
 }
 
 static ares_status_t ares_dns_write_rr(const ares_dns_record_t *dnsrec,
-                                       ares_llist_t           **namelist,
+                                       ares_htable_binvp_t    **namelist,
                                        ares_dns_section_t       section,
                                        ares_buf_t              *buf)
 {
@@ -1242,12 +1242,11 @@ static ares_status_t ares_dns_write_rr(const ares_dns_record_t *dnsrec,
     const ares_dns_rr_t *rr;
     ares_dns_rec_type_t  type;
     ares_bool_t          allow_compress;
-    ares_llist_t       **namelistptr = NULL;
+    ares_htable_binvp_t **namelistptr = NULL;
     size_t               pos_len;
     ares_status_t        status;
     size_t               rdlength;
     size_t               end_length;
-    unsigned int         ttl;
 
     rr = ares_dns_record_rr_get_const(dnsrec, section, i);
     if (rr == NULL) {
@@ -1281,13 +1280,7 @@ static ares_status_t ares_dns_write_rr(const ares_dns_record_t *dnsrec,
     }
 
     /* TTL */
-    ttl = ares_dns_rr_get_ttl(rr);
-    if (rr->parent->ttl_decrement > ttl) {
-      ttl = 0;
-    } else {
-      ttl -= rr->parent->ttl_decrement;
-    }
-    status = ares_buf_append_be32(buf, ttl);
+    status = ares_buf_append_be32(buf, ares_dns_rr_get_ttl(rr));
     if (status != ARES_SUCCESS) {
       return status; /* LCOV_EXCL_LINE: OutOfMemory */
     }
@@ -1415,9 +1408,9 @@ static ares_status_t ares_dns_write_rr(const ares_dns_record_t *dnsrec,
 ares_status_t ares_dns_write_buf(const ares_dns_record_t *dnsrec,
                                  ares_buf_t              *buf)
 {
-  ares_llist_t *namelist = NULL;
-  size_t        orig_len;
-  ares_status_t status;
+  ares_htable_binvp_t *namelist = NULL;
+  size_t               orig_len;
+  ares_status_t        status;
 
   if (dnsrec == NULL || buf == NULL) {
     return ARES_EFORMERR;
@@ -1451,7 +1444,7 @@ ares_status_t ares_dns_write_buf(const ares_dns_record_t *dnsrec,
   }
 
 done:
-  ares_llist_destroy(namelist);
+  ares_htable_binvp_destroy(namelist);
   if (status != ARES_SUCCESS) {
     ares_buf_set_length(buf, orig_len);
   }
@@ -1536,12 +1529,3 @@ ares_status_t ares_dns_write(const ares_dns_record_t *dnsrec,
   *buf = ares_buf_finish_bin(b, buf_len);
   return status;
 }
-
-void ares_dns_record_ttl_decrement(ares_dns_record_t *dnsrec,
-                                   unsigned int       ttl_decrement)
-{
-  if (dnsrec == NULL) {
-    return;
-  }
-  dnsrec->ttl_decrement = ttl_decrement;
-}
@@ -30,19 +30,6 @@
 #  include <stdint.h>
 #endif
 
-struct ares_buf {
-  const unsigned char *data;          /*!< pointer to start of data buffer */
-  size_t               data_len;      /*!< total size of data in buffer */
-
-  unsigned char       *alloc_buf;     /*!< Pointer to allocated data buffer,
-                                       *   not used for const buffers */
-  size_t               alloc_buf_len; /*!< Size of allocated data buffer */
-
-  size_t               offset;        /*!< Current working offset in buffer */
-  size_t               tag_offset;    /*!< Tagged offset in buffer. Uses
-                                       *   SIZE_MAX if not set. */
-};
-
 ares_buf_t *ares_buf_create(void)
 {
   ares_buf_t *buf = ares_malloc_zero(sizeof(*buf));
@@ -73,6 +60,34 @@ ares_buf_t *ares_buf_create_const(const unsigned char *data, size_t data_len)
   return buf;
 }
 
+void ares_buf_init_const(ares_buf_t *buf, const unsigned char *data,
+                         size_t data_len)
+{
+  if (buf == NULL) {
+    return;
+  }
+
+  memset(buf, 0, sizeof(*buf));
+  buf->data       = data;
+  buf->data_len   = data_len;
+  buf->tag_offset = SIZE_MAX;
+}
+
+void ares_buf_init_fixed(ares_buf_t *buf, unsigned char *storage,
+                         size_t storage_len)
+{
+  if (buf == NULL) {
+    return;
+  }
+
+  memset(buf, 0, sizeof(*buf));
+  buf->data          = storage;
+  buf->alloc_buf     = storage;
+  buf->alloc_buf_len = storage_len;
+  buf->tag_offset    = SIZE_MAX;
+  buf->fixed         = ARES_TRUE;
+}
+
 void ares_buf_destroy(ares_buf_t *buf)
 {
   if (buf == NULL) {
@@ -180,6 +195,10 @@ static ares_status_t ares_buf_ensure_space(ares_buf_t *buf, size_t needed_size)
     return ARES_SUCCESS;
   }
 
+  if (buf->fixed) {
+    return ARES_ENOMEM;
+  }
+
   alloc_size = buf->alloc_buf_len;
 
   /* Not yet started */
@@ -1497,14 +1516,14 @@ ares_status_t ares_buf_set_position(ares_buf_t *buf, size_t idx)
   return ARES_SUCCESS;
 }
 
+/* Parse a string, appending it to binbuf if not NULL */
 static ares_status_t
   ares_buf_parse_dns_binstr_int(ares_buf_t *buf, size_t remaining_len,
-                                unsigned char **bin, size_t *bin_len,
+                                ares_buf_t *binbuf,
                                 ares_bool_t validate_printable)
 {
   unsigned char len;
   ares_status_t status = ARES_EBADRESP;
-  ares_buf_t   *binbuf = NULL;
 
   if (buf == NULL) {
     return ARES_EFORMERR;
@@ -1514,61 +1533,72 @@ static ares_status_t
     return ARES_EBADRESP;
   }
 
-  binbuf = ares_buf_create();
-  if (binbuf == NULL) {
-    return ARES_ENOMEM;
-  }
-
   status = ares_buf_fetch_bytes(buf, &len, 1);
   if (status != ARES_SUCCESS) {
-    goto done; /* LCOV_EXCL_LINE: DefensiveCoding */
+    return status; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
   remaining_len--;
 
   if (len > remaining_len) {
-    status = ARES_EBADRESP;
-    goto done;
+    return ARES_EBADRESP;
   }
 
-  if (len) {
-    /* When used by the _str() parser, it really needs to be validated to
-     * be a valid printable ascii string.  Do that here */
-    if (validate_printable && ares_buf_len(buf) >= len) {
-      size_t      mylen;
-      const char *data = (const char *)ares_buf_peek(buf, &mylen);
-      if (!ares_str_isprint(data, len)) {
-        status = ARES_EBADSTR;
-        goto done;
-      }
+  if (len == 0) {
+    return ARES_SUCCESS;
+  }
+
+  /* When used by the _str() parser, it really needs to be validated to
+   * be a valid printable ascii string.  Do that here */
+  if (validate_printable && ares_buf_len(buf) >= len) {
+    size_t      mylen;
+    const char *data = (const char *)ares_buf_peek(buf, &mylen);
+    if (!ares_str_isprint(data, len)) {
+      return ARES_EBADSTR;
     }
+  }
 
-    if (bin != NULL) {
-      status = ares_buf_fetch_bytes_into_buf(buf, binbuf, len);
-    } else {
-      status = ares_buf_consume(buf, len);
+  if (binbuf != NULL) {
+    return ares_buf_fetch_bytes_into_buf(buf, binbuf, len);
+  }
+  return ares_buf_consume(buf, len);
+}
+
+static ares_status_t
+  ares_buf_parse_dns_binstr_dup(ares_buf_t *buf, size_t remaining_len,
+                                unsigned char **bin, size_t *bin_len,
+                                ares_bool_t validate_printable)
+{
+  ares_status_t status;
+  ares_buf_t   *binbuf = NULL;
+  size_t        mylen  = 0;
+
+  if (bin != NULL) {
+    binbuf = ares_buf_create();
+    if (binbuf == NULL) {
+      return ARES_ENOMEM;
     }
   }
 
-done:
-  if (status == ARES_SUCCESS && bin != NULL) {
-    size_t mylen = 0;
-    /* NOTE: we use ares_buf_finish_str() here as we guarantee NULL
-     *       Termination even though we are technically returning binary data.
-     */
-    *bin     = (unsigned char *)ares_buf_finish_str(binbuf, &mylen);
-    *bin_len = mylen;
-  } else {
+  status = ares_buf_parse_dns_binstr_int(buf, remaining_len, binbuf,
+                                         validate_printable);
+  if (status != ARES_SUCCESS || bin == NULL) {
     ares_buf_destroy(binbuf);
+    return status;
   }
 
-  return status;
+  /* NOTE: we use ares_buf_finish_str() here as we guarantee NULL
+   *       Termination even though we are technically returning binary data.
+   */
+  *bin     = (unsigned char *)ares_buf_finish_str(binbuf, &mylen);
+  *bin_len = mylen;
+  return ARES_SUCCESS;
 }
 
 ares_status_t ares_buf_parse_dns_binstr(ares_buf_t *buf, size_t remaining_len,
                                         unsigned char **bin, size_t *bin_len)
 {
-  return ares_buf_parse_dns_binstr_int(buf, remaining_len, bin, bin_len,
+  return ares_buf_parse_dns_binstr_dup(buf, remaining_len, bin, bin_len,
                                        ARES_FALSE);
 }
 
@@ -1577,10 +1607,17 @@ ares_status_t ares_buf_parse_dns_str(ares_buf_t *buf, size_t remaining_len,
 {
   size_t len;
 
-  return ares_buf_parse_dns_binstr_int(buf, remaining_len,
+  return ares_buf_parse_dns_binstr_dup(buf, remaining_len,
                                        (unsigned char **)str, &len, ARES_TRUE);
 }
 
+ares_status_t ares_buf_parse_dns_str_into_buf(ares_buf_t *buf,
+                                              size_t      remaining_len,
+                                              ares_buf_t *str)
+{
+  return ares_buf_parse_dns_binstr_int(buf, remaining_len, str, ARES_TRUE);
+}
+
 ares_status_t ares_buf_append_num_dec(ares_buf_t *buf, size_t num, size_t len)
 {
   size_t i;
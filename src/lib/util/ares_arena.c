@@ -0,0 +1,218 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "ares_private.h"
+
+typedef union {
+  void  *p;
+  double d;
+  size_t s;
+  long   l;
+} ares_arena_align_t;
+
+#define ARES_ARENA_ALIGN(x)                                                  \
+  ((((x) + sizeof(ares_arena_align_t) - 1) / sizeof(ares_arena_align_t)) * \
+   sizeof(ares_arena_align_t))
+
+#define ARES_ARENA_MIN_CHUNK 256
+
+typedef struct ares_arena_chunk ares_arena_chunk_t;
+
+struct ares_arena_chunk {
+  ares_arena_chunk_t *next;
+  unsigned char      *data;
+  size_t              size;
+  size_t              used;
+};
+
+/* The first chunk and its data directly follow the arena in the same
+ * allocation.  New chunks are pushed on the front, the front chunk is the
+ * only one allocated from. */
+struct ares_arena {
+  ares_arena_chunk_t *chunks;
+  size_t              next_size;
+  ares_buf_t         *scratch;
+  ares_arena_chunk_t  first;
+};
+
+ares_arena_t *ares_arena_create(size_t size_hint)
+{
+  ares_arena_t *arena;
+  size_t        hdr_len = ARES_ARENA_ALIGN(sizeof(*arena));
+
+  if (size_hint < ARES_ARENA_MIN_CHUNK) {
+    size_hint = ARES_ARENA_MIN_CHUNK;
+  }
+  size_hint = ARES_ARENA_ALIGN(size_hint);
+
+  arena = ares_malloc(hdr_len + size_hint);
+  if (arena == NULL) {
+    return NULL;
+  }
+
+  arena->first.next = NULL;
+  arena->first.data = (unsigned char *)arena + hdr_len;
+  arena->first.size = size_hint;
+  arena->first.used = 0;
+  arena->chunks     = &arena->first;
+  arena->next_size  = size_hint * 2;
+  arena->scratch    = NULL;
+
+  return arena;
+}
+
+void ares_arena_destroy(ares_arena_t *arena)
+{
+  ares_arena_chunk_t *chunk;
+
+  if (arena == NULL) {
+    return;
+  }
+
+  chunk = arena->chunks;
+  while (chunk != &arena->first) {
+    ares_arena_chunk_t *next = chunk->next;
+    ares_free(chunk);
+    chunk = next;
+  }
+
+  ares_buf_destroy(arena->scratch);
+  ares_free(arena);
+}
+
+void *ares_arena_alloc(ares_arena_t *arena, size_t len)
+{
+  ares_arena_chunk_t *chunk;
+  void               *ptr;
+
+  if (arena == NULL) {
+    return NULL;
+  }
+
+  if (len == 0) {
+    len = 1;
+  }
+  len = ARES_ARENA_ALIGN(len);
+
+  chunk = arena->chunks;
+  if (chunk->size - chunk->used < len) {
+    size_t hdr_len = ARES_ARENA_ALIGN(sizeof(*chunk));
+    size_t size    = arena->next_size;
+
+    while (size < len) {
+      size *= 2;
+    }
+
+    chunk = ares_malloc(hdr_len + size);
+    if (chunk == NULL) {
+      return NULL;
+    }
+
+    chunk->next      = arena->chunks;
+    chunk->data      = (unsigned char *)chunk + hdr_len;
+    chunk->size      = size;
+    chunk->used      = 0;
+    arena->chunks    = chunk;
+    arena->next_size = size * 2;
+  }
+
+  ptr          = chunk->data + chunk->used;
+  chunk->used += len;
+  return ptr;
+}
+
+void *ares_arena_memdup(ares_arena_t *arena, const void *data, size_t len,
+                        ares_bool_t null_term)
+{
+  unsigned char *ptr;
+
+  if (data == NULL && len != 0) {
+    return NULL;
+  }
+
+  ptr = ares_arena_alloc(arena, null_term ? len + 1 : len);
+  if (ptr == NULL) {
+    return NULL;
+  }
+
+  if (len != 0) {
+    memcpy(ptr, data, len);
+  }
+  if (null_term) {
+    ptr[len] = 0;
+  }
+  return ptr;
+}
+
+ares_bool_t ares_arena_owns(const ares_arena_t *arena, const void *ptr)
+{
+  const ares_arena_chunk_t *chunk;
+  const unsigned char      *p = ptr;
+
+  if (arena == NULL || ptr == NULL) {
+    return ARES_FALSE;
+  }
+
+  for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+    if (p >= chunk->data && p < chunk->data + chunk->size) {
+      return ARES_TRUE;
+    }
+  }
+  return ARES_FALSE;
+}
+
+ares_buf_t *ares_arena_scratch(ares_arena_t *arena)
+{
+  if (arena == NULL) {
+    return NULL;
+  }
+
+  if (arena->scratch == NULL) {
+    arena->scratch = ares_buf_create();
+    return arena->scratch;
+  }
+
+  if (ares_buf_len(arena->scratch) != 0) {
+    ares_buf_set_length(arena->scratch, 0);
+  }
+  return arena->scratch;
+}
+
+char *ares_arena_scratch_finish(ares_arena_t *arena, size_t *len)
+{
+  const unsigned char *data;
+  size_t               data_len = 0;
+
+  if (arena == NULL || arena->scratch == NULL) {
+    return NULL;
+  }
+
+  data = ares_buf_peek(arena->scratch, &data_len);
+  if (len != NULL) {
+    *len = data_len;
+  }
+  return ares_arena_memdup(arena, data, data_len, ARES_TRUE);
+}
@@ -0,0 +1,99 @@
+/* MIT License
+ *
+ * Copyright (c) 2024 Brad House
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef __ARES_ARENA_H
+#define __ARES_ARENA_H
+
+#include "ares_buf.h"
+
+/*! A bump allocator for objects that all share the lifetime of one owner,
+ *  such as the strings of a parsed DNS record.  Individual allocations are
+ *  never freed, everything is released at once when the arena is destroyed.
+ *  Memory comes from ares_malloc() in chunks that double in size.  Not
+ *  thread-safe. */
+struct ares_arena;
+typedef struct ares_arena ares_arena_t;
+
+/*! Create an arena.
+ *
+ *  \param[in] size_hint  Expected total size of allocations, the first chunk
+ *                        is allocated along with the arena itself
+ *  \return arena or NULL on out of memory
+ */
+ares_arena_t *ares_arena_create(size_t size_hint);
+
+/*! Destroy an arena and everything allocated from it.
+ *
+ *  \param[in] arena  Arena, NULL allowed
+ */
+void ares_arena_destroy(ares_arena_t *arena);
+
+/*! Allocate memory suitably aligned for any type.
+ *
+ *  \param[in] arena  Initialized arena
+ *  \param[in] len    Length to allocate
+ *  \return pointer or NULL on out of memory
+ */
+void *ares_arena_alloc(ares_arena_t *arena, size_t len);
+
+/*! Duplicate memory into the arena.
+ *
+ *  \param[in] arena      Initialized arena
+ *  \param[in] data       Data to copy, may be NULL if len is 0
+ *  \param[in] len        Length of data
+ *  \param[in] null_term  Whether to add a NULL terminator after the data
+ *  \return pointer or NULL on out of memory
+ */
+void *ares_arena_memdup(ares_arena_t *arena, const void *data, size_t len,
+                        ares_bool_t null_term);
+
+/*! Whether the pointer was allocated from the arena.
+ *
+ *  \param[in] arena  Arena, NULL allowed
+ *  \param[in] ptr    Pointer to check
+ *  \return ARES_TRUE if it belongs to the arena
+ */
+ares_bool_t ares_arena_owns(const ares_arena_t *arena, const void *ptr);
+
+/*! Retrieve an empty buffer owned by the arena for building an object whose
+ *  length isn't known up front.  Finish with ares_arena_scratch_finish().
+ *  Only one may be in use at a time.
+ *
+ *  \param[in] arena  Initialized arena
+ *  \return buffer or NULL on out of memory
+ */
+ares_buf_t *ares_arena_scratch(ares_arena_t *arena);
+
+/*! Copy the contents of the scratch buffer into the arena as a NULL
+ *  terminated string.
+ *
+ *  \param[in]  arena  Initialized arena
+ *  \param[out] len    Length of the string, not including the terminator.
+ *                     May be NULL.
+ *  \return pointer or NULL on out of memory
+ */
+char *ares_arena_scratch_finish(ares_arena_t *arena, size_t *len);
+
+#endif
@@ -719,6 +719,144 @@ ares_bool_t ares_threadsafety(void)
 #endif
 
 
+#if defined(CARES_THREADS) && defined(_WIN32)
+
+ares_bool_t ares_atomics_available(void)
+{
+  return ARES_TRUE;
+}
+
+void *ares_atomic_ptr_get(void **ptr)
+{
+  return InterlockedCompareExchangePointer(ptr, NULL, NULL);
+}
+
+void *ares_atomic_ptr_swap(void **ptr, void *val)
+{
+  return InterlockedExchangePointer(ptr, val);
+}
+
+ares_bool_t ares_atomic_ptr_cas(void **ptr, void *expected, void *desired)
+{
+  return InterlockedCompareExchangePointer(ptr, desired, expected) == expected
+           ? ARES_TRUE
+           : ARES_FALSE;
+}
+
+#  ifdef _WIN64
+#    define ARES_INTERLOCKED_ADD(ptr, val) \
+      InterlockedExchangeAdd64((volatile LONG64 *)(ptr), (LONG64)(val))
+#  else
+#    define ARES_INTERLOCKED_ADD(ptr, val) \
+      InterlockedExchangeAdd((volatile LONG *)(ptr), (LONG)(val))
+#  endif
+
+void ares_atomic_size_add(size_t *ptr, size_t val)
+{
+  ARES_INTERLOCKED_ADD(ptr, val);
+}
+
+void ares_atomic_size_sub(size_t *ptr, size_t val)
+{
+  ARES_INTERLOCKED_ADD(ptr, 0 - val);
+}
+
+size_t ares_atomic_size_get(const size_t *ptr)
+{
+  /* Cast off const, an add of 0 doesn't modify the value */
+  return (size_t)ARES_INTERLOCKED_ADD((size_t *)((size_t)ptr), 0);
+}
+
+#elif defined(CARES_THREADS) && defined(__ATOMIC_SEQ_CST)
+
+/* GCC 4.7+ and Clang */
+
+ares_bool_t ares_atomics_available(void)
+{
+  return ARES_TRUE;
+}
+
+void *ares_atomic_ptr_get(void **ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+void *ares_atomic_ptr_swap(void **ptr, void *val)
+{
+  return __atomic_exchange_n(ptr, val, __ATOMIC_ACQ_REL);
+}
+
+ares_bool_t ares_atomic_ptr_cas(void **ptr, void *expected, void *desired)
+{
+  return __atomic_compare_exchange_n(ptr, &expected, desired, 0,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+           ? ARES_TRUE
+           : ARES_FALSE;
+}
+
+void ares_atomic_size_add(size_t *ptr, size_t val)
+{
+  __atomic_fetch_add(ptr, val, __ATOMIC_RELAXED);
+}
+
+void ares_atomic_size_sub(size_t *ptr, size_t val)
+{
+  __atomic_fetch_sub(ptr, val, __ATOMIC_RELAXED);
+}
+
+size_t ares_atomic_size_get(const size_t *ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+#else
+
+/* No atomics, plain operations only usable by a single thread */
+
+ares_bool_t ares_atomics_available(void)
+{
+  return ARES_FALSE;
+}
+
+void *ares_atomic_ptr_get(void **ptr)
+{
+  return *ptr;
+}
+
+void *ares_atomic_ptr_swap(void **ptr, void *val)
+{
+  void *old = *ptr;
+  *ptr      = val;
+  return old;
+}
+
+ares_bool_t ares_atomic_ptr_cas(void **ptr, void *expected, void *desired)
+{
+  if (*ptr != expected) {
+    return ARES_FALSE;
+  }
+  *ptr = desired;
+  return ARES_TRUE;
+}
+
+void ares_atomic_size_add(size_t *ptr, size_t val)
+{
+  *ptr += val;
+}
+
+void ares_atomic_size_sub(size_t *ptr, size_t val)
+{
+  *ptr -= val;
+}
+
+size_t ares_atomic_size_get(const size_t *ptr)
+{
+  return *ptr;
+}
+
+#endif
+
+
 ares_status_t ares_channel_threading_init(ares_channel_t *channel)
 {
   ares_status_t status = ARES_SUCCESS;
@@ -765,27 +903,15 @@ void ares_channel_unlock(const ares_channel_t *channel)
   ares_thread_mutex_unlock(channel->lock);
 }
 
-/* Must not be holding a channel lock already, public function only */
-ares_status_t ares_queue_wait_empty(ares_channel_t *channel, int timeout_ms)
+static ares_status_t ares_queue_wait_empty_int(ares_channel_t       *channel,
+                                               int                   timeout_ms,
+                                               const ares_timeval_t *tout)
 {
-  ares_status_t  status = ARES_SUCCESS;
-  ares_timeval_t tout;
-
-  if (!ares_threadsafety()) {
-    return ARES_ENOTIMP;
-  }
-
-  if (channel == NULL) {
-    return ARES_EFORMERR;
-  }
-
-  if (timeout_ms >= 0) {
-    ares_tvnow(&tout);
-    ares_timeval_add(&tout, (size_t)timeout_ms);
-  }
+  ares_status_t status = ARES_SUCCESS;
 
   ares_thread_mutex_lock(channel->lock);
-  while (ares_llist_len(channel->all_queries)) {
+  while (ares_llist_len(channel->all_queries) ||
+         ares_atomic_size_get(&channel->submit_pending)) {
     if (timeout_ms < 0) {
       ares_thread_cond_wait(channel->cond_empty, channel->lock);
     } else {
@@ -794,7 +920,7 @@ ares_status_t ares_queue_wait_empty(ares_channel_t *channel, int timeout_ms)
       unsigned long  tms;
 
       ares_tvnow(&tv_now);
-      ares_timeval_remaining(&tv_remaining, &tv_now, &tout);
+      ares_timeval_remaining(&tv_remaining, &tv_now, tout);
       tms =
         (unsigned long)((tv_remaining.sec * 1000) + (tv_remaining.usec / 1000));
       if (tms == 0) {
@@ -815,6 +941,35 @@ ares_status_t ares_queue_wait_empty(ares_channel_t *channel, int timeout_ms)
   return status;
 }
 
+/* Must not be holding a channel lock already, public function only */
+ares_status_t ares_queue_wait_empty(ares_channel_t *channel, int timeout_ms)
+{
+  ares_status_t  status;
+  ares_timeval_t tout;
+  size_t         i;
+
+  if (!ares_threadsafety()) {
+    return ARES_ENOTIMP;
+  }
+
+  if (channel == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  if (timeout_ms >= 0) {
+    ares_tvnow(&tout);
+    ares_timeval_add(&tout, (size_t)timeout_ms);
+  }
+
+  /* The timeout applies to all shards together */
+  status = ares_queue_wait_empty_int(channel, timeout_ms, &tout);
+  for (i = 0; i < channel->nshards && status == ARES_SUCCESS; i++) {
+    status = ares_queue_wait_empty_int(channel->shards[i], timeout_ms, &tout);
+  }
+
+  return status;
+}
+
 void ares_queue_notify_empty(ares_channel_t *channel)
 {
   if (channel == NULL) {
@@ -59,4 +59,17 @@ ares_status_t ares_thread_create(ares_thread_t    **thread,
                                  ares_thread_func_t func, void *arg);
 ares_status_t ares_thread_join(ares_thread_t *thread, void **rv);
 
+
+/*! Whether the ares_atomic_*() operations are lock-free and safe to use
+ *  between threads.  If not, they are plain operations only safe to use from
+ *  a single thread. */
+ares_bool_t ares_atomics_available(void);
+void       *ares_atomic_ptr_get(void **ptr);
+void       *ares_atomic_ptr_swap(void **ptr, void *val);
+/*! Store desired if *ptr is still expected, returns ARES_TRUE if stored */
+ares_bool_t ares_atomic_ptr_cas(void **ptr, void *expected, void *desired);
+void        ares_atomic_size_add(size_t *ptr, size_t val);
+void        ares_atomic_size_sub(size_t *ptr, size_t val);
+size_t      ares_atomic_size_get(const size_t *ptr);
+
 #endif
@@ -46,4 +46,10 @@ void ares_timeval_remaining(ares_timeval_t       *remaining,
 void ares_timeval_diff(ares_timeval_t *tvdiff, const ares_timeval_t *tvstart,
                        const ares_timeval_t *tvstop);
 
+/* Convert to milliseconds, any partial millisecond is rounded up if round_up
+ * is set, otherwise truncated */
+ares_uint64_t ares_timeval_to_ms(const ares_timeval_t *tv,
+                                 ares_bool_t           round_up);
+void          ares_timeval_from_ms(ares_timeval_t *tv, ares_uint64_t ms);
+
 #endif
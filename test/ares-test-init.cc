@@ -153,6 +153,89 @@ TEST_F(LibraryTest, OptionsChannelInit) {
   ares_destroy(channel2);
 }
 
+TEST_F(LibraryTest, OptionsLatencyTimeout) {
+  struct ares_options opts;
+  memset(&opts, 0, sizeof(opts));
+  opts.latency_timeout_opts.percentile = 90;
+  opts.latency_timeout_opts.multiplier = 150;
+
+  ares_channel_t *channel = nullptr;
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_init_options(&channel, &opts, ARES_OPT_LATENCY_TIMEOUT));
+  EXPECT_NE(nullptr, channel);
+
+  struct ares_options opts2;
+  int optmask2 = 0;
+  memset(&opts2, 0, sizeof(opts2));
+  EXPECT_EQ(ARES_SUCCESS, ares_save_options(channel, &opts2, &optmask2));
+  EXPECT_EQ(ARES_OPT_LATENCY_TIMEOUT, optmask2 & ARES_OPT_LATENCY_TIMEOUT);
+  EXPECT_EQ(90, opts2.latency_timeout_opts.percentile);
+  EXPECT_EQ(150, opts2.latency_timeout_opts.multiplier);
+  ares_destroy_options(&opts2);
+  ares_destroy(channel);
+
+  // Out of range percentile or a zero multiplier are rejected
+  opts.latency_timeout_opts.percentile = 101;
+  channel = nullptr;
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_init_options(&channel, &opts, ARES_OPT_LATENCY_TIMEOUT));
+  opts.latency_timeout_opts.percentile = 99;
+  opts.latency_timeout_opts.multiplier = 0;
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_init_options(&channel, &opts, ARES_OPT_LATENCY_TIMEOUT));
+}
+
+TEST_F(LibraryTest, OptionsHedge) {
+  struct ares_options opts;
+  memset(&opts, 0, sizeof(opts));
+  opts.hedge_opts.percentile = 95;
+  opts.hedge_opts.budget = 5;
+
+  ares_channel_t *channel = nullptr;
+  EXPECT_EQ(ARES_SUCCESS, ares_init_options(&channel, &opts, ARES_OPT_HEDGE));
+  EXPECT_NE(nullptr, channel);
+
+  struct ares_options opts2;
+  int optmask2 = 0;
+  memset(&opts2, 0, sizeof(opts2));
+  EXPECT_EQ(ARES_SUCCESS, ares_save_options(channel, &opts2, &optmask2));
+  EXPECT_EQ(ARES_OPT_HEDGE, optmask2 & ARES_OPT_HEDGE);
+  EXPECT_EQ(95, opts2.hedge_opts.percentile);
+  EXPECT_EQ(5, opts2.hedge_opts.budget);
+  ares_destroy_options(&opts2);
+  ares_destroy(channel);
+
+  // Percentile must be below 100 and the budget non-zero
+  opts.hedge_opts.percentile = 100;
+  channel = nullptr;
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_init_options(&channel, &opts, ARES_OPT_HEDGE));
+  opts.hedge_opts.percentile = 95;
+  opts.hedge_opts.budget = 0;
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_init_options(&channel, &opts, ARES_OPT_HEDGE));
+}
+
+TEST_F(LibraryTest, OptionsSearchNegcache) {
+  struct ares_options opts;
+  memset(&opts, 0, sizeof(opts));
+  opts.search_negcache_ttl = 60;
+
+  ares_channel_t *channel = nullptr;
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_init_options(&channel, &opts, ARES_OPT_SEARCH_NEGCACHE));
+  EXPECT_NE(nullptr, channel);
+
+  struct ares_options opts2;
+  int optmask2 = 0;
+  memset(&opts2, 0, sizeof(opts2));
+  EXPECT_EQ(ARES_SUCCESS, ares_save_options(channel, &opts2, &optmask2));
+  EXPECT_EQ(ARES_OPT_SEARCH_NEGCACHE, optmask2 & ARES_OPT_SEARCH_NEGCACHE);
+  EXPECT_EQ(60U, opts2.search_negcache_ttl);
+  ares_destroy_options(&opts2);
+  ares_destroy(channel);
+}
+
 TEST_F(LibraryTest, ChannelAllocFail) {
   ares_channel_t *channel;
   for (int ii = 1; ii <= 25; ii++) {
@@ -2126,6 +2126,71 @@ TEST_F(LibraryTest, DNSRecord) {
     EXPECT_EQ(0xaa, bin[0]);
   }
 
+  /* An arena-backed parse must be identical, and every field must still be
+   * replaceable without freeing memory that belongs to the arena */
+  {
+    ares_dns_record_t *arenarec    = NULL;
+    unsigned char     *arenamsg    = NULL;
+    size_t             arenamsglen = 0;
+    const unsigned char newbin[]   = { 0x01, 0x02 };
+
+    EXPECT_EQ(ARES_SUCCESS,
+      ares_dns_parse(msg, msglen, ARES_DNS_PARSE_ARENA, &arenarec));
+    EXPECT_EQ(ARES_SUCCESS, ares_dns_write(arenarec, &arenamsg, &arenamsglen));
+    EXPECT_EQ(msglen, arenamsglen);
+    EXPECT_EQ(0, memcmp(msg, arenamsg, msglen));
+    ares_free_string(arenamsg);
+
+    EXPECT_EQ(ARES_SUCCESS,
+      ares_dns_record_query_set_name(arenarec, 0, "changed.example.com"));
+    for (size_t i = ARES_SECTION_ANSWER; i < ARES_SECTION_ADDITIONAL + 1; i++) {
+      ares_dns_section_t sect = (ares_dns_section_t)i;
+      for (size_t j = 0; j < ares_dns_record_rr_cnt(arenarec, sect); j++) {
+        rr = ares_dns_record_rr_get(arenarec, sect, j);
+        size_t keys_cnt;
+        const ares_dns_rr_key_t *keys =
+          ares_dns_rr_get_keys(ares_dns_rr_get_type(rr), &keys_cnt);
+        for (size_t k = 0; k < keys_cnt; k++) {
+          unsigned short       opt;
+          const unsigned char *optval;
+          size_t               optval_len;
+          switch (ares_dns_rr_key_datatype(keys[k])) {
+            case ARES_DATATYPE_NAME:
+            case ARES_DATATYPE_STR:
+              EXPECT_EQ(ARES_SUCCESS,
+                ares_dns_rr_set_str(rr, keys[k], "changed.example.com"));
+              break;
+            case ARES_DATATYPE_BIN:
+            case ARES_DATATYPE_BINP:
+              EXPECT_EQ(ARES_SUCCESS,
+                ares_dns_rr_set_bin(rr, keys[k], newbin, sizeof(newbin)));
+              break;
+            case ARES_DATATYPE_ABINP:
+              EXPECT_EQ(ARES_SUCCESS,
+                ares_dns_rr_add_abin(rr, keys[k], newbin, sizeof(newbin)));
+              break;
+            case ARES_DATATYPE_OPT:
+              if (ares_dns_rr_get_opt_cnt(rr, keys[k]) > 0) {
+                opt = ares_dns_rr_get_opt(rr, keys[k], 0, &optval,
+                                          &optval_len);
+                EXPECT_EQ(ARES_SUCCESS,
+                  ares_dns_rr_set_opt(rr, keys[k], opt, newbin,
+                                      sizeof(newbin)));
+                EXPECT_EQ(ARES_SUCCESS,
+                  ares_dns_rr_del_opt_byid(rr, keys[k], opt));
+              }
+              break;
+            default:
+              break;
+          }
+        }
+      }
+    }
+    EXPECT_EQ(ARES_SUCCESS,
+      ares_dns_record_rr_del(arenarec, ARES_SECTION_ANSWER, 0));
+    ares_dns_record_destroy(arenarec);
+  }
+
   /* Iterate and print */
   ares_buf_t *printmsg = ares_buf_create();
   ares_buf_append_str(printmsg, ";; ->>HEADER<<- opcode: ");
@@ -2268,9 +2333,6 @@ TEST_F(LibraryTest, DNSRecord) {
   EXPECT_EQ(0, ares_dns_rr_get_ttl(NULL));
   EXPECT_NE(ARES_SUCCESS, ares_dns_rr_set_ttl(NULL, 100));
   EXPECT_NE(ARES_SUCCESS, ares_dns_write(NULL, NULL, NULL));
-#ifndef CARES_SYMBOL_HIDING
-  ares_dns_record_ttl_decrement(NULL, 0);
-#endif
   EXPECT_EQ(nullptr, ares_dns_rr_get_addr(NULL, ARES_RR_A_ADDR));
   EXPECT_EQ(nullptr, ares_dns_rr_get_addr(NULL, ARES_RR_NS_NSDNAME));
   EXPECT_EQ(nullptr, ares_dns_rr_get_addr6(NULL, ARES_RR_AAAA_ADDR));
@@ -2356,6 +2418,196 @@ TEST_F(LibraryTest, DNSNameCompression14Bit) {
   ares_dns_record_destroy(dnsrec);
 }
 
+TEST_F(LibraryTest, DNSNameCompressionSuffix) {
+  ares_dns_record_t *dnsrec = NULL;
+  ares_dns_record_t *parsed = NULL;
+  ares_dns_rr_t     *rr     = NULL;
+  unsigned char     *msg    = NULL;
+  size_t             msglen = 0;
+  struct in_addr     addr;
+
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_create(&dnsrec, 0x1234, ARES_FLAG_QR,
+      ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_query_add(dnsrec, "www.example.com", ARES_REC_TYPE_ANY,
+      ARES_CLASS_IN));
+  /* Shares only the "example.com" suffix with the question */
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+      "mail.example.com", ARES_REC_TYPE_CNAME, ARES_CLASS_IN, 300));
+  /* An escaped period doesn't start a new label */
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_rr_set_str(rr, ARES_RR_CNAME_CNAME, "a\\.b.example.com"));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+      "a\\.b.example.com", ARES_REC_TYPE_A, ARES_CLASS_IN, 300));
+  memset(&addr, 0, sizeof(addr));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr));
+
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_write(dnsrec, &msg, &msglen));
+
+  /* 12 hdr + 21 question + (7 name + 10 + 6 rdata) CNAME +
+   * (2 name + 10 + 4 rdata) A */
+  EXPECT_EQ(72U, msglen);
+
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_parse(msg, msglen, 0, &parsed));
+  ASSERT_NE(nullptr, parsed);
+  rr = ares_dns_record_rr_get(parsed, ARES_SECTION_ANSWER, 0);
+  EXPECT_STREQ("mail.example.com", ares_dns_rr_get_name(rr));
+  EXPECT_STREQ("a\\.b.example.com", ares_dns_rr_get_str(rr, ARES_RR_CNAME_CNAME));
+  rr = ares_dns_record_rr_get(parsed, ARES_SECTION_ANSWER, 1);
+  EXPECT_STREQ("a\\.b.example.com", ares_dns_rr_get_name(rr));
+
+  ares_dns_record_destroy(parsed);
+  ares_free_string(msg);
+  ares_dns_record_destroy(dnsrec);
+}
+
+TEST_F(LibraryTest, DNSView) {
+  ares_dns_record_t   *dnsrec = NULL;
+  ares_dns_rr_t       *rr     = NULL;
+  struct in_addr       addr;
+  struct ares_in6_addr addr6;
+  unsigned char       *msg    = NULL;
+  size_t               msglen = 0;
+  ares_dns_view_t      view;
+  ares_dns_view_rr_t   vrr;
+  char                 name[1025];
+  char                 small[8];
+  ares_dns_rec_type_t  qtype;
+  ares_dns_class_t     qclass;
+  unsigned short       priority;
+  unsigned short       weight;
+  unsigned short       port;
+
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_create(&dnsrec, 0x1234,
+      ARES_FLAG_QR|ARES_FLAG_RD|ARES_FLAG_RA, ARES_OPCODE_QUERY,
+      ARES_RCODE_BADSIG));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_query_add(dnsrec, "www.example.com", ARES_REC_TYPE_ANY,
+      ARES_CLASS_IN));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+      "www.example.com", ARES_REC_TYPE_CNAME, ARES_CLASS_IN, 300));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_rr_set_str(rr, ARES_RR_CNAME_CNAME, "host.example.com"));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+      "host.example.com", ARES_REC_TYPE_A, ARES_CLASS_IN, 300));
+  memset(&addr, 0, sizeof(addr));
+  addr.s_addr = htonl(0xC0A80102);
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+      "host.example.com", ARES_REC_TYPE_AAAA, ARES_CLASS_IN, 300));
+  memset(&addr6, 0, sizeof(addr6));
+  addr6._S6_un._S6_u8[0]  = 0x20;
+  addr6._S6_un._S6_u8[15] = 0x01;
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_rr_set_addr6(rr, ARES_RR_AAAA_ADDR, &addr6));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+      "_sip._udp.example.com", ARES_REC_TYPE_SRV, ARES_CLASS_IN, 60));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_u16(rr, ARES_RR_SRV_PRIORITY, 10));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_u16(rr, ARES_RR_SRV_WEIGHT, 20));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_u16(rr, ARES_RR_SRV_PORT, 5060));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_rr_set_str(rr, ARES_RR_SRV_TARGET, "sip.example.com"));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_AUTHORITY,
+      "example.com", ARES_REC_TYPE_NS, ARES_CLASS_IN, 3600));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_rr_set_str(rr, ARES_RR_NS_NSDNAME, "ns1.example.com"));
+  /* Extended rcode BADSIG (16) via OPT */
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ADDITIONAL, "",
+      ARES_REC_TYPE_OPT, ARES_CLASS_IN, 0));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_u16(rr, ARES_RR_OPT_UDP_SIZE, 1232));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_write(dnsrec, &msg, &msglen));
+  ares_dns_record_destroy(dnsrec);
+
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_view_init(&view, msg, msglen));
+  EXPECT_EQ(0x1234, ares_dns_view_get_id(&view));
+  EXPECT_EQ(ARES_FLAG_QR|ARES_FLAG_RD|ARES_FLAG_RA,
+    ares_dns_view_get_flags(&view));
+  EXPECT_EQ(ARES_OPCODE_QUERY, ares_dns_view_get_opcode(&view));
+  EXPECT_EQ(ARES_RCODE_BADSIG, ares_dns_view_get_rcode(&view));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_view_query_get(&view, name, sizeof(name), &qtype, &qclass));
+  EXPECT_STREQ("www.example.com", name);
+  EXPECT_EQ(ARES_REC_TYPE_ANY, qtype);
+  EXPECT_EQ(ARES_CLASS_IN, qclass);
+  EXPECT_EQ(4, ares_dns_view_rr_cnt(&view, ARES_SECTION_ANSWER));
+  EXPECT_EQ(1, ares_dns_view_rr_cnt(&view, ARES_SECTION_AUTHORITY));
+  EXPECT_EQ(1, ares_dns_view_rr_cnt(&view, ARES_SECTION_ADDITIONAL));
+
+  /* Answers, with compressed names decoded on demand */
+  EXPECT_TRUE(ares_dns_view_rr_first(&view, ARES_SECTION_ANSWER, &vrr));
+  EXPECT_EQ(ARES_REC_TYPE_CNAME, ares_dns_view_rr_get_type(&vrr));
+  EXPECT_EQ(ARES_CLASS_IN, ares_dns_view_rr_get_class(&vrr));
+  EXPECT_EQ(300, ares_dns_view_rr_get_ttl(&vrr));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_view_rr_get_name(&vrr, name, sizeof(name)));
+  EXPECT_STREQ("www.example.com", name);
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_view_rr_get_dname(&vrr, name, sizeof(name)));
+  EXPECT_STREQ("host.example.com", name);
+  EXPECT_EQ(ARES_ENOMEM,
+    ares_dns_view_rr_get_dname(&vrr, small, sizeof(small)));
+  EXPECT_EQ(ARES_EFORMERR, ares_dns_view_rr_get_addr(&vrr, &addr));
+
+  EXPECT_TRUE(ares_dns_view_rr_next(&vrr));
+  EXPECT_EQ(ARES_REC_TYPE_A, ares_dns_view_rr_get_type(&vrr));
+  memset(&addr, 0, sizeof(addr));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_view_rr_get_addr(&vrr, &addr));
+  EXPECT_EQ(htonl(0xC0A80102), addr.s_addr);
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_view_rr_get_name(&vrr, name, sizeof(name)));
+  EXPECT_STREQ("host.example.com", name);
+
+  EXPECT_TRUE(ares_dns_view_rr_next(&vrr));
+  EXPECT_EQ(ARES_REC_TYPE_AAAA, ares_dns_view_rr_get_type(&vrr));
+  struct ares_in6_addr addr6_out;
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_view_rr_get_addr6(&vrr, &addr6_out));
+  EXPECT_EQ(0, memcmp(&addr6, &addr6_out, sizeof(addr6)));
+  size_t rdata_len = 0;
+  EXPECT_NE(nullptr, ares_dns_view_rr_get_rdata(&vrr, &rdata_len));
+  EXPECT_EQ(16, rdata_len);
+
+  EXPECT_TRUE(ares_dns_view_rr_next(&vrr));
+  EXPECT_EQ(ARES_REC_TYPE_SRV, ares_dns_view_rr_get_type(&vrr));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_view_rr_get_srv(&vrr, &priority, &weight, &port, name,
+      sizeof(name)));
+  EXPECT_EQ(10, priority);
+  EXPECT_EQ(20, weight);
+  EXPECT_EQ(5060, port);
+  EXPECT_STREQ("sip.example.com", name);
+  EXPECT_FALSE(ares_dns_view_rr_next(&vrr));
+
+  EXPECT_TRUE(ares_dns_view_rr_first(&view, ARES_SECTION_AUTHORITY, &vrr));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_view_rr_get_dname(&vrr, name, sizeof(name)));
+  EXPECT_STREQ("ns1.example.com", name);
+  EXPECT_FALSE(ares_dns_view_rr_next(&vrr));
+
+  /* Every truncation of the message is rejected */
+  for (size_t len = 1; len < msglen; len++) {
+    EXPECT_NE(ARES_SUCCESS, ares_dns_view_init(&view, msg, len));
+  }
+
+  /* Misuse */
+  EXPECT_EQ(ARES_EFORMERR, ares_dns_view_init(NULL, msg, msglen));
+  EXPECT_EQ(ARES_EFORMERR, ares_dns_view_init(&view, NULL, 0));
+  EXPECT_EQ(0, ares_dns_view_get_id(NULL));
+  EXPECT_EQ(0, ares_dns_view_rr_cnt(NULL, ARES_SECTION_ANSWER));
+  EXPECT_FALSE(ares_dns_view_rr_first(NULL, ARES_SECTION_ANSWER, &vrr));
+  EXPECT_FALSE(ares_dns_view_rr_next(NULL));
+  EXPECT_EQ(ARES_EFORMERR, ares_dns_view_rr_get_name(NULL, name, sizeof(name)));
+
+  ares_free_string(msg);
+}
+
 #ifndef CARES_SYMBOL_HIDING
 /* Regression coverage for the zero-length salt/type-bitmap code paths in
 * NSEC3 and NSEC3PARAM (empty non-terminal / opt-out per RFC 5155 7.1),
@@ -2707,6 +2959,21 @@ TEST_F(LibraryTest, HtableSzvpMisuse) {
   EXPECT_EQ((size_t)0, ares_htable_szvp_num_keys(NULL));
 }
 
+TEST_F(LibraryTest, HtableBinvpMisuse) {
+  EXPECT_EQ(ARES_FALSE, ares_htable_binvp_insert(NULL, NULL, 0, NULL));
+  EXPECT_EQ(ARES_FALSE, ares_htable_binvp_get(NULL, NULL, 0, NULL));
+  EXPECT_EQ(ARES_FALSE, ares_htable_binvp_remove(NULL, NULL, 0));
+  EXPECT_EQ((size_t)0, ares_htable_binvp_num_keys(NULL));
+}
+
+TEST_F(LibraryTest, QidmapMisuse) {
+  int val = 0;
+  EXPECT_EQ(ARES_FALSE, ares_qidmap_insert(NULL, 0, &val));
+  EXPECT_EQ((void *)NULL, ares_qidmap_get(NULL, 0));
+  EXPECT_EQ(ARES_FALSE, ares_qidmap_remove(NULL, 0));
+  EXPECT_EQ((size_t)0, ares_qidmap_len(NULL));
+}
+
 TEST_F(LibraryTest, HtableVpvpMisuse) {
   EXPECT_EQ(ARES_FALSE, ares_htable_vpvp_insert(NULL, NULL, NULL));
   EXPECT_EQ(ARES_FALSE, ares_htable_vpvp_get(NULL, NULL, NULL));
@@ -3168,6 +3435,280 @@ TEST_F(LibraryTest, HtableSzvp) {
   ares_htable_szvp_destroy(h);
 }
 
+TEST_F(LibraryTest, Qidmap) {
+  ares_qidmap_t *m      = ares_qidmap_create();
+  int            vals[3];
+  size_t         i;
+
+  EXPECT_NE((void *)NULL, m);
+
+  /* NULL is reserved to mark unused ids */
+  EXPECT_FALSE(ares_qidmap_insert(m, 1, NULL));
+
+  /* Every id is usable, including both ends of a page and of the range */
+  for (i = 0; i < 65536; i++) {
+    EXPECT_TRUE(ares_qidmap_insert(m, (unsigned short)i, &vals[i % 3]));
+  }
+  EXPECT_EQ((size_t)65536, ares_qidmap_len(m));
+
+  /* Replacing an existing id doesn't change the count */
+  EXPECT_TRUE(ares_qidmap_insert(m, 255, &vals[2]));
+  EXPECT_EQ((size_t)65536, ares_qidmap_len(m));
+  EXPECT_EQ(&vals[2], ares_qidmap_get(m, 255));
+  EXPECT_EQ(&vals[1], ares_qidmap_get(m, 256));
+  EXPECT_EQ(&vals[0], ares_qidmap_get(m, 65535));
+
+  for (i = 0; i < 65536; i += 2) {
+    EXPECT_TRUE(ares_qidmap_remove(m, (unsigned short)i));
+  }
+  EXPECT_EQ((size_t)32768, ares_qidmap_len(m));
+  EXPECT_FALSE(ares_qidmap_remove(m, 0));
+  EXPECT_EQ((void *)NULL, ares_qidmap_get(m, 0));
+  EXPECT_EQ(&vals[1], ares_qidmap_get(m, 1));
+
+  for (i = 1; i < 65536; i += 2) {
+    EXPECT_TRUE(ares_qidmap_remove(m, (unsigned short)i));
+  }
+  EXPECT_EQ((size_t)0, ares_qidmap_len(m));
+  EXPECT_EQ((void *)NULL, ares_qidmap_get(m, 1));
+
+  /* Emptied pages are reusable */
+  EXPECT_TRUE(ares_qidmap_insert(m, 1, &vals[0]));
+  EXPECT_EQ(&vals[0], ares_qidmap_get(m, 1));
+
+  ares_qidmap_destroy(m);
+}
+
+TEST_F(LibraryTest, TimerwheelMisuse) {
+  ares_uint64_t expire;
+  EXPECT_EQ((void *)NULL, ares_timerwheel_insert(NULL, 0, NULL));
+  EXPECT_EQ((void *)NULL, ares_timerwheel_first_expired(NULL, 0));
+  EXPECT_FALSE(ares_timerwheel_next_expire(NULL, &expire));
+  EXPECT_EQ((void *)NULL, ares_timerwheel_node_val(NULL));
+  EXPECT_EQ((ares_uint64_t)0, ares_timerwheel_node_expire(NULL));
+  EXPECT_EQ((void *)NULL, ares_timerwheel_node_claim(NULL));
+  ares_timerwheel_node_destroy(NULL);
+  EXPECT_EQ((size_t)0, ares_timerwheel_len(NULL));
+}
+
+TEST_F(LibraryTest, Timerwheel) {
+  ares_timerwheel_t                    *w = ares_timerwheel_create();
+  std::vector<ares_timerwheel_node_t *> nodes;
+  ares_uint64_t                         now = 1700000000000ULL;
+  ares_uint64_t                         expire;
+  ares_timerwheel_node_t               *node;
+  size_t                                i;
+
+  EXPECT_NE((void *)NULL, w);
+  EXPECT_FALSE(ares_timerwheel_next_expire(w, &expire));
+  EXPECT_EQ((void *)NULL, ares_timerwheel_first_expired(w, now));
+
+  /* Deadlines spread across every level, including beyond the top level, and
+   * inserted before the wheel has ever been advanced */
+  srand(1234);
+  for (i = 0; i < 2000; i++) {
+    ares_uint64_t delta = (ares_uint64_t)rand() % 5000;
+    if (i % 10 == 0) {
+      delta <<= (i % 40);
+    }
+    node = ares_timerwheel_insert(w, now + delta, (void *)(nodes.size() + 1));
+    EXPECT_NE((void *)NULL, node);
+    nodes.push_back(node);
+  }
+  EXPECT_EQ(nodes.size(), ares_timerwheel_len(w));
+
+  while (!nodes.empty()) {
+    ares_uint64_t min = ares_timerwheel_node_expire(nodes[0]);
+    for (i = 1; i < nodes.size(); i++) {
+      if (ares_timerwheel_node_expire(nodes[i]) < min) {
+        min = ares_timerwheel_node_expire(nodes[i]);
+      }
+    }
+
+    /* Next deadline is always exact */
+    EXPECT_TRUE(ares_timerwheel_next_expire(w, &expire));
+    EXPECT_EQ(min, expire);
+
+    /* Remove a few arbitrary nodes so slot minimums go stale */
+    if (nodes.size() % 7 == 0) {
+      size_t idx = (size_t)rand() % nodes.size();
+      ares_timerwheel_node_destroy(nodes[idx]);
+      nodes.erase(nodes.begin() + (std::ptrdiff_t)idx);
+      continue;
+    }
+
+    /* Nothing is returned before its deadline */
+    if (min > now) {
+      EXPECT_EQ((void *)NULL, ares_timerwheel_first_expired(w, min - 1));
+      now = min;
+    }
+
+    while ((node = ares_timerwheel_first_expired(w, now)) != NULL) {
+      EXPECT_LE(ares_timerwheel_node_expire(node), now);
+      for (i = 0; i < nodes.size(); i++) {
+        if (nodes[i] == node) {
+          break;
+        }
+      }
+      ASSERT_LT(i, nodes.size());
+      EXPECT_NE((void *)NULL, ares_timerwheel_node_val(node));
+      nodes.erase(nodes.begin() + (std::ptrdiff_t)i);
+      EXPECT_NE((void *)NULL, ares_timerwheel_node_claim(node));
+    }
+
+    for (i = 0; i < nodes.size(); i++) {
+      EXPECT_GT(ares_timerwheel_node_expire(nodes[i]), now);
+    }
+  }
+
+  EXPECT_EQ((size_t)0, ares_timerwheel_len(w));
+  EXPECT_FALSE(ares_timerwheel_next_expire(w, &expire));
+
+  /* Deadlines already in the past expire immediately, and remaining nodes are
+   * released with the wheel */
+  EXPECT_NE((void *)NULL, ares_timerwheel_insert(w, now - 5, NULL));
+  EXPECT_NE((void *)NULL, ares_timerwheel_insert(w, now + 100000, NULL));
+  EXPECT_TRUE(ares_timerwheel_next_expire(w, &expire));
+  EXPECT_EQ(now - 5, expire);
+  EXPECT_NE((void *)NULL, ares_timerwheel_first_expired(w, now));
+  ares_timerwheel_destroy(w);
+}
+
+TEST_F(LibraryTest, PoolMisuse) {
+  int val = 0;
+  EXPECT_EQ((void *)NULL, ares_pool_create(0, 0));
+  EXPECT_EQ((void *)NULL, ares_pool_alloc(NULL));
+  ares_pool_free(NULL, &val);
+  ares_pool_destroy(NULL);
+  EXPECT_EQ((size_t)0, ares_pool_len(NULL));
+}
+
+TEST_F(LibraryTest, Pool) {
+  ares_pool_t        *p = ares_pool_create(3, 4);
+  std::vector<char *> objs;
+  size_t              i;
+
+  EXPECT_NE((void *)NULL, p);
+
+  /* Spans several slabs, every object is zeroed, distinct and aligned */
+  for (i = 0; i < 50; i++) {
+    char *obj = (char *)ares_pool_alloc(p);
+    ASSERT_NE((void *)NULL, obj);
+    EXPECT_EQ(0, obj[0]);
+    EXPECT_EQ(0, obj[1]);
+    EXPECT_EQ(0, obj[2]);
+    EXPECT_EQ((size_t)0, ((size_t)obj) % sizeof(void *));
+    for (size_t j = 0; j < objs.size(); j++) {
+      EXPECT_NE(objs[j], obj);
+    }
+    memset(obj, 0xFF, 3);
+    objs.push_back(obj);
+  }
+  EXPECT_EQ((size_t)50, ares_pool_len(p));
+
+  /* Free every other object, full slabs become usable again */
+  for (i = objs.size(); i-- > 0;) {
+    if (i % 2 == 0) {
+      ares_pool_free(p, objs[i]);
+      objs.erase(objs.begin() + (std::ptrdiff_t)i);
+    }
+  }
+  EXPECT_EQ((size_t)25, ares_pool_len(p));
+
+  for (i = 0; i < 25; i++) {
+    char *obj = (char *)ares_pool_alloc(p);
+    ASSERT_NE((void *)NULL, obj);
+    EXPECT_EQ(0, obj[0]);
+    objs.push_back(obj);
+  }
+  EXPECT_EQ((size_t)50, ares_pool_len(p));
+
+  /* Emptying slabs releases them, and the pool is still usable after */
+  for (i = 0; i < objs.size(); i++) {
+    ares_pool_free(p, objs[i]);
+  }
+  objs.clear();
+  EXPECT_EQ((size_t)0, ares_pool_len(p));
+  EXPECT_NE((void *)NULL, ares_pool_alloc(p));
+  EXPECT_EQ((size_t)1, ares_pool_len(p));
+
+  /* Outstanding objects are released with the pool */
+  ares_pool_destroy(p);
+}
+
+TEST_F(LibraryTest, LlistPool) {
+  ares_pool_t       *p  = ares_pool_create(ares_llist_node_size(), 0);
+  ares_llist_t      *l1 = ares_llist_create(NULL);
+  ares_llist_t      *l2 = ares_llist_create(NULL);
+  ares_llist_node_t *node;
+  int                vals[10];
+  size_t             i;
+
+  ares_llist_set_pool(l1, p);
+  for (i = 0; i < 10; i++) {
+    EXPECT_NE((void *)NULL, ares_llist_insert_last(l1, &vals[i]));
+  }
+  EXPECT_EQ((size_t)10, ares_pool_len(p));
+
+  /* Nodes moved to a list without a pool still go back to their pool */
+  node = ares_llist_node_first(l1);
+  ares_llist_node_mvparent_last(node, l2);
+  EXPECT_NE((void *)NULL, ares_llist_insert_last(l2, &vals[0]));
+  EXPECT_EQ((size_t)10, ares_pool_len(p));
+  ares_llist_destroy(l2);
+  EXPECT_EQ((size_t)9, ares_pool_len(p));
+
+  ares_llist_destroy(l1);
+  EXPECT_EQ((size_t)0, ares_pool_len(p));
+  ares_pool_destroy(p);
+}
+
+TEST_F(LibraryTest, Arena) {
+  ares_arena_t *a = ares_arena_create(0);
+  char         *str;
+  size_t        len = 0;
+  size_t        i;
+  int           outside;
+
+  EXPECT_EQ((void *)NULL, ares_arena_alloc(NULL, 1));
+  EXPECT_EQ((void *)NULL, ares_arena_scratch(NULL));
+  EXPECT_FALSE(ares_arena_owns(NULL, &outside));
+  ares_arena_destroy(NULL);
+  ASSERT_NE((void *)NULL, a);
+
+  /* Allocations are aligned and spill over into new chunks */
+  for (i = 0; i < 100; i++) {
+    unsigned char *ptr = (unsigned char *)ares_arena_alloc(a, 1 + i);
+    ASSERT_NE((void *)NULL, ptr);
+    EXPECT_EQ((size_t)0, ((size_t)ptr) % sizeof(void *));
+    memset(ptr, 0xFF, 1 + i);
+    EXPECT_TRUE(ares_arena_owns(a, ptr));
+  }
+  EXPECT_FALSE(ares_arena_owns(a, &outside));
+
+  /* Larger than any chunk so far */
+  EXPECT_NE((void *)NULL, ares_arena_alloc(a, 100000));
+
+  str = (char *)ares_arena_memdup(a, "hello", 5, ARES_TRUE);
+  EXPECT_STREQ("hello", str);
+
+  /* Scratch buffer is reset between uses */
+  ares_buf_t *buf = ares_arena_scratch(a);
+  ASSERT_NE((void *)NULL, buf);
+  EXPECT_EQ(ARES_SUCCESS, ares_buf_append_str(buf, "first"));
+  str = ares_arena_scratch_finish(a, &len);
+  EXPECT_STREQ("first", str);
+  EXPECT_EQ((size_t)5, len);
+  EXPECT_TRUE(ares_arena_owns(a, str));
+  buf = ares_arena_scratch(a);
+  EXPECT_EQ((size_t)0, ares_buf_len(buf));
+  EXPECT_EQ(ARES_SUCCESS, ares_buf_append_str(buf, "2nd"));
+  EXPECT_STREQ("2nd", ares_arena_scratch_finish(a, NULL));
+  EXPECT_STREQ("first", str);
+
+  ares_arena_destroy(a);
+}
+
 typedef struct {
   char s[32];
 } test_htable_vpstr_t;
@@ -3267,6 +3808,59 @@ TEST_F(LibraryTest, HtableStrvp) {
   ares_htable_strvp_destroy(h);
 }
 
+typedef struct {
+  unsigned char s[8];
+} test_htable_binvp_t;
+
+TEST_F(LibraryTest, HtableBinvp) {
+  ares_llist_t        *l = NULL;
+  ares_htable_binvp_t *h = NULL;
+  ares_llist_node_t   *n = NULL;
+  size_t                i;
+
+#define BINVP_TABLE_SIZE 1000
+
+  l = ares_llist_create(NULL);
+  EXPECT_NE((void *)NULL, l);
+
+  h = ares_htable_binvp_create(ares_free);
+  EXPECT_NE((void *)NULL, h);
+
+  for (i=0; i<BINVP_TABLE_SIZE; i++) {
+    test_htable_binvp_t *s = (test_htable_binvp_t *)ares_malloc_zero(sizeof(*s));
+    EXPECT_NE((void *)NULL, s);
+    /* Keys differing only in embedded NULs and length must be distinct */
+    s->s[0] = (unsigned char)(i & 0xFF);
+    s->s[1] = 0;
+    s->s[2] = (unsigned char)((i >> 8) & 0xFF);
+    EXPECT_NE((void *)NULL, ares_llist_insert_last(l, s));
+    EXPECT_TRUE(ares_htable_binvp_insert(h, s->s, sizeof(s->s), s));
+  }
+
+  EXPECT_EQ(BINVP_TABLE_SIZE, ares_llist_len(l));
+  EXPECT_EQ(BINVP_TABLE_SIZE, ares_htable_binvp_num_keys(h));
+
+  n = ares_llist_node_first(l);
+  EXPECT_NE((void *)NULL, n);
+  while (n != NULL) {
+    ares_llist_node_t *next = ares_llist_node_next(n);
+    test_htable_binvp_t *s   = (test_htable_binvp_t *)ares_llist_node_val(n);
+    EXPECT_NE((void *)NULL, s);
+    EXPECT_EQ(s, ares_htable_binvp_get_direct(h, s->s, sizeof(s->s)));
+    EXPECT_FALSE(ares_htable_binvp_get(h, s->s, sizeof(s->s) - 1, NULL));
+    EXPECT_TRUE(ares_htable_binvp_get(h, s->s, sizeof(s->s), NULL));
+    EXPECT_TRUE(ares_htable_binvp_remove(h, s->s, sizeof(s->s)));
+    ares_llist_node_destroy(n);
+    n = next;
+  }
+
+  EXPECT_EQ(0, ares_llist_len(l));
+  EXPECT_EQ(0, ares_htable_binvp_num_keys(h));
+
+  ares_llist_destroy(l);
+  ares_htable_binvp_destroy(h);
+}
+
 TEST_F(LibraryTest, HtableDict) {
   ares_htable_dict_t  *h = NULL;
   size_t               i;
@@ -942,6 +942,129 @@ TEST_P(MockChannelTestAI, SearchDomainsServFailOnAAAA) {
   EXPECT_THAT(result.ai_, IncludesV4Address("2.3.4.5"));
 }
 
+class MockParallelSearchChannelTestAI : public MockFlagsChannelOptsTestAI {
+ public:
+  MockParallelSearchChannelTestAI() : MockFlagsChannelOptsTestAI(ARES_FLAG_PARALLEL_SEARCH) {}
+};
+
+// Addresses of both families come from the highest priority name with any
+TEST_P(MockParallelSearchChannelTestAI, SearchDomainsUnspec) {
+  DNSPacket nofirst4;
+  nofirst4.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillOnce(SetReply(&server_, &nofirst4));
+  DNSPacket nofirst6;
+  nofirst6.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_AAAA));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_AAAA))
+    .WillOnce(SetReply(&server_, &nofirst6));
+  DNSPacket yessecond4;
+  yessecond4.set_response().set_aa()
+    .add_question(new DNSQuestion("www.second.org", T_A))
+    .add_answer(new DNSARR("www.second.org", 0x0200, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillOnce(SetReply(&server_, &yessecond4));
+  DNSPacket nodatasecond6;
+  nodatasecond6.set_response().set_aa()
+    .add_question(new DNSQuestion("www.second.org", T_AAAA));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_AAAA))
+    .WillOnce(SetReply(&server_, &nodatasecond6));
+  DNSPacket yesthird4;
+  yesthird4.set_response().set_aa()
+    .add_question(new DNSQuestion("www.third.gov", T_A))
+    .add_answer(new DNSARR("www.third.gov", 0x0200, {3, 4, 5, 6}));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillOnce(SetReply(&server_, &yesthird4));
+  DNSPacket yesthird6;
+  yesthird6.set_response().set_aa()
+    .add_question(new DNSQuestion("www.third.gov", T_AAAA))
+    .add_answer(new DNSAaaaRR("www.third.gov", 0x0200,
+                              {0x21, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03}));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_AAAA))
+    .WillOnce(SetReply(&server_, &yesthird6));
+  DNSPacket nobare4;
+  nobare4.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_A));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .WillOnce(SetReply(&server_, &nobare4));
+  DNSPacket nobare6;
+  nobare6.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_AAAA));
+  EXPECT_CALL(server_, OnRequest("www", T_AAAA))
+    .WillOnce(SetReply(&server_, &nobare6));
+
+  AddrInfoResult result;
+  struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_flags = ARES_AI_NOSORT;
+  ares_getaddrinfo(channel_, "www", NULL, &hints, AddrInfoCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(result.status_, ARES_SUCCESS);
+  EXPECT_THAT(result.ai_, IncludesNumAddresses(1));
+  EXPECT_THAT(result.ai_, IncludesV4Address("2.3.4.5"));
+}
+
+class MockParallelSearchCacheChannelTestAI
+    : public MockChannelOptsTest,
+      public ::testing::WithParamInterface< std::pair<int, bool> > {
+ public:
+  MockParallelSearchCacheChannelTestAI()
+    : MockChannelOptsTest(1, GetParam().first, GetParam().second, false,
+                          FillOptions(&opts_),
+                          ARES_OPT_FLAGS|ARES_OPT_QUERY_CACHE) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->flags          = ARES_FLAG_PARALLEL_SEARCH;
+    opts->qcache_max_ttl = 3600;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+// A repeated lookup is answered from the cache for the names that exist while
+// the ones that don't are queried again.
+TEST_P(MockParallelSearchCacheChannelTestAI, SearchDomainsCached) {
+  DNSPacket nofirst;
+  nofirst.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillRepeatedly(SetReply(&server_, &nofirst));
+  DNSPacket yessecond;
+  yessecond.set_response().set_aa()
+    .add_question(new DNSQuestion("www.second.org", T_A))
+    .add_answer(new DNSARR("www.second.org", 0x0200, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillOnce(SetReply(&server_, &yessecond));
+  DNSPacket yesthird;
+  yesthird.set_response().set_aa()
+    .add_question(new DNSQuestion("www.third.gov", T_A))
+    .add_answer(new DNSARR("www.third.gov", 0x0200, {3, 4, 5, 6}));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillOnce(SetReply(&server_, &yesthird));
+  DNSPacket nobare;
+  nobare.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_A));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .WillRepeatedly(SetReply(&server_, &nobare));
+
+  for (int i = 0; i < 2; i++) {
+    AddrInfoResult result;
+    struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+    hints.ai_family = AF_INET;
+    hints.ai_flags = ARES_AI_NOSORT;
+    ares_getaddrinfo(channel_, "www", NULL, &hints, AddrInfoCallback, &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+    EXPECT_EQ(result.status_, ARES_SUCCESS);
+    EXPECT_THAT(result.ai_, IncludesNumAddresses(1));
+    EXPECT_THAT(result.ai_, IncludesV4Address("2.3.4.5"));
+  }
+}
+
 class MockMultiServerChannelTestAI
   : public MockChannelOptsTest,
     public ::testing::WithParamInterface< std::pair<int, bool> > {
@@ -1034,6 +1157,116 @@ TEST_P(NoRotateMultiMockTestAI, v6Worksv4TimesoutFirst) {
 
 }
 
+struct PartialAddrInfoResult {
+  PartialAddrInfoResult() : calls_(0), v4_(0), v6_(0) {}
+  int calls_;
+  int v4_;
+  int v6_;
+};
+
+static void PartialAddrInfoCallback(void *data, const struct ares_addrinfo *res) {
+  PartialAddrInfoResult *result = reinterpret_cast<PartialAddrInfoResult *>(data);
+  const struct ares_addrinfo_node *node;
+  result->calls_++;
+  for (node = res->nodes; node != NULL; node = node->ai_next) {
+    if (node->ai_family == AF_INET) {
+      result->v4_++;
+    } else if (node->ai_family == AF_INET6) {
+      result->v6_++;
+    }
+  }
+}
+
+struct PartialAndFinalResult {
+  PartialAddrInfoResult partial_;
+  AddrInfoResult        final_;
+};
+
+static void PartialCallback(void *data, const struct ares_addrinfo *res) {
+  PartialAndFinalResult *result = reinterpret_cast<PartialAndFinalResult *>(data);
+  // The final result must never precede the partial one
+  EXPECT_FALSE(result->final_.done_);
+  PartialAddrInfoCallback(&result->partial_, res);
+}
+
+static void PartialFinalCallback(void *data, int status, int timeouts,
+                                 struct ares_addrinfo *res) {
+  PartialAndFinalResult *result = reinterpret_cast<PartialAndFinalResult *>(data);
+  AddrInfoCallback(&result->final_, status, timeouts, res);
+}
+
+/* AAAA answer arrives while A is being retried on another server, IPv6
+ * addresses are handed out right away and the final result has both */
+TEST_P(NoRotateMultiMockTestAI, PartialV6First) {
+  std::vector<byte> nothing;
+
+  DNSPacket rsp4;
+  rsp4.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 0x0100, {0x01, 0x02, 0x03, 0x04}));
+
+  DNSPacket rsp6;
+  rsp6.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_AAAA))
+    .add_answer(new DNSAaaaRR("www.example.com", 100,
+                              {0x21, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03}));
+
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .WillOnce(SetReplyData(servers_[0].get(), nothing));
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_AAAA))
+    .WillOnce(SetReply(servers_[0].get(), &rsp6));
+  EXPECT_CALL(*servers_[1], OnRequest("www.example.com", T_A))
+    .WillOnce(SetReply(servers_[1].get(), &rsp4));
+
+  PartialAndFinalResult result;
+  struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_flags = ARES_AI_NOSORT;
+  ares_getaddrinfo_partial(channel_, "www.example.com.", NULL, &hints,
+                           PartialCallback, PartialFinalCallback, &result);
+  Process();
+  EXPECT_EQ(1, result.partial_.calls_);
+  EXPECT_EQ(0, result.partial_.v4_);
+  EXPECT_EQ(1, result.partial_.v6_);
+  EXPECT_TRUE(result.final_.done_);
+  EXPECT_EQ(result.final_.status_, ARES_SUCCESS);
+  EXPECT_THAT(result.final_.ai_, IncludesNumAddresses(2));
+  EXPECT_THAT(result.final_.ai_, IncludesV4Address("1.2.3.4"));
+  EXPECT_THAT(result.final_.ai_, IncludesV6Address("2121:0000:0000:0000:0000:0000:0000:0303"));
+}
+
+/* A answer arrives but AAAA never does, IPv4 addresses are handed out once
+ * the resolution delay passes */
+TEST_P(NoRotateMultiMockTestAI, PartialV4AfterResolutionDelay) {
+  std::vector<byte> nothing;
+
+  DNSPacket rsp4;
+  rsp4.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 0x0100, {0x01, 0x02, 0x03, 0x04}));
+
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .WillOnce(SetReply(servers_[0].get(), &rsp4));
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_AAAA))
+    .WillOnce(SetReplyData(servers_[0].get(), nothing));
+
+  PartialAndFinalResult result;
+  struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_flags = ARES_AI_NOSORT;
+  ares_getaddrinfo_partial(channel_, "www.example.com.", NULL, &hints,
+                           PartialCallback, PartialFinalCallback, &result);
+  Process();
+  EXPECT_EQ(1, result.partial_.calls_);
+  EXPECT_EQ(1, result.partial_.v4_);
+  EXPECT_EQ(0, result.partial_.v6_);
+  EXPECT_TRUE(result.final_.done_);
+  EXPECT_EQ(result.final_.status_, ARES_SUCCESS);
+  EXPECT_THAT(result.final_.ai_, IncludesNumAddresses(1));
+  EXPECT_THAT(result.final_.ai_, IncludesV4Address("1.2.3.4"));
+}
+
 TEST_P(NoRotateMultiMockTestAI, ThirdServer) {
   struct ares_options opts;
   int optmask = 0;
@@ -1305,6 +1538,12 @@ INSTANTIATE_TEST_SUITE_P(AddressFamiliesAI, MockNoCheckRespChannelTestAI,
 INSTANTIATE_TEST_SUITE_P(AddressFamiliesAI, MockEDNSChannelTestAI,
 			::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
 
+INSTANTIATE_TEST_SUITE_P(AddressFamiliesAI, MockParallelSearchChannelTestAI,
+			::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
+INSTANTIATE_TEST_SUITE_P(AddressFamiliesAI, MockParallelSearchCacheChannelTestAI,
+			::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
 INSTANTIATE_TEST_SUITE_P(TransportModesAI, NoRotateMultiMockTestAI,
 			::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
 
@@ -33,6 +33,7 @@
 #include <sys/stat.h>
 #endif
 
+#include <atomic>
 #include <sstream>
 #include <vector>
 
@@ -357,6 +358,133 @@ TEST_P(MockUDPEventThreadMaxQueriesTest, GetHostByNameParallelLookups) {
   }
 }
 
+#define SHARDS_COUNT   4
+#define SHARDS_QUERIES 16
+
+class MockUDPEventThreadShardsTest
+    : public MockEventThreadOptsTest,
+      public ::testing::WithParamInterface<std::tuple<ares_evsys_t,int>> {
+ public:
+  MockUDPEventThreadShardsTest()
+    : MockEventThreadOptsTest(1, std::get<0>(GetParam()), std::get<1>(GetParam()), false,
+                          FillOptions(&opts_),
+                          ARES_OPT_EVENT_THREAD_SHARDS) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->event_thread_shards = SHARDS_COUNT;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(MockUDPEventThreadShardsTest, GetHostByNameParallelLookups) {
+  DNSPacket rsp[SHARDS_QUERIES];
+  for (size_t i=0; i<SHARDS_QUERIES; i++) {
+    std::string name = "host" + std::to_string(i) + ".example.com";
+    rsp[i].set_response().set_aa()
+      .add_question(new DNSQuestion(name, T_A))
+      .add_answer(new DNSARR(name, 100, {2, 3, 4, (byte)i}));
+    ON_CALL(server_, OnRequest(name, T_A))
+      .WillByDefault(SetReply(&server_, &rsp[i]));
+  }
+
+  struct ares_options opts;
+  int optmask = 0;
+  EXPECT_EQ(ARES_SUCCESS, ares_save_options(channel_, &opts, &optmask));
+  EXPECT_EQ(ARES_OPT_EVENT_THREAD_SHARDS, optmask & ARES_OPT_EVENT_THREAD_SHARDS);
+  EXPECT_EQ((size_t)SHARDS_COUNT, opts.event_thread_shards);
+  ares_destroy_options(&opts);
+
+  /* Queries are spread across the shards by name, the servers set after
+   * init must have reached all of them */
+  HostResult result[SHARDS_QUERIES];
+  for (size_t i=0; i<SHARDS_QUERIES; i++) {
+    std::string name = "host" + std::to_string(i) + ".example.com.";
+    ares_gethostbyname(channel_, name.c_str(), AF_INET, HostCallback, &result[i]);
+  }
+
+  Process();
+
+  EXPECT_EQ(0, (int)ares_queue_active_queries(channel_));
+  for (size_t i=0; i<SHARDS_QUERIES; i++) {
+    std::stringstream ss;
+    std::stringstream expected;
+    EXPECT_TRUE(result[i].done_);
+    ss << result[i].host_;
+    expected << "{'host" << i << ".example.com' aliases=[] addrs=[2.3.4." << i << "]}";
+    EXPECT_EQ(expected.str(), ss.str());
+  }
+}
+
+TEST_P(MockUDPEventThreadShardsTest, CancelAllShards) {
+  EXPECT_CALL(server_, OnRequest(testing::_, T_A))
+    .WillRepeatedly(testing::Return());
+
+  HostResult result[SHARDS_QUERIES];
+  for (size_t i=0; i<SHARDS_QUERIES; i++) {
+    std::string name = "host" + std::to_string(i) + ".example.com.";
+    ares_gethostbyname(channel_, name.c_str(), AF_INET, HostCallback, &result[i]);
+  }
+  EXPECT_EQ(SHARDS_QUERIES, (int)ares_queue_active_queries(channel_));
+
+  ares_cancel(channel_);
+
+  EXPECT_EQ(ARES_SUCCESS, ares_queue_wait_empty(channel_, 1000));
+  for (size_t i=0; i<SHARDS_QUERIES; i++) {
+    EXPECT_TRUE(result[i].done_);
+    EXPECT_EQ(ARES_ECANCELLED, result[i].status_);
+  }
+}
+
+static ares_ssize_t count_sendto(ares_socket_t sock, const void *buffer,
+                                 size_t length, int flags,
+                                 const struct sockaddr *address,
+                                 ares_socklen_t address_len, void *user_data)
+{
+  std::atomic<int> *count = (std::atomic<int> *)user_data;
+  (*count)++;
+  return noop_sendto(sock, buffer, length, flags, address, address_len, NULL);
+}
+
+TEST_P(MockUDPEventThreadShardsTest, SocketFunctionsAllShards) {
+  /* Every query must be written through the custom functions no matter which
+   * shard it was hashed to, so the mock server never sees any of them */
+  EXPECT_CALL(server_, OnRequest(testing::_, testing::_)).Times(0);
+
+  std::atomic<int> sends(0);
+  struct ares_socket_functions_ex count_sock_funcs;
+  memset(&count_sock_funcs, 0, sizeof(count_sock_funcs));
+  count_sock_funcs.version     = 1;
+  count_sock_funcs.asocket     = noop_socket;
+  count_sock_funcs.aclose      = noop_close;
+  count_sock_funcs.asetsockopt = noop_setsockopt;
+  count_sock_funcs.aconnect    = noop_connect;
+  count_sock_funcs.arecvfrom   = noop_recvfrom;
+  count_sock_funcs.asendto     = count_sendto;
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_set_socket_functions_ex(channel_, &count_sock_funcs, &sends));
+
+  HostResult result[SHARDS_QUERIES];
+  for (size_t i=0; i<SHARDS_QUERIES; i++) {
+    std::string name = "host" + std::to_string(i) + ".example.com.";
+    ares_gethostbyname(channel_, name.c_str(), AF_INET, HostCallback, &result[i]);
+  }
+
+  /* Writes may be flushed by the event threads, give them a moment */
+  for (size_t i=0; i<100 && sends < SHARDS_QUERIES; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(SHARDS_QUERIES, (int)sends);
+
+  ares_cancel(channel_);
+  EXPECT_EQ(ARES_SUCCESS, ares_queue_wait_empty(channel_, 1000));
+  for (size_t i=0; i<SHARDS_QUERIES; i++) {
+    EXPECT_TRUE(result[i].done_);
+    EXPECT_EQ(ARES_ECANCELLED, result[i].status_);
+  }
+}
+
 /* This test case is likely to fail in heavily loaded environments, it was
  * there to stress the windows event system.  Not needed to be on normally */
 #if 0
@@ -1123,6 +1251,62 @@ TEST_P(MockEventThreadTest, ExplicitIP) {
   EXPECT_EQ("{'1.2.3.4' aliases=[] addrs=[1.2.3.4]}", ss.str());
 }
 
+#define SUBMIT_THREADS 8
+#define SUBMIT_QUERIES 8
+TEST_P(MockEventThreadTest, ConcurrentSubmit) {
+  DNSPacket rsp[SUBMIT_THREADS][SUBMIT_QUERIES];
+  for (size_t t=0; t<SUBMIT_THREADS; t++) {
+    for (size_t i=0; i<SUBMIT_QUERIES; i++) {
+      std::string name = "t" + std::to_string(t) + "q" + std::to_string(i) + ".example.com";
+      rsp[t][i].set_response().set_aa()
+        .add_question(new DNSQuestion(name, T_A))
+        .add_answer(new DNSARR(name, 100, {2, 3, (byte)t, (byte)i}));
+      ON_CALL(server_, OnRequest(name, T_A))
+        .WillByDefault(SetReply(&server_, &rsp[t][i]));
+    }
+  }
+
+  /* Requests from many threads at once are queued without the channel lock
+   * and started by the event thread */
+  QueryResult    qresult[SUBMIT_THREADS][SUBMIT_QUERIES];
+  AddrInfoResult airesult[SUBMIT_THREADS][SUBMIT_QUERIES];
+  std::vector<std::thread> threads;
+  for (size_t t=0; t<SUBMIT_THREADS; t++) {
+    threads.push_back(std::thread([this, t, &qresult, &airesult]() {
+      struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+      hints.ai_family = AF_INET;
+      for (size_t i=0; i<SUBMIT_QUERIES; i++) {
+        std::string name = "t" + std::to_string(t) + "q" + std::to_string(i) + ".example.com.";
+        EXPECT_EQ(ARES_SUCCESS, ares_query_dnsrec(channel_, name.c_str(), ARES_CLASS_IN,
+                                                  ARES_REC_TYPE_A, QueryCallback,
+                                                  &qresult[t][i], NULL));
+        ares_getaddrinfo(channel_, name.c_str(), NULL, &hints, AddrInfoCallback,
+                         &airesult[t][i]);
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  Process();
+
+  EXPECT_EQ(0, (int)ares_queue_active_queries(channel_));
+  for (size_t t=0; t<SUBMIT_THREADS; t++) {
+    for (size_t i=0; i<SUBMIT_QUERIES; i++) {
+      std::stringstream expected;
+      expected << "{addr=[2.3." << t << "." << i << "]}";
+      EXPECT_TRUE(qresult[t][i].done_);
+      EXPECT_EQ(ARES_SUCCESS, qresult[t][i].status_);
+      EXPECT_TRUE(airesult[t][i].done_);
+      EXPECT_EQ(ARES_SUCCESS, airesult[t][i].status_);
+      std::stringstream ss;
+      ss << airesult[t][i].ai_;
+      EXPECT_EQ(expected.str(), ss.str());
+    }
+  }
+}
+
 TEST_P(MockEventThreadTest, SortListV4) {
   DNSPacket rsp;
   rsp.set_response().set_aa()
@@ -1723,6 +1907,8 @@ static const char *evsys_tostr(ares_evsys_t evsys)
       return "POLL";
     case ARES_EVSYS_SELECT:
       return "SELECT";
+    case ARES_EVSYS_IO_URING:
+      return "IO_URING";
     case ARES_EVSYS_DEFAULT:
       return "DEFAULT";
   }
@@ -1758,6 +1944,8 @@ INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockUDPEventThreadTest, ::testing::Val
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockUDPEventThreadMaxQueriesTest, ::testing::ValuesIn(ares::test::evsys_families), ares::test::PrintEvsysFamily);
 
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockUDPEventThreadShardsTest, ::testing::ValuesIn(ares::test::evsys_families), ares::test::PrintEvsysFamily);
+
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, CacheQueriesEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families), ares::test::PrintEvsysFamily);
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockTCPEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families), ares::test::PrintEvsysFamily);
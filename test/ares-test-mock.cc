@@ -29,6 +29,7 @@
 #ifndef WIN32
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #endif
 
 #include <sstream>
@@ -393,6 +394,56 @@ TEST_P(MockChannelTest, ServStateCallbackSuccess) {
   ares_free_string(exp_server_string);
 }
 
+TEST_P(MockChannelTest, ServerLatency) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  ON_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp));
+
+  // The channel used for this test has a single server configured.
+  char *server_string = ares_get_servers_csv(channel_);
+  ares_server_latency_t lat;
+
+  // Nothing recorded yet.
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_get_server_latency(channel_, server_string,
+                                    ARES_METRICS_PERIOD_1MINUTE, &lat));
+  EXPECT_EQ(0, lat.count);
+
+  for (int i = 0; i < 3; i++) {
+    HostResult result;
+    ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback,
+                       &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+  }
+
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_get_server_latency(channel_, server_string,
+                                    ARES_METRICS_PERIOD_INCEPTION, &lat));
+  EXPECT_EQ(3, lat.count);
+  EXPECT_LE(lat.min_ms, lat.p50_ms);
+  EXPECT_LE(lat.p50_ms, lat.p90_ms);
+  EXPECT_LE(lat.p90_ms, lat.p99_ms);
+  EXPECT_LE(lat.p99_ms, lat.max_ms);
+  EXPECT_LE(lat.min_ms, lat.avg_ms);
+  EXPECT_LE(lat.avg_ms, lat.max_ms);
+
+  EXPECT_EQ(ARES_ENOTFOUND,
+            ares_get_server_latency(channel_, "192.0.2.1:53",
+                                    ARES_METRICS_PERIOD_1MINUTE, &lat));
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_get_server_latency(channel_, server_string,
+                                    (ares_metrics_period_t)99, &lat));
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_get_server_latency(channel_, nullptr,
+                                    ARES_METRICS_PERIOD_1MINUTE, &lat));
+
+  ares_free_string(server_string);
+}
+
 TEST_P(MockChannelTest, ServStateCallbackFailure) {
   // Set up the server response. The server always returns SERVFAIL.
   DNSPacket rsp;
@@ -641,6 +692,218 @@ TEST_P(CacheQueriesTest, GetHostByNameCache) {
   EXPECT_EQ(1, sock_cb_count);
 }
 
+class CacheLimitQueriesTest
+    : public MockChannelOptsTest,
+      public ::testing::WithParamInterface<int> {
+ public:
+  CacheLimitQueriesTest()
+    : MockChannelOptsTest(1, GetParam(), false, false,
+                          FillOptions(&opts_),
+                          ARES_OPT_QUERY_CACHE|ARES_OPT_QUERY_CACHE_OPTS) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->qcache_max_ttl          = 3600;
+    opts->qcache_opts.max_entries = 2;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(CacheLimitQueriesTest, EvictLeastRecentlyUsed) {
+  DNSPacket rsp1;
+  rsp1.set_response().set_aa()
+    .add_question(new DNSQuestion("one.com", T_A))
+    .add_answer(new DNSARR("one.com", 100, {1, 1, 1, 1}));
+  DNSPacket rsp2;
+  rsp2.set_response().set_aa()
+    .add_question(new DNSQuestion("two.com", T_A))
+    .add_answer(new DNSARR("two.com", 100, {2, 2, 2, 2}));
+  DNSPacket rsp3;
+  rsp3.set_response().set_aa()
+    .add_question(new DNSQuestion("three.com", T_A))
+    .add_answer(new DNSARR("three.com", 100, {3, 3, 3, 3}));
+
+  // one.com is refreshed in the LRU before three.com is inserted, so two.com
+  // is the one evicted and must be re-queried.
+  EXPECT_CALL(server_, OnRequest("one.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp1));
+  EXPECT_CALL(server_, OnRequest("two.com", T_A))
+    .Times(2).WillRepeatedly(SetReply(&server_, &rsp2));
+  EXPECT_CALL(server_, OnRequest("three.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp3));
+
+  const char *names[] = { "one.com", "two.com", "one.com", "three.com",
+                          "one.com", "two.com" };
+  for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++) {
+    QueryResult result;
+    ares_query_dnsrec(channel_, names[i], ARES_CLASS_IN, ARES_REC_TYPE_A,
+                      QueryCallback, &result, NULL);
+    Process();
+    EXPECT_TRUE(result.done_);
+    EXPECT_EQ(ARES_SUCCESS, result.status_);
+  }
+
+  struct ares_options opts;
+  int                 optmask = 0;
+  memset(&opts, 0, sizeof(opts));
+  EXPECT_EQ(ARES_SUCCESS, ares_save_options(channel_, &opts, &optmask));
+  EXPECT_TRUE(optmask & ARES_OPT_QUERY_CACHE_OPTS);
+  EXPECT_EQ(2, opts.qcache_opts.max_entries);
+  ares_destroy_options(&opts);
+}
+
+class CacheStaleQueriesTest
+    : public MockChannelOptsTest,
+      public ::testing::WithParamInterface<int> {
+ public:
+  CacheStaleQueriesTest()
+    : MockChannelOptsTest(1, GetParam(), false, false,
+                          FillOptions(&opts_),
+                          ARES_OPT_QUERY_CACHE|ARES_OPT_QUERY_CACHE_OPTS) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->qcache_max_ttl            = 3600;
+    opts->qcache_opts.stale_max_ttl = 3600;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(CacheStaleQueriesTest, ServeStaleOnFailure) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 1, {2, 3, 4, 5}));
+  DNSPacket servfail;
+  servfail.set_response().set_aa().set_rcode(SERVFAIL)
+    .add_question(new DNSQuestion("www.google.com", T_A));
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp))
+    .WillRepeatedly(SetReply(&server_, &servfail));
+
+  QueryResult result1;
+  ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN, ARES_REC_TYPE_A,
+                    QueryCallback, &result1, NULL);
+  Process();
+  EXPECT_TRUE(result1.done_);
+  EXPECT_EQ(ARES_SUCCESS, result1.status_);
+
+  /* Let the entry expire */
+  ares_sleep_time(1100);
+
+  /* Servers fail, so the expired entry is served with a short TTL */
+  QueryResult result2;
+  ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN, ARES_REC_TYPE_A,
+                    QueryCallback, &result2, NULL);
+  Process();
+  EXPECT_TRUE(result2.done_);
+  EXPECT_EQ(ARES_SUCCESS, result2.status_);
+  const ares_dns_rr_t *rr =
+    ares_dns_record_rr_get_const(result2.dnsrec_.dnsrec_, ARES_SECTION_ANSWER, 0);
+  ASSERT_NE(nullptr, rr);
+  EXPECT_EQ(30, ares_dns_rr_get_ttl(rr));
+}
+
+class CachePrefetchQueriesTest
+    : public MockChannelOptsTest,
+      public ::testing::WithParamInterface<int> {
+ public:
+  CachePrefetchQueriesTest()
+    : MockChannelOptsTest(1, GetParam(), false, false,
+                          FillOptions(&opts_),
+                          ARES_OPT_QUERY_CACHE|ARES_OPT_QUERY_CACHE_OPTS) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->qcache_max_ttl                = 3600;
+    /* Any hit is within the prefetch window, so only hits matter */
+    opts->qcache_opts.prefetch_pct      = 100;
+    opts->qcache_opts.prefetch_min_hits = 2;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+class CacheSharedQueriesTest
+    : public MockChannelOptsTest,
+      public ::testing::WithParamInterface<int> {
+ public:
+  CacheSharedQueriesTest()
+    : MockChannelOptsTest(1, GetParam(), false, false,
+                          FillOptions(&opts_),
+                          ARES_OPT_QUERY_CACHE_SHARED) {}
+  ~CacheSharedQueriesTest() {
+    /* Channel still holds a reference */
+    ares_qcache_shared_destroy(opts_.qcache_shared);
+  }
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    EXPECT_EQ(ARES_SUCCESS,
+              ares_qcache_shared_create(3600, NULL, &opts->qcache_shared));
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(CacheSharedQueriesTest, SharedBetweenChannels) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp));
+
+  QueryResult result;
+  ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN, ARES_REC_TYPE_A,
+                    QueryCallback, &result, NULL);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.status_);
+
+  /* The duplicated channel attaches to the same cache, so it is answered
+   * without contacting the server */
+  ares_channel_t *copy = NULL;
+  EXPECT_EQ(ARES_SUCCESS, ares_dup(&copy, channel_));
+
+  QueryResult cacheresult;
+  ares_query_dnsrec(copy, "www.google.com", ARES_CLASS_IN, ARES_REC_TYPE_A,
+                    QueryCallback, &cacheresult, NULL);
+  EXPECT_TRUE(cacheresult.done_);
+  EXPECT_EQ(ARES_SUCCESS, cacheresult.status_);
+  ares_destroy(copy);
+
+  /* Still usable by the original channel once the copy is gone */
+  QueryResult cacheresult2;
+  ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN,
+                    ARES_REC_TYPE_A, QueryCallback, &cacheresult2, NULL);
+  EXPECT_TRUE(cacheresult2.done_);
+  EXPECT_EQ(ARES_SUCCESS, cacheresult2.status_);
+}
+
+TEST_P(CachePrefetchQueriesTest, PrefetchPopularEntry) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+
+  // Initial miss plus a single refresh on the second cache hit.  The refreshed
+  // entry starts with no hits so isn't prefetched again.
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .Times(2).WillRepeatedly(SetReply(&server_, &rsp));
+
+  for (size_t i = 0; i < 4; i++) {
+    QueryResult result;
+    ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN,
+                      ARES_REC_TYPE_A, QueryCallback, &result, NULL);
+    Process();
+    EXPECT_TRUE(result.done_);
+    EXPECT_EQ(ARES_SUCCESS, result.status_);
+  }
+}
+
 #define TCPPARALLELLOOKUPS 32
 TEST_P(MockTCPChannelTest, GetHostByNameParallelLookups) {
   DNSPacket rsp;
@@ -946,13 +1209,278 @@ TEST_P(MockChannelTest, SearchDomains) {
   ON_CALL(server_, OnRequest("www.third.gov", T_A))
     .WillByDefault(SetReply(&server_, &yesthird));
 
-  HostResult result;
-  ares_gethostbyname(channel_, "www", AF_INET, HostCallback, &result);
-  Process();
-  EXPECT_TRUE(result.done_);
-  std::stringstream ss;
-  ss << result.host_;
-  EXPECT_EQ("{'www.third.gov' aliases=[] addrs=[2.3.4.5]}", ss.str());
+  HostResult result;
+  ares_gethostbyname(channel_, "www", AF_INET, HostCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  std::stringstream ss;
+  ss << result.host_;
+  EXPECT_EQ("{'www.third.gov' aliases=[] addrs=[2.3.4.5]}", ss.str());
+}
+
+class MockParallelSearchChannelTest : public MockFlagsChannelOptsTest {
+ public:
+  MockParallelSearchChannelTest() : MockFlagsChannelOptsTest(ARES_FLAG_PARALLEL_SEARCH) {}
+};
+
+// All candidates are sent, the highest priority success wins even though lower
+// priority ones also succeed.
+TEST_P(MockParallelSearchChannelTest, SearchPriority) {
+  DNSPacket nofirst;
+  nofirst.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillOnce(SetReply(&server_, &nofirst));
+  DNSPacket yessecond;
+  yessecond.set_response().set_aa()
+    .add_question(new DNSQuestion("www.second.org", T_A))
+    .add_answer(new DNSARR("www.second.org", 0x0200, {1, 2, 3, 4}));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillOnce(SetReply(&server_, &yessecond));
+  DNSPacket yesthird;
+  yesthird.set_response().set_aa()
+    .add_question(new DNSQuestion("www.third.gov", T_A))
+    .add_answer(new DNSARR("www.third.gov", 0x0200, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillOnce(SetReply(&server_, &yesthird));
+  DNSPacket nobare;
+  nobare.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_A));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .WillOnce(SetReply(&server_, &nobare));
+
+  SearchResult result;
+  ares_search(channel_, "www", C_IN, T_A, SearchCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.status_);
+  std::stringstream ss;
+  ss << PacketToString(result.data_);
+  EXPECT_EQ("RSP QRY AA NOERROR Q:{'www.second.org' IN A} "
+            "A:{'www.second.org' IN A TTL=512 1.2.3.4}",
+            ss.str());
+}
+
+TEST_P(MockParallelSearchChannelTest, SearchAllFail) {
+  DNSPacket nofirst;
+  nofirst.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillOnce(SetReply(&server_, &nofirst));
+  DNSPacket nodatasecond;
+  nodatasecond.set_response().set_aa()
+    .add_question(new DNSQuestion("www.second.org", T_A));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillOnce(SetReply(&server_, &nodatasecond));
+  DNSPacket nothird;
+  nothird.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.third.gov", T_A));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillOnce(SetReply(&server_, &nothird));
+  DNSPacket nobare;
+  nobare.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_A));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .WillOnce(SetReply(&server_, &nobare));
+
+  SearchResult result;
+  ares_search(channel_, "www", C_IN, T_A, SearchCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_ENODATA, result.status_);
+}
+
+TEST_P(MockParallelSearchChannelTest, GetHostByNamePriority) {
+  DNSPacket nofirst;
+  nofirst.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillOnce(SetReply(&server_, &nofirst));
+  DNSPacket nosecond;
+  nosecond.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.second.org", T_A));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillOnce(SetReply(&server_, &nosecond));
+  DNSPacket yesthird;
+  yesthird.set_response().set_aa()
+    .add_question(new DNSQuestion("www.third.gov", T_A))
+    .add_answer(new DNSARR("www.third.gov", 0x0200, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillOnce(SetReply(&server_, &yesthird));
+  DNSPacket yesbare;
+  yesbare.set_response().set_aa()
+    .add_question(new DNSQuestion("www", T_A))
+    .add_answer(new DNSARR("www", 0x0200, {1, 2, 3, 4}));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .WillOnce(SetReply(&server_, &yesbare));
+
+  HostResult result;
+  ares_gethostbyname(channel_, "www", AF_INET, HostCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  std::stringstream ss;
+  ss << result.host_;
+  EXPECT_EQ("{'www.third.gov' aliases=[] addrs=[2.3.4.5]}", ss.str());
+}
+
+class MockParallelSearchCacheChannelTest
+    : public MockChannelOptsTest,
+      public ::testing::WithParamInterface< std::pair<int, bool> > {
+ public:
+  MockParallelSearchCacheChannelTest()
+    : MockChannelOptsTest(1, GetParam().first, GetParam().second, false,
+                          FillOptions(&opts_),
+                          ARES_OPT_FLAGS|ARES_OPT_QUERY_CACHE) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->flags          = ARES_FLAG_PARALLEL_SEARCH;
+    opts->qcache_max_ttl = 3600;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+// Responses answered from the cache complete before any name is selected and
+// must still be delivered once it is their turn.
+TEST_P(MockParallelSearchCacheChannelTest, SearchCached) {
+  // NXDOMAIN without an SOA is not cached, so is queried each time
+  DNSPacket nofirst;
+  nofirst.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillRepeatedly(SetReply(&server_, &nofirst));
+  DNSPacket yessecond;
+  yessecond.set_response().set_aa()
+    .add_question(new DNSQuestion("www.second.org", T_A))
+    .add_answer(new DNSARR("www.second.org", 0x0200, {1, 2, 3, 4}));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillOnce(SetReply(&server_, &yessecond));
+  DNSPacket yesthird;
+  yesthird.set_response().set_aa()
+    .add_question(new DNSQuestion("www.third.gov", T_A))
+    .add_answer(new DNSARR("www.third.gov", 0x0200, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillOnce(SetReply(&server_, &yesthird));
+  DNSPacket nobare;
+  nobare.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_A));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .WillRepeatedly(SetReply(&server_, &nobare));
+
+  for (int i = 0; i < 2; i++) {
+    SearchResult result;
+    ares_search(channel_, "www", C_IN, T_A, SearchCallback, &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+    EXPECT_EQ(ARES_SUCCESS, result.status_);
+    std::stringstream ss;
+    ss << PacketToString(result.data_);
+    EXPECT_NE(std::string::npos, ss.str().find("A:{'www.second.org' IN A"));
+  }
+}
+
+TEST_P(MockParallelSearchCacheChannelTest, GetHostByNameCached) {
+  DNSPacket nofirst;
+  nofirst.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillRepeatedly(SetReply(&server_, &nofirst));
+  DNSPacket yessecond;
+  yessecond.set_response().set_aa()
+    .add_question(new DNSQuestion("www.second.org", T_A))
+    .add_answer(new DNSARR("www.second.org", 0x0200, {1, 2, 3, 4}));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillOnce(SetReply(&server_, &yessecond));
+  DNSPacket yesthird;
+  yesthird.set_response().set_aa()
+    .add_question(new DNSQuestion("www.third.gov", T_A))
+    .add_answer(new DNSARR("www.third.gov", 0x0200, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillOnce(SetReply(&server_, &yesthird));
+  DNSPacket nobare;
+  nobare.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_A));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .WillRepeatedly(SetReply(&server_, &nobare));
+
+  for (int i = 0; i < 2; i++) {
+    HostResult result;
+    ares_gethostbyname(channel_, "www", AF_INET, HostCallback, &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+    std::stringstream ss;
+    ss << result.host_;
+    EXPECT_EQ("{'www.second.org' aliases=[] addrs=[1.2.3.4]}", ss.str());
+  }
+}
+
+class MockSearchNegcacheChannelTest
+    : public MockChannelOptsTest,
+      public ::testing::WithParamInterface< std::pair<int, bool> > {
+ public:
+  MockSearchNegcacheChannelTest()
+    : MockChannelOptsTest(1, GetParam().first, GetParam().second, false,
+                          FillOptions(&opts_), ARES_OPT_SEARCH_NEGCACHE) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->search_negcache_ttl = 60;
+    return opts;
+  }
+  void ExpectSearchDomains() {
+    // Only the first search may query the search domains that don't exist,
+    // the query cache is disabled so the answer is queried each time.
+    nofirst_.set_response().set_aa().set_rcode(NXDOMAIN)
+      .add_question(new DNSQuestion("www.first.com", T_A));
+    EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+      .WillOnce(SetReply(&server_, &nofirst_));
+    nosecond_.set_response().set_aa().set_rcode(NXDOMAIN)
+      .add_question(new DNSQuestion("www.second.org", T_A));
+    EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+      .WillOnce(SetReply(&server_, &nosecond_));
+    yesthird_.set_response().set_aa()
+      .add_question(new DNSQuestion("www.third.gov", T_A))
+      .add_answer(new DNSARR("www.third.gov", 0x0200, {2, 3, 4, 5}));
+    EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+      .Times(2)
+      .WillRepeatedly(SetReply(&server_, &yesthird_));
+  }
+ private:
+  struct ares_options opts_;
+  DNSPacket nofirst_;
+  DNSPacket nosecond_;
+  DNSPacket yesthird_;
+};
+
+TEST_P(MockSearchNegcacheChannelTest, SearchSkipsNXDOMAIN) {
+  ExpectSearchDomains();
+
+  for (int i = 0; i < 2; i++) {
+    SearchResult result;
+    ares_search(channel_, "www", C_IN, T_A, SearchCallback, &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+    EXPECT_EQ(ARES_SUCCESS, result.status_);
+    std::stringstream ss;
+    ss << PacketToString(result.data_);
+    EXPECT_EQ("RSP QRY AA NOERROR Q:{'www.third.gov' IN A} "
+              "A:{'www.third.gov' IN A TTL=512 2.3.4.5}",
+              ss.str());
+  }
+}
+
+TEST_P(MockSearchNegcacheChannelTest, GetHostByNameSkipsNXDOMAIN) {
+  ExpectSearchDomains();
+
+  for (int i = 0; i < 2; i++) {
+    HostResult result;
+    ares_gethostbyname(channel_, "www", AF_INET, HostCallback, &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+    std::stringstream ss;
+    ss << result.host_;
+    EXPECT_EQ("{'www.third.gov' aliases=[] addrs=[2.3.4.5]}", ss.str());
+  }
 }
 
 #ifdef HAVE_CONTAINER
@@ -1039,6 +1567,87 @@ TEST_P(CacheQueriesTest, BlankName) {
   EXPECT_EQ(0, cacheresult.timeouts_);
 }
 
+TEST_P(CacheQueriesTest, TTLDecrement) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}))
+    .add_answer(new DNSARR("www.google.com", 200, {3, 4, 5, 6}));
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp));
+
+  QueryResult result;
+  ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN, ARES_REC_TYPE_A, QueryCallback, &result, NULL);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.status_);
+
+  ares_sleep_time(1100);
+
+  // Each TTL in the cached response is reduced by the time spent in the cache
+  QueryResult cacheresult;
+  ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN, ARES_REC_TYPE_A, QueryCallback, &cacheresult, NULL);
+  Process();
+  EXPECT_TRUE(cacheresult.done_);
+  EXPECT_EQ(ARES_SUCCESS, cacheresult.status_);
+  ASSERT_EQ(2, ares_dns_record_rr_cnt(cacheresult.dnsrec_.dnsrec_, ARES_SECTION_ANSWER));
+  const ares_dns_rr_t *rr1 = ares_dns_record_rr_get_const(cacheresult.dnsrec_.dnsrec_, ARES_SECTION_ANSWER, 0);
+  const ares_dns_rr_t *rr2 = ares_dns_record_rr_get_const(cacheresult.dnsrec_.dnsrec_, ARES_SECTION_ANSWER, 1);
+  EXPECT_GT(100, ares_dns_rr_get_ttl(rr1));
+  EXPECT_LE(98, ares_dns_rr_get_ttl(rr1));
+  EXPECT_EQ(100, ares_dns_rr_get_ttl(rr2) - ares_dns_rr_get_ttl(rr1));
+  char addr[INET_ADDRSTRLEN];
+  ares_inet_ntop(AF_INET, ares_dns_rr_get_addr(rr2, ARES_RR_A_ADDR), addr, sizeof(addr));
+  EXPECT_EQ(std::string("3.4.5.6"), addr);
+}
+
+TEST_P(CacheQueriesTest, CaseInsensitiveKey) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp));
+
+  QueryResult result;
+  ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN, ARES_REC_TYPE_A, QueryCallback, &result, NULL);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.status_);
+
+  // Differs only in case and trailing '.', must be served from cache
+  QueryResult cacheresult;
+  ares_query_dnsrec(channel_, "WWW.Google.COM.", ARES_CLASS_IN, ARES_REC_TYPE_A, QueryCallback, &cacheresult, NULL);
+  Process();
+  EXPECT_TRUE(cacheresult.done_);
+  EXPECT_EQ(ARES_SUCCESS, cacheresult.status_);
+}
+
+TEST_P(CacheQueriesTest, CoalesceInFlight) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp));
+
+  // All identical requests made before the first is answered share a single
+  // request to the server
+  QueryResult results[4];
+  for (size_t i = 0; i < 4; i++) {
+    ares_query_dnsrec(channel_, (i % 2) ? "WWW.Google.COM" : "www.google.com",
+                      ARES_CLASS_IN, ARES_REC_TYPE_A, QueryCallback,
+                      &results[i], NULL);
+  }
+  EXPECT_EQ(1, (int)ares_queue_active_queries(channel_));
+  Process();
+  for (size_t i = 0; i < 4; i++) {
+    EXPECT_TRUE(results[i].done_);
+    EXPECT_EQ(ARES_SUCCESS, results[i].status_);
+    EXPECT_EQ(1, ares_dns_record_rr_cnt(results[i].dnsrec_.dnsrec_, ARES_SECTION_ANSWER));
+  }
+}
+
 TEST_P(CacheQueriesTest, SearchDomainsCache) {
   DNSPacket nofirst;
   nofirst.set_response().set_aa().set_rcode(NXDOMAIN)
@@ -1837,6 +2446,223 @@ TEST_P(MockUDPChannelTest, TriggerResendThenConnFailEDNS) {
   EXPECT_EQ("{'www.google.com' aliases=[] addrs=[1.2.3.4]}", ss.str());
 }
 
+#ifndef WIN32
+static int batch_recvmmsg_calls = 0;
+static int batch_recvfrom_calls = 0;
+static int batch_sendmmsg_calls = 0;
+static int batch_sendmmsg_msgs  = 0;
+static int batch_sendto_calls   = 0;
+
+static ares_socket_t batch_socket(int domain, int type, int protocol,
+                                  void *user_data)
+{
+  ares_socket_t s = socket(domain, type, protocol);
+  (void)user_data;
+  if (s != ARES_SOCKET_BAD) {
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+  }
+  return s;
+}
+
+static int batch_close(ares_socket_t sock, void *user_data)
+{
+  (void)user_data;
+  return close(sock);
+}
+
+static int batch_setsockopt(ares_socket_t sock, ares_socket_opt_t opt,
+                            const void *val, ares_socklen_t val_size,
+                            void *user_data)
+{
+  (void)sock;
+  (void)opt;
+  (void)val;
+  (void)val_size;
+  (void)user_data;
+  errno = ENOSYS;
+  return -1;
+}
+
+static int batch_connect(ares_socket_t sock, const struct sockaddr *address,
+                         ares_socklen_t address_len, unsigned int flags,
+                         void *user_data)
+{
+  (void)flags;
+  (void)user_data;
+  return connect(sock, address, address_len);
+}
+
+static ares_ssize_t batch_recvfrom(ares_socket_t sock, void *buffer,
+                                   size_t length, int flags,
+                                   struct sockaddr *address,
+                                   ares_socklen_t *address_len,
+                                   void *user_data)
+{
+  (void)user_data;
+  batch_recvfrom_calls++;
+  return recvfrom(sock, buffer, length, flags, address, address_len);
+}
+
+static ares_ssize_t batch_sendto(ares_socket_t sock, const void *buffer,
+                                 size_t length, int flags,
+                                 const struct sockaddr *address,
+                                 ares_socklen_t address_len, void *user_data)
+{
+  (void)address;
+  (void)address_len;
+  (void)user_data;
+  batch_sendto_calls++;
+  return send(sock, buffer, length, flags);
+}
+
+/* Emulates sendmmsg() with one send() per datagram */
+static ares_ssize_t batch_sendmmsg(ares_socket_t                 sock,
+                                   const struct ares_socket_msg *msgs,
+                                   size_t cnt, int flags, void *user_data)
+{
+  size_t i;
+  (void)user_data;
+  batch_sendmmsg_calls++;
+  for (i = 0; i < cnt; i++) {
+    if (send(sock, msgs[i].buffer, msgs[i].length, flags) < 0) {
+      break;
+    }
+    batch_sendmmsg_msgs++;
+  }
+  return i == 0 ? -1 : (ares_ssize_t)i;
+}
+
+/* Emulates recvmmsg() by draining the socket into as many slots as possible */
+static ares_ssize_t batch_recvmmsg(ares_socket_t sock,
+                                   struct ares_socket_msg *msgs, size_t cnt,
+                                   int flags, void *user_data)
+{
+  size_t i;
+  (void)user_data;
+  batch_recvmmsg_calls++;
+  for (i = 0; i < cnt; i++) {
+    ares_ssize_t rv = recvfrom(sock, msgs[i].buffer, msgs[i].length, flags,
+                               msgs[i].address, &msgs[i].address_len);
+    if (rv < 0) {
+      break;
+    }
+    msgs[i].datagram_len = (size_t)rv;
+  }
+  return i == 0 ? -1 : (ares_ssize_t)i;
+}
+
+TEST_P(MockUDPChannelTest, BatchedReceive) {
+  std::vector<std::string> names = { "www1.google.com", "www2.google.com",
+                                     "www3.google.com", "www4.google.com" };
+  DNSPacket rsp[4];
+  for (size_t i = 0; i < names.size(); i++) {
+    rsp[i].set_response().set_aa()
+      .add_question(new DNSQuestion(names[i], T_A))
+      .add_answer(new DNSARR(names[i], 100, {1, 2, 3, (byte)(i + 1)}));
+    ON_CALL(server_, OnRequest(names[i], T_A))
+      .WillByDefault(SetReply(&server_, &rsp[i]));
+  }
+
+  struct ares_socket_functions_ex sock_funcs;
+  memset(&sock_funcs, 0, sizeof(sock_funcs));
+  sock_funcs.version     = 2;
+  sock_funcs.flags       = ARES_SOCKFUNC_FLAG_NONBLOCKING;
+  sock_funcs.asocket     = batch_socket;
+  sock_funcs.aclose      = batch_close;
+  sock_funcs.asetsockopt = batch_setsockopt;
+  sock_funcs.aconnect    = batch_connect;
+  sock_funcs.arecvfrom   = batch_recvfrom;
+  sock_funcs.asendto     = batch_sendto;
+  sock_funcs.arecvmmsg   = batch_recvmmsg;
+  sock_funcs.asendmmsg   = batch_sendmmsg;
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_set_socket_functions_ex(channel_, &sock_funcs, NULL));
+
+  batch_recvmmsg_calls = 0;
+  batch_recvfrom_calls = 0;
+
+  HostResult result[4];
+  for (size_t i = 0; i < names.size(); i++) {
+    ares_gethostbyname(channel_, names[i].c_str(), AF_INET, HostCallback,
+                       &result[i]);
+  }
+  Process();
+
+  for (size_t i = 0; i < names.size(); i++) {
+    EXPECT_TRUE(result[i].done_);
+    EXPECT_EQ(ARES_SUCCESS, result[i].status_);
+    std::stringstream ss;
+    ss << result[i].host_;
+    EXPECT_EQ("{'" + names[i] + "' aliases=[] addrs=[1.2.3." +
+                std::to_string(i + 1) + "]}",
+              ss.str());
+  }
+  EXPECT_LT(0, batch_recvmmsg_calls);
+  EXPECT_EQ(0, batch_recvfrom_calls);
+
+  /* Unknown ABI versions are rejected */
+  sock_funcs.version = 3;
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_set_socket_functions_ex(channel_, &sock_funcs, NULL));
+}
+
+TEST_P(MockUDPChannelTest, BatchedSend) {
+  DNSPacket rsp4;
+  rsp4.set_response().set_aa()
+    .add_question(new DNSQuestion("example.com", T_A))
+    .add_answer(new DNSARR("example.com", 100, {2, 3, 4, 5}));
+  ON_CALL(server_, OnRequest("example.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp4));
+  DNSPacket rsp6;
+  rsp6.set_response().set_aa()
+    .add_question(new DNSQuestion("example.com", T_AAAA))
+    .add_answer(new DNSAaaaRR("example.com", 100,
+                              {0x21, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03}));
+  ON_CALL(server_, OnRequest("example.com", T_AAAA))
+    .WillByDefault(SetReply(&server_, &rsp6));
+
+  struct ares_socket_functions_ex sock_funcs;
+  memset(&sock_funcs, 0, sizeof(sock_funcs));
+  sock_funcs.version     = 2;
+  sock_funcs.flags       = ARES_SOCKFUNC_FLAG_NONBLOCKING;
+  sock_funcs.asocket     = batch_socket;
+  sock_funcs.aclose      = batch_close;
+  sock_funcs.asetsockopt = batch_setsockopt;
+  sock_funcs.aconnect    = batch_connect;
+  sock_funcs.arecvfrom   = batch_recvfrom;
+  sock_funcs.asendto     = batch_sendto;
+  sock_funcs.asendmmsg   = batch_sendmmsg;
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_set_socket_functions_ex(channel_, &sock_funcs, NULL));
+
+  batch_sendmmsg_calls = 0;
+  batch_sendmmsg_msgs  = 0;
+  batch_sendto_calls   = 0;
+
+  /* The A and AAAA queries must leave in a single batched send */
+  AddrInfoResult result;
+  struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_flags  = ARES_AI_NOSORT;
+  ares_getaddrinfo(channel_, "example.com.", NULL, &hints, AddrInfoCallback,
+                   &result);
+  EXPECT_EQ(1, batch_sendmmsg_calls);
+  EXPECT_EQ(2, batch_sendmmsg_msgs);
+  EXPECT_EQ(0, batch_sendto_calls);
+
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.status_);
+  size_t naddrs = 0;
+  for (const struct ares_addrinfo_node *node = result.ai_->nodes;
+       node != nullptr; node = node->ai_next) {
+    naddrs++;
+  }
+  EXPECT_EQ(2, naddrs);
+}
+#endif
+
 // Regression for issue #1043: a long chain of retryable connection failures
 // used to recurse ares_requeue_query() -> ares_send_query() until the stack was
 // exhausted.  With a very high retry count and a socket that always fails to be
@@ -2568,6 +3394,161 @@ TEST_P(NoRotateMultiMockTest, ServerNoResponseFailover) {
   EXPECT_EQ("{'www.example.com' aliases=[] addrs=[2.3.4.5]}", ss4.str());
 }
 
+class LatencySelectMultiMockTest : public MockMultiServerChannelTest {
+ public:
+  LatencySelectMultiMockTest()
+    : MockMultiServerChannelTest(FillOptions(&opts_), ARES_OPT_FLAGS) {}
+  static struct ares_options* FillOptions(struct ares_options *opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->flags = ARES_FLAG_LATENCY_SELECT;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(LatencySelectMultiMockTest, SamplesAllServers) {
+  struct ares_options opts;
+  int optmask = 0;
+  memset(&opts, 0, sizeof(opts));
+  EXPECT_EQ(ARES_SUCCESS, ares_save_options(channel_, &opts, &optmask));
+  EXPECT_EQ(ARES_FLAG_LATENCY_SELECT, (opts.flags & ARES_FLAG_LATENCY_SELECT));
+  ares_destroy_options(&opts);
+
+  DNSPacket okrsp;
+  okrsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {2,3,4,5}));
+
+  // Servers that have not answered yet are always preferred over measured
+  // ones, so every healthy server ends up being used.
+  for (size_t i = 0; i < servers_.size(); i++) {
+    EXPECT_CALL(*servers_[i], OnRequest("www.example.com", T_A))
+      .Times(testing::AtLeast(1))
+      .WillRepeatedly(SetReply(servers_[i].get(), &okrsp));
+  }
+
+  for (int i = 0; i < 30; i++) {
+    CheckExample();
+  }
+}
+
+TEST_P(LatencySelectMultiMockTest, SkipsFailedServer) {
+  DNSPacket servfailrsp;
+  servfailrsp.set_response().set_aa().set_rcode(SERVFAIL)
+    .add_question(new DNSQuestion("www.example.com", T_A));
+  DNSPacket okrsp;
+  okrsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {2,3,4,5}));
+
+  // Once server [0] has failed it drops out of the highest priority bracket
+  // and is never selected again while the others stay healthy.
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .Times(testing::AtMost(1))
+    .WillRepeatedly(SetReply(servers_[0].get(), &servfailrsp));
+  ON_CALL(*servers_[1], OnRequest("www.example.com", T_A))
+    .WillByDefault(SetReply(servers_[1].get(), &okrsp));
+  ON_CALL(*servers_[2], OnRequest("www.example.com", T_A))
+    .WillByDefault(SetReply(servers_[2].get(), &okrsp));
+
+  for (int i = 0; i < 20; i++) {
+    CheckExample();
+  }
+}
+
+class HedgeMultiMockTest
+  : public MockChannelOptsTest,
+    public ::testing::WithParamInterface< std::pair<int, bool> > {
+ public:
+  HedgeMultiMockTest()
+    : MockChannelOptsTest(2, GetParam().first, GetParam().second, false,
+                          FillOptions(&opts_),
+                          ARES_OPT_HEDGE | ARES_OPT_NOROTATE) {}
+  static struct ares_options* FillOptions(struct ares_options *opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->hedge_opts.percentile = 50;
+    opts->hedge_opts.budget = 100;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(HedgeMultiMockTest, HedgeWins) {
+  std::vector<byte> nothing;
+  DNSPacket okrsp;
+  okrsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {2,3,4,5}));
+
+  // Server [0] answers the first 3 queries so its latency is known, then
+  // doesn't answer the 4th which gets hedged to server [1].  Losing the race
+  // isn't a failure, so server [0] still gets the 5th.
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReplyData(servers_[0].get(), nothing))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp));
+  EXPECT_CALL(*servers_[1], OnRequest("www.example.com", T_A))
+    .Times(testing::AtLeast(1))
+    .WillRepeatedly(SetReply(servers_[1].get(), &okrsp));
+
+  for (int i = 0; i < 5; i++) {
+    HostResult result;
+    ares_gethostbyname(channel_, "www.example.com.", AF_INET, HostCallback,
+                       &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+    EXPECT_EQ(0, result.timeouts_);
+    std::stringstream ss;
+    ss << result.host_;
+    EXPECT_EQ("{'www.example.com' aliases=[] addrs=[2.3.4.5]}", ss.str());
+  }
+}
+
+TEST_P(HedgeMultiMockTest, HedgeCancelled) {
+  std::vector<byte> nothing;
+  DNSPacket okrsp;
+  okrsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {2,3,4,5}));
+
+  // Neither server answers the 4th query or its hedge, cancelling the
+  // query must clean up the hedge along with it.
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReplyData(servers_[0].get(), nothing))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp));
+  EXPECT_CALL(*servers_[1], OnRequest("www.example.com", T_A))
+    .WillOnce(SetReplyData(servers_[1].get(), nothing));
+
+  for (int i = 0; i < 3; i++) {
+    HostResult result;
+    ares_gethostbyname(channel_, "www.example.com.", AF_INET, HostCallback,
+                       &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+  }
+
+  HostResult result;
+  ares_gethostbyname(channel_, "www.example.com.", AF_INET, HostCallback,
+                     &result);
+  Process(50);
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_ECANCELLED, result.status_);
+
+  HostResult result2;
+  ares_gethostbyname(channel_, "www.example.com.", AF_INET, HostCallback,
+                     &result2);
+  Process();
+  EXPECT_TRUE(result2.done_);
+  EXPECT_EQ(ARES_SUCCESS, result2.status_);
+}
+
 #if defined(_WIN32)
 #  define SERVER_FAILOVER_RETRY_DELAY 500
 #else
@@ -3041,6 +4022,11 @@ INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockUDPMaxQueriesTest, ::testing::Valu
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, CacheQueriesTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
 
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, CacheLimitQueriesTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, CacheStaleQueriesTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, CachePrefetchQueriesTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, CacheSharedQueriesTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
+
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockTCPChannelTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockExtraOptsTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
@@ -3049,8 +4035,17 @@ INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockNoCheckRespChannelTest, ::testing:
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockEDNSChannelTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
 
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockParallelSearchChannelTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockParallelSearchCacheChannelTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockSearchNegcacheChannelTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
 INSTANTIATE_TEST_SUITE_P(TransportModes, NoRotateMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
 
+INSTANTIATE_TEST_SUITE_P(TransportModes, LatencySelectMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
+INSTANTIATE_TEST_SUITE_P(TransportModes, HedgeMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
 INSTANTIATE_TEST_SUITE_P(TransportModes, ServerFailoverOptsMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
 
 INSTANTIATE_TEST_SUITE_P(TransportModes, ServerRecoveryMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
@@ -0,0 +1,212 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Microbenchmark comparing the direct-indexed query id map used for
+ * channel->queries_by_qid against the generic size_t keyed hashtable it
+ * replaced.  Measures lookups (as done for every response received) and
+ * remove+insert churn (as done for every query completed and started) with a
+ * configurable number of outstanding queries.
+ *
+ * Usage: ares_qidbench [outstanding_queries] [rounds] */
+
+#include "ares_private.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+  const char *name;
+  void *(*create)(void);
+  void (*destroy)(void *ctx);
+  ares_bool_t (*insert)(void *ctx, unsigned short id, void *val);
+  void *(*get)(void *ctx, unsigned short id);
+  ares_bool_t (*remove)(void *ctx, unsigned short id);
+} bench_impl_t;
+
+static void *szvp_create(void)
+{
+  return ares_htable_szvp_create(NULL);
+}
+
+static void szvp_destroy(void *ctx)
+{
+  ares_htable_szvp_destroy(ctx);
+}
+
+static ares_bool_t szvp_insert(void *ctx, unsigned short id, void *val)
+{
+  return ares_htable_szvp_insert(ctx, id, val);
+}
+
+static void *szvp_get(void *ctx, unsigned short id)
+{
+  return ares_htable_szvp_get_direct(ctx, id);
+}
+
+static ares_bool_t szvp_remove(void *ctx, unsigned short id)
+{
+  return ares_htable_szvp_remove(ctx, id);
+}
+
+static void *qidmap_create(void)
+{
+  return ares_qidmap_create();
+}
+
+static void qidmap_destroy(void *ctx)
+{
+  ares_qidmap_destroy(ctx);
+}
+
+static ares_bool_t qidmap_insert(void *ctx, unsigned short id, void *val)
+{
+  return ares_qidmap_insert(ctx, id, val);
+}
+
+static void *qidmap_get(void *ctx, unsigned short id)
+{
+  return ares_qidmap_get(ctx, id);
+}
+
+static ares_bool_t qidmap_remove(void *ctx, unsigned short id)
+{
+  return ares_qidmap_remove(ctx, id);
+}
+
+static const bench_impl_t impls[] = {
+  { "ares_htable_szvp", szvp_create, szvp_destroy, szvp_insert, szvp_get,
+    szvp_remove },
+  { "ares_qidmap", qidmap_create, qidmap_destroy, qidmap_insert, qidmap_get,
+    qidmap_remove }
+};
+
+static double elapsed_ns(clock_t start, size_t ops)
+{
+  return ((double)(clock() - start) * 1000000000.0 / CLOCKS_PER_SEC) /
+         (double)ops;
+}
+
+static int run_bench(const bench_impl_t *impl, const unsigned short *ids,
+                     size_t cnt, size_t rounds)
+{
+  void       *ctx   = impl->create();
+  size_t      found = 0;
+  size_t      i;
+  size_t      r;
+  clock_t     start;
+  double      lookup_ns;
+  double      churn_ns;
+  static char val;
+
+  if (ctx == NULL) {
+    return 1;
+  }
+
+  for (i = 0; i < cnt; i++) {
+    if (!impl->insert(ctx, ids[i], &val)) {
+      impl->destroy(ctx);
+      return 1;
+    }
+  }
+
+  start = clock();
+  for (r = 0; r < rounds; r++) {
+    for (i = 0; i < cnt; i++) {
+      if (impl->get(ctx, ids[i]) != NULL) {
+        found++;
+      }
+    }
+  }
+  lookup_ns = elapsed_ns(start, rounds * cnt);
+
+  start = clock();
+  for (r = 0; r < rounds; r++) {
+    for (i = 0; i < cnt; i++) {
+      impl->remove(ctx, ids[i]);
+      impl->insert(ctx, ids[i], &val);
+    }
+  }
+  churn_ns = elapsed_ns(start, rounds * cnt);
+
+  impl->destroy(ctx);
+
+  if (found != rounds * cnt) {
+    return 1;
+  }
+
+  printf("%-18s lookup %8.2f ns/op   remove+insert %8.2f ns/op\n", impl->name,
+         lookup_ns, churn_ns);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned short *ids;
+  size_t          cnt    = 10000;
+  size_t          rounds = 1000;
+  size_t          i;
+  int             rv = 0;
+
+  if (argc > 1) {
+    cnt = (size_t)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    rounds = (size_t)strtoul(argv[2], NULL, 10);
+  }
+  if (cnt == 0 || cnt > 65536 || rounds == 0) {
+    fprintf(stderr, "Usage: %s [outstanding_queries (1-65536)] [rounds]\n",
+            argv[0]);
+    return 1;
+  }
+
+  /* Random distinct ids, like generate_unique_qid() would hand out */
+  ids = malloc(65536 * sizeof(*ids));
+  if (ids == NULL) {
+    return 1;
+  }
+  for (i = 0; i < 65536; i++) {
+    ids[i] = (unsigned short)i;
+  }
+  srand((unsigned int)time(NULL));
+  for (i = 65535; i > 0; i--) {
+    size_t         j   = (((size_t)rand() << 16) ^ (size_t)rand()) % (i + 1);
+    unsigned short tmp = ids[i];
+    ids[i]             = ids[j];
+    ids[j]             = tmp;
+  }
+
+  printf("%lu outstanding queries, %lu rounds\n", (unsigned long)cnt,
+         (unsigned long)rounds);
+  for (i = 0; i < sizeof(impls) / sizeof(*impls); i++) {
+    if (run_bench(&impls[i], ids, cnt, rounds) != 0) {
+      fprintf(stderr, "%s: failed\n", impls[i].name);
+      rv = 1;
+    }
+  }
+
+  free(ids);
+  return rv;
+}
@@ -0,0 +1,138 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Microbenchmark for ares_dns_write() of large responses, which is dominated
+ * by the name compression lookups in ares_dns_name_write().  Builds a response
+ * with a configurable number of A records, each with a distinct owner name
+ * below a handful of shared zones plus a CNAME pointing into another zone, so
+ * every name written has several compression candidates.
+ *
+ * Usage: ares_writebench [records] [rounds] */
+
+#include "ares_private.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static ares_dns_record_t *build_response(size_t cnt)
+{
+  ares_dns_record_t *dnsrec = NULL;
+  ares_dns_rr_t     *rr     = NULL;
+  struct in_addr     addr;
+  char               name[256];
+  char               target[256];
+  size_t             i;
+
+  if (ares_dns_record_create(&dnsrec, 0x1234, ARES_FLAG_QR | ARES_FLAG_AA,
+                             ARES_OPCODE_QUERY,
+                             ARES_RCODE_NOERROR) != ARES_SUCCESS) {
+    return NULL;
+  }
+
+  if (ares_dns_record_query_add(dnsrec, "www.example.com", ARES_REC_TYPE_ANY,
+                                ARES_CLASS_IN) != ARES_SUCCESS) {
+    goto fail;
+  }
+
+  for (i = 0; i < cnt; i++) {
+    snprintf(name, sizeof(name), "host%lu.zone%lu.example.com",
+             (unsigned long)i, (unsigned long)(i % 8));
+    snprintf(target, sizeof(target), "alias%lu.cdn%lu.example.net",
+             (unsigned long)i, (unsigned long)(i % 4));
+
+    if (ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER, name,
+                               ARES_REC_TYPE_CNAME, ARES_CLASS_IN,
+                               300) != ARES_SUCCESS ||
+        ares_dns_rr_set_str(rr, ARES_RR_CNAME_CNAME, target) != ARES_SUCCESS) {
+      goto fail;
+    }
+
+    if (ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER, target,
+                               ARES_REC_TYPE_A, ARES_CLASS_IN,
+                               300) != ARES_SUCCESS) {
+      goto fail;
+    }
+    addr.s_addr = htonl((unsigned int)(0x0A000000 + i));
+    if (ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr) != ARES_SUCCESS) {
+      goto fail;
+    }
+  }
+
+  return dnsrec;
+
+fail:
+  ares_dns_record_destroy(dnsrec);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  ares_dns_record_t *dnsrec;
+  size_t             cnt    = 500;
+  size_t             rounds = 200;
+  size_t             msglen = 0;
+  size_t             r;
+  clock_t            start;
+  double             ns;
+
+  if (argc > 1) {
+    cnt = (size_t)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    rounds = (size_t)strtoul(argv[2], NULL, 10);
+  }
+  if (cnt == 0 || cnt > 32767 || rounds == 0) {
+    fprintf(stderr, "Usage: %s [records (1-32767)] [rounds]\n", argv[0]);
+    return 1;
+  }
+
+  dnsrec = build_response(cnt);
+  if (dnsrec == NULL) {
+    fprintf(stderr, "failed to build response\n");
+    return 1;
+  }
+
+  start = clock();
+  for (r = 0; r < rounds; r++) {
+    unsigned char *msg = NULL;
+
+    if (ares_dns_write(dnsrec, &msg, &msglen) != ARES_SUCCESS) {
+      fprintf(stderr, "ares_dns_write() failed\n");
+      ares_dns_record_destroy(dnsrec);
+      return 1;
+    }
+    ares_free_string(msg);
+  }
+  ns = ((double)(clock() - start) * 1000000000.0 / CLOCKS_PER_SEC) /
+       (double)rounds;
+
+  printf("%lu records, %lu rounds: %lu bytes, %10.0f ns/message, %8.1f ns/rr\n",
+         (unsigned long)(cnt * 2), (unsigned long)rounds,
+         (unsigned long)msglen, ns, ns / (double)(cnt * 2));
+
+  ares_dns_record_destroy(dnsrec);
+  return 0;
+}